@@ -46,6 +46,7 @@
 #include "peripherals.h"
 #include "ports.h"
 #include "sessions.h"
+#include "stats.h"
 #include "ver.h"
 #include "virtual.h"
 #include "webhooks.h"
@@ -83,10 +84,9 @@
 })
 
 #define SEQ_INVALID_FIELD(response_json, field) ({ \
-    free(port->sequence_values);                   \
-    free(port->sequence_delays);                   \
-    port->sequence_pos = -1;                       \
-    port->sequence_repeat = -1;                    \
+    free(sequence->values);                        \
+    free(sequence->delays);                        \
+    free(sequence);                                \
     INVALID_FIELD(response_json, field);           \
 })
 
@@ -148,6 +148,10 @@ static json_t ICACHE_FLASH_ATTR *device_from_json(
 static json_t ICACHE_FLASH_ATTR *port_attrdefs_to_json(port_t *port, json_refs_ctx_t *json_refs_ctx);
 static json_t ICACHE_FLASH_ATTR *device_attrdefs_to_json(void);
 
+static void   ICACHE_FLASH_ATTR  write_ports_json(json_writer_t *writer);
+
+static bool   ICACHE_FLASH_ATTR  expr_fits_heap(expr_t *expr, uint32 free_heap);
+
 static void   ICACHE_FLASH_ATTR  on_sequence_timer(void *arg);
 
 #ifdef _OTA
@@ -399,6 +403,19 @@ json_t *api_call_handle(int method, char* path, json_t *query_json, json_t *requ
             RESPOND_NO_SUCH_FUNCTION(response_json);
         }
     }
+#ifdef _STATS
+    else if (!strcmp(part1, "debug") && part2 && !strcmp(part2, "stats") && !part3) {
+        if (method == HTTP_METHOD_GET) {
+            response_json = api_get_debug_stats(query_json, code);
+        }
+        else if (method == HTTP_METHOD_DELETE) {
+            response_json = api_delete_debug_stats(query_json, code);
+        }
+        else {
+            RESPOND_NO_SUCH_FUNCTION(response_json);
+        }
+    }
+#endif
     else if (!strcmp(part1, "provisioning")) {
         if (part2) {
             RESPOND_NO_SUCH_FUNCTION(response_json);
@@ -483,44 +500,50 @@ json_t *port_to_json(port_t *port, json_refs_ctx_t *json_refs_ctx) {
 
     /* Common to all ports */
 
-    json_obj_append(json, "id", json_str_new(port->id));
-    json_obj_append(json, "display_name", json_str_new(port->display_name ? port->display_name : ""));
-    json_obj_append(json, "enabled", json_bool_new(IS_PORT_ENABLED(port)));
-    json_obj_append(json, "writable", json_bool_new(IS_PORT_WRITABLE(port)));
-    json_obj_append(json, "persisted", json_bool_new(IS_PORT_PERSISTED(port)));
-    json_obj_append(json, "internal", json_bool_new(IS_PORT_INTERNAL(port)));
+    json_obj_append_static(json, "id", json_str_new(port->id));
+    json_obj_append_static(json, "display_name", json_str_new(port->display_name ? port->display_name : ""));
+    json_obj_append_static(json, "enabled", json_bool_new(IS_PORT_ENABLED(port)));
+    json_obj_append_static(json, "writable", json_bool_new(IS_PORT_WRITABLE(port)));
+    json_obj_append_static(json, "persisted", json_bool_new(IS_PORT_PERSISTED(port)));
+    json_obj_append_static(json, "internal", json_bool_new(IS_PORT_INTERNAL(port)));
 
     if (IS_PORT_VIRTUAL(port)) {
-        json_obj_append(json, "virtual", json_bool_new(TRUE));
+        json_obj_append_static(json, "virtual", json_bool_new(TRUE));
     }
 
     if (!IS_PORT_VIRTUAL(port) && port->min_sampling_interval < port->max_sampling_interval) {
-        json_obj_append(json, "sampling_interval", json_int_new(port->sampling_interval));
+        json_obj_append_static(json, "sampling_interval", json_int_new(port->sampling_interval));
     }
 
     if (port->stransform_read) {
-        json_obj_append(json, "transform_read", json_str_new(port->stransform_read));
+        json_obj_append_static(json, "transform_read", json_str_new(port->stransform_read));
     }
     else {
-        json_obj_append(json, "transform_read", json_str_new(""));
+        json_obj_append_static(json, "transform_read", json_str_new(""));
     }
 
+    json_obj_append_static(json, "min_event_interval", json_int_new(port->min_event_interval));
+    json_obj_append_static(json, "persist_interval", json_int_new(port->persist_interval));
+
     /* Specific to numeric ports */
     if (port->type == PORT_TYPE_NUMBER) {
-        json_obj_append(json, "type", json_str_new(API_PORT_TYPE_NUMBER));
-        json_obj_append(json, "unit", json_str_new(port->unit ? port->unit : ""));
+        json_obj_append_static(json, "type", json_str_new(API_PORT_TYPE_NUMBER));
+        json_obj_append_static(json, "unit", json_str_new(port->unit ? port->unit : ""));
+        json_obj_append_static(json, "change_threshold", json_double_new(port->change_threshold));
+        json_obj_append_static(json, "change_threshold_relative", json_bool_new(IS_PORT_REL_THRESHOLD(port)));
+        json_obj_append_static(json, "persist_threshold", json_double_new(port->persist_threshold));
 
         if (!IS_UNDEFINED(port->min)) {
-            json_obj_append(json, "min", json_double_new(port->min));
+            json_obj_append_static(json, "min", json_double_new(port->min));
         }
         if (!IS_UNDEFINED(port->max)) {
-            json_obj_append(json, "max", json_double_new(port->max));
+            json_obj_append_static(json, "max", json_double_new(port->max));
         }
         if (!IS_UNDEFINED(port->step)) {
-            json_obj_append(json, "step", json_double_new(port->step));
+            json_obj_append_static(json, "step", json_double_new(port->step));
         }
         if (port->integer) {
-            json_obj_append(json, "integer", json_bool_new(TRUE));
+            json_obj_append_static(json, "integer", json_bool_new(TRUE));
         }
 
         if (port->choices) {
@@ -545,7 +568,7 @@ json_t *port_to_json(port_t *port, json_refs_ctx_t *json_refs_ctx) {
                 char *ref_str = json_str_get(json_obj_value_at(ref, 0));
                 DEBUG_API("replacing \"%s.choices\" with $ref \"%s\"", port->id, ref_str);
 #endif
-                json_obj_append(json, "choices", ref);
+                json_obj_append_static(json, "choices", ref);
 
             }
             else {
@@ -555,54 +578,60 @@ json_t *port_to_json(port_t *port, json_refs_ctx_t *json_refs_ctx) {
                     json_list_append(list, choice_to_json(c, PORT_TYPE_NUMBER));
                 }
 
-                json_obj_append(json, "choices", list);
+                json_obj_append_static(json, "choices", list);
             }
         }
     }
     /* Specific to boolean ports */
     else { /* Assuming PORT_TYPE_BOOLEAN */
-        json_obj_append(json, "type", json_str_new(API_PORT_TYPE_BOOLEAN));
+        json_obj_append_static(json, "type", json_str_new(API_PORT_TYPE_BOOLEAN));
     }
 
     /* Specific to writable ports */
     if (IS_PORT_WRITABLE(port)) {
         if (port->sexpr) {
-            json_obj_append(json, "expression", json_str_new(port->sexpr));
+            json_obj_append_static(json, "expression", json_str_new(port->sexpr));
         }
         else {
-            json_obj_append(json, "expression", json_str_new(""));
+            json_obj_append_static(json, "expression", json_str_new(""));
         }
 
         if (port->stransform_write) {
-            json_obj_append(json, "transform_write", json_str_new(port->stransform_write));
+            json_obj_append_static(json, "transform_write", json_str_new(port->stransform_write));
         }
         else {
-            json_obj_append(json, "transform_write", json_str_new(""));
+            json_obj_append_static(json, "transform_write", json_str_new(""));
         }
     }
 
-    /* Extra attributes */
+    /* Estimated heap usage of expression & transforms */
+    uint32 expr_heap_size = port_get_expr_heap_size(port);
+    if (expr_heap_size) {
+        json_obj_append_static(json, "expr_heap_size", json_int_new(expr_heap_size));
+    }
+
+    /* Extra attributes; their names live as long as the port, which outlives this JSON, stringified below */
     if (port->attrdefs) {
         attrdef_t *a, **attrdefs = port->attrdefs;
         int index;
         while ((a = *attrdefs++)) {
             switch (a->type) {
                 case ATTR_TYPE_BOOLEAN:
-                    json_obj_append(json, a->name, json_bool_new(((int_getter_t) a->get)(port, a)));
+                    json_obj_append_static(json, a->name, json_bool_new(((int_getter_t) a->get)(port, a)));
                     break;
 
                 case ATTR_TYPE_NUMBER:
                     if (a->choices) {
                         /* When dealing with choices, the getter returns the index inside the choices array */
                         index = ((int_getter_t) a->get)(port, a);
-                        json_obj_append(json, a->name, json_double_new(get_choice_value_num(a->choices[index])));
+                        json_obj_append_static(json, a->name, json_double_new(get_choice_value_num(a->choices[index])));
                     }
                     else {
                         if (IS_ATTRDEF_INTEGER(a)) {
-                            json_obj_append(json, a->name, json_int_new(((int_getter_t) a->get)(port, a)));
+                            json_obj_append_static(json, a->name, json_int_new(((int_getter_t) a->get)(port, a)));
                         }
                         else { /* float */
-                            json_obj_append(json, a->name, json_int_new(((float_getter_t) a->get)(port, a)));
+                            json_obj_append_static(json, a->name, json_int_new(((float_getter_t) a->get)(port, a)));
                         }
                     }
                     break;
@@ -611,10 +640,10 @@ json_t *port_to_json(port_t *port, json_refs_ctx_t *json_refs_ctx) {
                     if (a->choices) {
                         /* When dealing with choices, the getter returns the index inside the choices array */
                         index = ((int_getter_t) a->get)(port, a);
-                        json_obj_append(json, a->name, json_str_new(get_choice_value_str(a->choices[index])));
+                        json_obj_append_static(json, a->name, json_str_new(get_choice_value_str(a->choices[index])));
                     }
                     else {
-                        json_obj_append(json, a->name, json_str_new(((str_getter_t) a->get)(port, a)));
+                        json_obj_append_static(json, a->name, json_str_new(((str_getter_t) a->get)(port, a)));
                     }
                     break;
             }
@@ -622,10 +651,10 @@ json_t *port_to_json(port_t *port, json_refs_ctx_t *json_refs_ctx) {
     }
 
     /* Port value */
-    json_obj_append(json, "value", port_make_json_value(port));
+    json_obj_append_static(json, "value", port_make_json_value(port));
 
     /* Attribute definitions */
-    json_obj_append(json, "definitions", port_attrdefs_to_json(port, json_refs_ctx));
+    json_obj_append_static(json, "definitions", port_attrdefs_to_json(port, json_refs_ctx));
 
     json_stringify(json);
 
@@ -637,33 +666,33 @@ json_t *device_to_json(void) {
     json_t *json = json_obj_new();
 
     /* Common attributes */
-    json_obj_append(json, "name", json_str_new(device_name));
-    json_obj_append(json, "display_name", json_str_new(device_display_name));
-    json_obj_append(json, "version", json_str_new(FW_VERSION));
-    json_obj_append(json, "api_version", json_str_new(API_VERSION));
-    json_obj_append(json, "vendor", json_str_new(VENDOR));
+    json_obj_append_static(json, "name", json_str_new(device_name));
+    json_obj_append_static(json, "display_name", json_str_new(device_display_name));
+    json_obj_append_static(json, "version", json_str_new(FW_VERSION));
+    json_obj_append_static(json, "api_version", json_str_new(API_VERSION));
+    json_obj_append_static(json, "vendor", json_str_new(VENDOR));
 
     /* Passwords - never reveal them */
 
     if (!strncmp(device_admin_password_hash, EMPTY_SHA256_HEX, SHA256_HEX_LEN)) {
-        json_obj_append(json, "admin_password", json_str_new(""));
+        json_obj_append_static(json, "admin_password", json_str_new(""));
     }
     else {
-        json_obj_append(json, "admin_password", json_str_new("set"));
+        json_obj_append_static(json, "admin_password", json_str_new("set"));
     }
 
     if (!strncmp(device_normal_password_hash, EMPTY_SHA256_HEX, SHA256_HEX_LEN)) {
-        json_obj_append(json, "normal_password", json_str_new(""));
+        json_obj_append_static(json, "normal_password", json_str_new(""));
     }
     else {
-        json_obj_append(json, "normal_password", json_str_new("set"));
+        json_obj_append_static(json, "normal_password", json_str_new("set"));
     }
 
     if (!strncmp(device_viewonly_password_hash, EMPTY_SHA256_HEX, SHA256_HEX_LEN)) {
-        json_obj_append(json, "viewonly_password", json_str_new(""));
+        json_obj_append_static(json, "viewonly_password", json_str_new(""));
     }
     else {
-        json_obj_append(json, "viewonly_password", json_str_new("set"));
+        json_obj_append_static(json, "viewonly_password", json_str_new("set"));
     }
 
     /* Flags */
@@ -681,71 +710,71 @@ json_t *device_to_json(void) {
 #endif
     json_list_append(flags_json, json_str_new("webhooks"));
 
-    json_obj_append(json, "flags", flags_json);
+    json_obj_append_static(json, "flags", flags_json);
 
     /* Various optional attributes */
-    json_obj_append(json, "uptime", json_int_new(system_uptime()));
+    json_obj_append_static(json, "uptime", json_int_new(system_uptime()));
 
-    json_obj_append(json, "virtual_ports", json_int_new(VIRTUAL_MAX_PORTS));
+    json_obj_append_static(json, "virtual_ports", json_int_new(VIRTUAL_MAX_PORTS));
 
     /* IP configuration */
     ip_addr_t ip = wifi_get_ip_address();
     if (ip.addr) {
         snprintf(value, 256, WIFI_IP_FMT, IP2STR(&ip));
-        json_obj_append(json, "ip_address", json_str_new(value));
+        json_obj_append_static(json, "ip_address", json_str_new(value));
     }
     else {
-        json_obj_append(json, "ip_address", json_str_new(""));
+        json_obj_append_static(json, "ip_address", json_str_new(""));
     }
 
-    json_obj_append(json, "ip_netmask", json_int_new(wifi_get_netmask()));
+    json_obj_append_static(json, "ip_netmask", json_int_new(wifi_get_netmask()));
 
     ip = wifi_get_gateway();
     if (ip.addr) {
         snprintf(value, 256, WIFI_IP_FMT, IP2STR(&ip));
-        json_obj_append(json, "ip_gateway", json_str_new(value));
+        json_obj_append_static(json, "ip_gateway", json_str_new(value));
     }
     else {
-        json_obj_append(json, "ip_gateway", json_str_new(""));
+        json_obj_append_static(json, "ip_gateway", json_str_new(""));
     }
 
     ip = wifi_get_dns();
     if (ip.addr) {
         snprintf(value, 256, WIFI_IP_FMT, IP2STR(&ip));
-        json_obj_append(json, "ip_dns", json_str_new(value));
+        json_obj_append_static(json, "ip_dns", json_str_new(value));
     }
     else {
-        json_obj_append(json, "ip_dns", json_str_new(""));
+        json_obj_append_static(json, "ip_dns", json_str_new(""));
     }
 
     /* Current IP info */
     ip = wifi_get_ip_address_current();
     if (ip.addr) {
         snprintf(value, 256, WIFI_IP_FMT, IP2STR(&ip));
-        json_obj_append(json, "ip_address_current", json_str_new(value));
+        json_obj_append_static(json, "ip_address_current", json_str_new(value));
     }
     else {
-        json_obj_append(json, "ip_address_current", json_str_new(""));
+        json_obj_append_static(json, "ip_address_current", json_str_new(""));
     }
 
-    json_obj_append(json, "ip_netmask_current", json_int_new(wifi_get_netmask_current()));
+    json_obj_append_static(json, "ip_netmask_current", json_int_new(wifi_get_netmask_current()));
 
     ip = wifi_get_gateway_current();
     if (ip.addr) {
         snprintf(value, 256, WIFI_IP_FMT, IP2STR(&ip));
-        json_obj_append(json, "ip_gateway_current", json_str_new(value));
+        json_obj_append_static(json, "ip_gateway_current", json_str_new(value));
     }
     else {
-        json_obj_append(json, "ip_gateway_current", json_str_new(""));
+        json_obj_append_static(json, "ip_gateway_current", json_str_new(""));
     }
 
     ip = wifi_get_dns_current();
     if (ip.addr) {
         snprintf(value, 256, WIFI_IP_FMT, IP2STR(&ip));
-        json_obj_append(json, "ip_dns_current", json_str_new(value));
+        json_obj_append_static(json, "ip_dns_current", json_str_new(value));
     }
     else {
-        json_obj_append(json, "ip_dns_current", json_str_new(""));
+        json_obj_append_static(json, "ip_dns_current", json_str_new(""));
     }
 
     /* Wi-Fi configuration */
@@ -754,25 +783,25 @@ json_t *device_to_json(void) {
     uint8 *bssid = wifi_get_bssid();
 
     if (ssid) {
-        json_obj_append(json, "wifi_ssid", json_str_new(ssid));
+        json_obj_append_static(json, "wifi_ssid", json_str_new(ssid));
     }
     else {
-        json_obj_append(json, "wifi_ssid", json_str_new(""));
+        json_obj_append_static(json, "wifi_ssid", json_str_new(""));
     }
 
     if (psk) {
-        json_obj_append(json, "wifi_key", json_str_new(psk));
+        json_obj_append_static(json, "wifi_key", json_str_new(psk));
     }
     else {
-        json_obj_append(json, "wifi_key", json_str_new(""));
+        json_obj_append_static(json, "wifi_key", json_str_new(""));
     }
 
     if (bssid) {
         snprintf(value, 256, "%02X:%02X:%02X:%02X:%02X:%02X", WIFI_BSSID2STR(bssid));
-        json_obj_append(json, "wifi_bssid", json_str_new(value));
+        json_obj_append_static(json, "wifi_bssid", json_str_new(value));
     }
     else {
-        json_obj_append(json, "wifi_bssid", json_str_new(""));
+        json_obj_append_static(json, "wifi_bssid", json_str_new(""));
     }
 
     /* Current Wi-Fi info */
@@ -793,7 +822,7 @@ json_t *device_to_json(void) {
             WIFI_BSSID2STR(wifi_get_bssid_current())
         );
     }
-    json_obj_append(json, "wifi_bssid_current", json_str_new(current_bssid_str));
+    json_obj_append_static(json, "wifi_bssid_current", json_str_new(current_bssid_str));
 
     int8  wifi_signal_strength = -1;
     if (wifi_station_is_connected()) {
@@ -810,48 +839,50 @@ json_t *device_to_json(void) {
             wifi_signal_strength = 0;
         }
     }
-    json_obj_append(json, "wifi_signal_strength", json_int_new(wifi_signal_strength));
+    json_obj_append_static(json, "wifi_signal_strength", json_int_new(wifi_signal_strength));
 
-    json_obj_append(json, "mem_usage", json_int_new(100 - 100 * system_get_free_heap_size() / MAX_AVAILABLE_RAM));
-    json_obj_append(json, "flash_size", json_int_new(system_get_flash_size() / 1024));
+    int mem_usage = 100 - 100 * system_get_free_heap_size() / MAX_AVAILABLE_RAM;
+    json_obj_append_static(json, "mem_usage", json_int_new(mem_usage));
+    json_obj_append_static(json, "flash_size", json_int_new(system_get_flash_size() / 1024));
+    json_obj_append_static(json, "min_free_heap", json_int_new(device_min_free_heap));
 
 #ifdef _OTA
-    json_obj_append(json, "firmware_auto_update", json_bool_new(device_flags & DEVICE_FLAG_OTA_AUTO_UPDATE));
-    json_obj_append(json, "firmware_beta_enabled", json_bool_new(device_flags & DEVICE_FLAG_OTA_BETA_ENABLED));
+    json_obj_append_static(json, "firmware_auto_update", json_bool_new(device_flags & DEVICE_FLAG_OTA_AUTO_UPDATE));
+    json_obj_append_static(json, "firmware_beta_enabled", json_bool_new(device_flags & DEVICE_FLAG_OTA_BETA_ENABLED));
 #endif
 
     /* Flash id */
     char id[10];
     snprintf(id, 10, "%08x", spi_flash_get_id());
-    json_obj_append(json, "flash_id", json_str_new(id));
+    json_obj_append_static(json, "flash_id", json_str_new(id));
 
     /* Chip id */
     snprintf(id, 10, "%08x", system_get_chip_id());
-    json_obj_append(json, "chip_id", json_str_new(id));
+    json_obj_append_static(json, "chip_id", json_str_new(id));
 
     /* Configuration name */
-    json_obj_append(json, "config_name", json_str_new(device_config_name));
+    json_obj_append_static(json, "config_name", json_str_new(device_config_name));
 
 #ifdef _DEBUG
-    json_obj_append(json, "debug", json_bool_new(TRUE));
+    json_obj_append_static(json, "debug", json_bool_new(TRUE));
 #endif
 
     /* Sleep mode */
 #ifdef _SLEEP
-    json_obj_append(json, "sleep_wake_interval", json_int_new(sleep_get_wake_interval()));
-    json_obj_append(json, "sleep_wake_duration", json_int_new(sleep_get_wake_duration()));
+    json_obj_append_static(json, "sleep_wake_interval", json_int_new(sleep_get_wake_interval()));
+    json_obj_append_static(json, "sleep_wake_duration", json_int_new(sleep_get_wake_duration()));
 #endif
 
     /* Battery */
 #ifdef _BATTERY
     if (battery_enabled()) {
-        json_obj_append(json, "battery_level", json_int_new(battery_get_level()));
-        json_obj_append(json, "battery_voltage", json_int_new(battery_get_voltage()));
+        json_obj_append_static(json, "battery_level", json_int_new(battery_get_level()));
+        json_obj_append_static(json, "battery_voltage", json_int_new(battery_get_voltage()));
     }
 #endif
 
     /* Attribute definitions */
-    json_obj_append(json, "definitions", device_attrdefs_to_json());
+    json_obj_append_static(json, "definitions", device_attrdefs_to_json());
 
     json_stringify(json);
 
@@ -866,7 +897,7 @@ json_t *peripheral_to_json(peripheral_t *peripheral) {
     int i;
 
     /* Type */
-    json_obj_append(peripheral_json, "type", json_int_new(peripheral->type_id));
+    json_obj_append_static(peripheral_json, "type", json_int_new(peripheral->type_id));
 
     /* Flags */
 
@@ -874,11 +905,11 @@ json_t *peripheral_to_json(peripheral_t *peripheral) {
         flags_str[i] = '0' + !!(peripheral->flags & BIT(15 - i));
     }
     flags_str[16] = '\0';
-    json_obj_append(peripheral_json, "flags", json_str_new(flags_str));
+    json_obj_append_static(peripheral_json, "flags", json_str_new(flags_str));
 
     /* int8 params */
     json = json_list_new();
-    json_obj_append(peripheral_json, "int8_params", json);
+    json_obj_append_static(peripheral_json, "int8_params", json);
     for (i = 0; i < PERIPHERAL_MAX_INT8_PARAMS; i++) {
         snprintf(hex, sizeof(hex), "%02X", PERIPHERAL_PARAM_UINT8(peripheral, i));
         json_list_append(json, json_str_new(hex));
@@ -886,7 +917,7 @@ json_t *peripheral_to_json(peripheral_t *peripheral) {
 
     /* Port IDs */
     json = json_list_new();
-    json_obj_append(peripheral_json, "port_ids", json);
+    json_obj_append_static(peripheral_json, "port_ids", json);
     for (i = 0; i < all_ports_count; i++) {
         port_t *port = all_ports[i];
         if (port->peripheral != peripheral) {
@@ -1073,7 +1104,7 @@ json_t *api_get_firmware(json_t *query_json, int *code) {
 
         if (!ota_get_latest(beta, on_ota_latest)) {
             response_json = json_obj_new();
-            json_obj_append(response_json, "error", json_str_new("busy"));
+            json_obj_append_static(response_json, "error", json_str_new("busy"));
             *code = 503;
         }
     }
@@ -1081,8 +1112,8 @@ json_t *api_get_firmware(json_t *query_json, int *code) {
         char *ota_state_str = ota_states_str[ota_state];
 
         response_json = json_obj_new();
-        json_obj_append(response_json, "version", json_str_new(FW_VERSION));
-        json_obj_append(response_json, "status", json_str_new(ota_state_str));
+        json_obj_append_static(response_json, "version", json_str_new(FW_VERSION));
+        json_obj_append_static(response_json, "status", json_str_new(ota_state_str));
     }
 
     return response_json;
@@ -1130,19 +1161,19 @@ json_t *api_get_access(json_t *query_json, int *code) {
 
     switch (api_access_level) {
         case API_ACCESS_LEVEL_ADMIN:
-            json_obj_append(response_json, "level", json_str_new("admin"));
+            json_obj_append_static(response_json, "level", json_str_new("admin"));
             break;
 
         case API_ACCESS_LEVEL_NORMAL:
-            json_obj_append(response_json, "level", json_str_new("normal"));
+            json_obj_append_static(response_json, "level", json_str_new("normal"));
             break;
 
         case API_ACCESS_LEVEL_VIEWONLY:
-            json_obj_append(response_json, "level", json_str_new("viewonly"));
+            json_obj_append_static(response_json, "level", json_str_new("viewonly"));
             break;
     
         default:
-            json_obj_append(response_json, "level", json_str_new("none"));
+            json_obj_append_static(response_json, "level", json_str_new("none"));
             break;
     }
 
@@ -1159,16 +1190,16 @@ json_t *api_get_backup_endpoints(json_t *query_json, int *code) {
     }
 
     json_t *peripherals_json = json_obj_new();
-    json_obj_append(peripherals_json, "path", json_str_new("/peripherals"));
-    json_obj_append(peripherals_json, "display_name", json_str_new("Peripherals"));
-    json_obj_append(peripherals_json, "restore_method", json_str_new("PUT"));
-    json_obj_append(peripherals_json, "order", json_int_new(5));
+    json_obj_append_static(peripherals_json, "path", json_str_new("/peripherals"));
+    json_obj_append_static(peripherals_json, "display_name", json_str_new("Peripherals"));
+    json_obj_append_static(peripherals_json, "restore_method", json_str_new("PUT"));
+    json_obj_append_static(peripherals_json, "order", json_int_new(5));
 
     json_t *system_json = json_obj_new();
-    json_obj_append(system_json, "path", json_str_new("/system"));
-    json_obj_append(system_json, "display_name", json_str_new("System Configuration"));
-    json_obj_append(system_json, "restore_method", json_str_new("PATCH"));
-    json_obj_append(system_json, "order", json_int_new(6));
+    json_obj_append_static(system_json, "path", json_str_new("/system"));
+    json_obj_append_static(system_json, "display_name", json_str_new("System Configuration"));
+    json_obj_append_static(system_json, "restore_method", json_str_new("PATCH"));
+    json_obj_append_static(system_json, "order", json_int_new(6));
 
     json_list_append(response_json, peripherals_json);
     json_list_append(response_json, system_json);
@@ -1177,26 +1208,19 @@ json_t *api_get_backup_endpoints(json_t *query_json, int *code) {
 }
 
 json_t *api_get_ports(json_t *query_json, int *code) {
-    json_t *response_json = json_list_new();
-
     if (api_access_level < API_ACCESS_LEVEL_VIEWONLY) {
-        return FORBIDDEN(response_json, API_ACCESS_LEVEL_VIEWONLY);
+        return FORBIDDEN(NULL, API_ACCESS_LEVEL_VIEWONLY);
     }
 
-    port_t *p;
-    int i;
-    json_refs_ctx_t json_refs_ctx;
-    json_refs_ctx_init(&json_refs_ctx, JSON_REFS_TYPE_PORTS_LIST);
-    for (i = 0; i < all_ports_count; i++) {
-        p = all_ports[i];
-        DEBUG_API("returning attributes of port %s", p->id);
-        json_list_append(response_json, port_to_json(p, &json_refs_ctx));
-        json_refs_ctx.index++;
-    }
+    /* The response is written as it goes, so that only one port at a time is held as a JSON structure */
+    json_writer_t *writer = respond_json_begin(api_conn, 200);
+    write_ports_json(writer);
+    respond_json_end(writer);
+    api_conn_reset();
 
     *code = 200;
 
-    return response_json;
+    return NULL;
 }
 
 json_t *api_post_ports(json_t *query_json, json_t *request_json, int *code) {
@@ -1425,9 +1449,6 @@ json_t *api_post_ports(json_t *query_json, json_t *request_json, int *code) {
         DEBUG_API("adding virtual port: %d choices", len);
     }
 
-    /* Sequence */
-    new_port->sequence_pos = -1;
-
     if (!virtual_port_register(new_port)) {
         port_cleanup(new_port, /* free_id = */ TRUE);
         free(new_port);
@@ -1529,7 +1550,7 @@ json_t *api_put_ports(json_t *query_json, json_t *request_json, int *code) {
         json_free(response_json);
         response_json = error_response_json;
         if (error_port_id) {
-            json_obj_append(response_json, "id", json_str_new(error_port_id));
+            json_obj_append_static(response_json, "id", json_str_new(error_port_id));
             free(error_port_id);
         }
         *code = 400;
@@ -1714,11 +1735,7 @@ json_t *api_patch_port(port_t *port, json_t *query_json, json_t *request_json, i
                 return INVALID_FIELD(response_json, key);
             }
 
-            if (port->sexpr) {
-                port_expr_remove(port);
-            }
-
-            if (port->sequence_pos >= 0) {
+            if (port->sequence) {
                 port_sequence_cancel(port);
             }
 
@@ -1742,11 +1759,24 @@ json_t *api_patch_port(port_t *port, json_t *query_json, json_t *request_json, i
                     );
                 }
 
+                /* The current expression is only replaced once the new one is accepted, so its heap counts as free */
+                uint32 free_heap = system_get_free_heap_size() + (port->expr ? expr_get_heap_size(port->expr) : 0);
                 expr_t *expr = expr_parse(port->id, sexpr, strlen(sexpr));
                 if (!expr) {
                     return INVALID_EXPRESSION_FROM_ERROR(response_json, "expression");
                 }
 
+                if (!expr_fits_heap(expr, free_heap)) {
+                    expr_free(expr);
+                    return INVALID_EXPRESSION(
+                        response_json,
+                        "expression",
+                        "not-enough-memory",
+                        /* token = */ NULL,
+                        /* pos = */ -1
+                    );
+                }
+
                 if (expr_check_loops(expr, port) > 1) {
                     DEBUG_API("loop detected in expression \"%s\"", sexpr);
                     expr_free(expr);
@@ -1759,6 +1789,10 @@ json_t *api_patch_port(port_t *port, json_t *query_json, json_t *request_json, i
                     );
                 }
 
+                if (port->sexpr) {
+                    port_expr_remove(port);
+                }
+
                 port->sexpr = strdup(sexpr);
 
                 if (IS_PORT_ENABLED(port)) {
@@ -1769,6 +1803,9 @@ json_t *api_patch_port(port_t *port, json_t *query_json, json_t *request_json, i
                     expr_free(expr);
                 }
             }
+            else if (port->sexpr) {
+                port_expr_remove(port);
+            }
 
             DEBUG_PORT(port, "expression set to \"%s\"", port->sexpr ? port->sexpr : "");
             update_port_expression(port);
@@ -1778,14 +1815,6 @@ json_t *api_patch_port(port_t *port, json_t *query_json, json_t *request_json, i
                 return INVALID_FIELD(response_json, key);
             }
 
-            if (port->transform_write) {
-                DEBUG_PORT(port, "removing write transform");
-                expr_free(port->transform_write);
-                free(port->stransform_write);
-                port->transform_write = NULL;
-                port->stransform_write = NULL;
-            }
-
             char *stransform_write = json_str_get(child);
 
             /* Use auxiliary s to check if expression is not empty (contains non-space characters) */
@@ -1806,30 +1835,50 @@ json_t *api_patch_port(port_t *port, json_t *query_json, json_t *request_json, i
                     );
                 }
 
+                /* As with expressions, the heap of the transform being replaced counts as free */
+                uint32 free_heap = system_get_free_heap_size();
+                if (port->transform_write) {
+                    free_heap += expr_get_heap_size(port->transform_write);
+                }
                 expr_t *transform_write = expr_parse(port->id, stransform_write, strlen(stransform_write));
                 if (!transform_write) {
                     return INVALID_EXPRESSION_FROM_ERROR(response_json, "transform_write");
                 }
 
+                if (!expr_fits_heap(transform_write, free_heap)) {
+                    expr_free(transform_write);
+                    return INVALID_EXPRESSION(
+                        response_json,
+                        "transform_write",
+                        "not-enough-memory",
+                        /* token = */ NULL,
+                        /* pos = */ -1
+                    );
+                }
+
+                if (port->transform_write) {
+                    expr_free(port->transform_write);
+                    free(port->stransform_write);
+                }
+
                 port->stransform_write = strdup(stransform_write);
                 port->transform_write = transform_write;
 
                 DEBUG_PORT(port, "write transform set to \"%s\"", port->stransform_write ? port->stransform_write : "");
             }
+            else if (port->transform_write) {
+                DEBUG_PORT(port, "removing write transform");
+                expr_free(port->transform_write);
+                free(port->stransform_write);
+                port->transform_write = NULL;
+                port->stransform_write = NULL;
+            }
         }
         else if (!strcmp(key, "transform_read")) {
             if (json_get_type(child) != JSON_TYPE_STR) {
                 return INVALID_FIELD(response_json, key);
             }
 
-            if (port->transform_read) {
-                DEBUG_PORT(port, "removing read transform");
-                expr_free(port->transform_read);
-                free(port->stransform_read);
-                port->transform_read = NULL;
-                port->stransform_read = NULL;
-            }
-
             char *stransform_read = json_str_get(child);
 
             /* Use auxiliary s to check if expression is not empty (contains non-space characters) */
@@ -1850,16 +1899,44 @@ json_t *api_patch_port(port_t *port, json_t *query_json, json_t *request_json, i
                     );
                 }
 
+                /* As with expressions, the heap of the transform being replaced counts as free */
+                uint32 free_heap = system_get_free_heap_size();
+                if (port->transform_read) {
+                    free_heap += expr_get_heap_size(port->transform_read);
+                }
                 expr_t *transform_read = expr_parse(port->id, stransform_read, strlen(stransform_read));
                 if (!transform_read) {
                     return INVALID_EXPRESSION_FROM_ERROR(response_json, "transform_read");
                 }
 
+                if (!expr_fits_heap(transform_read, free_heap)) {
+                    expr_free(transform_read);
+                    return INVALID_EXPRESSION(
+                        response_json,
+                        "transform_read",
+                        "not-enough-memory",
+                        /* token = */ NULL,
+                        /* pos = */ -1
+                    );
+                }
+
+                if (port->transform_read) {
+                    expr_free(port->transform_read);
+                    free(port->stransform_read);
+                }
+
                 port->stransform_read = strdup(stransform_read);
                 port->transform_read = transform_read;
 
                 DEBUG_PORT(port, "read transform set to \"%s\"", port->stransform_read ? port->stransform_read : "");
             }
+            else if (port->transform_read) {
+                DEBUG_PORT(port, "removing read transform");
+                expr_free(port->transform_read);
+                free(port->stransform_read);
+                port->transform_read = NULL;
+                port->stransform_read = NULL;
+            }
         }
         else if (!strcmp(key, "persisted")) {
             if (json_get_type(child) != JSON_TYPE_BOOL) {
@@ -1908,9 +1985,82 @@ json_t *api_patch_port(port_t *port, json_t *query_json, json_t *request_json, i
             }
 
             port->sampling_interval = sampling_interval;
+            core_invalidate_poll_schedule();
 
             DEBUG_PORT(port, "sampling interval set to %d ms", sampling_interval);
         }
+        else if (!strcmp(key, "min_event_interval")) {
+            if (json_get_type(child) != JSON_TYPE_INT) {
+                return INVALID_FIELD(response_json, key);
+            }
+
+            int min_event_interval = json_int_get(child);
+            if (!validate_num(min_event_interval, 0, API_MAX_MIN_EVENT_INTERVAL, TRUE, 0, NULL)) {
+                return INVALID_FIELD(response_json, key);
+            }
+
+            port->min_event_interval = min_event_interval;
+
+            DEBUG_PORT(port, "minimum event interval set to %d ms", min_event_interval);
+        }
+        else if (!strcmp(key, "persist_interval")) {
+            if (json_get_type(child) != JSON_TYPE_INT) {
+                return INVALID_FIELD(response_json, key);
+            }
+
+            int persist_interval = json_int_get(child);
+            if (!validate_num(persist_interval, 0, API_MAX_PERSIST_INTERVAL, TRUE, 0, NULL)) {
+                return INVALID_FIELD(response_json, key);
+            }
+
+            port->persist_interval = persist_interval;
+
+            DEBUG_PORT(port, "persist interval set to %d ms", persist_interval);
+        }
+        else if (port->type == PORT_TYPE_NUMBER && !strcmp(key, "change_threshold")) {
+            if (json_get_type(child) != JSON_TYPE_INT && json_get_type(child) != JSON_TYPE_DOUBLE) {
+                return INVALID_FIELD(response_json, key);
+            }
+
+            double change_threshold = json_get_type(child) == JSON_TYPE_INT ? json_int_get(child) :
+                                                                              json_double_get(child);
+            if (!validate_num(change_threshold, 0, UNDEFINED, FALSE, 0, NULL)) {
+                return INVALID_FIELD(response_json, key);
+            }
+
+            port->change_threshold = change_threshold;
+
+            DEBUG_PORT(port, "change threshold set to %s", dtostr(change_threshold, -1));
+        }
+        else if (port->type == PORT_TYPE_NUMBER && !strcmp(key, "change_threshold_relative")) {
+            if (json_get_type(child) != JSON_TYPE_BOOL) {
+                return INVALID_FIELD(response_json, key);
+            }
+
+            if (json_bool_get(child)) {
+                port->flags |= PORT_FLAG_REL_THRESHOLD;
+                DEBUG_PORT(port, "relative change threshold enabled");
+            }
+            else {
+                port->flags &= ~PORT_FLAG_REL_THRESHOLD;
+                DEBUG_PORT(port, "relative change threshold disabled");
+            }
+        }
+        else if (port->type == PORT_TYPE_NUMBER && !strcmp(key, "persist_threshold")) {
+            if (json_get_type(child) != JSON_TYPE_INT && json_get_type(child) != JSON_TYPE_DOUBLE) {
+                return INVALID_FIELD(response_json, key);
+            }
+
+            double persist_threshold = json_get_type(child) == JSON_TYPE_INT ? json_int_get(child) :
+                                                                               json_double_get(child);
+            if (!validate_num(persist_threshold, 0, UNDEFINED, FALSE, 0, NULL)) {
+                return INVALID_FIELD(response_json, key);
+            }
+
+            port->persist_threshold = persist_threshold;
+
+            DEBUG_PORT(port, "persist threshold set to %s", dtostr(persist_threshold, -1));
+        }
         else if (!strcmp(key, "id") ||
                  !strcmp(key, "type") ||
                  !strcmp(key, "writable") ||
@@ -1918,7 +2068,8 @@ json_t *api_patch_port(port_t *port, json_t *query_json, json_t *request_json, i
                  !strcmp(key, "max") ||
                  !strcmp(key, "integer") ||
                  !strcmp(key, "step") ||
-                 !strcmp(key, "choices")) {
+                 !strcmp(key, "choices") ||
+                 !strcmp(key, "expr_heap_size")) {
 
             if (!provisioning) {
                 return ATTR_NOT_MODIFIABLE(response_json, key);
@@ -2048,7 +2199,13 @@ json_t *api_patch_port_value(port_t *port, json_t *query_json, json_t *request_j
             return API_ERROR(response_json, 400, "invalid-value");
         }
     }
-    
+
+    /* Asynchronous writes are merely queued at this point */
+    if (port->write_value_async) {
+        *code = 202;
+        return response_json;
+    }
+
     double after_value = port_read_value(port);
     if (IS_UNDEFINED(after_value) || (abs(after_value - old_value) < 1e-9 && abs(old_value - desired_value) > 1e-9)) {
         *code = 202; /* Value was not applied (right away) */
@@ -2113,15 +2270,15 @@ json_t *api_patch_port_sequence(port_t *port, json_t *query_json, json_t *reques
     int i;
     json_t *j;
     
-    if (port->sequence_pos >= 0) {
+    if (port->sequence) {
         port_sequence_cancel(port);
     }
 
-    port->sequence_len = json_list_get_len(values_json);
-    port->sequence_pos = 0;
-    port->sequence_repeat = repeat;
-    port->sequence_values = malloc(sizeof(double) * port->sequence_len);
-    port->sequence_delays = malloc(sizeof(int) * (port->sequence_len));
+    port_sequence_t *sequence = zalloc(sizeof(port_sequence_t));
+    sequence->len = json_list_get_len(values_json);
+    sequence->repeat = repeat;
+    sequence->values = malloc(sizeof(double) * sequence->len);
+    sequence->delays = malloc(sizeof(int) * (sequence->len));
 
     /* Values */
     for (i = 0; i < json_list_get_len(values_json); i++) {
@@ -2131,7 +2288,7 @@ json_t *api_patch_port_sequence(port_t *port, json_t *query_json, json_t *reques
                 return SEQ_INVALID_FIELD(response_json, "values");
             }
 
-            port->sequence_values[i] = json_bool_get(j);
+            sequence->values[i] = json_bool_get(j);
         }
         if (port->type == PORT_TYPE_NUMBER) {
             if (json_get_type(j) != JSON_TYPE_INT &&
@@ -2145,7 +2302,7 @@ json_t *api_patch_port_sequence(port_t *port, json_t *query_json, json_t *reques
                 return SEQ_INVALID_FIELD(response_json, "values");
             }
 
-            port->sequence_values[i] = value;
+            sequence->values[i] = value;
         }
     }
 
@@ -2156,18 +2313,18 @@ json_t *api_patch_port_sequence(port_t *port, json_t *query_json, json_t *reques
             return SEQ_INVALID_FIELD(response_json, "delays");
         }
         
-        port->sequence_delays[i] = json_int_get(j);
+        sequence->delays[i] = json_int_get(j);
         
-        if (port->sequence_delays[i] < API_MIN_SEQUENCE_DELAY || port->sequence_delays[i] > API_MAX_SEQUENCE_DELAY) {
+        if (sequence->delays[i] < API_MIN_SEQUENCE_DELAY || sequence->delays[i] > API_MAX_SEQUENCE_DELAY) {
             return SEQ_INVALID_FIELD(response_json, "delays");
         }
     }
     
     /* Start sequence timer */
-    port->sequence_timer = zalloc(sizeof(os_timer_t));
-    os_timer_disarm(port->sequence_timer);
-    os_timer_setfn(port->sequence_timer, on_sequence_timer, port);
-    os_timer_arm(port->sequence_timer, 1, /* repeat = */ FALSE);
+    port->sequence = sequence;
+    os_timer_disarm(&sequence->timer);
+    os_timer_setfn(&sequence->timer, on_sequence_timer, port);
+    os_timer_arm(&sequence->timer, 1, /* repeat = */ FALSE);
 
     response_json = json_obj_new();
     *code = 204;
@@ -2184,16 +2341,16 @@ json_t *api_get_webhooks(json_t *query_json, int *code) {
 
     DEBUG_API("returning webhooks parameters");
 
-    json_obj_append(response_json, "enabled", json_bool_new(device_flags & DEVICE_FLAG_WEBHOOKS_ENABLED));
-    json_obj_append(
+    json_obj_append_static(response_json, "enabled", json_bool_new(device_flags & DEVICE_FLAG_WEBHOOKS_ENABLED));
+    json_obj_append_static(
         response_json,
         "scheme",
         json_str_new(device_flags & DEVICE_FLAG_WEBHOOKS_HTTPS ? "https" : "http")
     );
-    json_obj_append(response_json, "host", json_str_new(webhooks_host ? webhooks_host : ""));
-    json_obj_append(response_json, "port", json_int_new(webhooks_port));
-    json_obj_append(response_json, "path", json_str_new(webhooks_path ? webhooks_path : ""));
-    json_obj_append(response_json, "password_hash", json_str_new(webhooks_password_hash));
+    json_obj_append_static(response_json, "host", json_str_new(webhooks_host ? webhooks_host : ""));
+    json_obj_append_static(response_json, "port", json_int_new(webhooks_port));
+    json_obj_append_static(response_json, "path", json_str_new(webhooks_path ? webhooks_path : ""));
+    json_obj_append_static(response_json, "password_hash", json_str_new(webhooks_password_hash));
 
     json_t *json_events = json_list_new();
 
@@ -2204,9 +2361,9 @@ json_t *api_get_webhooks(json_t *query_json, int *code) {
         }
     }
 
-    json_obj_append(response_json, "events", json_events);
-    json_obj_append(response_json, "timeout", json_int_new(webhooks_timeout));
-    json_obj_append(response_json, "retries", json_int_new(webhooks_retries));
+    json_obj_append_static(response_json, "events", json_events);
+    json_obj_append_static(response_json, "timeout", json_int_new(webhooks_timeout));
+    json_obj_append_static(response_json, "retries", json_int_new(webhooks_retries));
 
     *code = 200;
 
@@ -2434,7 +2591,7 @@ json_t *api_get_wifi(json_t *query_json, int *code) {
 
     if (!wifi_scan(on_wifi_scan)) {
         response_json = json_obj_new();
-        json_obj_append(response_json, "error", json_str_new("busy"));
+        json_obj_append_static(response_json, "error", json_str_new("busy"));
         *code = 503;
 
         return response_json;
@@ -2458,18 +2615,18 @@ json_t *api_get_raw_io(char *io, json_t *query_json, int *code) {
             return API_ERROR(response_json, 404, "no-such-io");
         }
 
-        json_obj_append(response_json, "value", json_bool_new(gpio_read_value(gpio_no)));
-        json_obj_append(response_json, "configured", json_bool_new(gpio_is_configured(gpio_no)));
-        json_obj_append(response_json, "output", json_bool_new(gpio_is_output(gpio_no)));
+        json_obj_append_static(response_json, "value", json_bool_new(gpio_read_value(gpio_no)));
+        json_obj_append_static(response_json, "configured", json_bool_new(gpio_is_configured(gpio_no)));
+        json_obj_append_static(response_json, "output", json_bool_new(gpio_is_output(gpio_no)));
         if (gpio_no == 16) {
-            json_obj_append(response_json, "pull_down", json_bool_new(!gpio_get_pull(gpio_no)));
+            json_obj_append_static(response_json, "pull_down", json_bool_new(!gpio_get_pull(gpio_no)));
         }
         else {
-            json_obj_append(response_json, "pull_up", json_bool_new(gpio_get_pull(gpio_no)));
+            json_obj_append_static(response_json, "pull_up", json_bool_new(gpio_get_pull(gpio_no)));
         }
     }
     else if (!strcmp(io, "adc0")) {
-        json_obj_append(response_json, "value", json_int_new(system_adc_read()));
+        json_obj_append_static(response_json, "value", json_int_new(system_adc_read()));
     }
     else if (!strcmp(io, "hspi")) {
         uint8 bit_order;
@@ -2478,11 +2635,11 @@ json_t *api_get_raw_io(char *io, json_t *query_json, int *code) {
         uint32 freq;
         bool configured = hspi_get_current_setup(&bit_order, &cpol, &cpha, &freq);
 
-        json_obj_append(response_json, "bit_order", json_str_new(bit_order ? "lsb_first" : "msb_first"));
-        json_obj_append(response_json, "cpol", json_bool_new(cpol));
-        json_obj_append(response_json, "cpha", json_bool_new(cpha));
-        json_obj_append(response_json, "freq", json_int_new(freq));
-        json_obj_append(response_json, "configured", json_bool_new(configured));
+        json_obj_append_static(response_json, "bit_order", json_str_new(bit_order ? "lsb_first" : "msb_first"));
+        json_obj_append_static(response_json, "cpol", json_bool_new(cpol));
+        json_obj_append_static(response_json, "cpha", json_bool_new(cpha));
+        json_obj_append_static(response_json, "freq", json_int_new(freq));
+        json_obj_append_static(response_json, "configured", json_bool_new(configured));
     }
     else {
         return API_ERROR(response_json, 404, "no-such-io");
@@ -2606,7 +2763,7 @@ json_t *api_patch_raw_io(char *io, json_t *query_json, json_t *request_json, int
                 }
             }
 
-            json_obj_append(response_json, "value", value_json);
+            json_obj_append_static(response_json, "value", value_json);
 
             *code = 200;
         }
@@ -3012,18 +3169,18 @@ json_t *api_get_system(json_t *query_json, int *code) {
     uint8 hold, reset_hold;
     system_setup_button_get_config(&pin, &level, &hold, &reset_hold);
     json_t *setup_button_json = json_obj_new();
-    json_obj_append(response_json, "setup_button", setup_button_json);
-    json_obj_append(setup_button_json, "pin", json_int_new(pin));
-    json_obj_append(setup_button_json, "level", json_bool_new(level));
-    json_obj_append(setup_button_json, "hold", json_int_new(hold));
-    json_obj_append(setup_button_json, "reset_hold", json_int_new(reset_hold));
+    json_obj_append_static(response_json, "setup_button", setup_button_json);
+    json_obj_append_static(setup_button_json, "pin", json_int_new(pin));
+    json_obj_append_static(setup_button_json, "level", json_bool_new(level));
+    json_obj_append_static(setup_button_json, "hold", json_int_new(hold));
+    json_obj_append_static(setup_button_json, "reset_hold", json_int_new(reset_hold));
 
     /* Status LED */
     system_status_led_get_config(&pin, &level);
     json_t *status_led_json = json_obj_new();
-    json_obj_append(response_json, "status_led", status_led_json);
-    json_obj_append(status_led_json, "pin", json_int_new(pin));
-    json_obj_append(status_led_json, "level", json_bool_new(level));
+    json_obj_append_static(response_json, "status_led", status_led_json);
+    json_obj_append_static(status_led_json, "pin", json_int_new(pin));
+    json_obj_append_static(status_led_json, "level", json_bool_new(level));
 
     /* Battery */
 #ifdef _BATTERY
@@ -3031,10 +3188,10 @@ json_t *api_get_system(json_t *query_json, int *code) {
     uint16 voltages[BATTERY_LUT_LEN];
     battery_get_config(&div_factor, voltages);
     json_t *battery_json = json_obj_new();
-    json_obj_append(response_json, "battery", battery_json);
-    json_obj_append(battery_json, "div", json_int_new(div_factor));
+    json_obj_append_static(response_json, "battery", battery_json);
+    json_obj_append_static(battery_json, "div", json_int_new(div_factor));
     json_t *voltages_json = json_list_new();
-    json_obj_append(battery_json, "voltages", voltages_json);
+    json_obj_append_static(battery_json, "voltages", voltages_json);
     for (int i = 0; i < BATTERY_LUT_LEN; i++) {
         json_list_append(voltages_json, json_int_new(voltages[i]));
     }
@@ -3178,23 +3335,71 @@ json_t *api_patch_system(json_t *query_json, json_t *request_json, int *code) {
     return response_json;
 }
 
-json_t *api_get_provisioning(json_t *query_json, int *code) {
+#ifdef _STATS
+
+json_t *api_get_debug_stats(json_t *query_json, int *code) {
+    if (api_access_level < API_ACCESS_LEVEL_ADMIN) {
+        return FORBIDDEN(json_obj_new(), API_ACCESS_LEVEL_ADMIN);
+    }
+
+    *code = 200;
+
+    return stats_to_json();
+}
+
+json_t *api_delete_debug_stats(json_t *query_json, int *code) {
     json_t *response_json = json_obj_new();
 
     if (api_access_level < API_ACCESS_LEVEL_ADMIN) {
         return FORBIDDEN(response_json, API_ACCESS_LEVEL_ADMIN);
     }
 
+    stats_reset();
+
+    *code = 204;
+
+    return response_json;
+}
+
+#endif
+
+json_t *api_get_provisioning(json_t *query_json, int *code) {
+    if (api_access_level < API_ACCESS_LEVEL_ADMIN) {
+        return FORBIDDEN(NULL, API_ACCESS_LEVEL_ADMIN);
+    }
+
     int dummy_code;
+    json_t *json;
+
+    /* Written as it goes, like the ports list */
+    json_writer_t *writer = respond_json_begin(api_conn, 200);
+    json_writer_begin_obj(writer);
+
+    json_writer_key(writer, "peripherals");
+    json = api_get_peripherals(NULL, &dummy_code);
+    json_writer_json(writer, json);
+    json_free(json);
+
+    json_writer_key(writer, "system");
+    json = api_get_system(NULL, &dummy_code);
+    json_writer_json(writer, json);
+    json_free(json);
 
-    json_obj_append(response_json, "peripherals", api_get_peripherals(NULL, &dummy_code));
-    json_obj_append(response_json, "system", api_get_system(NULL, &dummy_code));
-    json_obj_append(response_json, "device", api_get_device(NULL, &dummy_code));
-    json_obj_append(response_json, "ports", api_get_ports(NULL, &dummy_code));
+    json_writer_key(writer, "device");
+    json = api_get_device(NULL, &dummy_code);
+    json_writer_json(writer, json);
+    json_free(json);
+
+    json_writer_key(writer, "ports");
+    write_ports_json(writer);
+
+    json_writer_end_obj(writer);
+    respond_json_end(writer);
+    api_conn_reset();
 
     *code = 200;
 
-    return response_json;
+    return NULL;
 }
 
 json_t *api_put_provisioning(json_t *query_json, json_t *request_json, int *code) {
@@ -3227,7 +3432,7 @@ json_t *api_put_provisioning(json_t *query_json, json_t *request_json, int *code
 json_t *_api_error(json_t *response_json, char *error, char *field_name, char *field_value) {
     json_free(response_json);
     response_json = json_obj_new();
-    json_obj_append(response_json, "error", json_str_new(error));
+    json_obj_append_static(response_json, "error", json_str_new(error));
     if (field_name) {
         json_obj_append(response_json, field_name, json_str_new(field_value));
     }
@@ -3261,18 +3466,18 @@ json_t *_forbidden_error(json_t *response_json, uint8 level) {
 json_t *_invalid_expression_error(json_t *response_json, char *field, char *reason, char *token, int32 pos) {
     json_free(response_json);
     response_json = json_obj_new();
-    json_obj_append(response_json, "error", json_str_new("invalid-field"));
-    json_obj_append(response_json, "field", json_str_new(field));
+    json_obj_append_static(response_json, "error", json_str_new("invalid-field"));
+    json_obj_append_static(response_json, "field", json_str_new(field));
 
     json_t *details_json = json_obj_new();
-    json_obj_append(details_json, "reason", json_str_new(reason));
+    json_obj_append_static(details_json, "reason", json_str_new(reason));
     if (token) {
-        json_obj_append(details_json, "token", json_str_new(token));
+        json_obj_append_static(details_json, "token", json_str_new(token));
     }
     if (pos >= 1) {
-        json_obj_append(details_json, "pos", json_int_new(pos));
+        json_obj_append_static(details_json, "pos", json_int_new(pos));
     }
-    json_obj_append(response_json, "details", details_json);
+    json_obj_append_static(response_json, "details", details_json);
 
     return response_json;
 }
@@ -3506,6 +3711,27 @@ json_t *device_from_json(
             }
             *needs_reset = TRUE;
         }
+        else if (!strcmp(key, "min_free_heap")) {
+            if (json_get_type(child) != JSON_TYPE_INT) {
+                return INVALID_FIELD(response_json, key);
+            }
+
+            uint32 min_free_heap = json_int_get(child);
+            bool valid = validate_num(
+                min_free_heap,
+                MIN_FREE_HEAP_MIN,
+                MIN_FREE_HEAP_MAX,
+                /* integer = */ TRUE,
+                /* step = */ 0,
+                /* choices = */ NULL
+            );
+            if (!valid) {
+                return INVALID_FIELD(response_json, key);
+            }
+
+            device_min_free_heap = min_free_heap;
+            DEBUG_DEVICE("min free heap set to %d", device_min_free_heap);
+        }
 #ifdef _SLEEP
         else if (!strcmp(key, "sleep_wake_interval")) {
             if (json_get_type(child) != JSON_TYPE_INT) {
@@ -3727,11 +3953,11 @@ json_t *port_attrdefs_to_json(port_t *port, json_refs_ctx_t *json_refs_ctx) {
                     ref_str
                 );
 #endif
-                json_obj_append(attrdef_json, "choices", ref);
+                json_obj_append_static(attrdef_json, "choices", ref);
             }
 
             json_stringify(attrdef_json);
-            json_obj_append(json, a->name, attrdef_json);
+            json_obj_append_static(json, a->name, attrdef_json);
         }
     }
 
@@ -3767,7 +3993,99 @@ json_t *port_attrdefs_to_json(port_t *port, json_refs_ctx_t *json_refs_ctx) {
 //                json_refs_ctx->sampling_interval_port_index = json_refs_ctx->index;
 //            }
 //        }
-        json_obj_append(json, "sampling_interval", attrdef_json);
+        json_obj_append_static(json, "sampling_interval", attrdef_json);
+    }
+
+    attrdef_json = attrdef_to_json(
+        "Minimum Event Interval",
+        "Value changes that come sooner than this after the last reported one are reported later, at once.",
+        "ms",
+        ATTR_TYPE_NUMBER,
+        /* modifiable = */ TRUE,
+        /* min = */ 0,
+        /* max = */ API_MAX_MIN_EVENT_INTERVAL,
+        /* integer = */ TRUE,
+        /* step = */ 0,
+        /* choices = */ NULL,
+        /* reconnect = */ FALSE
+    );
+    json_obj_append_static(json, "min_event_interval", attrdef_json);
+
+    attrdef_json = attrdef_to_json(
+        "Persist Interval",
+        "Persisted values that come sooner than this after the last persisted one are persisted later, at once.",
+        "ms",
+        ATTR_TYPE_NUMBER,
+        /* modifiable = */ TRUE,
+        /* min = */ 0,
+        /* max = */ API_MAX_PERSIST_INTERVAL,
+        /* integer = */ TRUE,
+        /* step = */ 0,
+        /* choices = */ NULL,
+        /* reconnect = */ FALSE
+    );
+    json_obj_append_static(json, "persist_interval", attrdef_json);
+
+    attrdef_json = attrdef_to_json(
+        "Expression Heap Size",
+        "Estimated heap memory used by the expression and transforms of the port.",
+        "bytes",
+        ATTR_TYPE_NUMBER,
+        /* modifiable = */ FALSE,
+        /* min = */ UNDEFINED,
+        /* max = */ UNDEFINED,
+        /* integer = */ TRUE,
+        /* step = */ 0,
+        /* choices = */ NULL,
+        /* reconnect = */ FALSE
+    );
+    json_obj_append_static(json, "expr_heap_size", attrdef_json);
+
+    if (port->type == PORT_TYPE_NUMBER) {
+        attrdef_json = attrdef_to_json(
+            "Change Threshold",
+            "Value changes smaller than this, with respect to the last reported value, are not reported.",
+            /* unit = */ NULL,
+            ATTR_TYPE_NUMBER,
+            /* modifiable = */ TRUE,
+            /* min = */ 0,
+            /* max = */ UNDEFINED,
+            /* integer = */ FALSE,
+            /* step = */ 0,
+            /* choices = */ NULL,
+            /* reconnect = */ FALSE
+        );
+        json_obj_append_static(json, "change_threshold", attrdef_json);
+
+        attrdef_json = attrdef_to_json(
+            "Relative Change Threshold",
+            "Indicates that the change threshold is a percent of the last reported value.",
+            /* unit = */ NULL,
+            ATTR_TYPE_BOOLEAN,
+            /* modifiable = */ TRUE,
+            /* min = */ UNDEFINED,
+            /* max = */ UNDEFINED,
+            /* integer = */ FALSE,
+            /* step = */ 0,
+            /* choices = */ NULL,
+            /* reconnect = */ FALSE
+        );
+        json_obj_append_static(json, "change_threshold_relative", attrdef_json);
+
+        attrdef_json = attrdef_to_json(
+            "Persist Threshold",
+            "Values of persisted ports that differ by at most this from the last persisted value are not persisted.",
+            /* unit = */ NULL,
+            ATTR_TYPE_NUMBER,
+            /* modifiable = */ TRUE,
+            /* min = */ 0,
+            /* max = */ UNDEFINED,
+            /* integer = */ FALSE,
+            /* step = */ 0,
+            /* choices = */ NULL,
+            /* reconnect = */ FALSE
+        );
+        json_obj_append_static(json, "persist_threshold", attrdef_json);
     }
 
     json_stringify(json);
@@ -3779,6 +4097,21 @@ json_t *device_attrdefs_to_json(void) {
     json_t *json = json_obj_new();
     json_t *attrdef_json;
 
+    attrdef_json = attrdef_to_json(
+        "Minimum Free Memory",
+        "Expressions that would leave less free memory than this are refused.",
+        /* unit = */ "bytes",
+        ATTR_TYPE_NUMBER,
+        /* modifiable = */ TRUE,
+        /* min = */ MIN_FREE_HEAP_MIN,
+        /* max = */ MIN_FREE_HEAP_MAX,
+        /* integer = */ TRUE,
+        /* step = */ 0,
+        /* choices = */ NULL,
+        /* reconnect = */ FALSE
+    );
+    json_obj_append_static(json, "min_free_heap", attrdef_json);
+
 #ifdef _SLEEP
     attrdef_json = attrdef_to_json(
         "Sleep Wake Interval",
@@ -3793,7 +4126,7 @@ json_t *device_attrdefs_to_json(void) {
         /* choices = */ NULL,
         /* reconnect = */ FALSE
     );
-    json_obj_append(json, "sleep_wake_interval", attrdef_json);
+    json_obj_append_static(json, "sleep_wake_interval", attrdef_json);
 
     attrdef_json = attrdef_to_json(
         "Sleep Wake Duration",
@@ -3808,7 +4141,7 @@ json_t *device_attrdefs_to_json(void) {
         /* choices = */ NULL,
         /* reconnect = */ FALSE
     );
-    json_obj_append(json, "sleep_wake_duration", attrdef_json);
+    json_obj_append_static(json, "sleep_wake_duration", attrdef_json);
 #endif
 
 #ifdef _OTA
@@ -3825,7 +4158,7 @@ json_t *device_attrdefs_to_json(void) {
         /* choices = */ NULL,
         /* reconnect = */ FALSE
     );
-    json_obj_append(json, "firmware_auto_update", attrdef_json);
+    json_obj_append_static(json, "firmware_auto_update", attrdef_json);
 
     attrdef_json = attrdef_to_json(
         "Firmware Beta Versions",
@@ -3839,7 +4172,7 @@ json_t *device_attrdefs_to_json(void) {
         /* choices = */ NULL,
         /* reconnect = */ FALSE
     );
-    json_obj_append(json, "firmware_beta_enabled", attrdef_json);
+    json_obj_append_static(json, "firmware_beta_enabled", attrdef_json);
 #endif
 
 #ifdef _BATTERY
@@ -3857,7 +4190,7 @@ json_t *device_attrdefs_to_json(void) {
             /* choices = */ NULL,
             /* reconnect = */ FALSE
         );
-        json_obj_append(json, "battery_voltage", attrdef_json);
+        json_obj_append_static(json, "battery_voltage", attrdef_json);
     }
 #endif
 
@@ -3874,7 +4207,7 @@ json_t *device_attrdefs_to_json(void) {
         /* choices = */ NULL,
         /* reconnect = */ FALSE
     );
-    json_obj_append(json, "flash_size", attrdef_json);
+    json_obj_append_static(json, "flash_size", attrdef_json);
 
     attrdef_json = attrdef_to_json(
         "Flash ID",
@@ -3889,7 +4222,7 @@ json_t *device_attrdefs_to_json(void) {
         /* choices = */ NULL,
         /* reconnect = */ FALSE
     );
-    json_obj_append(json, "flash_id", attrdef_json);
+    json_obj_append_static(json, "flash_id", attrdef_json);
 
     attrdef_json = attrdef_to_json(
         "Chip ID",
@@ -3904,7 +4237,7 @@ json_t *device_attrdefs_to_json(void) {
         /* choices = */ NULL,
         /* reconnect = */ FALSE
     );
-    json_obj_append(json, "chip_id", attrdef_json);
+    json_obj_append_static(json, "chip_id", attrdef_json);
 
 #ifdef _DEBUG
     attrdef_json = attrdef_to_json(
@@ -3920,41 +4253,73 @@ json_t *device_attrdefs_to_json(void) {
         /* choices = */ NULL,
         /* reconnect = */ FALSE
     );
-    json_obj_append(json, "debug", attrdef_json);
+    json_obj_append_static(json, "debug", attrdef_json);
 #endif
 
     return json;
 }
 
+void write_ports_json(json_writer_t *writer) {
+    port_t *p;
+    json_t *port_json;
+    int i;
+    json_refs_ctx_t json_refs_ctx;
+    json_refs_ctx_init(&json_refs_ctx, JSON_REFS_TYPE_PORTS_LIST);
+
+    json_writer_begin_list(writer);
+    for (i = 0; i < all_ports_count; i++) {
+        p = all_ports[i];
+        DEBUG_API("returning attributes of port %s", p->id);
+        port_json = port_to_json(p, &json_refs_ctx);
+        json_writer_json(writer, port_json);
+        json_free(port_json);
+        json_refs_ctx.index++;
+    }
+    json_writer_end_list(writer);
+}
+
+bool expr_fits_heap(expr_t *expr, uint32 free_heap) {
+    /* free_heap is measured before parsing, so that it doesn't include the expression itself */
+    uint32 heap_size = expr_get_heap_size(expr);
+    if (free_heap < heap_size + device_min_free_heap) {
+        DEBUG_API(
+            "expression needs about %d bytes, while only %d bytes are free (%d bytes must be kept free)",
+            heap_size,
+            free_heap,
+            device_min_free_heap
+        );
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 void on_sequence_timer(void *arg) {
     port_t *port = arg;
+    port_sequence_t *sequence = port->sequence;
 
-    if (port->sequence_pos < port->sequence_len) {
-        port_write_value(port, port->sequence_values[port->sequence_pos], CHANGE_REASON_SEQUENCE);
+    if (sequence->pos < sequence->len) {
+        port_write_value(port, sequence->values[sequence->pos], CHANGE_REASON_SEQUENCE);
 
-        DEBUG_PORT(port, "sequence delay of %d ms", port->sequence_delays[port->sequence_pos]);
+        DEBUG_PORT(port, "sequence delay of %d ms", sequence->delays[sequence->pos]);
 
-        os_timer_arm(port->sequence_timer, port->sequence_delays[port->sequence_pos], /* repeat = */ FALSE);
-        port->sequence_pos++;
+        os_timer_arm(&sequence->timer, sequence->delays[sequence->pos], /* repeat = */ FALSE);
+        sequence->pos++;
     }
     else { /* Sequence ended */
-        if (port->sequence_repeat > 1 || port->sequence_repeat == 0) { /* Must repeat */
-            if (port->sequence_repeat) {
-                port->sequence_repeat--;
+        if (sequence->repeat > 1 || sequence->repeat == 0) { /* Must repeat */
+            if (sequence->repeat) {
+                sequence->repeat--;
             }
 
-            DEBUG_PORT(port, "repeating sequence (%d remaining iterations)", port->sequence_repeat);
+            DEBUG_PORT(port, "repeating sequence (%d remaining iterations)", sequence->repeat);
 
-            port->sequence_pos = 0;
+            sequence->pos = 0;
             on_sequence_timer(arg);
         }
         else { /* Single iteration or repeat ended */
             port_sequence_cancel(port);
             DEBUG_PORT(port, "sequence done");
-
-            if (IS_PORT_PERSISTED(port)) {
-                config_mark_for_saving();
-            }
         }
     }
 }
@@ -3964,13 +4329,13 @@ void on_sequence_timer(void *arg) {
 void on_ota_latest(char *version, char *date, char *url) {
     if (api_conn) {
         json_t *response_json = json_obj_new();
-        json_obj_append(response_json, "version", json_str_new(FW_VERSION));
-        json_obj_append(response_json, "status", json_str_new(ota_states_str[OTA_STATE_IDLE]));
+        json_obj_append_static(response_json, "version", json_str_new(FW_VERSION));
+        json_obj_append_static(response_json, "status", json_str_new(ota_states_str[OTA_STATE_IDLE]));
 
         if (version) {
-            json_obj_append(response_json, "latest_version", json_str_new(version));
-            json_obj_append(response_json, "latest_date", json_str_new(date));
-            json_obj_append(response_json, "latest_url", json_str_new(url));
+            json_obj_append_static(response_json, "latest_version", json_str_new(version));
+            json_obj_append_static(response_json, "latest_date", json_str_new(date));
+            json_obj_append_static(response_json, "latest_url", json_str_new(url));
         }
 
         respond_json(api_conn, 200, response_json);
@@ -3995,7 +4360,7 @@ void on_ota_perform(int code) {
     }
     else {  /* Error */
         json_t *response_json = json_obj_new();
-        json_obj_append(response_json, "error", json_str_new("no-such-version"));
+        json_obj_append_static(response_json, "error", json_str_new("no-such-version"));
         respond_json(api_conn, 404, response_json);
     }
 
@@ -4019,7 +4384,7 @@ void on_wifi_scan(wifi_scan_result_t *results, int len) {
 
     for (i = 0; i < len; i++) {
         result_json = json_obj_new();
-        json_obj_append(result_json, "ssid", json_str_new(results[i].ssid));
+        json_obj_append_static(result_json, "ssid", json_str_new(results[i].ssid));
         snprintf(
             bssid,
             sizeof(bssid),
@@ -4031,9 +4396,9 @@ void on_wifi_scan(wifi_scan_result_t *results, int len) {
             results[i].bssid[4],
             results[i].bssid[5]
         );
-        json_obj_append(result_json, "bssid", json_str_new(bssid));
-        json_obj_append(result_json, "channel", json_int_new(results[i].channel));
-        json_obj_append(result_json, "rssi", json_int_new(results[i].rssi));
+        json_obj_append_static(result_json, "bssid", json_str_new(bssid));
+        json_obj_append_static(result_json, "channel", json_int_new(results[i].channel));
+        json_obj_append_static(result_json, "rssi", json_int_new(results[i].rssi));
 
         switch (results[i].auth_mode) {
             case AUTH_OPEN:
@@ -4054,7 +4419,7 @@ void on_wifi_scan(wifi_scan_result_t *results, int len) {
             default:
                 auth = "unknown";
         }
-        json_obj_append(result_json, "auth_mode", json_str_new(auth));
+        json_obj_append_static(result_json, "auth_mode", json_str_new(auth));
 
         json_list_append(response_json, result_json);
     }
@@ -58,6 +58,9 @@
 #define API_MIN_LISTEN_TIMEOUT         1
 #define API_MAX_LISTEN_TIMEOUT         3600
 
+#define API_MAX_MIN_EVENT_INTERVAL     3600000 /* Milliseconds */
+#define API_MAX_PERSIST_INTERVAL       86400000 /* Milliseconds */
+
 #define API_PORT_TYPE_BOOLEAN          "boolean"
 #define API_PORT_TYPE_NUMBER           "number"
 
@@ -122,6 +125,10 @@ json_t ICACHE_FLASH_ATTR *api_get_peripherals(json_t *query_json, int *code);
 json_t ICACHE_FLASH_ATTR *api_put_peripherals(json_t *query_json, json_t *request_json, int *code);
 json_t ICACHE_FLASH_ATTR *api_get_system(json_t *query_json, int *code);
 json_t ICACHE_FLASH_ATTR *api_patch_system(json_t *query_json, json_t *request_json, int *code);
+#ifdef _STATS
+json_t ICACHE_FLASH_ATTR *api_get_debug_stats(json_t *query_json, int *code);
+json_t ICACHE_FLASH_ATTR *api_delete_debug_stats(json_t *query_json, int *code);
+#endif
 json_t ICACHE_FLASH_ATTR *api_get_provisioning(json_t *query_json, int *code);
 json_t ICACHE_FLASH_ATTR *api_put_provisioning(json_t *query_json, json_t *request_json, int *code);
 
@@ -72,14 +72,14 @@ json_t *choice_to_json(char *choice, char type) {
 
     char *display_name = get_choice_display_name(choice);
     if (display_name) {
-        json_obj_append(choice_json, "display_name", json_str_new(display_name));
+        json_obj_append_static(choice_json, "display_name", json_str_new(display_name));
     }
 
     if (type == ATTR_TYPE_NUMBER) /* Also PORT_TYPE_NUMBER */ {
-        json_obj_append(choice_json, "value", json_double_new(get_choice_value_num(choice)));
+        json_obj_append_static(choice_json, "value", json_double_new(get_choice_value_num(choice)));
     }
     else {
-        json_obj_append(choice_json, "value", json_str_new(get_choice_value_str(choice)));
+        json_obj_append_static(choice_json, "value", json_str_new(get_choice_value_str(choice)));
     }
 
     return choice_json;
@@ -268,42 +268,42 @@ json_t *attrdef_to_json(
 ) {
     json_t *json = json_obj_new();
 
-    json_obj_append(json, "display_name", json_str_new(display_name));
-    json_obj_append(json, "description", json_str_new(description));
+    json_obj_append_static(json, "display_name", json_str_new(display_name));
+    json_obj_append_static(json, "description", json_str_new(description));
     if (unit) {
-        json_obj_append(json, "unit", json_str_new(unit));
+        json_obj_append_static(json, "unit", json_str_new(unit));
     }
-    json_obj_append(json, "modifiable", json_bool_new(modifiable));
+    json_obj_append_static(json, "modifiable", json_bool_new(modifiable));
 
     switch (type) {
         case ATTR_TYPE_BOOLEAN:
-            json_obj_append(json, "type", json_str_new(API_ATTR_TYPE_BOOLEAN));
+            json_obj_append_static(json, "type", json_str_new(API_ATTR_TYPE_BOOLEAN));
             break;
 
         case ATTR_TYPE_NUMBER:
-            json_obj_append(json, "type", json_str_new(API_ATTR_TYPE_NUMBER));
+            json_obj_append_static(json, "type", json_str_new(API_ATTR_TYPE_NUMBER));
             break;
 
         case ATTR_TYPE_STRING:
-            json_obj_append(json, "type", json_str_new(API_ATTR_TYPE_STRING));
+            json_obj_append_static(json, "type", json_str_new(API_ATTR_TYPE_STRING));
             break;
     }
 
     if (type == ATTR_TYPE_NUMBER) {
         if (!IS_UNDEFINED(min)) {
-            json_obj_append(json, "min", json_double_new(min));
+            json_obj_append_static(json, "min", json_double_new(min));
         }
 
         if (!IS_UNDEFINED(max)) {
-            json_obj_append(json, "max", json_double_new(max));
+            json_obj_append_static(json, "max", json_double_new(max));
         }
 
         if (integer) {
-            json_obj_append(json, "integer", json_bool_new(TRUE));
+            json_obj_append_static(json, "integer", json_bool_new(TRUE));
         }
 
         if (step && !IS_UNDEFINED(step)) {
-            json_obj_append(json, "step", json_double_new(step));
+            json_obj_append_static(json, "step", json_double_new(step));
         }
     }
 
@@ -314,11 +314,11 @@ json_t *attrdef_to_json(
             json_list_append(list, choice_to_json(c, type));
         }
 
-        json_obj_append(json, "choices", list);
+        json_obj_append_static(json, "choices", list);
     }
 
     if (reconnect) {
-        json_obj_append(json, "reconnect", json_bool_new(TRUE));
+        json_obj_append_static(json, "reconnect", json_bool_new(TRUE));
     }
 
     return json;
@@ -64,6 +64,8 @@ static void ICACHE_FLASH_ATTR  on_tcp_recv(struct espconn *conn, httpserver_cont
 static void ICACHE_FLASH_ATTR  on_tcp_sent(struct espconn *conn, httpserver_context_t *hc);
 static void ICACHE_FLASH_ATTR  on_tcp_disc(struct espconn *conn, httpserver_context_t *hc);
 
+static void ICACHE_FLASH_ATTR  on_response_chunk(uint8 *chunk, int len, void *arg);
+
 static void ICACHE_FLASH_ATTR  on_invalid_http_request(struct espconn *conn);
 static void ICACHE_FLASH_ATTR  on_http_request_timeout(struct espconn *conn);
 static void ICACHE_FLASH_ATTR  on_http_request(
@@ -169,6 +171,10 @@ void on_tcp_disc(struct espconn *conn, httpserver_context_t *hc) {
     httpserver_context_reset(hc);
 }
 
+void on_response_chunk(uint8 *chunk, int len, void *arg) {
+    tcp_queue((struct espconn *) arg, chunk, len);
+}
+
 
 /* HTTP request/response handling */
 
@@ -224,7 +230,8 @@ void on_http_request(
 
     if (method == HTTP_METHOD_POST || method == HTTP_METHOD_PATCH || method == HTTP_METHOD_PUT) {
         if (body) {
-            request_json = json_parse(body);
+            /* The body is only needed as JSON, so it's parsed in place, sparing one allocation per element */
+            request_json = json_parse_in_situ(body);
             if (!request_json) {
                 /* Invalid JSON */
                 DEBUG_ESPQTCLIENT_CONN(conn, "invalid JSON");
@@ -419,8 +426,8 @@ void on_http_request(
 
         if (access_level < API_ACCESS_LEVEL_VIEWONLY) {
             json_t *json = json_obj_new();
-            json_obj_append(json, "error", json_str_new("forbidden"));
-            json_obj_append(json, "required_level", json_str_new("viewonly"));
+            json_obj_append_static(json, "error", json_str_new("forbidden"));
+            json_obj_append_static(json, "required_level", json_str_new("viewonly"));
 
             respond_json(conn, 403, json);
             goto done;
@@ -522,7 +529,7 @@ void on_http_request(
 
 void respond_error_extra(struct espconn *conn, int status, char *error, char *extra_name, char *extra_value) {
     json_t *json = json_obj_new();
-    json_obj_append(json, "error", json_str_new(error));
+    json_obj_append_static(json, "error", json_str_new(error));
     json_obj_append(json, extra_name, json_str_new(extra_value));
 
     respond_json(conn, status, json);
@@ -552,61 +559,94 @@ void client_init(void) {
 }
 
 void respond_json(struct espconn *conn, int status, json_t *json) {
-    char *body;
-    uint8 *response;
-
 #if defined(_DEBUG) && defined(_DEBUG_ESPQTCLIENT)
-    int free_mem_before_dump = system_get_free_heap_size();
+    int free_mem_before_write = system_get_free_heap_size();
+
+    if (status >= 400) {
+        char *body = json_dump_r(json, /* free_mode = */ JSON_FREE_NOTHING);
+        DEBUG_ESPQTCLIENT_CONN(conn, "responding with status %d: %s", status, body);
+    }
 #endif
 
-    body = json_dump_r(json, /* free_mode = */ JSON_FREE_EVERYTHING);
+    /* 204 No Content */
+    if (status == 204) {
+        json_free(json);
+
+        static char free_mem_str[16];
+        snprintf(free_mem_str, 16, "%d", system_get_free_heap_size());
+        char *extra_header_values[] = {free_mem_str, NULL};
+        int len = 0;
+        uint8 *response = httpserver_build_response(
+            status, JSON_CONTENT_TYPE,
+            extra_header_names,
+            extra_header_values,
+            /* header_count = */ 1,
+            /* body = */ NULL,
+            &len
+        );
+
+        DEBUG_ESPQTCLIENT_CONN(conn, "responding with status %d", status);
+        tcp_send(conn, response, len, /* free on sent = */ TRUE);
+
+        return;
+    }
+
+    /* The JSON structure is written straight into packets, instead of being dumped and then copied into a response */
+    json_writer_t *writer = respond_json_begin(conn, status);
+    json_writer_json(writer, json);
+    json_free(json);
+    respond_json_end(writer);
 
 #if defined(_DEBUG) && defined(_DEBUG_ESPQTCLIENT)
-    int free_mem_after_dump = system_get_free_heap_size();
+    int free_mem_after_write = system_get_free_heap_size();
+
+    /* Show free memory after writing the response */
+    DEBUG_ESPQTCLIENT(
+        "free memory: before write=%d, after write=%d",
+        free_mem_before_write,
+        free_mem_after_write
+    );
 #endif
+}
 
-    int len = strlen(body);
-    if (status == 204) {
-        len = 0;  /* 204 No Content */
-    }
+json_writer_t *respond_json_begin(struct espconn *conn, int status) {
+    json_writer_t *writer = malloc(sizeof(json_writer_t));
+    json_writer_init(writer, TCP_SEND_PACKET_SIZE, on_response_chunk, conn);
 
     static char free_mem_str[16];
     snprintf(free_mem_str, 16, "%d", system_get_free_heap_size());
     char *extra_header_values[] = {free_mem_str, NULL};
-    response = httpserver_build_response(
-        status, JSON_CONTENT_TYPE,
+    int len;
+    uint8 *head = httpserver_build_stream_head(
+        status,
+        JSON_CONTENT_TYPE,
         extra_header_names,
         extra_header_values,
         /* header_count = */ 1,
-        (uint8 *) body,
         &len
     );
 
-    if (status >= 400) {
-        DEBUG_ESPQTCLIENT_CONN(conn, "responding with status %d: %s", status, body);
-    }
-    else {
+    /* The head goes along with the beginning of the body, in the first packet */
+    json_writer_raw(writer, head, len);
+    free(head);
+
+    if (status < 400) {
         DEBUG_ESPQTCLIENT_CONN(conn, "responding with status %d", status);
     }
 
-    tcp_send(conn, response, len, /* free on sent = */ TRUE);
+    return writer;
+}
 
-#if defined(_DEBUG) && defined(_DEBUG_ESPQTCLIENT)
-    int free_mem_after_send = system_get_free_heap_size();
+void respond_json_end(json_writer_t *writer) {
+    DEBUG_ESPQTCLIENT_CONN(writer->flush_arg, "response written (%d bytes)", writer->len);
 
-    /* Show free memory after sending the response */
-    DEBUG_ESPQTCLIENT(
-        "free memory: before dump=%d, after dump=%d, after send=%d",
-        free_mem_before_dump,
-        free_mem_after_dump,
-        free_mem_after_send
-    );
-#endif
+    json_writer_finish(writer);
+    free(writer);
 }
 
 void respond_error(struct espconn *conn, int status, char *error) {
     json_t *json = json_obj_new();
-    json_obj_append(json, "error", json_str_new(error));
+    json_obj_append_static(json, "error", json_str_new(error));
 
     respond_json(conn, status, json);
 }
@@ -38,6 +38,12 @@ void ICACHE_FLASH_ATTR client_init(void);
 
     /* respond_json() will free the json structure by itself, using json_free() ! */
 void ICACHE_FLASH_ATTR respond_json(struct espconn *conn, int status, json_t *json);
+
+/* Responses can also be written piece by piece, between respond_json_begin() and respond_json_end(), being sent as
+ * they are written, without ever building them as a whole */
+json_writer_t ICACHE_FLASH_ATTR *respond_json_begin(struct espconn *conn, int status);
+void          ICACHE_FLASH_ATTR  respond_json_end(json_writer_t *writer);
+
 void ICACHE_FLASH_ATTR respond_error(struct espconn *conn, int status, char *error);
 void ICACHE_FLASH_ATTR respond_html(struct espconn *conn, int status, uint8 *html, int len);
 
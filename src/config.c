@@ -33,6 +33,7 @@
 #include "core.h"
 #include "device.h"
 #include "events.h"
+#include "journal.h"
 #include "peripherals.h"
 #include "ports.h"
 #include "stringpool.h"
@@ -95,6 +96,7 @@ void config_init(void) {
             continue;
         }
 
+        /* Persisted expressions passed the heap limit when set through the API and are not checked again here */
         if (p->sexpr) {
             p->expr = expr_parse(p->id, p->sexpr, strlen(p->sexpr));
             if (p->expr) {
@@ -118,12 +120,26 @@ void config_save(void) {
     uint32 strings_offs = 1; /* Address 0 in strings pool represents an unset string, so it's left out */
 
     flashcfg_load(FLASH_CONFIG_SLOT_DEFAULT, config_data);
+
+    /* Older layouts may have strings where records of extra ports now go; the strings pool is rebuilt anyway */
+    if (config_data[CONFIG_OFFS_LAYOUT_VERSION] < CONFIG_LAYOUT_VERSION) {
+        DEBUG_CONFIG("upgrading layout to version %d", CONFIG_LAYOUT_VERSION);
+        memset(config_data + CONFIG_OFFS_PORT_EXTRA_BASE, 0,
+               CONFIG_PORT_SIZE * (CONFIG_MAX_PORTS - CONFIG_BASE_PORTS));
+        config_data[CONFIG_OFFS_LAYOUT_VERSION] = CONFIG_LAYOUT_VERSION;
+    }
+
     peripherals_save(config_data, &strings_offs);
     ports_save(config_data, &strings_offs);
     device_save(config_data, &strings_offs);
-    flashcfg_save(FLASH_CONFIG_SLOT_DEFAULT, config_data);
+    bool saved = flashcfg_save(FLASH_CONFIG_SLOT_DEFAULT, config_data);
     free(config_data);
 
+    /* Saved configuration includes current port values, superseding journaled ones */
+    if (saved) {
+        journal_reset();
+    }
+
     DEBUG_CONFIG("total strings size is %d", strings_offs - 1);
 }
 
@@ -132,11 +148,14 @@ void config_factory_reset(void) {
     uint32 strings_offs = 1; /* Address 0 in strings pool represents an unset string, so it's left out */
     char *strings_ptr = (char *) config_data + CONFIG_OFFS_STR_BASE;
 
+    config_data[CONFIG_OFFS_LAYOUT_VERSION] = CONFIG_LAYOUT_VERSION;
+
     /* Preserve configuration name */
     string_pool_write(strings_ptr, &strings_offs, device_config_name, config_data + CONFIG_OFFS_CONFIG_NAME);
 
     flashcfg_save(FLASH_CONFIG_SLOT_DEFAULT, config_data);
     free(config_data);
+    journal_reset();
 }
 
 void config_start_auto_provisioning(void) {
@@ -463,32 +482,32 @@ bool config_apply_port_provisioning(json_t *port_config, char **port_id, json_t
 
                 DEBUG_CONFIG("provisioning: adding virtual port %s", id);
                 request_json = json_obj_new();
-                json_obj_append(request_json, "id", json_str_new(id));
+                json_obj_append_static(request_json, "id", json_str_new(id));
 
                 /* Pass non-modifiable virtual port attributes from port_config to request_json */
                 attr_json = json_obj_pop_key(port_config, "type");
                 if (attr_json) {
-                    json_obj_append(request_json, "type", attr_json);
+                    json_obj_append_static(request_json, "type", attr_json);
                 }
                 attr_json = json_obj_pop_key(port_config, "min");
                 if (attr_json) {
-                    json_obj_append(request_json, "min", attr_json);
+                    json_obj_append_static(request_json, "min", attr_json);
                 }
                 attr_json = json_obj_pop_key(port_config, "max");
                 if (attr_json) {
-                    json_obj_append(request_json, "max", attr_json);
+                    json_obj_append_static(request_json, "max", attr_json);
                 }
                 attr_json = json_obj_pop_key(port_config, "integer");
                 if (attr_json) {
-                    json_obj_append(request_json, "integer", attr_json);
+                    json_obj_append_static(request_json, "integer", attr_json);
                 }
                 attr_json = json_obj_pop_key(port_config, "step");
                 if (attr_json) {
-                    json_obj_append(request_json, "step", attr_json);
+                    json_obj_append_static(request_json, "step", attr_json);
                 }
                 attr_json = json_obj_pop_key(port_config, "choices");
                 if (attr_json) {
-                    json_obj_append(request_json, "choices", attr_json);
+                    json_obj_append_static(request_json, "choices", attr_json);
                 }
 
                 code = 200;
@@ -591,7 +610,7 @@ void on_provisioning_config_response(
     provisioning = FALSE;
 
     if (status == 200) {
-        json_t *config = json_parse(body);
+        json_t *config = json_parse_in_situ(body);
         if (!config) {
             DEBUG_CONFIG("provisioning: invalid JSON");
             return;
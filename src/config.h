@@ -33,7 +33,8 @@
 
 #define CONFIG_OFFS_DEVICE_NAME       0x0000 /*    4 bytes - strings pool pointer */
 #define CONFIG_OFFS_DEVICE_DISP_NAME  0x0004 /*    4 bytes - strings pool pointer */
-                                             /* 0x0008 - 0x005F: reserved */
+#define CONFIG_OFFS_LAYOUT_VERSION    0x0008 /*    1 bytes */
+                                             /* 0x0009 - 0x005F: reserved */
 #define CONFIG_OFFS_ADMIN_PASSWORD    0x0060 /*   32 bytes */
 #define CONFIG_OFFS_NORMAL_PASSWORD   0x0080 /*   32 bytes */
 #define CONFIG_OFFS_VIEWONLY_PASSWORD 0x00A0 /*   32 bytes */
@@ -56,15 +57,30 @@
                                              /* 0x0183 - 0x018F: reserved */
 #define CONFIG_OFFS_WAKE_INTERVAL     0x0190 /*    2 bytes */
 #define CONFIG_OFFS_WAKE_DURATION     0x0192 /*    2 bytes */
-                                             /* 0x0194 - 0x019F: reserved */
-#define CONFIG_OFFS_PORT_BASE         0x0200 /*   96 bytes for each 32 supported ports */
+#define CONFIG_OFFS_MIN_FREE_HEAP     0x0194 /*    2 bytes */
+                                             /* 0x0196 - 0x019F: reserved */
+#define CONFIG_OFFS_PORT_BASE         0x0200 /*   96 bytes for each CONFIG_BASE_PORTS ports */
 #define CONFIG_OFFS_PERIPHERALS_BASE  0x0E00 /*   64 bytes for each 16 supported peripherals */
-#define CONFIG_OFFS_STR_BASE          0x1200 /* 3584 bytes for strings pool */
+#define CONFIG_OFFS_STR_BASE          0x1200 /* 2816 bytes for strings pool */
+#define CONFIG_OFFS_PORT_EXTRA_BASE   0x1D00 /*   96 bytes for each of the remaining CONFIG_MAX_PORTS ports */
 
-#define CONFIG_STR_SIZE               0x0E00 /* 3584 bytes */
+#define CONFIG_STR_SIZE               0x0B00 /* 2816 bytes */
 #define CONFIG_PORT_SIZE              0x0060 /*   96 bytes for each port */
 #define CONFIG_PERIPHERAL_SIZE        0x0040 /*   64 bytes for each peripheral */
 
+#define CONFIG_BASE_PORTS             32     /* Ports whose records come before peripherals configuration */
+#define CONFIG_MAX_PORTS              40     /* Ports whose attributes are persisted, one for each of the first slots */
+
+/* Version 1 takes the end of the strings pool for the records of the ports past CONFIG_BASE_PORTS; older
+ * configurations may still have strings there */
+#define CONFIG_LAYOUT_VERSION         1
+
+/* Configuration record of the port in a given slot, or NULL if the slot isn't persisted */
+#define CONFIG_PORT_RECORD(config_data, slot)                                                                        \
+    ((slot) < CONFIG_BASE_PORTS ? (config_data) + CONFIG_OFFS_PORT_BASE + CONFIG_PORT_SIZE * (slot) :               \
+     (slot) < CONFIG_MAX_PORTS && (config_data)[CONFIG_OFFS_LAYOUT_VERSION] >= 1 ?                                  \
+     (config_data) + CONFIG_OFFS_PORT_EXTRA_BASE + CONFIG_PORT_SIZE * ((slot) - CONFIG_BASE_PORTS) : NULL)
+
 
 void ICACHE_FLASH_ATTR config_init(void);
 void ICACHE_FLASH_ATTR config_save(void);
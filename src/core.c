@@ -16,6 +16,8 @@
  *
  */
 
+#include <math.h>
+#include <string.h>
 #include <user_interface.h>
 
 #include "espgoodies/common.h"
@@ -28,6 +30,8 @@
 #include "common.h"
 #include "config.h"
 #include "device.h"
+#include "journal.h"
+#include "stats.h"
 #include "core.h"
 
 
@@ -36,6 +40,20 @@
 
 #define CONFIG_SAVE_INTERVAL 5    /* Seconds */
 
+#define MAX_HEAP_SLOTS       PORT_MAX_SLOTS
+#define HEAP_NEVER           0xFFFFFFFFFFFFFFFFULL /* Same as EXPR_NO_DEADLINE */
+
+
+/* Min-heap of port slots, ordered by a time associated to each slot */
+typedef struct {
+
+    uint8         slots[MAX_HEAP_SLOTS];
+    uint8         len;
+    uint8         pos[MAX_HEAP_SLOTS];      /* Position in heap + 1, indexed by slot; 0 means not scheduled */
+    uint64        times_ms[MAX_HEAP_SLOTS]; /* Indexed by slot */
+
+} slot_heap_t;
+
 
 static uint32     last_expr_time = 0;
 static uint32     last_config_save_time = 0;
@@ -43,23 +61,70 @@ static uint32     now;
 static uint64     now_ms;
 static uint64     now_us;
 
-static uint32     force_eval_expressions_mask = 0;
+static portset_t  force_eval_expressions_mask;
+static uint8     *eval_order = NULL;        /* Slots of ports with expressions, dependencies first */
+static int        eval_order_len = 0;
+static bool       eval_order_valid = FALSE;
+
+/* Port slots whose expressions asked to be reevaluated at a given time */
+static slot_heap_t     wakeup_heap;
+
+/* Port slots ordered by the time of their next sample or heart beat, whichever comes first */
+static slot_heap_t     poll_heap;
+static port_t         *poll_ports[MAX_HEAP_SLOTS]; /* Indexed by slot */
+static bool            poll_schedule_valid = FALSE;
+static volatile bool   poll_task_scheduled = FALSE;
+static os_timer_t      poll_timer;
+static volatile portset_t interrupt_slots_mask;   /* Ports that signaled a change since the last polling round */
+
+/* Port slots whose value-change events are held back until their minimum event interval elapses */
+static slot_heap_t     event_heap;
+
+/* Port slots whose persisted values are held back until their minimum persist interval elapses */
+static slot_heap_t     persist_heap;
+#ifdef _STATS
+static uint64          poll_due_time_us = 0;       /* When the next polling round became due; 0 if unknown */
+#endif
+
 static bool       config_needs_saving = FALSE;
 static uint32     poll_started_time_ms = 0;
 static bool       polling_enabled = FALSE;
 
 #ifdef _SLEEP
 /* Used to prevent more than one value-change per port when using sleep mode with short wakes */
-static uint32     value_change_trigger_mask = 0;
+static portset_t  value_change_trigger_mask;
 #endif
 
 
-static void ICACHE_FLASH_ATTR core_task_handler(uint32 task_id, void *param);
-static void ICACHE_FLASH_ATTR handle_value_changes(uint64 change_mask, uint32 change_reasons_expression_mask);
+static void   ICACHE_FLASH_ATTR core_task_handler(uint32 task_id, void *param);
+static void   ICACHE_FLASH_ATTR handle_value_changes(
+                                    portset_t *change_mask,
+                                    portset_t *change_reasons_expression_mask
+                                );
+static void   ICACHE_FLASH_ATTR rebuild_eval_order(void);
+static bool   ICACHE_FLASH_ATTR value_change_event_due(port_t *p);
+static bool   ICACHE_FLASH_ATTR value_persist_due(port_t *p);
+
+static void   ICACHE_FLASH_ATTR poll_port(
+                                    port_t *p,
+                                    bool forced,
+                                    portset_t *change_mask,
+                                    portset_t *change_reasons_expression_mask
+                                );
+static void   ICACHE_FLASH_ATTR rebuild_poll_schedule(void);
+static uint64 ICACHE_FLASH_ATTR port_next_poll_time_ms(port_t *p);
+static void   ICACHE_FLASH_ATTR schedule_next_poll(void);
+static void   ICACHE_FLASH_ATTR on_poll_timer(void *arg);
+
+static void   ICACHE_FLASH_ATTR slot_heap_schedule(slot_heap_t *heap, int8 slot, uint64 time_ms);
+static void   ICACHE_FLASH_ATTR slot_heap_swap(slot_heap_t *heap, uint8 i, uint8 j);
+static void   ICACHE_FLASH_ATTR slot_heap_sift_up(slot_heap_t *heap, uint8 i);
+static void   ICACHE_FLASH_ATTR slot_heap_sift_down(slot_heap_t *heap, uint8 i);
 
 
 void core_init(void) {
     system_task_set_handler(core_task_handler);
+    os_timer_setfn(&poll_timer, on_poll_timer, NULL);
 }
 
 void core_listen_respond(session_t *session) {
@@ -73,7 +138,7 @@ void core_enable_polling(void) {
 
     DEBUG_CORE("enabling polling");
     polling_enabled = TRUE;
-    system_task_schedule(TASK_ID_POLL, NULL);
+    core_schedule_poll();
 }
 
 void core_disable_polling(void) {
@@ -83,6 +148,36 @@ void core_disable_polling(void) {
 
     DEBUG_CORE("disabling polling");
     polling_enabled = FALSE;
+    os_timer_disarm(&poll_timer);
+}
+
+void core_schedule_poll(void) {
+    if (!polling_enabled || poll_task_scheduled) {
+        return;
+    }
+
+    os_timer_disarm(&poll_timer);
+    poll_task_scheduled = TRUE;
+    system_task_schedule(TASK_ID_POLL, NULL);
+
+#ifdef _STATS
+    /* When called by the poll timer, the round has been due since the timer was meant to fire */
+    uint64 time_us = system_uptime_us();
+    if (!poll_due_time_us || poll_due_time_us > time_us) {
+        poll_due_time_us = time_us;
+    }
+#endif
+}
+
+void core_port_interrupt(port_t *port) {
+    PORTSET_ADD(&interrupt_slots_mask, port->slot);
+
+    /* The armed poll timer, if any, is left alone, as timers can't be handled from ISRs; it will merely cause an extra
+     * polling round */
+    if (polling_enabled && !poll_task_scheduled) {
+        poll_task_scheduled = TRUE;
+        system_task_schedule(TASK_ID_POLL, NULL);
+    }
 }
 
 void core_poll(void) {
@@ -92,10 +187,24 @@ void core_poll(void) {
         return;
     }
 #endif
-    static uint64 change_mask = -1;
-    uint32 change_reasons_expression_mask = 0;
+    static bool first_poll = TRUE;
+    portset_t change_mask, change_reasons_expression_mask;
+    portset_clear(&change_reasons_expression_mask);
+
+    /* All ports are considered changed during the very first polling round */
+    if (first_poll) {
+        first_poll = FALSE;
+        portset_fill(&change_mask);
+    }
+    else {
+        portset_clear(&change_mask);
+    }
+
+#ifdef _STATS
+    uint64 due_us = poll_due_time_us;
+    poll_due_time_us = 0;
+#endif
 
-    double value;
     now_us = system_uptime_us();
     now_ms = now_us / 1000;
     now = now_ms / 1000;
@@ -103,14 +212,18 @@ void core_poll(void) {
     /* Add time dependency masks */
     if (now != last_expr_time) {
         last_expr_time = now;
-        change_mask |= (1ULL << TIME_EXPR_DEP_BIT);
+        PORTSET_ADD(&change_mask, TIME_EXPR_DEP_BIT);
     }
 
     if (poll_started_time_ms == 0) {
         poll_started_time_ms = now_ms;
     }
 
-    change_mask |= (1ULL << TIME_MS_EXPR_DEP_BIT);
+    /* Force evaluation of expressions whose deadlines have passed */
+    while (wakeup_heap.len && wakeup_heap.times_ms[wakeup_heap.slots[0]] <= now_ms) {
+        PORTSET_ADD(&force_eval_expressions_mask, wakeup_heap.slots[0]);
+        slot_heap_schedule(&wakeup_heap, wakeup_heap.slots[0], HEAP_NEVER);
+    }
 
     if (config_needs_saving && ((int64) now - last_config_save_time > CONFIG_SAVE_INTERVAL)) {
         last_config_save_time = now;
@@ -118,71 +231,70 @@ void core_poll(void) {
         config_save();
     }
 
-    /* Determine changed ports */
-    port_t *p;
-    int i;
-    for (i = 0; i < all_ports_count; i++) {
-        p = all_ports[i];
-        if (!IS_PORT_ENABLED(p)) {
-            continue;
-        }
-
-        if (p->heart_beat && (now_ms - p->last_heart_beat_time_ms >= p->heart_beat_interval)) {
-            p->last_heart_beat_time_ms = now_ms;
-            p->heart_beat(p);
-        }
-
-        /* Don't read value more often than indicated by sampling interval */
-        if (now_ms - p->last_sample_time_ms < p->sampling_interval) {
-            continue;
-        }
-
-        p->last_sample_time_ms = now_ms;
-        value = port_read_value(p);
-        if (IS_UNDEFINED(value)) {
-            continue;
-        }
-
-        if (p->last_read_value != value) {
-            if (IS_UNDEFINED(p->last_read_value)) {
-                DEBUG_PORT(
-                    p,
-                    "detected value change: (undefined) -> %s, reason = %c",
-                    dtostr(value, -1),
-                    p->change_reason
-                );
-            }
-            else {
-                DEBUG_PORT(
-                    p,
-                    "detected value change: %s -> %s, reason = %c",
-                    dtostr(p->last_read_value, -1),
-                    dtostr(value, -1),
-                    p->change_reason
-                );
-            }
+    if (!poll_schedule_valid) {
+        rebuild_poll_schedule();
+    }
 
-            p->last_read_value = value;
-            change_mask |= 1ULL << p->slot;
+    /* Ports that signaled a change from an interrupt are read regardless of their schedule */
+    portset_t interrupt_mask;
+    int i;
+    ETS_INTR_LOCK();
+    for (i = 0; i < PORTSET_WORDS; i++) {
+        interrupt_mask.words[i] = interrupt_slots_mask.words[i];
+        interrupt_slots_mask.words[i] = 0;
+    }
+    ETS_INTR_UNLOCK();
+
+    /* Take out all due ports first, so that ports with no sampling interval are polled only once per round */
+    uint8 due_slots[MAX_HEAP_SLOTS];
+    int due_count = 0;
+    while (poll_heap.len && poll_heap.times_ms[poll_heap.slots[0]] <= now_ms) {
+        due_slots[due_count++] = poll_heap.slots[0];
+        PORTSET_REMOVE(&interrupt_mask, poll_heap.slots[0]);
+        slot_heap_schedule(&poll_heap, poll_heap.slots[0], HEAP_NEVER);
+    }
 
-            /* Remember and reset change reason */
-            if (p->change_reason == CHANGE_REASON_EXPRESSION) {
-                change_reasons_expression_mask |= 1UL << p->slot;
+    if (!portset_is_empty(&interrupt_mask)) {
+        for (i = 0; i < MAX_HEAP_SLOTS; i++) {
+            if (PORTSET_HAS(&interrupt_mask, i) && poll_ports[i]) {
+                due_slots[due_count++] = i;
             }
-            p->change_reason = CHANGE_REASON_NATIVE;
         }
     }
 
-    handle_value_changes(change_mask, change_reasons_expression_mask);
+    /* Determine changed ports, visiting only the due ones */
+    port_t *p;
+    for (i = 0; i < due_count; i++) {
+        p = poll_ports[due_slots[i]];
+        poll_port(
+            p,
+            IS_PORT_INTERRUPT(p) || PORTSET_HAS(&interrupt_mask, p->slot),
+            &change_mask,
+            &change_reasons_expression_mask
+        );
+        slot_heap_schedule(&poll_heap, p->slot, port_next_poll_time_ms(p));
+    }
+
+    handle_value_changes(&change_mask, &change_reasons_expression_mask);
 
-    change_mask = 0;
+    STATS_POLL(now_us, due_us);
 }
 
 void update_port_expression(port_t *port) {
     DEBUG_PORT(port, "updating expression");
 
-    force_eval_expressions_mask |= 1UL << port->slot;
+    PORTSET_ADD(&force_eval_expressions_mask, port->slot);
     port->change_reason = CHANGE_REASON_NATIVE;
+    core_schedule_poll();
+}
+
+void core_invalidate_eval_order(void) {
+    eval_order_valid = FALSE;
+}
+
+void core_invalidate_poll_schedule(void) {
+    poll_schedule_valid = FALSE;
+    core_schedule_poll();
 }
 
 void config_mark_for_saving(void) {
@@ -204,10 +316,10 @@ void config_ensure_saved(void) {
 void core_task_handler(uint32 task_id, void *param) {
     switch (task_id) {
         case TASK_ID_POLL: {
+            poll_task_scheduled = FALSE;
             if (polling_enabled) {
-                /* Schedule next polling */
-                system_task_schedule(TASK_ID_POLL, NULL);
                 core_poll();
+                schedule_next_poll();
             }
 
             break;
@@ -227,27 +339,147 @@ void core_task_handler(uint32 task_id, void *param) {
     }
 }
 
-void handle_value_changes(uint64 change_mask, uint32 change_reasons_expression_mask) {
+void handle_value_changes(portset_t *change_mask, portset_t *change_reasons_expression_mask) {
     /* Also consider ports whose expressions were marked for forced evaluation */
-    uint64 forced_mask = force_eval_expressions_mask;
-    force_eval_expressions_mask = 0;
+    portset_t forced_mask = force_eval_expressions_mask;
+    portset_clear(&force_eval_expressions_mask);
+
+    if (!eval_order_valid) {
+        rebuild_eval_order();
+    }
 
-    /* Trigger value-change events; save persisted ports */
+    /* Reevaluate the expressions depending on changed ports; since ports are visited in dependency order, a change
+     * propagates through a whole chain of expressions within a single pass */
+    port_slot_t *port_slot;
     port_t *p;
-    int i;
-    for (i = 0; i < all_ports_count; i++) {
-        p = all_ports[i];
+    uint8 slot;
+    int i, j;
+    double value;
+    for (i = 0; i < eval_order_len; i++) {
+        slot = eval_order[i];
+        port_slot = PORT_SLOT_AT(slot);
 
-        if (!((1ULL << p->slot) & change_mask)) {
+        /* Evaluate a port's expression when one of its deps changed; this is normally not the case, which is told by
+         * the slot table alone, without visiting the port itself */
+        if (!portset_intersects(change_mask, &port_slot->change_dep_mask) && !PORTSET_HAS(&forced_mask, slot)) {
             continue;
         }
 
+        p = port_slot->port;
+
+        if (!IS_PORT_ENABLED(p)) {
+            continue;
+        }
+
+        /* Only writable ports have value expressions */
+        if (!IS_PORT_WRITABLE(p)) {
+            continue;
+        }
+
+        if (!p->expr) {
+            continue;
+        }
+
+        /* If port expression depends on port itself and the change reason is the evaluation of its expression, prevent
+         * evaluating its expression again to avoid evaluation loops */
+        if (PORTSET_HAS(change_mask, p->slot) &&
+            PORTSET_HAS(change_reasons_expression_mask, p->slot) &&
+            PORTSET_HAS(&port_slot->change_dep_mask, p->slot)) {
+
+            DEBUG_CORE("skipping evaluation of port \"%s\" expression to prevent loops", p->id);
+
+            /* Don't lose a pending deadline, though */
+            if (PORTSET_HAS(&forced_mask, p->slot)) {
+                PORTSET_ADD(&force_eval_expressions_mask, p->slot);
+            }
+
+            continue;
+        }
+
+        STATS_START(start_us);
+        value = expr_eval(p->expr);
+        STATS_PORT_EVAL(p, start_us);
+
+        /* Time dependent functions tell when they need reevaluation, regardless of their dependencies */
+        slot_heap_schedule(&wakeup_heap, p->slot, expr_get_deadline_ms(p->expr));
+
+        if (IS_UNDEFINED(value)) {
+            continue;
+        }
+
+        /* Adapt boolean type value */
+        if (p->type == PORT_TYPE_BOOLEAN) {
+            value = !!value;
+        }
+
+        /* Check if value has changed after expression evaluation */
+        if (value == p->last_read_value) {
+            continue;
+        }
+
+        DEBUG_PORT(p, "expression \"%s\" evaluated to %s", p->sexpr, dtostr(value, -1));
+
+        if (!port_write_value(p, value, CHANGE_REASON_EXPRESSION)) {
+            continue;
+        }
+
+        /* Asynchronous writes have the port read once they complete */
+        if (p->write_value_async) {
+            continue;
+        }
+
+        /* Read back the written value right away, so that expressions depending on this port see the change during
+         * this same pass, instead of waiting for the next polling round */
+        port_slot->last_sample_time_ms = now_ms;
+        if (poll_schedule_valid) {
+            slot_heap_schedule(&poll_heap, p->slot, port_next_poll_time_ms(p));
+        }
+        value = port_read_value(p);
+        if (IS_UNDEFINED(value) || value == p->last_read_value) {
+            continue;
+        }
+
+        DEBUG_PORT(
+            p,
+            "detected value change: %s -> %s, reason = %c",
+            dtostr(p->last_read_value, -1),
+            dtostr(value, -1),
+            p->change_reason
+        );
+
+        p->last_read_value = value;
+        PORTSET_ADD(change_mask, p->slot);
+        PORTSET_ADD(change_reasons_expression_mask, p->slot);
+        p->change_reason = CHANGE_REASON_NATIVE;
+
+        /* Ports that have already been visited in this pass but depend on this port (which only happens with
+         * circular dependencies) will be evaluated during the next pass */
+        for (j = 0; j < i; j++) {
+            if (eval_order[j] != slot && PORTSET_HAS(&PORT_SLOT_AT(eval_order[j])->change_dep_mask, slot)) {
+                PORTSET_ADD(&force_eval_expressions_mask, eval_order[j]);
+            }
+        }
+    }
+
+    /* Trigger value-change events and persist values, including those that were held back */
+    bool changed, held_event_due, held_persist_due;
+    for (i = 0; i < port_slots_count; i++) {
+        slot = port_slots[i].slot;
+        changed = PORTSET_HAS(change_mask, slot);
+        held_event_due = event_heap.pos[slot] && event_heap.times_ms[slot] <= now_ms;
+        held_persist_due = persist_heap.pos[slot] && persist_heap.times_ms[slot] <= now_ms;
+        if (!changed && !held_event_due && !held_persist_due) {
+            continue;
+        }
+
+        p = port_slots[i].port;
+
         /* Add a value-change event, but only for non-internal ports */
-        if (!IS_PORT_INTERNAL(p)) {
+        if (!IS_PORT_INTERNAL(p) && (changed || held_event_due) && value_change_event_due(p)) {
 #ifdef _SLEEP
             if (sleep_is_short_wake()) {
-                if (!(value_change_trigger_mask & (1UL << p->slot))) {
-                    value_change_trigger_mask |= 1UL << p->slot;
+                if (!PORTSET_HAS(&value_change_trigger_mask, p->slot)) {
+                    PORTSET_ADD(&value_change_trigger_mask, p->slot);
                     event_push_value_change(p);
                 }
                 else {
@@ -262,64 +494,349 @@ void handle_value_changes(uint64 change_mask, uint32 change_reasons_expression_m
 #endif
         }
 
-        if (IS_PORT_PERSISTED(p) && (now_ms - poll_started_time_ms > 2000)) {
-            /* Don't save config during the first few seconds since polling starts; this avoids saving at each boot due
-             * to port values transitioning from undefined to their initial value */
-            config_mark_for_saving();
+        /* Persisted values go to the journal rather than into the configuration. Don't persist during the first few
+         * seconds since polling starts; this avoids writing at each boot due to port values transitioning from
+         * undefined to their initial value. */
+        if (!IS_PORT_PERSISTED(p)) {
+            slot_heap_schedule(&persist_heap, p->slot, HEAP_NEVER);
+        }
+        else if (now_ms - poll_started_time_ms > 2000 && value_persist_due(p)) {
+            journal_append(p);
+        }
+    }
+}
+
+bool value_change_event_due(port_t *p) {
+    /* Changes that are too small, with respect to the last reported value, are not reported at all */
+    if (p->change_threshold > 0 && p->last_event_time_ms && p->type == PORT_TYPE_NUMBER &&
+        !IS_UNDEFINED(p->last_event_value) && !IS_UNDEFINED(p->last_read_value)) {
+
+        double threshold = p->change_threshold;
+        if (IS_PORT_REL_THRESHOLD(p)) {
+            threshold *= fabs(p->last_event_value) / 100;
+        }
+
+        if (fabs(p->last_read_value - p->last_event_value) < threshold) {
+            DEBUG_PORT(p, "skipping value-change event below threshold");
+            slot_heap_schedule(&event_heap, p->slot, HEAP_NEVER);
+            return FALSE;
         }
     }
 
-    /* Reevaluate the expressions depending on changed ports */
+    /* Changes that come too soon are held back and reported, with the then current value, once the minimum event
+     * interval elapses */
+    if (p->min_event_interval && p->last_event_time_ms && now_ms - p->last_event_time_ms < p->min_event_interval) {
+        if (!event_heap.pos[p->slot]) {
+            DEBUG_PORT(p, "holding back value-change event");
+            slot_heap_schedule(&event_heap, p->slot, p->last_event_time_ms + p->min_event_interval);
+        }
+
+        return FALSE;
+    }
+
+    slot_heap_schedule(&event_heap, p->slot, HEAP_NEVER);
+    p->last_event_value = p->last_read_value;
+    p->last_event_time_ms = now_ms;
+
+    return TRUE;
+}
+
+bool value_persist_due(port_t *p) {
+    /* Values within the deadband around the persisted value, including the persisted value itself, are not persisted */
+    if (IS_UNDEFINED(p->last_read_value) == IS_UNDEFINED(p->last_persisted_value) &&
+        (IS_UNDEFINED(p->last_read_value) ||
+         fabs(p->last_read_value - p->last_persisted_value) <= p->persist_threshold)) {
+
+        slot_heap_schedule(&persist_heap, p->slot, HEAP_NEVER);
+        return FALSE;
+    }
+
+    /* Values that come too soon are held back and persisted, if still needed, once the minimum persist interval
+     * elapses */
+    if (p->persist_interval && p->last_persist_time_ms && now_ms - p->last_persist_time_ms < p->persist_interval) {
+        if (!persist_heap.pos[p->slot]) {
+            DEBUG_PORT(p, "holding back persisted value");
+            slot_heap_schedule(&persist_heap, p->slot, p->last_persist_time_ms + p->persist_interval);
+        }
+
+        return FALSE;
+    }
+
+    slot_heap_schedule(&persist_heap, p->slot, HEAP_NEVER);
+    p->last_persisted_value = p->last_read_value;
+    p->last_persist_time_ms = now_ms;
+
+    return TRUE;
+}
+
+void rebuild_eval_order(void) {
+    port_t *p, *q;
+    int i, j, count = 0;
+
+    DEBUG_CORE("rebuilding expressions evaluation order");
+
+    free(eval_order);
+    eval_order = NULL;
+    eval_order_len = 0;
+    eval_order_valid = TRUE;
+
+    /* Only ports with expressions take part in evaluation; all other ports are mere sources of value changes */
+    portset_t pending_mask;
+    portset_clear(&pending_mask);
     for (i = 0; i < all_ports_count; i++) {
         p = all_ports[i];
+        if (p->expr) {
+            PORTSET_ADD(&pending_mask, p->slot);
+            count++;
+        }
+    }
 
-        if (!IS_PORT_ENABLED(p)) {
-            continue;
+    if (!count) {
+        return;
+    }
+
+    eval_order = malloc(count);
+
+    /* Repeatedly pick the ports whose dependencies (other than themselves) have all been already placed */
+    while (eval_order_len < count) {
+        int prev_len = eval_order_len;
+        for (i = 0; i < all_ports_count; i++) {
+            p = all_ports[i];
+            if (!PORTSET_HAS(&pending_mask, p->slot)) {
+                continue;
+            }
+
+            if (portset_intersects_except(&PORT_SLOT(p)->change_dep_mask, &pending_mask, p->slot)) {
+                continue;
+            }
+
+            eval_order[eval_order_len++] = p->slot;
+            PORTSET_REMOVE(&pending_mask, p->slot);
         }
 
-        /* Only writable ports have value expressions */
-        if (!IS_PORT_WRITABLE(p)) {
-            continue;
+        if (eval_order_len == prev_len) {
+            /* Circular dependencies; place remaining ports in their natural order */
+            for (j = 0; j < all_ports_count; j++) {
+                q = all_ports[j];
+                if (PORTSET_HAS(&pending_mask, q->slot)) {
+                    eval_order[eval_order_len++] = q->slot;
+                }
+            }
+
+            DEBUG_CORE("circular dependencies detected among port expressions");
+            break;
         }
+    }
+}
 
-        if (!p->expr) {
+void poll_port(port_t *p, bool forced, portset_t *change_mask, portset_t *change_reasons_expression_mask) {
+    port_slot_t *port_slot = PORT_SLOT(p);
+    if (p->heart_beat && (now_ms - port_slot->last_heart_beat_time_ms >= p->heart_beat_interval)) {
+        port_slot->last_heart_beat_time_ms = now_ms;
+        p->heart_beat(p);
+    }
+
+    /* Don't read value more often than indicated by sampling interval */
+    if (!forced && now_ms - port_slot->last_sample_time_ms < p->sampling_interval) {
+        return;
+    }
+
+    port_slot->last_sample_time_ms = now_ms;
+    double value = port_read_value(p);
+    if (IS_UNDEFINED(value)) {
+        return;
+    }
+
+    if (p->last_read_value == value) {
+        return;
+    }
+
+    if (IS_UNDEFINED(p->last_read_value)) {
+        DEBUG_PORT(p, "detected value change: (undefined) -> %s, reason = %c", dtostr(value, -1), p->change_reason);
+    }
+    else {
+        DEBUG_PORT(
+            p,
+            "detected value change: %s -> %s, reason = %c",
+            dtostr(p->last_read_value, -1),
+            dtostr(value, -1),
+            p->change_reason
+        );
+    }
+
+    p->last_read_value = value;
+    PORTSET_ADD(change_mask, p->slot);
+
+    /* Remember and reset change reason */
+    if (p->change_reason == CHANGE_REASON_EXPRESSION) {
+        PORTSET_ADD(change_reasons_expression_mask, p->slot);
+    }
+    p->change_reason = CHANGE_REASON_NATIVE;
+}
+
+void rebuild_poll_schedule(void) {
+    port_t *p;
+    int i;
+
+    DEBUG_CORE("rebuilding polling schedule");
+
+    poll_heap.len = 0;
+    memset(poll_heap.pos, 0, sizeof(poll_heap.pos));
+    memset(poll_ports, 0, sizeof(poll_ports));
+    poll_schedule_valid = TRUE;
+
+    /* Disabled ports are left out entirely */
+    for (i = 0; i < port_slots_count; i++) {
+        p = port_slots[i].port;
+        if (!IS_PORT_ENABLED(p)) {
             continue;
         }
 
-        /* If port expression depends on port itself and the change reason is the evaluation of its expression, prevent
-         * evaluating its expression again to avoid evaluation loops */
-        uint64 slot_bit_value = 1ULL << p->slot;
-        if ((change_mask & slot_bit_value) &&
-            (change_reasons_expression_mask & slot_bit_value) &&
-            (p->change_dep_mask & slot_bit_value)) {
+        poll_ports[p->slot] = p;
+        slot_heap_schedule(&poll_heap, p->slot, port_next_poll_time_ms(p));
+    }
 
-            DEBUG_CORE("skipping evaluation of port \"%s\" expression to prevent loops", p->id);
-            continue;
+    /* Forget about held back events and values of ports that are gone or disabled */
+    for (i = 0; i < MAX_HEAP_SLOTS; i++) {
+        if (!poll_ports[i]) {
+            slot_heap_schedule(&event_heap, i, HEAP_NEVER);
+            slot_heap_schedule(&persist_heap, i, HEAP_NEVER);
         }
+    }
+}
 
-        /* Evaluate a port's expression when one of its deps changed */
+uint64 port_next_poll_time_ms(port_t *p) {
+    /* Sample and heart beat times start out in the distant past, meaning that they're due right away; ports that
+     * signal their changes are still read once initially */
+    port_slot_t *port_slot = PORT_SLOT(p);
+    uint64 time_ms = 0;
+    if (port_slot->last_sample_time_ms >= 0) {
+        time_ms = IS_PORT_INTERRUPT(p) ? HEAP_NEVER : port_slot->last_sample_time_ms + p->sampling_interval;
+    }
 
-        if (!(change_mask & p->change_dep_mask) && !(forced_mask & slot_bit_value)) {
-            continue;
+    if (p->heart_beat) {
+        if (port_slot->last_heart_beat_time_ms > now_ms) {
+            return 0;
         }
 
-        double value = expr_eval(p->expr);
-        if (IS_UNDEFINED(value)) {
-            continue;
+        uint64 heart_beat_time_ms = port_slot->last_heart_beat_time_ms + p->heart_beat_interval;
+        if (heart_beat_time_ms < time_ms) {
+            time_ms = heart_beat_time_ms;
         }
+    }
 
-        /* Adapt boolean type value */
-        if (p->type == PORT_TYPE_BOOLEAN) {
-            value = !!value;
+    return time_ms;
+}
+
+void schedule_next_poll(void) {
+    /* Anything left to be done during the very next round? */
+    if (!portset_is_empty(&force_eval_expressions_mask) || !poll_schedule_valid) {
+        core_schedule_poll();
+        return;
+    }
+
+    /* Wake up at least at each second, for time dependent expressions and saving configuration */
+    uint64 next_time_ms = (now + 1) * 1000ULL;
+    if (poll_heap.len && poll_heap.times_ms[poll_heap.slots[0]] < next_time_ms) {
+        next_time_ms = poll_heap.times_ms[poll_heap.slots[0]];
+    }
+    if (wakeup_heap.len && wakeup_heap.times_ms[wakeup_heap.slots[0]] < next_time_ms) {
+        next_time_ms = wakeup_heap.times_ms[wakeup_heap.slots[0]];
+    }
+    if (event_heap.len && event_heap.times_ms[event_heap.slots[0]] < next_time_ms) {
+        next_time_ms = event_heap.times_ms[event_heap.slots[0]];
+    }
+    if (persist_heap.len && persist_heap.times_ms[persist_heap.slots[0]] < next_time_ms) {
+        next_time_ms = persist_heap.times_ms[persist_heap.slots[0]];
+    }
+
+    uint64 time_ms = system_uptime_ms();
+    if (next_time_ms <= time_ms) {
+        core_schedule_poll();
+        return;
+    }
+
+    os_timer_arm(&poll_timer, next_time_ms - time_ms, /* repeat = */ FALSE);
+#ifdef _STATS
+    poll_due_time_us = next_time_ms * 1000;
+#endif
+}
+
+void on_poll_timer(void *arg) {
+    core_schedule_poll();
+}
+
+void slot_heap_schedule(slot_heap_t *heap, int8 slot, uint64 time_ms) {
+    uint8 i = heap->pos[slot];
+
+    if (time_ms == HEAP_NEVER) { /* Remove from heap, if scheduled */
+        if (!i--) {
+            return;
         }
 
-        /* Check if value has changed after expression evaluation */
-        if (value == p->last_read_value) {
-            continue;
+        heap->pos[slot] = 0;
+        if (i == --heap->len) {
+            return;
         }
 
-        DEBUG_PORT(p, "expression \"%s\" evaluated to %s", p->sexpr, dtostr(value, -1));
+        /* Move last element in place of the removed one and restore heap order */
+        heap->slots[i] = heap->slots[heap->len];
+        heap->pos[heap->slots[i]] = i + 1;
+        slot_heap_sift_up(heap, i);
+        slot_heap_sift_down(heap, heap->pos[heap->slots[i]] - 1);
+
+        return;
+    }
+
+    if (!i) { /* Not yet scheduled; add to heap */
+        i = heap->len++;
+        heap->slots[i] = slot;
+        heap->pos[slot] = i + 1;
+    }
+    else {
+        i--;
+    }
+
+    heap->times_ms[slot] = time_ms;
+    slot_heap_sift_up(heap, i);
+    slot_heap_sift_down(heap, heap->pos[slot] - 1);
+}
+
+void slot_heap_swap(slot_heap_t *heap, uint8 i, uint8 j) {
+    uint8 slot = heap->slots[i];
+
+    heap->slots[i] = heap->slots[j];
+    heap->slots[j] = slot;
+    heap->pos[heap->slots[i]] = i + 1;
+    heap->pos[heap->slots[j]] = j + 1;
+}
+
+void slot_heap_sift_up(slot_heap_t *heap, uint8 i) {
+    uint8 parent;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (heap->times_ms[heap->slots[parent]] <= heap->times_ms[heap->slots[i]]) {
+            break;
+        }
+
+        slot_heap_swap(heap, i, parent);
+        i = parent;
+    }
+}
+
+void slot_heap_sift_down(slot_heap_t *heap, uint8 i) {
+    uint8 child;
+    while ((child = 2 * i + 1) < heap->len) {
+        if (child + 1 < heap->len &&
+            heap->times_ms[heap->slots[child + 1]] < heap->times_ms[heap->slots[child]]) {
+            child++;
+        }
+
+        if (heap->times_ms[heap->slots[i]] <= heap->times_ms[heap->slots[child]]) {
+            break;
+        }
 
-        port_write_value(p, value, CHANGE_REASON_EXPRESSION);
+        slot_heap_swap(heap, i, child);
+        i = child;
     }
 }
@@ -32,8 +32,7 @@
 #define DEBUG_CORE(...)      {}
 #endif
 
-#define TIME_EXPR_DEP_BIT    63  /* Used in change masks */
-#define TIME_MS_EXPR_DEP_BIT 62  /* Used in change masks */
+#define TIME_EXPR_DEP_BIT    PORTSET_BIT_TIME /* Used in change masks */
 
 
 void ICACHE_FLASH_ATTR core_init(void);
@@ -41,9 +40,16 @@ void ICACHE_FLASH_ATTR core_listen_respond(session_t *session);
 
 void ICACHE_FLASH_ATTR core_enable_polling(void);
 void ICACHE_FLASH_ATTR core_disable_polling(void);
+/* Schedules a polling round right away, instead of waiting for the next port to be due */
+void ICACHE_FLASH_ATTR core_schedule_poll(void);
+/* Has the port read during the very next polling round; must not be in flash, as it's called from ISRs */
+void                   core_port_interrupt(port_t *port);
 void ICACHE_FLASH_ATTR core_poll(void);
 
 void ICACHE_FLASH_ATTR update_port_expression(port_t *port);
+void ICACHE_FLASH_ATTR core_invalidate_eval_order(void);
+/* Must be called whenever ports are added, removed, enabled, disabled or get their sampling interval changed */
+void ICACHE_FLASH_ATTR core_invalidate_poll_schedule(void);
 void ICACHE_FLASH_ATTR config_mark_for_saving(void);
 void ICACHE_FLASH_ATTR config_ensure_saved(void);
 
@@ -42,6 +42,7 @@ char    device_config_name[API_MAX_DEVICE_CONFIG_NAME_LEN + 1] = {0};   // TODO:
 uint32  device_flags = 0;
 uint16  device_tcp_port = 0;
 uint16  device_provisioning_version = 0;
+uint16  device_min_free_heap = DEFAULT_MIN_FREE_HEAP;
 
 
 void device_load(uint8 *config_data) {
@@ -125,6 +126,12 @@ void device_load(uint8 *config_data) {
     memcpy(&device_flags, config_data + CONFIG_OFFS_DEVICE_FLAGS, 4);
     DEBUG_DEVICE("flags = %08X", device_flags);
 
+    memcpy(&device_min_free_heap, config_data + CONFIG_OFFS_MIN_FREE_HEAP, 2);
+    if (!device_min_free_heap) {
+        device_min_free_heap = DEFAULT_MIN_FREE_HEAP;
+    }
+    DEBUG_DEVICE("min free heap = %d", device_min_free_heap);
+
     /* Provisioning version */
     memcpy(&device_provisioning_version, config_data + CONFIG_OFFS_PROVISIONING_VER, 2);
     DEBUG_CONFIG("provisioning version = %d", device_provisioning_version);
@@ -239,6 +246,7 @@ void device_save(uint8 *config_data, uint32 *strings_offs) {
     /* Flags & others */
     memcpy(config_data + CONFIG_OFFS_TCP_PORT, &device_tcp_port, 2);
     memcpy(config_data + CONFIG_OFFS_DEVICE_FLAGS, &device_flags, 4);
+    memcpy(config_data + CONFIG_OFFS_MIN_FREE_HEAP, &device_min_free_heap, 2);
 
     /* Provisioning version */
     memcpy(config_data + CONFIG_OFFS_PROVISIONING_VER, &device_provisioning_version, 2);
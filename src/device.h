@@ -27,6 +27,9 @@
 #endif
 
 #define DEFAULT_TCP_PORT             80
+#define DEFAULT_MIN_FREE_HEAP        8192  /* Bytes */
+#define MIN_FREE_HEAP_MIN            1024
+#define MIN_FREE_HEAP_MAX            32768
 
 #define DEVICE_FLAG_WEBHOOKS_ENABLED 0x00000001
 #define DEVICE_FLAG_WEBHOOKS_HTTPS   0x00000002
@@ -43,6 +46,7 @@ extern char    device_config_name[];
 extern uint32  device_flags;
 extern uint16  device_tcp_port;
 extern uint16  device_provisioning_version;
+extern uint16  device_min_free_heap;
 
 
 void ICACHE_FLASH_ATTR device_load(uint8 *config_data);
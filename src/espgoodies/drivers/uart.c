@@ -49,6 +49,8 @@
 
 #define UART_TXFIFO_CNT          0x000000FF
 #define UART_TXFIFO_CNT_S        16
+#define UART_TXFIFO_LEN(uart_no) ((READ_PERI_REG(UART_STATUS(uart_no)) >> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT)
+#define UART_TXFIFO_SIZE         128
 
 #define UART_PARITY_EN           0x00000002
 #define UART_PARITY              0x00000001
@@ -194,6 +196,21 @@ uint16 uart_write(uint8 uart_no, uint8 *buff, uint16 len, uint32 timeout_us) {
     return written;
 }
 
+bool uart_write_fifo(uint8 uart_no, uint8 *buff, uint16 len) {
+    uint16 i, room = UART_TXFIFO_SIZE - UART_TXFIFO_LEN(uart_no);
+    if (len > room) {
+        return FALSE;
+    }
+
+    for (i = 0; i < len; i++) {
+        WRITE_PERI_REG(UART_FIFO(uart_no), buff[i]);
+    }
+
+    DEBUG_UART(uart_no, "wrote %d bytes to FIFO", len);
+
+    return TRUE;
+}
+
 void uart_write_char(uint8 uart_no, char c) {
     uint32 fifo_count;
 
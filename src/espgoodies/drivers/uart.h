@@ -44,6 +44,8 @@
 void   ICACHE_FLASH_ATTR uart_setup(uint8 uart_no, uint32 baud, uint8 parity, uint8 stop_bits, bool alt);
 uint16 ICACHE_FLASH_ATTR uart_read(uint8 uart_no, uint8 *buff, uint16 max_len, uint32 timeout_us);
 uint16 ICACHE_FLASH_ATTR uart_write(uint8 uart_no, uint8 *buff, uint16 len, uint32 timeout_us);
+/* Writes all bytes to the TX FIFO if it has room for them, without waiting; returns whether they were written */
+bool   ICACHE_FLASH_ATTR uart_write_fifo(uint8 uart_no, uint8 *buff, uint16 len);
 void   ICACHE_FLASH_ATTR uart_write_char(uint8 uart_no, char c);
 
 void   ICACHE_FLASH_ATTR uart_buff_setup(uint8 uart_no, uint16 size);
@@ -24,20 +24,14 @@
 #include "espgoodies/flashcfg.h"
 
 
+static void ICACHE_FLASH_ATTR get_slot_location(uint8 slot, uint32 *offs, uint32 *size);
+static bool ICACHE_FLASH_ATTR erase_sectors(uint32 offs, uint32 size);
+
+
 bool flashcfg_load(uint8 slot, uint8 *data) {
     uint32 size = 0;
     uint32 offs = 0;
-    switch (slot) {
-        case FLASH_CONFIG_SLOT_DEFAULT:
-            size = FLASH_CONFIG_SIZE_DEFAULT;
-            offs = FLASH_CONFIG_OFFS_DEFAULT;
-            break;
-
-        case FLASH_CONFIG_SLOT_SYSTEM:
-            size = FLASH_CONFIG_SIZE_SYSTEM;
-            offs = FLASH_CONFIG_OFFS_SYSTEM;
-            break;
-    }
+    get_slot_location(slot, &offs, &size);
 
     SpiFlashOpResult result = spi_flash_read(FLASH_CONFIG_ADDR + offs, (uint32 *) data, size);
     if (result != SPI_FLASH_RESULT_OK) {
@@ -54,18 +48,112 @@ bool flashcfg_load(uint8 slot, uint8 *data) {
 bool flashcfg_save(uint8 slot, uint8 *data) {
     uint32 size = 0;
     uint32 offs = 0;
+    get_slot_location(slot, &offs, &size);
+
+    if (!erase_sectors(offs, size)) {
+        return FALSE;
+    }
+
+    SpiFlashOpResult result = spi_flash_write(FLASH_CONFIG_ADDR + offs, (uint32 *) data, size);
+    if (result != SPI_FLASH_RESULT_OK) {
+        DEBUG_FLASHCFG("failed to write %d bytes of flash config at 0x%05X", size, FLASH_CONFIG_ADDR + offs);
+        return FALSE;
+    }
+    else {
+        DEBUG_FLASHCFG("successfully written %d bytes of flash config at 0x%05X", size, FLASH_CONFIG_ADDR + offs);
+    }
+
+    return TRUE;
+}
+
+bool flashcfg_reset(uint8 slot) {
+    uint32 size = 0;
+    uint32 offs = 0;
+    get_slot_location(slot, &offs, &size);
+
+    uint8 *config_data = zalloc(size);
+    bool result = flashcfg_save(slot, config_data);
+    free(config_data);
+
+    /* Journal records are written on top of the regular configuration and are meaningless without it */
+    if (slot == FLASH_CONFIG_SLOT_DEFAULT) {
+        erase_sectors(FLASH_CONFIG_OFFS_JOURNAL, FLASH_CONFIG_SIZE_JOURNAL);
+    }
+
+    return result;
+}
+
+bool flashcfg_read(uint8 slot, uint32 offs, uint8 *data, uint32 len) {
+    uint32 size = 0;
+    uint32 slot_offs = 0;
+    get_slot_location(slot, &slot_offs, &size);
+    if (offs + len > size) {
+        return FALSE;
+    }
+
+    SpiFlashOpResult result = spi_flash_read(FLASH_CONFIG_ADDR + slot_offs + offs, (uint32 *) data, len);
+    if (result != SPI_FLASH_RESULT_OK) {
+        DEBUG_FLASHCFG(
+            "failed to read %d bytes from flash config at 0x%05X",
+            len,
+            FLASH_CONFIG_ADDR + slot_offs + offs
+        );
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+bool flashcfg_write(uint8 slot, uint32 offs, uint8 *data, uint32 len) {
+    uint32 size = 0;
+    uint32 slot_offs = 0;
+    get_slot_location(slot, &slot_offs, &size);
+    if (offs + len > size) {
+        return FALSE;
+    }
+
+    SpiFlashOpResult result = spi_flash_write(FLASH_CONFIG_ADDR + slot_offs + offs, (uint32 *) data, len);
+    if (result != SPI_FLASH_RESULT_OK) {
+        DEBUG_FLASHCFG(
+            "failed to write %d bytes of flash config at 0x%05X",
+            len,
+            FLASH_CONFIG_ADDR + slot_offs + offs
+        );
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+bool flashcfg_erase(uint8 slot) {
+    uint32 size = 0;
+    uint32 offs = 0;
+    get_slot_location(slot, &offs, &size);
+
+    return erase_sectors(offs, size);
+}
+
+
+void get_slot_location(uint8 slot, uint32 *offs, uint32 *size) {
     switch (slot) {
         case FLASH_CONFIG_SLOT_DEFAULT:
-            size = FLASH_CONFIG_SIZE_DEFAULT;
-            offs = FLASH_CONFIG_OFFS_DEFAULT;
+            *size = FLASH_CONFIG_SIZE_DEFAULT;
+            *offs = FLASH_CONFIG_OFFS_DEFAULT;
             break;
 
         case FLASH_CONFIG_SLOT_SYSTEM:
-            size = FLASH_CONFIG_SIZE_SYSTEM;
-            offs = FLASH_CONFIG_OFFS_SYSTEM;
+            *size = FLASH_CONFIG_SIZE_SYSTEM;
+            *offs = FLASH_CONFIG_OFFS_SYSTEM;
+            break;
+
+        case FLASH_CONFIG_SLOT_JOURNAL:
+            *size = FLASH_CONFIG_SIZE_JOURNAL;
+            *offs = FLASH_CONFIG_OFFS_JOURNAL;
             break;
     }
+}
 
+bool erase_sectors(uint32 offs, uint32 size) {
     int i, sector;
     SpiFlashOpResult result;
     for (i = 0; i < size / SPI_FLASH_SEC_SIZE; i++) {
@@ -86,33 +174,5 @@ bool flashcfg_save(uint8 slot, uint8 *data) {
         }
     }
 
-    result = spi_flash_write(FLASH_CONFIG_ADDR + offs, (uint32 *) data, size);
-    if (result != SPI_FLASH_RESULT_OK) {
-        DEBUG_FLASHCFG("failed to write %d bytes of flash config at 0x%05X", size, FLASH_CONFIG_ADDR + offs);
-        return FALSE;
-    }
-    else {
-        DEBUG_FLASHCFG("successfully written %d bytes of flash config at 0x%05X", size, FLASH_CONFIG_ADDR + offs);
-    }
-
     return TRUE;
 }
-
-bool flashcfg_reset(uint8 slot) {
-    uint32 size = 0;
-    switch (slot) {
-        case FLASH_CONFIG_SLOT_DEFAULT:
-            size = FLASH_CONFIG_SIZE_DEFAULT;
-            break;
-
-        case FLASH_CONFIG_SLOT_SYSTEM:
-            size = FLASH_CONFIG_SIZE_SYSTEM;
-            break;
-    }
-
-    uint8 *config_data = zalloc(size);
-    bool result = flashcfg_save(slot, config_data);
-    free(config_data);
-
-    return result;
-}
@@ -28,17 +28,27 @@
 
 #define FLASH_CONFIG_SLOT_DEFAULT 0 /* Slot for regular configuration */
 #define FLASH_CONFIG_SLOT_SYSTEM  1 /* Slot for system configuration */
+#define FLASH_CONFIG_SLOT_JOURNAL 2 /* Slot for append-only records, written without erasing */
 
 #define FLASH_CONFIG_SIZE_DEFAULT 0x2000 /*  8k bytes */
 #define FLASH_CONFIG_SIZE_SYSTEM  0x1000 /*  4k bytes */
+#define FLASH_CONFIG_SIZE_JOURNAL 0x1000 /*  4k bytes */
 
 #define FLASH_CONFIG_OFFS_DEFAULT 0x0000
 #define FLASH_CONFIG_OFFS_SYSTEM  0x2000
+#define FLASH_CONFIG_OFFS_JOURNAL 0x3000
 
 
 bool ICACHE_FLASH_ATTR flashcfg_load(uint8 slot, uint8 *data);
 bool ICACHE_FLASH_ATTR flashcfg_save(uint8 slot, uint8 *data);
 bool ICACHE_FLASH_ATTR flashcfg_reset(uint8 slot);
 
+/* Partial access to a slot; offs and len must be multiples of 4 and data must be 4-byte aligned */
+bool ICACHE_FLASH_ATTR flashcfg_read(uint8 slot, uint32 offs, uint8 *data, uint32 len);
+/* Writing only clears bits; the written area must have been erased in the meantime */
+bool ICACHE_FLASH_ATTR flashcfg_write(uint8 slot, uint32 offs, uint8 *data, uint32 len);
+/* Sets all bytes of a slot to 0xFF */
+bool ICACHE_FLASH_ATTR flashcfg_erase(uint8 slot);
+
 
 #endif /* _ESPGOODIES_FLASHCFG_H */
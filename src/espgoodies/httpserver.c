@@ -39,6 +39,13 @@
                                   "Content-Length: %d\r\n"      \
                                   "Connection: close\r\n"
 
+/* The body of a streamed response simply ends when the connection is closed */
+#define RESPONSE_TEMPLATE_STREAM  "HTTP/1.1 %d %s\r\n"          \
+                                  "Content-Type: %s\r\n"        \
+                                  "Cache-Control: no-cache\r\n" \
+                                  "Server: %s\r\n"              \
+                                  "Connection: close\r\n"
+
 #define DEF_REQUEST_TIMEOUT 8
 
 #define STATUS_MSG_200 "OK"
@@ -63,6 +70,15 @@ static void ICACHE_FLASH_ATTR handle_header_value_ready(httpserver_context_t *hc
 static void ICACHE_FLASH_ATTR handle_invalid(httpserver_context_t *hc, char c);
 static void ICACHE_FLASH_ATTR handle_request(httpserver_context_t *hc);
 static void ICACHE_FLASH_ATTR handle_request_timeout(void *arg);
+static uint8 ICACHE_FLASH_ATTR *build_head(
+                                    int status,
+                                    char *content_type,
+                                    char *header_names[],
+                                    char *header_values[],
+                                    int header_count,
+                                    int body_len,
+                                    int *len
+                                );
 
 
 void handle_header_value_ready(httpserver_context_t *hc) {
@@ -116,6 +132,99 @@ void handle_request(httpserver_context_t *hc) {
     }
 }
 
+uint8 *build_head(
+    int status,
+    char *content_type,
+    char *header_names[],
+    char *header_values[],
+    int header_count,
+    int body_len,
+    int *len
+) {
+
+    char *status_msg;
+    uint8 *head = NULL;
+    char h[256];
+    int i, hl, head_len = 0;
+
+    switch (status) {
+        case 200:
+            status_msg = STATUS_MSG_200;
+            break;
+
+        case 201:
+            status_msg = STATUS_MSG_201;
+            break;
+
+        case 202:
+            status_msg = STATUS_MSG_202;
+            break;
+
+        case 204:
+            status_msg = STATUS_MSG_204;
+            break;
+
+        case 400:
+            status_msg = STATUS_MSG_400;
+            break;
+
+        case 401:
+            status_msg = STATUS_MSG_401;
+            break;
+
+        case 403:
+            status_msg = STATUS_MSG_403;
+            break;
+
+        case 404:
+            status_msg = STATUS_MSG_404;
+            break;
+            
+        case 500:
+            status_msg = STATUS_MSG_500;
+            break;
+            
+        case 503:
+            status_msg = STATUS_MSG_503;
+            break;
+            
+        default:
+            status_msg = STATUS_MSG_500;
+    }
+    
+    /* Start with response template */
+    if (body_len < 0) {
+        snprintf(h, 256, RESPONSE_TEMPLATE_STREAM, status, status_msg, content_type, server_name);
+    }
+    else if (body_len) {
+        snprintf(h, 256, RESPONSE_TEMPLATE, status, status_msg, content_type, server_name, body_len);
+    }
+    else {
+        snprintf(h, 256, RESPONSE_TEMPLATE_NO_BODY, status, status_msg, server_name);
+    }
+    h[255] = 0;
+
+    head_len = strlen(h);
+    head = malloc(head_len + 1);
+    strcpy((char *) head, h);
+
+    /* Add supplied headers */
+    for (i = 0; i < header_count; i++) {
+        hl = snprintf(h, 256, "%s: %s\r\n", header_names[i], header_values[i]);
+        h[sizeof(h) - 1] = 0;
+        head = realloc(head, head_len + hl + 1);
+        strcpy((char *) head + head_len, h);
+        head_len += hl;
+    }
+
+    /* Head terminator */
+    head = realloc(head, head_len + 3);
+    strcpy((char *) head + head_len, "\r\n");
+    *len = head_len + 2;
+
+    return head;
+}
+
 void httpserver_set_name(char *name) {
     free(server_name);
     server_name = strdup(name);
@@ -439,89 +548,23 @@ uint8 *httpserver_build_response(
     int *len
 ) {
 
-    char *status_msg;
-    uint8 *response = NULL;
-    char h[256];
-    int i, hl, response_len = 0;
-    
-    switch (status) {
-        case 200:
-            status_msg = STATUS_MSG_200;
-            break;
-
-        case 201:
-            status_msg = STATUS_MSG_201;
-            break;
-
-        case 202:
-            status_msg = STATUS_MSG_202;
-            break;
-
-        case 204:
-            status_msg = STATUS_MSG_204;
-            break;
-
-        case 400:
-            status_msg = STATUS_MSG_400;
-            break;
-
-        case 401:
-            status_msg = STATUS_MSG_401;
-            break;
-
-        case 403:
-            status_msg = STATUS_MSG_403;
-            break;
-
-        case 404:
-            status_msg = STATUS_MSG_404;
-            break;
-            
-        case 500:
-            status_msg = STATUS_MSG_500;
-            break;
-            
-        case 503:
-            status_msg = STATUS_MSG_503;
-            break;
-            
-        default:
-            status_msg = STATUS_MSG_500;
-    }
-    
-    /* Start with response template */
-    if (body && *len) {
-        snprintf(h, 256, RESPONSE_TEMPLATE, status, status_msg, content_type, server_name, *len);
-    }
-    else {
-        snprintf(h, 256, RESPONSE_TEMPLATE_NO_BODY, status, status_msg, server_name);
-    }
-    h[255] = 0;
-
-    response_len = strlen(h);
-    response = malloc(response_len + 1);
-    strcpy((char *) response, h);
-
-    /* Add supplied headers */
-    for (i = 0; i < header_count; i++) {
-        hl = snprintf(h, 256, "%s: %s\r\n", header_names[i], header_values[i]);
-        h[sizeof(h) - 1] = 0;
-        response = realloc(response, response_len + hl + 1);
-        strcpy((char *) response + response_len, h);
-        response_len += hl;
-    }
+    int head_len;
+    uint8 *response = build_head(
+        status,
+        content_type,
+        header_names,
+        header_values,
+        header_count,
+        body ? *len : 0,
+        &head_len
+    );
 
-    int head_len = response_len;
-    response_len += 2 /* \r\n head terminator */;
-    response_len += *len;
+    int response_len = head_len + *len;
     response = realloc(response, response_len + 1);
-    uint8 *head_end = response + head_len;
-    strcpy((char *) head_end, "\r\n");
-
     if (body && *len) {
-        memcpy(head_end + 2, body, *len);
+        memcpy(response + head_len, body, *len);
     }
-    
+
     *len = response_len;
 
 #if defined(_DEBUG) && defined(_DEBUG_HTTPSERVER)
@@ -535,6 +578,22 @@ uint8 *httpserver_build_response(
     return response;
 }
 
+uint8 *httpserver_build_stream_head(
+    int status,
+    char *content_type,
+    char *header_names[],
+    char *header_values[],
+    int header_count,
+    int *len
+) {
+
+    uint8 *head = build_head(status, content_type, header_names, header_values, header_count, -1, len);
+
+    DEBUG_HTTPSERVER("streamed response head (%d bytes)", *len);
+
+    return head;
+}
+
 #if defined(_DEBUG) && defined(_DEBUG_HTTPSERVER)
 
 void DEBUG_HTTPSERVER_CTX(httpserver_context_t *hc, char *fmt, ...) {
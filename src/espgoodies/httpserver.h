@@ -137,6 +137,16 @@ uint8 ICACHE_FLASH_ATTR *httpserver_build_response(
                              uint8 *body,
                              int *len
                          );
+/* Builds the head of a response whose body is sent afterwards, as it is produced, until the connection is closed; the
+ * returned head must be freed after use */
+uint8 ICACHE_FLASH_ATTR *httpserver_build_stream_head(
+                             int status,
+                             char *content_type,
+                             char *header_names[],
+                             char *header_values[],
+                             int header_count,
+                             int *len
+                         );
 
 
 #endif /* _ESPGOODIES_HTTPSERVER_H */
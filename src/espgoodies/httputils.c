@@ -87,6 +87,9 @@ json_t *http_parse_url_encoded(char *input) {
         json_obj_append(json, name, json_str_new(value));
     }
 
+    /* The query is kept for the whole request, so it's trimmed to its actual length */
+    json_shrink(json);
+
     return json;
 }
 
@@ -32,25 +32,83 @@
 
 #define STRINGIFIED_CHUNK_SIZE 128
 
+/* Objects large enough to be indexed keep the order of their keys right after them, in the same allocation, as an
+ * array of member indices sorted by key; these give its length and the room it takes, in key pointers */
+#define ORDER_LEN(capacity)    ((capacity) > JSON_OBJ_INDEX_MIN_LEN ? (capacity) : 0)
+#define ORDER_SIZE(capacity)   ((ORDER_LEN(capacity) * sizeof(uint16) + sizeof(char *) - 1) / sizeof(char *))
+
 
 typedef struct {
 
     json_t *json;
     char   *key;
+    uint32  first_member;  /* In situ, index of the container's first member in the arena's members */
 
 } stack_t;
 
+typedef struct {
+
+    json_t *json;
+    char   *key;
+
+} member_t;
+
+typedef struct {
+
+    json_t   *nodes;         /* The arena itself, starting with the root */
+    uint32    nodes_count;
+    uint32    nodes_len;
+    json_t  **children;      /* Children of all containers, following the nodes */
+    uint32    children_len;
+    char    **keys;          /* Keys of all objects, following the children */
+    uint32    keys_count;
+    uint32    keys_len;
+
+    /* Members of the containers that are still open, moved into the arena as their containers are closed; these,
+     * along with the parsing stack, take one temporary allocation, freed once parsing is done */
+    member_t *members;
+    uint32    members_len;
+
+} arena_t;
+
 typedef struct {
 
     uint32   stack_size;
     stack_t *stack;
+    arena_t *arena;          /* Only when parsing in situ */
 
 } ctx_t;
 
 
+static json_t ICACHE_FLASH_ATTR *parse(char *input, bool in_situ);
+static void   ICACHE_FLASH_ATTR  count_elements(
+                                    char *input,
+                                    uint32 length,
+                                    uint32 *nodes_count,
+                                    uint32 *keys_count,
+                                    uint32 *depth
+                                );
 static void   ICACHE_FLASH_ATTR  json_dump_rec(json_t *json, char **output, int *len, int *size, uint8 free_mode);
+static void   ICACHE_FLASH_ATTR  obj_append(json_t *json, char *key, json_t *child);
+static void   ICACHE_FLASH_ATTR  own_keys(json_t *json);
+
+static void   ICACHE_FLASH_ATTR  set_capacity(json_t *json, uint16 capacity);
+static bool   ICACHE_FLASH_ATTR  grow(json_t *json);
+
+static int    ICACHE_FLASH_ATTR  find_key(json_t *json, char *key);
+static uint16 ICACHE_FLASH_ATTR *get_order(json_t *json);
+static uint16 ICACHE_FLASH_ATTR  order_search(json_t *json, char *key, uint16 len, bool after_equal);
+static void   ICACHE_FLASH_ATTR  order_build(json_t *json);
+static void   ICACHE_FLASH_ATTR  order_insert(json_t *json, uint16 index);
+static void   ICACHE_FLASH_ATTR  order_remove(json_t *json, uint16 index);
+
+static void   ICACHE_FLASH_ATTR  writer_put(json_writer_t *writer, uint8 *data, int len);
+static void   ICACHE_FLASH_ATTR  writer_put_str(json_writer_t *writer, char *s);
+static void   ICACHE_FLASH_ATTR  writer_begin_value(json_writer_t *writer);
 
 static ctx_t  ICACHE_FLASH_ATTR *ctx_new(char *input);
+static json_t ICACHE_FLASH_ATTR *ctx_new_node(ctx_t *ctx, char type);
+static json_t ICACHE_FLASH_ATTR *ctx_new_str(ctx_t *ctx, char *value);
 static void   ICACHE_FLASH_ATTR  ctx_set_key(ctx_t *ctx, char *key);
 static void   ICACHE_FLASH_ATTR  ctx_clear_key(ctx_t *ctx);
 static json_t ICACHE_FLASH_ATTR *ctx_get_current(ctx_t *ctx);
@@ -61,765 +119,1187 @@ static void   ICACHE_FLASH_ATTR  ctx_free(ctx_t *ctx);
 
 
 json_t *json_parse(char *input) {
-    char c, c2;
-    char s[JSON_MAX_VALUE_LEN + 1];
-    bool end_found, point_seen, waiting_elem = TRUE;
-    uint32 i, sl, pos = 0;
-    uint32 length = strlen(input);
-    ctx_t *ctx = ctx_new(input);
-    json_t *json, *root = NULL;
-
-    /* Remove all whitespace at the end of input */
-    while (isspace((int) input[length - 1])) {
-        length--;
-    }
+    return parse(input, /* in_situ = */ FALSE);
+}
 
-    while (pos < length) {
-        c = input[pos];
+json_t *json_parse_in_situ(char *input) {
+    return parse(input, /* in_situ = */ TRUE);
+}
 
-        /* If root already popped, we don't expect any more characters */
-        if (root) {
-            DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
-            json_free(root);
-            ctx_free(ctx);
-            return NULL;
-        }
+char *json_dump(json_t *json, uint8 free_mode) {
+    char *output = NULL;
+    int len = 0, size = 0;
+    
+    json_dump_rec(json, &output, &len, &size, free_mode);
+    size = realloc_chunks(&output, size, len + 1);
+    output[len] = 0;
 
-        switch (c) {
-            case '{':
-                if (!waiting_elem) {
-                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
-                    ctx_free(ctx);
-                    return NULL;
-                }
+    return output;
+}
 
-                ctx_push(ctx, json_obj_new());
+char *json_dump_r(json_t *json, uint8 free_mode) {
+    int len = 0;
+    static char *dump_buffer = NULL;
+    static int dump_buffer_size = 0;
 
-                /* Waiting for a key, not an element */
-                waiting_elem = FALSE;
+    json_dump_rec(json, &dump_buffer, &len, &dump_buffer_size, free_mode);
+    dump_buffer_size = realloc_chunks(&dump_buffer, dump_buffer_size, len + 1);
+    dump_buffer[len] = 0;
 
-                pos++;
-                break;
+    return dump_buffer;
+}
 
-            case '}':
-                json = ctx_get_current(ctx);
-                if (!json || json_get_type(json) != JSON_TYPE_OBJ ||
-                    (waiting_elem && json_obj_get_len(json) > 0) || ctx_has_key(ctx)) {
+void json_stringify(json_t *json) {
+    if (json->type == JSON_TYPE_STRINGIFIED) {
+        return; /* Already stringified */
+    }
 
-                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
-                    ctx_free(ctx);
-                    return NULL;
-                }
+    if (json->flags & JSON_FLAG_ARENA) {
+        DEBUG_JSON("cannot stringify JSON parsed in situ");
+        return;
+    }
 
-                waiting_elem = FALSE;
-                root = ctx_pop(ctx);
-                pos++;
-                break;
+    char *stringified = json_dump_r(json, /* free_mode = */ JSON_FREE_MEMBERS);
 
-            case '[':
-                if (!waiting_elem) {
-                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
-                    ctx_free(ctx);
-                    return NULL;
-                }
+    uint16 i = 0, chunks = 0, chunk, pos;
+    char c, *s = stringified;
 
-                ctx_push(ctx, json_list_new());
-                pos++;
-                break;
+    while ((c = *s++)) {
+        chunk = i / STRINGIFIED_CHUNK_SIZE;
+        pos = i % STRINGIFIED_CHUNK_SIZE;
 
-            case ']':
-                json = ctx_get_current(ctx);
-                if (!json || json_get_type(json) != JSON_TYPE_LIST ||
-                    (waiting_elem && json_list_get_len(json) > 0)) {
+        if (chunk >= chunks) {
+            json->chunks = realloc(json->chunks, sizeof(char *) * ++chunks);
+            json->chunks[chunk] = malloc(STRINGIFIED_CHUNK_SIZE);
+        }
 
-                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
-                    ctx_free(ctx);
-                    return NULL;
-                }
+        json->chunks[chunk][pos] = c;
+        i++;
+    }
 
-                waiting_elem = FALSE;
-                root = ctx_pop(ctx);
-                pos++;
-                break;
+    json->len = i;
+    json->type = JSON_TYPE_STRINGIFIED;
+}
 
-            case ',':
-                json = ctx_get_current(ctx);
-                if (!json || waiting_elem) {
-                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
-                    ctx_free(ctx);
-                    return NULL;
-                }
+void json_shrink(json_t *json) {
+    if ((json->type != JSON_TYPE_LIST && json->type != JSON_TYPE_OBJ) || (json->flags & JSON_FLAG_ARENA)) {
+        return;
+    }
 
-                if (json_get_type(json) == JSON_TYPE_LIST) {
-                    waiting_elem = TRUE;
-                }
+    for (int i = 0; i < json->len; i++) {
+        json_shrink(json->children[i]);
+    }
 
-                pos++;
-                break;
+    if (json->capacity > json->len) {
+        set_capacity(json, json->len);
+    }
+}
 
-            case ':':
-                json = ctx_get_current(ctx);
-                if (!json || json_get_type(json) != JSON_TYPE_OBJ || !ctx_has_key(ctx) || waiting_elem) {
-                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
-                    ctx_free(ctx);
-                    return NULL;
-                }
+void json_free(json_t *json) {
+    if (!json) {
+        return;
+    }
 
-                waiting_elem = TRUE;
+    if (json->flags & JSON_FLAG_ARENA) {
+        /* Elements parsed in situ all go away at once, along with the root */
+        if (json->flags & JSON_FLAG_ARENA_ROOT) {
+            free(json);
+        }
 
-                pos++;
-                break;
+        return;
+    }
 
-            case ' ':
-            case '\b':
-            case '\f':
-            case '\n':
-            case '\r':
-            case '\t':
-                /* Skip whitespace */
-                pos++;
-                break;
+    int i, n, r;
 
-            case '"':
-                /* Parse a string, which can be either a standalone string element or an object key */
+    switch (json->type) {
+        case JSON_TYPE_NULL:
+        case JSON_TYPE_BOOL:
+        case JSON_TYPE_INT:
+        case JSON_TYPE_DOUBLE:
+        case JSON_TYPE_MEMBERS_FREED:
+            break;
 
-                json = ctx_get_current(ctx);
-                if (json && json_get_type(json) == JSON_TYPE_OBJ) {
-                    if (ctx_has_key(ctx) != waiting_elem) {
-                        DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
-                        ctx_free(ctx);
-                        return NULL;
-                    }
-                }
-                else { /* No parent or not an object */
-                    if (!waiting_elem) {
-                        DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
-                        ctx_free(ctx);
-                        return NULL;
-                    }
-                }
+        case JSON_TYPE_STR:
+            free(json->str_value);
+            break;
 
-                waiting_elem = FALSE;
+        case JSON_TYPE_LIST:
+            for (i = 0; i < json->len; i++) {
+                json_free(json->children[i]);
+            }
+            free(json->children);
+            break;
 
-                i = ++pos;
-                s[0] = 0;
-                sl = 0;
-                end_found = FALSE;
-                for (i = pos; !end_found && (i < length); i++) {
-                    c = input[i];
-                    switch (c) {
-                        case '\\':
-                            /* Escape codes */
-                            if (i < length - 1) {
-                                c2 = input[i + 1];
-                                i++;
-                                switch (c2) {
-                                    case 'b':
-                                        if (sl < JSON_MAX_VALUE_LEN) {
-                                            s[sl] = '\b'; s[++sl] = 0;
-                                        }
+        case JSON_TYPE_OBJ:
+            for (i = 0; i < json->len; i++) {
+                if (!(json->flags & JSON_FLAG_STATIC_KEYS)) {
+                    free(json->keys[i]);
+                }
+                json_free(json->children[i]);
+            }
+            free(json->keys);
+            free(json->children);
+            break;
 
-                                        break;
+        case JSON_TYPE_STRINGIFIED:
+            n = json->len / STRINGIFIED_CHUNK_SIZE;
+            r = json->len % STRINGIFIED_CHUNK_SIZE;
+            if (r) {
+                n++;
+            }
 
-                                    case 'f':
-                                        if (sl < JSON_MAX_VALUE_LEN) {
-                                            s[sl] = '\f'; s[++sl] = 0;
-                                        }
+            for (i = 0; i < n; i++) {
+                free(json->chunks[i]);
+            }
+            free(json->chunks);
 
-                                        break;
+            json->chunks = NULL;
+            json->len = 0;
 
-                                    case 'n':
-                                        if (sl < JSON_MAX_VALUE_LEN) {
-                                            s[sl] = '\n'; s[++sl] = 0;
-                                        }
+            break;
+    }
 
-                                        break;
+    free(json);
+}
 
-                                    case 'r':
-                                        if (sl < JSON_MAX_VALUE_LEN) {
-                                            s[sl] = '\r'; s[++sl] = 0;
-                                        }
+json_t *json_dup(json_t *json) {
+    switch (json->type) {
+        case JSON_TYPE_NULL:
+            return json_null_new();
 
-                                        break;
+        case JSON_TYPE_BOOL:
+            return json_bool_new(json_bool_get(json));
 
-                                    case 't':
-                                        if (sl < JSON_MAX_VALUE_LEN) {
-                                            s[sl] = '\t'; s[++sl] = 0;
-                                        }
+        case JSON_TYPE_INT:
+            return json_int_new(json_int_get(json));
 
-                                        break;
+        case JSON_TYPE_DOUBLE:
+            return json_double_new(json_double_get(json));
 
-                                    case '"':
-                                        if (sl < JSON_MAX_VALUE_LEN) {
-                                            s[sl] = '"'; s[++sl] = 0;
-                                        }
+        case JSON_TYPE_STR:
+            return json_str_new(json_str_get(json));
 
-                                        break;
-
-                                    case '\\':
-                                        if (sl < JSON_MAX_VALUE_LEN) {
-                                            s[sl] = '\\'; s[++sl] = 0;
-                                        }
-
-                                        break;
-
-                                    default:
-                                        if (sl < JSON_MAX_VALUE_LEN) {
-                                            s[sl] = c; s[++sl] = 0;
-                                        }
-                                }
-                            }
-                            else { /* The last char in input string is a backslash */
-                                if (sl < JSON_MAX_VALUE_LEN) {
-                                    s[sl] = '\\'; s[++sl] = 0;
-                                }
-                            }
-
-                            break;
-
-                        case '"':
-                            /* String end */
-                            pos = i + 1;
-                            end_found = TRUE;
-                            break;
-
-                        default:
-                            /* Regular character inside string */
-                            if (sl < JSON_MAX_VALUE_LEN) {
-                                s[sl] = c; s[++sl] = 0;
-                            }
-                    }
-                }
+        case JSON_TYPE_LIST: {
+            json_t *list = json_list_new();
+            int i;
+            set_capacity(list, json->len);
+            for (i = 0; i < json->len; i++) {
+                json_list_append(list, json_dup(json->children[i]));
+            }
 
-                if (!end_found) {
-                    DEBUG_JSON("unterminated string at pos %d", pos);
-                    ctx_free(ctx);
-                    return NULL;
-                }
+            return list;
+        }
 
-                json = ctx_get_current(ctx);
-                if (json) {
-                    if (json_get_type(json) == JSON_TYPE_OBJ) {
-                        if (ctx_has_key(ctx)) { /* String is a value */
-                            ctx_add(ctx, json_str_new(s));
-                        }
-                        else { /* String is a key */
-                            ctx_set_key(ctx, s);
-                        }
-                    }
-                    else if (json_get_type(json) == JSON_TYPE_LIST) {
-                        ctx_add(ctx, json_str_new(s));
-                    }
-                    else {
-                        DEBUG_JSON("unexpected string at pos %d", pos);
-                        ctx_free(ctx);
-                        return NULL;
-                    }
-                }
-                else { /* Root element is a string */
-                    ctx_add(ctx, json_str_new(s));
+        case JSON_TYPE_OBJ: {
+            json_t *obj = json_obj_new();
+            int i;
+            set_capacity(obj, json->len);
+            for (i = 0; i < json->len; i++) {
+                if (json->flags & JSON_FLAG_STATIC_KEYS) {
+                    json_obj_append_static(obj, json->keys[i], json_dup(json->children[i]));
                 }
-
-                break;
-
-            default:
-                /* null, true, false, a number or unexpected character */
-
-                json = ctx_get_current(ctx);
-                if ((json && json_get_type(json) == JSON_TYPE_OBJ && !ctx_has_key(ctx)) || !waiting_elem) {
-                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
-                    ctx_free(ctx);
-                    return NULL;
+                else {
+                    json_obj_append(obj, json->keys[i], json_dup(json->children[i]));
                 }
+            }
 
-                waiting_elem = FALSE;
+            return obj;
+        }
 
-                if ((c >= '0' && c <= '9') || (c == '-')) {
-                    /* number */
-                    i = pos;
-                    if (c == '-') {
-                        i++;
-                    }
+        case JSON_TYPE_STRINGIFIED: {
+            int i, n, r;
 
-                    point_seen = FALSE; /* One single point allowed in numerals */
-                    while (i < length) {
-                        c = input[i];
-                        if (c == '.') {
-                            if (point_seen) {
-                                break;
-                            }
-                            else {
-                                point_seen = TRUE;
-                            }
-                        }
-                        else if (c < '0' || c > '9') {
-                            break;
-                        }
+            json_t *new_json = malloc(sizeof(json_t));
+            new_json->type = JSON_TYPE_STRINGIFIED;
+            new_json->flags = 0;
+            new_json->len = json->len;
 
-                        i++;
-                    }
+            n = json->len / STRINGIFIED_CHUNK_SIZE;
+            r = json->len % STRINGIFIED_CHUNK_SIZE;
+            if (r) {
+                n++;
+            }
 
-                    strncpy(s, input + pos, i - pos + 1);
-                    s[i - pos] = 0;
-                    if (point_seen) { /* floating point */
-                        ctx_add(ctx, json_double_new(strtod(s, NULL)));
-                    }
-                    else { /* integer */
-                        ctx_add(ctx, json_int_new(strtol(s, NULL, 10)));
-                    }
-                    pos = i;
-                }
-                else if (!strncmp(input + pos, "null", 4)) {
-                    ctx_add(ctx, json_null_new());
-                    pos += 4;
-                }
-                else if (!strncmp(input + pos, "false", 5)) {
-                    ctx_add(ctx, json_bool_new(FALSE));
-                    pos += 5;
-                }
-                else if (!strncmp(input + pos, "true", 4)) {
-                    ctx_add(ctx, json_bool_new(TRUE));
-                    pos += 4;
-                }
-                else {
-                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
-                    ctx_free(ctx);
-                    return NULL;
-                }
-        }
-    }
+            new_json->chunks = malloc(sizeof(char *) * n);
+            for (i = 0; i < n; i++) {
+                new_json->chunks[i] = malloc(STRINGIFIED_CHUNK_SIZE);
+                memcpy(new_json->chunks[i], json->chunks[i], STRINGIFIED_CHUNK_SIZE);
+            }
 
-    if (!root) {
-        if (ctx_get_size(ctx) < 1) {
-            DEBUG_JSON("empty input");
-            ctx_free(ctx);
-            return NULL;
+            return new_json;
         }
 
-        if (ctx_get_size(ctx) > 1) {
-            DEBUG_JSON("unbalanced brackets");
-            ctx_free(ctx);
+        case JSON_TYPE_MEMBERS_FREED:
+            DEBUG_JSON("cannot duplicate JSON with freed members");
             return NULL;
-        }
 
-        root = ctx_pop(ctx);
-        if (json_get_type(root) == JSON_TYPE_LIST || json_get_type(root) == JSON_TYPE_OBJ) {
-            /* List and object roots should have already been popped as soon as closing brackets were encountered */
-            json_free(root);
-            DEBUG_JSON("unbalanced brackets");
-            ctx_free(ctx);
+        default:
             return NULL;
-        }
     }
+}
 
-    if (json_get_type(root) == JSON_TYPE_OBJ && ctx_has_key(ctx)) {
-        DEBUG_JSON("expected element at pos %d", pos);
-        ctx_free(ctx);
-        return NULL;
+char json_get_type(json_t *json) {
+    return json->type;
+}
+
+void json_assert_type(json_t *json, char type) {
+    if (json->type != type) {
+        DEBUG_JSON("unexpected JSON type: wanted %c, got %c", type, (json)->type);
     }
+}
 
-    ctx_free(ctx);
+json_t *json_null_new() {
+    json_t *json = malloc(sizeof(json_t));
+    json->type = JSON_TYPE_NULL;
+    json->flags = 0;
+    
+    return json;
+}
 
-    return root;
+json_t *json_bool_new(bool value) {
+    json_t *json = malloc(sizeof(json_t));
+    json->type = JSON_TYPE_BOOL;
+    json->flags = 0;
+    json->bool_value = value;
+
+    return json;
 }
 
-char *json_dump(json_t *json, uint8 free_mode) {
-    char *output = NULL;
-    int len = 0, size = 0;
-    
-    json_dump_rec(json, &output, &len, &size, free_mode);
-    size = realloc_chunks(&output, size, len + 1);
-    output[len] = 0;
+bool json_bool_get(json_t *json) {
+    json_assert_type(json, JSON_TYPE_BOOL);
 
-    return output;
+    return json->bool_value;
 }
 
-char *json_dump_r(json_t *json, uint8 free_mode) {
-    int len = 0;
-    static char *dump_buffer = NULL;
-    static int dump_buffer_size = 0;
+json_t *json_int_new(int value) {
+    json_t *json = malloc(sizeof(json_t));
+    json->type = JSON_TYPE_INT;
+    json->flags = 0;
+    json->int_value = value;
 
-    json_dump_rec(json, &dump_buffer, &len, &dump_buffer_size, free_mode);
-    dump_buffer_size = realloc_chunks(&dump_buffer, dump_buffer_size, len + 1);
-    dump_buffer[len] = 0;
+    return json;
+}
 
-    return dump_buffer;
+int32 json_int_get(json_t *json) {
+    json_assert_type(json, JSON_TYPE_INT);
+
+    return json->int_value;
 }
 
-void json_stringify(json_t *json) {
-    if (json->type == JSON_TYPE_STRINGIFIED) {
-        return; /* Already stringified */
-    }
+json_t *json_double_new(double value) {
+    json_t *json = malloc(sizeof(json_t));
+    json->type = JSON_TYPE_DOUBLE;
+    json->flags = 0;
+    json->double_value = value;
 
-    char *stringified = json_dump_r(json, /* free_mode = */ JSON_FREE_MEMBERS);
+    return json;
+}
 
-    uint16 i = 0, chunks = 0, chunk, pos;
-    char c, *s = stringified;
+double json_double_get(json_t *json) {
+    json_assert_type(json, JSON_TYPE_DOUBLE);
 
-    while ((c = *s++)) {
-        chunk = i / STRINGIFIED_CHUNK_SIZE;
-        pos = i % STRINGIFIED_CHUNK_SIZE;
+    return json->double_value;
+}
 
-        if (chunk >= chunks) {
-            json->chunks = realloc(json->chunks, sizeof(char *) * ++chunks);
-            json->chunks[chunk] = malloc(STRINGIFIED_CHUNK_SIZE);
-        }
+json_t *json_str_new(char *value) {
+    json_t *json = malloc(sizeof(json_t));
+    json->type = JSON_TYPE_STR;
+    json->flags = 0;
+    json->str_value = (void *) strdup(value);
 
-        json->chunks[chunk][pos] = c;
-        i++;
-    }
+    return json;
+}
 
-    json->len = i;
-    json->type = JSON_TYPE_STRINGIFIED;
+char *json_str_get(json_t *json) {
+    json_assert_type(json, JSON_TYPE_STR);
+
+    return json->str_value;
 }
 
-void json_free(json_t *json) {
-    if (!json) {
+json_t *json_list_new() {
+    json_t *json = malloc(sizeof(json_t));
+    json->type = JSON_TYPE_LIST;
+    json->flags = 0;
+
+    json->len = 0;
+    json->capacity = 0;
+    json->children = NULL;
+
+    return json;
+}
+
+void json_list_append(json_t *json, json_t *child) {
+    json_assert_type(json, JSON_TYPE_LIST);
+
+    if (json->flags & JSON_FLAG_ARENA) {
+        DEBUG_JSON("cannot append to JSON parsed in situ");
+        json_free(child);
         return;
     }
 
-    int i, n, r;
+    if (json->len >= json->capacity && !grow(json)) {
+        DEBUG_JSON("cannot append beyond %d members", 0xFFFF);
+        json_free(child);
+        return;
+    }
 
-    switch (json->type) {
-        case JSON_TYPE_NULL:
-        case JSON_TYPE_BOOL:
-        case JSON_TYPE_INT:
-        case JSON_TYPE_DOUBLE:
-        case JSON_TYPE_MEMBERS_FREED:
-            break;
+    json->children[(int) json->len++] = child;
+}
 
-        case JSON_TYPE_STR:
-            free(json->str_value);
-            break;
+json_t *json_list_value_at(json_t *json, uint32 index) {
+    json_assert_type(json, JSON_TYPE_LIST);
 
-        case JSON_TYPE_LIST:
-            for (i = 0; i < json->len; i++) {
-                json_free(json->children[i]);
-            }
-            free(json->children);
-            break;
+    return json->children[index];
+}
 
-        case JSON_TYPE_OBJ:
-            for (i = 0; i < json->len; i++) {
-                free(json->keys[i]);
-                json_free(json->children[i]);
-            }
-            free(json->keys);
-            free(json->children);
-            break;
+json_t *json_list_pop_at(json_t *json, uint32 index) {
+    json_t *child = json->children[index];
 
-        case JSON_TYPE_STRINGIFIED:
-            n = json->len / STRINGIFIED_CHUNK_SIZE;
-            r = json->len % STRINGIFIED_CHUNK_SIZE;
-            if (r) {
-                n++;
-            }
+    for (int i = index; i < json->len - 1; i++) {
+        json->children[i] = json->children[i + 1];
+    }
 
-            for (i = 0; i < n; i++) {
-                free(json->chunks[i]);
-            }
-            free(json->chunks);
+    /* The freed member is kept allocated, for further appends */
+    json->len--;
 
-            json->chunks = NULL;
-            json->len = 0;
+    return child;
+}
 
-            break;
-    }
+uint32 json_list_get_len(json_t *json) {
+    json_assert_type(json, JSON_TYPE_LIST);
 
-    free(json);
+    return json->len;
 }
 
-json_t *json_dup(json_t *json) {
-    switch (json->type) {
-        case JSON_TYPE_NULL:
-            return json_null_new();
-
-        case JSON_TYPE_BOOL:
-            return json_bool_new(json_bool_get(json));
+json_t *json_obj_lookup_key(json_t *json, char *key) {
+    json_assert_type(json, JSON_TYPE_OBJ);
 
-        case JSON_TYPE_INT:
-            return json_int_new(json_int_get(json));
+    int i = find_key(json, key);
+    if (i < 0) {
+        return NULL;
+    }
 
-        case JSON_TYPE_DOUBLE:
-            return json_double_new(json_double_get(json));
+    return json->children[i];
+}
 
-        case JSON_TYPE_STR:
-            return json_str_new(json_str_get(json));
+json_t *json_obj_pop_key(json_t *json, char *key) {
+    json_assert_type(json, JSON_TYPE_OBJ);
 
-        case JSON_TYPE_LIST: {
-            json_t *list = json_list_new();
-            int i;
-            for (i = 0; i < json->len; i++) {
-                json_list_append(list, json_dup(json->children[i]));
-            }
+    int i, p = find_key(json, key);
+    if (p < 0) {
+        return NULL;
+    }
 
-            return list;
-        }
+    if (json->flags & JSON_FLAG_INDEXED) {
+        order_remove(json, p);
+    }
 
-        case JSON_TYPE_OBJ: {
-            json_t *obj = json_obj_new();
-            int i;
-            for (i = 0; i < json->len; i++) {
-                json_obj_append(
-                    obj,
-                    json->keys[i],
-                    json_dup(json->children[i])
-                );
-            }
+    json_t *child = json->children[p];
+    if (!(json->flags & (JSON_FLAG_ARENA | JSON_FLAG_STATIC_KEYS))) {
+        free(json->keys[p]);
+    }
 
-            return obj;
-        }
+    for (i = p; i < json->len - 1; i++) {
+        json->children[i] = json->children[i + 1];
+        json->keys[i] = json->keys[i + 1];
+    }
 
-        case JSON_TYPE_STRINGIFIED: {
-            int i, n, r;
+    /* The freed member is kept allocated, for further appends */
+    json->len--;
 
-            json_t *new_json = malloc(sizeof(json_t));
-            new_json->type = JSON_TYPE_STRINGIFIED;
-            new_json->len = json->len;
+    return child;
+}
 
-            n = json->len / STRINGIFIED_CHUNK_SIZE;
-            r = json->len % STRINGIFIED_CHUNK_SIZE;
-            if (r) {
-                n++;
-            }
+json_t *json_obj_new() {
+    json_t *json = malloc(sizeof(json_t));
+    json->type = JSON_TYPE_OBJ;
+    json->flags = 0;
 
-            new_json->chunks = malloc(sizeof(char *) * n);
-            for (i = 0; i < n; i++) {
-                new_json->chunks[i] = malloc(STRINGIFIED_CHUNK_SIZE);
-                memcpy(new_json->chunks[i], json->chunks[i], STRINGIFIED_CHUNK_SIZE);
-            }
+    json->len = 0;
+    json->capacity = 0;
+    json->keys = NULL;
+    json->children = NULL;
 
-            return new_json;
-        }
+    return json;
+}
 
-        case JSON_TYPE_MEMBERS_FREED:
-            DEBUG_JSON("cannot duplicate JSON with freed members");
-            return NULL;
+void json_obj_append(json_t *json, char *key, json_t *child) {
+    json_assert_type(json, JSON_TYPE_OBJ);
 
-        default:
-            return NULL;
+    if (json->flags & JSON_FLAG_STATIC_KEYS) {
+        own_keys(json);
     }
-}
 
-char json_get_type(json_t *json) {
-    return json->type;
+    obj_append(json, key, child);
 }
 
-void json_assert_type(json_t *json, char type) {
-    if (json->type != type) {
-        DEBUG_JSON("unexpected JSON type: wanted %c, got %c", type, (json)->type);
+void json_obj_append_static(json_t *json, char *key, json_t *child) {
+    json_assert_type(json, JSON_TYPE_OBJ);
+
+    if (!json->len) {
+        json->flags |= JSON_FLAG_STATIC_KEYS;
     }
-}
 
-json_t *json_null_new() {
-    json_t *json = malloc(sizeof(json_t));
-    json->type = JSON_TYPE_NULL;
-    
-    return json;
+    obj_append(json, key, child);
 }
 
-json_t *json_bool_new(bool value) {
-    json_t *json = malloc(sizeof(json_t));
-    json->type = JSON_TYPE_BOOL;
-    json->bool_value = value;
+char *json_obj_key_at(json_t *json, uint32 index) {
+    json_assert_type(json, JSON_TYPE_OBJ);
 
-    return json;
+    return json->keys[index];
 }
 
-bool json_bool_get(json_t *json) {
-    json_assert_type(json, JSON_TYPE_BOOL);
+json_t *json_obj_value_at(json_t *json, uint32 index) {
+    json_assert_type(json, JSON_TYPE_OBJ);
 
-    return json->bool_value;
+    return json->children[index];
 }
 
-json_t *json_int_new(int value) {
-    json_t *json = malloc(sizeof(json_t));
-    json->type = JSON_TYPE_INT;
-    json->int_value = value;
-
-    return json;
+json_t *json_obj_pop_at(json_t *json, uint32 index) {
+    return json_obj_pop_key(json, json->keys[index]);
 }
 
-int32 json_int_get(json_t *json) {
-    json_assert_type(json, JSON_TYPE_INT);
+uint32 json_obj_get_len(json_t *json) {
+    json_assert_type(json, JSON_TYPE_OBJ);
 
-    return json->int_value;
+    return json->len;
 }
 
-json_t *json_double_new(double value) {
-    json_t *json = malloc(sizeof(json_t));
-    json->type = JSON_TYPE_DOUBLE;
-    json->double_value = value;
+void json_writer_init(json_writer_t *writer, uint16 chunk_size, json_writer_flush_t flush, void *flush_arg) {
+    memset(writer, 0, sizeof(json_writer_t));
+    writer->chunk_size = chunk_size;
+    writer->flush = flush;
+    writer->flush_arg = flush_arg;
+}
 
-    return json;
+void json_writer_raw(json_writer_t *writer, uint8 *data, int len) {
+    writer_put(writer, data, len);
 }
 
-double json_double_get(json_t *json) {
-    json_assert_type(json, JSON_TYPE_DOUBLE);
+void json_writer_begin_obj(json_writer_t *writer) {
+    writer_begin_value(writer);
+    writer_put(writer, (uint8 *) "{", 1);
+    if (++writer->level < JSON_WRITER_MAX_LEVEL) {
+        writer->comma_mask &= ~(1UL << writer->level);
+    }
+}
 
-    return json->double_value;
+void json_writer_end_obj(json_writer_t *writer) {
+    writer->level--;
+    writer_put(writer, (uint8 *) "}", 1);
 }
 
-json_t *json_str_new(char *value) {
-    json_t *json = malloc(sizeof(json_t));
-    json->type = JSON_TYPE_STR;
-    json->str_value = (void *) strdup(value);
+void json_writer_begin_list(json_writer_t *writer) {
+    writer_begin_value(writer);
+    writer_put(writer, (uint8 *) "[", 1);
+    if (++writer->level < JSON_WRITER_MAX_LEVEL) {
+        writer->comma_mask &= ~(1UL << writer->level);
+    }
+}
 
-    return json;
+void json_writer_end_list(json_writer_t *writer) {
+    writer->level--;
+    writer_put(writer, (uint8 *) "]", 1);
 }
 
-char *json_str_get(json_t *json) {
-    json_assert_type(json, JSON_TYPE_STR);
+void json_writer_key(json_writer_t *writer, char *key) {
+    writer_begin_value(writer);
+    writer_put_str(writer, key);
+    writer_put(writer, (uint8 *) ":", 1);
+    writer->after_key = TRUE;
+}
 
-    return json->str_value;
+void json_writer_null(json_writer_t *writer) {
+    writer_begin_value(writer);
+    writer_put(writer, (uint8 *) "null", 4);
 }
 
-json_t *json_list_new() {
-    json_t *json = malloc(sizeof(json_t));
-    json->type = JSON_TYPE_LIST;
+void json_writer_bool(json_writer_t *writer, bool value) {
+    writer_begin_value(writer);
+    if (value) {
+        writer_put(writer, (uint8 *) "true", 4);
+    }
+    else {
+        writer_put(writer, (uint8 *) "false", 5);
+    }
+}
 
-    json->len = 0;
-    json->children = NULL;
+void json_writer_int(json_writer_t *writer, int32 value) {
+    char s[16];
+    int l = snprintf(s, sizeof(s), "%d", value);
 
-    return json;
+    writer_begin_value(writer);
+    writer_put(writer, (uint8 *) s, l);
 }
 
-void json_list_append(json_t *json, json_t *child) {
-    json_assert_type(json, JSON_TYPE_LIST);
+void json_writer_double(json_writer_t *writer, double value) {
+    char *s = dtostr(value, -1);
 
-    json->children = realloc(json->children, sizeof(json_t *) * (json->len + 1));
-    json->children[(int) json->len++] = child;
+    writer_begin_value(writer);
+    writer_put(writer, (uint8 *) s, strlen(s));
 }
 
-json_t *json_list_value_at(json_t *json, uint32 index) {
-    json_assert_type(json, JSON_TYPE_LIST);
-
-    return json->children[index];
+void json_writer_str(json_writer_t *writer, char *value) {
+    writer_begin_value(writer);
+    writer_put_str(writer, value);
 }
 
-json_t *json_list_pop_at(json_t *json, uint32 index) {
-    json_t *child = json->children[index];
+void json_writer_json(json_writer_t *writer, json_t *json) {
+    int i, n, r;
 
-    for (int i = index; i < json->len - 1; i++) {
-        json->children[i] = json->children[i + 1];
-    }
+    switch (json->type) {
+        case JSON_TYPE_NULL:
+            json_writer_null(writer);
+            break;
 
-    json->len--;
-    if (json->len > 0) {
-        json->children = realloc(json->children, sizeof(json_t *) * json->len);
-    }
-    else {
-        free(json->children);
-        json->children = NULL;
-    }
+        case JSON_TYPE_BOOL:
+            json_writer_bool(writer, json_bool_get(json));
+            break;
 
-    return child;
-}
+        case JSON_TYPE_INT:
+            json_writer_int(writer, json_int_get(json));
+            break;
 
-uint32 json_list_get_len(json_t *json) {
-    json_assert_type(json, JSON_TYPE_LIST);
+        case JSON_TYPE_DOUBLE:
+            json_writer_double(writer, json_double_get(json));
+            break;
 
-    return json->len;
-}
+        case JSON_TYPE_STR:
+            json_writer_str(writer, json_str_get(json));
+            break;
+
+        case JSON_TYPE_LIST:
+            json_writer_begin_list(writer);
+            for (i = 0; i < json->len; i++) {
+                json_writer_json(writer, json->children[i]);
+            }
+            json_writer_end_list(writer);
+
+            break;
+
+        case JSON_TYPE_OBJ:
+            json_writer_begin_obj(writer);
+            for (i = 0; i < json->len; i++) {
+                json_writer_key(writer, json->keys[i]);
+                json_writer_json(writer, json->children[i]);
+            }
+            json_writer_end_obj(writer);
+
+            break;
+
+        case JSON_TYPE_STRINGIFIED:
+            writer_begin_value(writer);
+
+            n = json->len / STRINGIFIED_CHUNK_SIZE;
+            r = json->len % STRINGIFIED_CHUNK_SIZE;
+            for (i = 0; i < n; i++) {
+                writer_put(writer, (uint8 *) json->chunks[i], STRINGIFIED_CHUNK_SIZE);
+            }
+            if (r) {
+                writer_put(writer, (uint8 *) json->chunks[i], r);
+            }
+
+            break;
+
+        case JSON_TYPE_MEMBERS_FREED:
+            DEBUG_JSON("cannot write JSON with freed members");
+            break;
+    }
+}
+
+uint32 json_writer_finish(json_writer_t *writer) {
+    if (writer->chunk_len) {
+        writer->flush(writer->chunk, writer->chunk_len, writer->flush_arg);
+    }
+    else {
+        free(writer->chunk);
+    }
+
+    writer->chunk = NULL;
+    writer->chunk_len = 0;
+
+    return writer->len;
+}
+
+
+void writer_put(json_writer_t *writer, uint8 *data, int len) {
+    int l;
+    while (len > 0) {
+        if (!writer->chunk) {
+            writer->chunk = malloc(writer->chunk_size);
+            writer->chunk_len = 0;
+        }
+
+        l = writer->chunk_size - writer->chunk_len;
+        if (l > len) {
+            l = len;
+        }
+
+        memcpy(writer->chunk + writer->chunk_len, data, l);
+        writer->chunk_len += l;
+        writer->len += l;
+        data += l;
+        len -= l;
+
+        if (writer->chunk_len == writer->chunk_size) {
+            writer->flush(writer->chunk, writer->chunk_len, writer->flush_arg);
+            writer->chunk = NULL;
+            writer->chunk_len = 0;
+        }
+    }
+}
+
+void writer_put_str(json_writer_t *writer, char *s) {
+    /* Plain runs of characters are written at once, in between escaped ones */
+    char *run = s, c, escaped[2] = {'\\', 0};
+    writer_put(writer, (uint8 *) "\"", 1);
+    while ((c = *s)) {
+        switch (c) {
+            case '"':
+            case '\\':
+                escaped[1] = c;
+                break;
+
+            case '\b':
+                escaped[1] = 'b';
+                break;
+
+            case '\f':
+                escaped[1] = 'f';
+                break;
+
+            case '\n':
+                escaped[1] = 'n';
+                break;
+
+            case '\r':
+                escaped[1] = 'r';
+                break;
+
+            case '\t':
+                escaped[1] = 't';
+                break;
+
+            default:
+                s++;
+                continue;
+        }
+
+        writer_put(writer, (uint8 *) run, s - run);
+        writer_put(writer, (uint8 *) escaped, 2);
+        run = ++s;
+    }
+
+    writer_put(writer, (uint8 *) run, s - run);
+    writer_put(writer, (uint8 *) "\"", 1);
+}
+
+void writer_begin_value(json_writer_t *writer) {
+    /* Values following a key are never preceded by a comma; others are, unless they're first on their level */
+    if (writer->after_key) {
+        writer->after_key = FALSE;
+        return;
+    }
+
+    if (writer->level >= JSON_WRITER_MAX_LEVEL) {
+        return;
+    }
+
+    uint32 bit = 1UL << writer->level;
+    if (writer->comma_mask & bit) {
+        writer_put(writer, (uint8 *) ",", 1);
+    }
+    writer->comma_mask |= bit;
+}
+
+json_t *parse(char *input, bool in_situ) {
+    char c, c2;
+    char s[JSON_MAX_VALUE_LEN + 1], *d;
+    bool end_found, point_seen, waiting_elem = TRUE;
+    uint32 i, sl, pos = 0, keys_seen = 0;
+    uint32 length = strlen(input);
+    ctx_t *ctx = ctx_new(input);
+    json_t *json, *root = NULL;
+    arena_t arena;
+    uint32 depth;
+
+    /* Remove all whitespace at the end of input */
+    while (length > 0 && isspace((int) input[length - 1])) {
+        length--;
+    }
+
+    if (in_situ) {
+        /* Size the arena exactly, by counting elements beforehand, so that it takes one single allocation */
+        memset(&arena, 0, sizeof(arena_t));
+        count_elements(input, length, &arena.nodes_count, &arena.keys_count, &depth);
+        if (arena.nodes_count) {
+            /* Objects large enough to be indexed have room for their order after their keys; orders take at most two
+             * bytes per key, plus padding to a key pointer for each such object */
+            uint32 keys_size = arena.keys_count + arena.keys_count * sizeof(uint16) / sizeof(char *) + 1 +
+                               arena.keys_count / (JSON_OBJ_INDEX_MIN_LEN + 1);
+            arena.nodes = malloc(
+                sizeof(json_t) * arena.nodes_count +
+                sizeof(json_t *) * (arena.nodes_count - 1) +
+                sizeof(char *) * keys_size
+            );
+            arena.children = (json_t **) (arena.nodes + arena.nodes_count);
+            arena.keys = (char **) (arena.children + arena.nodes_count - 1);
+
+            /* A scalar root still takes one stack item */
+            if (!depth) {
+                depth = 1;
+            }
+            arena.members = malloc(sizeof(member_t) * arena.nodes_count + sizeof(stack_t) * depth);
+            ctx->stack = (stack_t *) (arena.members + arena.nodes_count);
+        }
+
+        ctx->arena = &arena;
+    }
+
+    while (pos < length) {
+        c = input[pos];
+
+        /* If root already popped, we don't expect any more characters */
+        if (root) {
+            DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
+            json_free(root);
+            ctx_free(ctx);
+            return NULL;
+        }
+
+        switch (c) {
+            case '{':
+                if (!waiting_elem) {
+                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
+                    ctx_free(ctx);
+                    return NULL;
+                }
+
+                if (!(json = ctx_new_node(ctx, JSON_TYPE_OBJ))) {
+                    ctx_free(ctx);
+                    return NULL;
+                }
+
+                ctx_push(ctx, json);
+
+                /* Waiting for a key, not an element */
+                waiting_elem = FALSE;
+
+                pos++;
+                break;
+
+            case '}':
+                json = ctx_get_current(ctx);
+                if (!json || json_get_type(json) != JSON_TYPE_OBJ ||
+                    (waiting_elem && json_obj_get_len(json) > 0) || ctx_has_key(ctx)) {
+
+                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
+                    ctx_free(ctx);
+                    return NULL;
+                }
+
+                waiting_elem = FALSE;
+                root = ctx_pop(ctx);
+                pos++;
+                break;
+
+            case '[':
+                if (!waiting_elem) {
+                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
+                    ctx_free(ctx);
+                    return NULL;
+                }
+
+                if (!(json = ctx_new_node(ctx, JSON_TYPE_LIST))) {
+                    ctx_free(ctx);
+                    return NULL;
+                }
+
+                ctx_push(ctx, json);
+                pos++;
+                break;
+
+            case ']':
+                json = ctx_get_current(ctx);
+                if (!json || json_get_type(json) != JSON_TYPE_LIST ||
+                    (waiting_elem && json_list_get_len(json) > 0)) {
+
+                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
+                    ctx_free(ctx);
+                    return NULL;
+                }
+
+                waiting_elem = FALSE;
+                root = ctx_pop(ctx);
+                pos++;
+                break;
+
+            case ',':
+                json = ctx_get_current(ctx);
+                if (!json || waiting_elem) {
+                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
+                    ctx_free(ctx);
+                    return NULL;
+                }
+
+                if (json_get_type(json) == JSON_TYPE_LIST) {
+                    waiting_elem = TRUE;
+                }
+
+                pos++;
+                break;
+
+            case ':':
+                json = ctx_get_current(ctx);
+                if (!json || json_get_type(json) != JSON_TYPE_OBJ || !ctx_has_key(ctx) || waiting_elem) {
+                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
+                    ctx_free(ctx);
+                    return NULL;
+                }
+
+                waiting_elem = TRUE;
+
+                pos++;
+                break;
+
+            case ' ':
+            case '\b':
+            case '\f':
+            case '\n':
+            case '\r':
+            case '\t':
+                /* Skip whitespace */
+                pos++;
+                break;
+
+            case '"':
+                /* Parse a string, which can be either a standalone string element or an object key */
+
+                json = ctx_get_current(ctx);
+                if (json && json_get_type(json) == JSON_TYPE_OBJ) {
+                    if (ctx_has_key(ctx) != waiting_elem) {
+                        DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
+                        ctx_free(ctx);
+                        return NULL;
+                    }
+                }
+                else { /* No parent or not an object */
+                    if (!waiting_elem) {
+                        DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
+                        ctx_free(ctx);
+                        return NULL;
+                    }
+                }
+
+                waiting_elem = FALSE;
+
+                /* In situ, strings are unescaped right where they are, as they never get longer than in input */
+                i = ++pos;
+                d = in_situ ? input + pos : s;
+                sl = 0;
+                end_found = FALSE;
+                for (i = pos; !end_found && (i < length); i++) {
+                    c = input[i];
+                    switch (c) {
+                        case '\\':
+                            /* Escape codes */
+                            if (i < length - 1) {
+                                c2 = input[i + 1];
+                                i++;
+                                switch (c2) {
+                                    case 'b':
+                                        c = '\b';
+                                        break;
+
+                                    case 'f':
+                                        c = '\f';
+                                        break;
+
+                                    case 'n':
+                                        c = '\n';
+                                        break;
+
+                                    case 'r':
+                                        c = '\r';
+                                        break;
+
+                                    case 't':
+                                        c = '\t';
+                                        break;
+
+                                    case '"':
+                                        c = '"';
+                                        break;
+
+                                    case '\\':
+                                        c = '\\';
+                                        break;
+                                }
+                            }
+
+                            /* Unknown escape codes and a backslash ending the input are kept as a backslash */
+                            if (sl < JSON_MAX_VALUE_LEN) {
+                                d[sl++] = c;
+                            }
+
+                            break;
+
+                        case '"':
+                            /* String end */
+                            pos = i + 1;
+                            end_found = TRUE;
+                            break;
+
+                        default:
+                            /* Regular character inside string */
+                            if (sl < JSON_MAX_VALUE_LEN) {
+                                d[sl++] = c;
+                            }
+                    }
+                }
+
+                if (!end_found) {
+                    DEBUG_JSON("unterminated string at pos %d", pos);
+                    ctx_free(ctx);
+                    return NULL;
+                }
+
+                d[sl] = 0;
+
+                json = ctx_get_current(ctx);
+                if (json && json_get_type(json) == JSON_TYPE_OBJ && !ctx_has_key(ctx)) { /* String is a key */
+                    if (in_situ && keys_seen++ >= arena.keys_count) {
+                        DEBUG_JSON("unexpected key at pos %d", pos);
+                        ctx_free(ctx);
+                        return NULL;
+                    }
+
+                    ctx_set_key(ctx, d);
+                }
+                else if (!json || json_get_type(json) == JSON_TYPE_OBJ || json_get_type(json) == JSON_TYPE_LIST) {
+                    if (!(json = ctx_new_str(ctx, d))) {
+                        ctx_free(ctx);
+                        return NULL;
+                    }
+
+                    ctx_add(ctx, json);
+                }
+                else {
+                    DEBUG_JSON("unexpected string at pos %d", pos);
+                    ctx_free(ctx);
+                    return NULL;
+                }
+
+                break;
+
+            default:
+                /* null, true, false, a number or unexpected character */
+
+                json = ctx_get_current(ctx);
+                if ((json && json_get_type(json) == JSON_TYPE_OBJ && !ctx_has_key(ctx)) || !waiting_elem) {
+                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
+                    ctx_free(ctx);
+                    return NULL;
+                }
+
+                waiting_elem = FALSE;
+
+                if ((c >= '0' && c <= '9') || (c == '-')) {
+                    /* number */
+                    i = pos;
+                    if (c == '-') {
+                        i++;
+                    }
+
+                    point_seen = FALSE; /* One single point allowed in numerals */
+                    while (i < length) {
+                        c = input[i];
+                        if (c == '.') {
+                            if (point_seen) {
+                                break;
+                            }
+                            else {
+                                point_seen = TRUE;
+                            }
+                        }
+                        else if (c < '0' || c > '9') {
+                            break;
+                        }
+
+                        i++;
+                    }
+
+                    if (!(json = ctx_new_node(ctx, point_seen ? JSON_TYPE_DOUBLE : JSON_TYPE_INT))) {
+                        ctx_free(ctx);
+                        return NULL;
+                    }
+
+                    strncpy(s, input + pos, i - pos + 1);
+                    s[i - pos] = 0;
+                    if (point_seen) { /* floating point */
+                        json->double_value = strtod(s, NULL);
+                    }
+                    else { /* integer */
+                        json->int_value = strtol(s, NULL, 10);
+                    }
+                    ctx_add(ctx, json);
+                    pos = i;
+                }
+                else if (!strncmp(input + pos, "null", 4)) {
+                    if (!(json = ctx_new_node(ctx, JSON_TYPE_NULL))) {
+                        ctx_free(ctx);
+                        return NULL;
+                    }
 
-json_t *json_obj_lookup_key(json_t *json, char *key) {
-    json_assert_type(json, JSON_TYPE_OBJ);
+                    ctx_add(ctx, json);
+                    pos += 4;
+                }
+                else if (!strncmp(input + pos, "false", 5) || !strncmp(input + pos, "true", 4)) {
+                    if (!(json = ctx_new_node(ctx, JSON_TYPE_BOOL))) {
+                        ctx_free(ctx);
+                        return NULL;
+                    }
 
-    int i;
-    for (i = 0; i < json->len; i++) {
-        if (!strcmp(key, json->keys[i])) {
-            return json->children[i];
+                    json->bool_value = (c == 't');
+                    ctx_add(ctx, json);
+                    pos += json->bool_value ? 4 : 5;
+                }
+                else {
+                    DEBUG_JSON("unexpected character \"%c\" at pos %d", c, pos);
+                    ctx_free(ctx);
+                    return NULL;
+                }
         }
     }
 
-    return NULL;
-}
+    if (!root) {
+        if (ctx_get_size(ctx) < 1) {
+            DEBUG_JSON("empty input");
+            ctx_free(ctx);
+            return NULL;
+        }
 
-json_t *json_obj_pop_key(json_t *json, char *key) {
-    json_assert_type(json, JSON_TYPE_OBJ);
+        if (ctx_get_size(ctx) > 1) {
+            DEBUG_JSON("unbalanced brackets");
+            ctx_free(ctx);
+            return NULL;
+        }
 
-    int i, p = -1;
-    for (i = 0; i < json->len; i++) {
-        if (!strcmp(key, json->keys[i])) {
-            p = i;
-            break;
+        root = ctx_pop(ctx);
+        if (json_get_type(root) == JSON_TYPE_LIST || json_get_type(root) == JSON_TYPE_OBJ) {
+            /* List and object roots should have already been popped as soon as closing brackets were encountered */
+            json_free(root);
+            DEBUG_JSON("unbalanced brackets");
+            ctx_free(ctx);
+            return NULL;
         }
     }
 
-    if (p < 0) {
+    if (json_get_type(root) == JSON_TYPE_OBJ && ctx_has_key(ctx)) {
+        DEBUG_JSON("expected element at pos %d", pos);
+        ctx_free(ctx);
         return NULL;
     }
 
-    json_t *child = json->children[p];
-    free(json->keys[p]);
-
-    for (i = p; i < json->len - 1; i++) {
-        json->children[i] = json->children[i + 1];
-        json->keys[i] = json->keys[i + 1];
-    }
-
-    json->len--;
-    if (json->len > 0) {
-        json->children = realloc(json->children, sizeof(json_t *) * json->len);
-        json->keys = realloc(json->keys, sizeof(char *) * json->len);
-    }
-    else {
-        free(json->children);
-        free(json->keys);
-
-        json->children = NULL;
-        json->keys = NULL;
+    if (in_situ) {
+        /* The arena now belongs to the root */
+        root->flags |= JSON_FLAG_ARENA_ROOT;
+        arena.nodes = NULL;
     }
 
-    return child;
-}
-
-json_t *json_obj_new() {
-    json_t *json = malloc(sizeof(json_t));
-    json->type = JSON_TYPE_OBJ;
-
-    json->len = 0;
-    json->keys = NULL;
-    json->children = NULL;
-
-    return json;
-}
-
-void json_obj_append(json_t *json, char *key, json_t *child) {
-    json_assert_type(json, JSON_TYPE_OBJ);
+    ctx_free(ctx);
 
-    json->children = realloc(json->children, sizeof(json_t *) * (json->len + 1));
-    json->keys = realloc(json->keys, sizeof(char *) * (json->len + 1));
-    json->keys[(int) json->len] = strdup(key);
-    json->children[(int) json->len++] = child;
+    return root;
 }
 
-char *json_obj_key_at(json_t *json, uint32 index) {
-    json_assert_type(json, JSON_TYPE_OBJ);
-
-    return json->keys[index];
-}
+void count_elements(char *input, uint32 length, uint32 *nodes_count, uint32 *keys_count, uint32 *depth) {
+    /* Splits input the way parse() does, only without validating it; counts are therefore exact for valid input,
+     * while invalid input, that may be miscounted, is rejected by parse() anyway */
+    bool point_seen;
+    uint32 pos = 0;
+    int level = 0;
+    char c;
 
-json_t *json_obj_value_at(json_t *json, uint32 index) {
-    json_assert_type(json, JSON_TYPE_OBJ);
+    *nodes_count = 0;
+    *keys_count = 0;
+    *depth = 0;
 
-    return json->children[index];
-}
+    while (pos < length) {
+        c = input[pos++];
 
-json_t *json_obj_pop_at(json_t *json, uint32 index) {
-    return json_obj_pop_key(json, json->keys[index]);
-}
+        if (c == '{' || c == '[') {
+            (*nodes_count)++;
+            if (++level > (int) *depth) {
+                *depth = level;
+            }
+        }
+        else if (c == '}' || c == ']') {
+            level--;
+        }
+        else if (c == '"') {
+            while (pos < length && input[pos] != '"') {
+                if (input[pos] == '\\') {
+                    pos++;
+                }
+                pos++;
+            }
+            pos++;
 
-uint32 json_obj_get_len(json_t *json) {
-    json_assert_type(json, JSON_TYPE_OBJ);
+            /* A string followed by a colon is an object key */
+            while (pos < length && (input[pos] == ' ' || input[pos] == '\b' || input[pos] == '\f' ||
+                                    input[pos] == '\n' || input[pos] == '\r' || input[pos] == '\t')) {
+                pos++;
+            }
+            if (pos < length && input[pos] == ':') {
+                (*keys_count)++;
+            }
+            else {
+                (*nodes_count)++;
+            }
+        }
+        else if ((c >= '0' && c <= '9') || (c == '-')) {
+            (*nodes_count)++;
+
+            point_seen = FALSE;
+            while (pos < length) {
+                c = input[pos];
+                if (c == '.') {
+                    if (point_seen) {
+                        break;
+                    }
+                    point_seen = TRUE;
+                }
+                else if (c < '0' || c > '9') {
+                    break;
+                }
 
-    return json->len;
+                pos++;
+            }
+        }
+        else if (!strncmp(input + pos - 1, "null", 4) || !strncmp(input + pos - 1, "true", 4)) {
+            (*nodes_count)++;
+            pos += 3;
+        }
+        else if (!strncmp(input + pos - 1, "false", 5)) {
+            (*nodes_count)++;
+            pos += 4;
+        }
+    }
 }
 
-
 void json_dump_rec(json_t *json, char **output, int *len, int *size, uint8 free_mode) {
     int i, l, n, r;
     char s[32], *s2, c;
+
+    if ((json->flags & JSON_FLAG_ARENA) && free_mode != JSON_FREE_NOTHING) {
+        /* Members of JSON parsed in situ can't be freed individually */
+        json_dump_rec(json, output, len, size, JSON_FREE_NOTHING);
+        if (free_mode >= JSON_FREE_EVERYTHING) {
+            json_free(json);
+        }
+
+        return;
+    }
     
     switch (json->type) {
         case JSON_TYPE_NULL:
@@ -981,7 +1461,7 @@ void json_dump_rec(json_t *json, char **output, int *len, int *size, uint8 free_
                     (*output)[(*len)++] = ',';
                 }
 
-                if (free_mode >= JSON_FREE_MEMBERS) {
+                if (free_mode >= JSON_FREE_MEMBERS && !(json->flags & JSON_FLAG_STATIC_KEYS)) {
                     free(json->keys[i]);
                 }
             }
@@ -1060,16 +1540,228 @@ void json_dump_rec(json_t *json, char **output, int *len, int *size, uint8 free_
     }
 }
 
+void obj_append(json_t *json, char *key, json_t *child) {
+    if (json->flags & JSON_FLAG_ARENA) {
+        DEBUG_JSON("cannot append to JSON parsed in situ");
+        json_free(child);
+        return;
+    }
+
+    if (json->len >= json->capacity && !grow(json)) {
+        DEBUG_JSON("cannot append beyond %d members", 0xFFFF);
+        json_free(child);
+        return;
+    }
+
+    json->keys[(int) json->len] = (json->flags & JSON_FLAG_STATIC_KEYS) ? key : strdup(key);
+    if (json->flags & JSON_FLAG_INDEXED) {
+        order_insert(json, json->len);
+    }
+
+    json->children[(int) json->len++] = child;
+}
+
+void own_keys(json_t *json) {
+    /* Keys of an object are either all static or all owned, so a first owned key means duplicating the static ones */
+    for (int i = 0; i < json->len; i++) {
+        json->keys[i] = strdup(json->keys[i]);
+    }
+
+    json->flags &= ~JSON_FLAG_STATIC_KEYS;
+}
+
+void set_capacity(json_t *json, uint16 capacity) {
+    if (json->flags & JSON_FLAG_INDEXED) {
+        if (ORDER_LEN(capacity)) {
+            /* The order follows the keys, so it has to be moved along with their end */
+            if (capacity < json->capacity) {
+                memmove(json->keys + capacity, get_order(json), sizeof(uint16) * json->len);
+            }
+        }
+        else {
+            json->flags &= ~JSON_FLAG_INDEXED;
+        }
+    }
+
+    if (capacity) {
+        json->children = realloc(json->children, sizeof(json_t *) * capacity);
+        if (json->type == JSON_TYPE_OBJ) {
+            json->keys = realloc(json->keys, sizeof(char *) * (capacity + ORDER_SIZE(capacity)));
+            if ((json->flags & JSON_FLAG_INDEXED) && capacity > json->capacity) {
+                memmove(json->keys + capacity, get_order(json), sizeof(uint16) * json->len);
+            }
+        }
+    }
+    else {
+        free(json->children);
+        json->children = NULL;
+        if (json->type == JSON_TYPE_OBJ) {
+            free(json->keys);
+            json->keys = NULL;
+        }
+    }
+
+    json->capacity = capacity;
+}
+
+bool grow(json_t *json) {
+    if (json->capacity >= 0xFFFF) {
+        return FALSE; /* Lengths are 16-bit, so there's no room for another member */
+    }
+
+    /* Doubling the capacity takes a logarithmic number of reallocations, instead of one per appended member */
+    uint32 capacity = json->capacity ? json->capacity * 2 : JSON_MIN_CAPACITY;
+    if (capacity > 0xFFFF) {
+        capacity = 0xFFFF;
+    }
+
+    set_capacity(json, capacity);
+
+    return TRUE;
+}
+
+int find_key(json_t *json, char *key) {
+    int i;
+
+    if (json->len > JSON_OBJ_INDEX_MIN_LEN) {
+        if (!(json->flags & JSON_FLAG_INDEXED)) {
+            order_build(json);
+        }
+
+        uint16 *order = get_order(json);
+        i = order_search(json, key, json->len, /* after_equal = */ FALSE);
+        if (i < json->len && !strcmp(key, json->keys[order[i]])) {
+            return order[i];
+        }
+
+        return -1;
+    }
+
+    for (i = 0; i < json->len; i++) {
+        if (!strcmp(key, json->keys[i])) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+uint16 *get_order(json_t *json) {
+    return (uint16 *) (json->keys + json->capacity);
+}
+
+uint16 order_search(json_t *json, char *key, uint16 len, bool after_equal) {
+    /* Binary search among the first len ordered members, for the position of key, before or after equal keys */
+    uint16 *order = get_order(json);
+    uint16 lo = 0, hi = len, mid;
+    int cmp;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        cmp = strcmp(json->keys[order[mid]], key);
+        if (cmp < 0 || (after_equal && !cmp)) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+void order_build(json_t *json) {
+    /* Members with equal keys stay in their order, so that the first one is found, as when scanning */
+    uint16 *order = get_order(json);
+    uint16 i, p;
+
+    for (i = 0; i < json->len; i++) {
+        p = order_search(json, json->keys[i], i, /* after_equal = */ TRUE);
+        memmove(order + p + 1, order + p, sizeof(uint16) * (i - p));
+        order[p] = i;
+    }
+
+    json->flags |= JSON_FLAG_INDEXED;
+}
+
+void order_insert(json_t *json, uint16 index) {
+    uint16 *order = get_order(json);
+    uint16 p = order_search(json, json->keys[index], json->len, /* after_equal = */ TRUE);
+
+    memmove(order + p + 1, order + p, sizeof(uint16) * (json->len - p));
+    order[p] = index;
+}
+
+void order_remove(json_t *json, uint16 index) {
+    uint16 *order = get_order(json);
+    uint16 i, p = order_search(json, json->keys[index], json->len, /* after_equal = */ FALSE);
+
+    while (order[p] != index) {
+        p++;
+    }
+
+    memmove(order + p, order + p + 1, sizeof(uint16) * (json->len - p - 1));
+
+    /* Members following the removed one move back by one */
+    for (i = 0; i < json->len - 1; i++) {
+        if (order[i] > index) {
+            order[i]--;
+        }
+    }
+}
+
 ctx_t *ctx_new(char *input) {
     return zalloc(sizeof(ctx_t));
 }
 
+json_t *ctx_new_node(ctx_t *ctx, char type) {
+    json_t *json;
+    arena_t *arena = ctx->arena;
+
+    if (arena) {
+        if (arena->nodes_len >= arena->nodes_count) {
+            DEBUG_JSON("unexpected element");
+            return NULL;
+        }
+
+        json = arena->nodes + arena->nodes_len++;
+        json->flags = JSON_FLAG_ARENA;
+    }
+    else {
+        json = malloc(sizeof(json_t));
+        json->flags = 0;
+    }
+
+    json->type = type;
+    json->len = 0;
+    json->capacity = 0;
+    json->keys = NULL;
+    json->children = NULL;
+
+    return json;
+}
+
+json_t *ctx_new_str(ctx_t *ctx, char *value) {
+    json_t *json = ctx_new_node(ctx, JSON_TYPE_STR);
+    if (json) {
+        json->str_value = ctx->arena ? value : strdup(value);
+    }
+
+    return json;
+}
+
 void ctx_set_key(ctx_t *ctx, char *key) {
     if (ctx->stack_size < 1) {
         return;
     }
 
     stack_t *stack_item = ctx->stack + (ctx->stack_size - 1);
+    if (ctx->arena) {
+        /* Keys parsed in situ are left where they are */
+        stack_item->key = key;
+        return;
+    }
+
     free(stack_item->key);
     stack_item->key = NULL;
 
@@ -1097,19 +1789,39 @@ bool ctx_add(ctx_t *ctx, json_t *json) {
     }
 
     json_t *current = ctx->stack[ctx->stack_size - 1].json;
+    member_t *member = NULL;
+    if (ctx->arena) {
+        /* Members are moved into the arena only when their container is closed, and their count is known */
+        member = ctx->arena->members + ctx->arena->members_len;
+    }
+
     if (current->type == JSON_TYPE_LIST) {
         if (ctx_has_key(ctx)) {
             return FALSE; /* Refuse to add to list if key is set */
         }
 
-        json_list_append(current, json);
+        if (member) {
+            member->json = json;
+            member->key = NULL;
+            ctx->arena->members_len++;
+        }
+        else {
+            json_list_append(current, json);
+        }
     }
     else if (current->type == JSON_TYPE_OBJ) {
         if (!ctx_has_key(ctx)) {
             return FALSE; /* Refuse to add to object if key is unset */
         }
 
-        json_obj_append(current, ctx_get_key(ctx), json);
+        if (member) {
+            member->json = json;
+            member->key = ctx_get_key(ctx);
+            ctx->arena->members_len++;
+        }
+        else {
+            json_obj_append(current, ctx_get_key(ctx), json);
+        }
         ctx_clear_key(ctx);
     }
     else {
@@ -1120,9 +1832,16 @@ bool ctx_add(ctx_t *ctx, json_t *json) {
 }
 
 void ctx_push(ctx_t *ctx, json_t *json) {
-    ctx->stack = realloc(ctx->stack, sizeof(stack_t) * (++ctx->stack_size));
+    /* In situ, the stack is allocated beforehand, as deep as input goes */
+    if (ctx->arena) {
+        ctx->stack_size++;
+    }
+    else {
+        ctx->stack = realloc(ctx->stack, sizeof(stack_t) * (++ctx->stack_size));
+    }
     ctx->stack[ctx->stack_size - 1].json = json;
     ctx->stack[ctx->stack_size - 1].key = NULL;
+    ctx->stack[ctx->stack_size - 1].first_member = ctx->arena ? ctx->arena->members_len : 0;
 }
 
 json_t *ctx_pop(ctx_t *ctx) {
@@ -1130,19 +1849,56 @@ json_t *ctx_pop(ctx_t *ctx) {
         return NULL; /* Shouldn't happen */
     }
 
+    arena_t *arena = ctx->arena;
+    stack_t *stack_item = ctx->stack + (ctx->stack_size - 1);
+    json_t *current = stack_item->json;
+    if (arena && (current->type == JSON_TYPE_LIST || current->type == JSON_TYPE_OBJ)) {
+        /* Move the members of the closed container into the arena, right after those of previously closed ones */
+        member_t *members = arena->members + stack_item->first_member;
+        uint32 i, count = arena->members_len - stack_item->first_member;
+
+        current->children = arena->children + arena->children_len;
+        arena->children_len += count;
+        if (current->type == JSON_TYPE_OBJ) {
+            current->keys = arena->keys + arena->keys_len;
+            arena->keys_len += count + ORDER_SIZE(count);
+        }
+
+        for (i = 0; i < count; i++) {
+            current->children[i] = members[i].json;
+            if (current->type == JSON_TYPE_OBJ) {
+                current->keys[i] = members[i].key;
+            }
+        }
+
+        current->len = current->capacity = count;
+        arena->members_len = stack_item->first_member;
+    }
+    else if ((current->type == JSON_TYPE_LIST || current->type == JSON_TYPE_OBJ) && current->capacity > current->len) {
+        /* Parsed containers are complete, so they don't need any more room; their members already have been trimmed
+         * as they were closed */
+        set_capacity(current, current->len);
+    }
+
     if (ctx->stack_size == 1) {
         /* When popping root element, return it */
         ctx->stack_size--;
         json_t *root = ctx->stack[0].json;
-        free(ctx->stack[0].key);
-        free(ctx->stack);
-        ctx->stack = NULL;
+        if (!arena) {
+            free(ctx->stack[0].key);
+            free(ctx->stack);
+            ctx->stack = NULL;
+        }
 
         return root;
     }
 
-    json_t *current = ctx->stack[ctx->stack_size - 1].json;
-    ctx->stack = realloc(ctx->stack, sizeof(stack_t) * (--ctx->stack_size));
+    if (arena) {
+        ctx->stack_size--;
+    }
+    else {
+        ctx->stack = realloc(ctx->stack, sizeof(stack_t) * (--ctx->stack_size));
+    }
 
     /* Add popped element to parent */
     ctx_add(ctx, current);
@@ -1152,7 +1908,12 @@ json_t *ctx_pop(ctx_t *ctx) {
 }
 
 void ctx_free(ctx_t *ctx) {
-    if (ctx->stack_size) {
+    if (ctx->arena) {
+        /* Elements and keys all live in the arena, unless it has been handed over to the root */
+        free(ctx->arena->nodes);
+        free(ctx->arena->members);
+    }
+    else if (ctx->stack_size) {
         /* Will free all JSON elements in hierarchy */
         json_free(ctx->stack[0].json);
 
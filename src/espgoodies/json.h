@@ -41,6 +41,16 @@
 #define JSON_FREE_MEMBERS       1
 #define JSON_FREE_EVERYTHING    2
 
+#define JSON_WRITER_MAX_LEVEL   32
+
+#define JSON_MIN_CAPACITY       4       /* Members of lists and objects, allocated with their first member */
+#define JSON_OBJ_INDEX_MIN_LEN  8       /* Objects with more keys are looked up through a sorted index of their keys */
+
+#define JSON_FLAG_ARENA         0x01    /* Lives in the arena of a document parsed in situ */
+#define JSON_FLAG_ARENA_ROOT    0x02    /* Root of a document parsed in situ, owning its arena */
+#define JSON_FLAG_INDEXED       0x04    /* Object whose key index has been built, and is kept up to date */
+#define JSON_FLAG_STATIC_KEYS   0x08    /* Object whose keys are all stored by pointer, and never freed */
+
 #if defined(_DEBUG) && defined(_DEBUG_JSON)
 #define DEBUG_JSON(fmt, ...) DEBUG("[json          ] " fmt, ##__VA_ARGS__)
 #else
@@ -66,15 +76,43 @@ typedef struct json {
     };
 
     uint16                len;
+    uint16                capacity;     /* Allocated members of lists and objects */
     char                  type;
+    uint8                 flags;
 
 } json_t;
 
+/* Receives a full (or, at the end, the last) chunk of written JSON text, taking ownership of it */
+typedef void (*json_writer_flush_t)(uint8 *chunk, int len, void *arg);
+
+typedef struct {
+
+    uint8                *chunk;       /* Allocated when first written to */
+    uint16                chunk_size;
+    uint16                chunk_len;
+    uint32                len;         /* Total written length */
+
+    uint32                comma_mask;  /* Levels that already have a value, so that next one needs a comma */
+    uint8                 level;
+    bool                  after_key;
+
+    json_writer_flush_t   flush;
+    void                 *flush_arg;
+
+} json_writer_t;
+
 
 json_t ICACHE_FLASH_ATTR *json_parse(char *input);
+/* Parses input in place, unescaping strings and keys right inside it, and places all elements in one arena, owned by
+ * the root; input must therefore be writable and outlive the returned document. Elements can be read and popped as
+ * usual, but not appended to or stringified; they are all freed at once, by json_free() on the root. */
+json_t ICACHE_FLASH_ATTR *json_parse_in_situ(char *input);
 char   ICACHE_FLASH_ATTR *json_dump(json_t *json, uint8 free_mode);
 char   ICACHE_FLASH_ATTR *json_dump_r(json_t *json, uint8 free_mode);
 void   ICACHE_FLASH_ATTR  json_stringify(json_t *json);
+/* Lists and objects grow geometrically as members are appended; this trims them, along with all their descendants,
+ * to their actual length, for structures that are complete and meant to be kept */
+void   ICACHE_FLASH_ATTR  json_shrink(json_t *json);
 void   ICACHE_FLASH_ATTR  json_free(json_t *json);
 json_t ICACHE_FLASH_ATTR *json_dup(json_t *json);
 
@@ -105,10 +143,38 @@ json_t ICACHE_FLASH_ATTR *json_obj_lookup_key(json_t *json, char *key);
 json_t ICACHE_FLASH_ATTR *json_obj_pop_key(json_t *json, char *key);
 json_t ICACHE_FLASH_ATTR *json_obj_new(void);
 void   ICACHE_FLASH_ATTR  json_obj_append(json_t *json, char *key, json_t *child);
+/* Stores key by pointer, rather than duplicating it; key must therefore be a literal, or otherwise outlive the object.
+ * Appending a regular key to an object duplicates all of its keys from then on. */
+void   ICACHE_FLASH_ATTR  json_obj_append_static(json_t *json, char *key, json_t *child);
 char   ICACHE_FLASH_ATTR *json_obj_key_at(json_t *json, uint32 index);
 json_t ICACHE_FLASH_ATTR *json_obj_value_at(json_t *json, uint32 index);
 json_t ICACHE_FLASH_ATTR *json_obj_pop_at(json_t *json, uint32 index);
 uint32 ICACHE_FLASH_ATTR  json_obj_get_len(json_t *json);
 
+/* The writer produces JSON text straight into chunks of a given size, handing each one over as soon as it fills, so
+ * that large documents don't need to be built as a whole, nor dumped into one contiguous buffer */
+void   ICACHE_FLASH_ATTR  json_writer_init(
+                              json_writer_t *writer,
+                              uint16 chunk_size,
+                              json_writer_flush_t flush,
+                              void *flush_arg
+                          );
+/* Writes data as it is, e.g. protocol headers preceding the JSON text */
+void   ICACHE_FLASH_ATTR  json_writer_raw(json_writer_t *writer, uint8 *data, int len);
+void   ICACHE_FLASH_ATTR  json_writer_begin_obj(json_writer_t *writer);
+void   ICACHE_FLASH_ATTR  json_writer_end_obj(json_writer_t *writer);
+void   ICACHE_FLASH_ATTR  json_writer_begin_list(json_writer_t *writer);
+void   ICACHE_FLASH_ATTR  json_writer_end_list(json_writer_t *writer);
+void   ICACHE_FLASH_ATTR  json_writer_key(json_writer_t *writer, char *key);
+void   ICACHE_FLASH_ATTR  json_writer_null(json_writer_t *writer);
+void   ICACHE_FLASH_ATTR  json_writer_bool(json_writer_t *writer, bool value);
+void   ICACHE_FLASH_ATTR  json_writer_int(json_writer_t *writer, int32 value);
+void   ICACHE_FLASH_ATTR  json_writer_double(json_writer_t *writer, double value);
+void   ICACHE_FLASH_ATTR  json_writer_str(json_writer_t *writer, char *value);
+/* Writes an entire JSON structure as a value; the structure is left untouched */
+void   ICACHE_FLASH_ATTR  json_writer_json(json_writer_t *writer, json_t *json);
+/* Hands over the last, partially filled chunk and returns the total written length */
+uint32 ICACHE_FLASH_ATTR  json_writer_finish(json_writer_t *writer);
+
 
 #endif /* _ESPGOODIES_JSON_H */
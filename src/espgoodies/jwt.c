@@ -46,14 +46,14 @@ void jwt_free(jwt_t *jwt) {
 
 char *jwt_dump(jwt_t *jwt, char *secret) {
     json_t *header = json_obj_new();
-    json_obj_append(header, "typ", json_str_new("JWT"));
+    json_obj_append_static(header, "typ", json_str_new("JWT"));
 
     sign_func_t sign_func;
     int signature_len;
 
     switch (jwt->alg) {
         case JWT_ALG_HS256:
-            json_obj_append(header, "alg", json_str_new("HS256"));
+            json_obj_append_static(header, "alg", json_str_new("HS256"));
             sign_func = hmac_sha256;
             signature_len = SHA256_LEN;
 
@@ -63,7 +63,8 @@ void   ICACHE_FLASH_ATTR system_config_save(void);
 void   ICACHE_FLASH_ATTR system_init(void);
 
 void   ICACHE_FLASH_ATTR system_task_set_handler(system_task_handler_t handler);
-void   ICACHE_FLASH_ATTR system_task_schedule(uint32 task_id, void *param);
+/* Must not be in flash, as it's called from ISRs */
+void                     system_task_schedule(uint32 task_id, void *param);
 
 uint32 ICACHE_FLASH_ATTR system_uptime(void);
 uint64 ICACHE_FLASH_ATTR system_uptime_ms(void);
@@ -26,15 +26,20 @@
 #include "espgoodies/tcpserver.h"
 
 
-#define SEND_PACKET_SIZE 1024
+typedef struct send_buffer {
+
+    uint8              *data;
+    int32               len;
+    int32               offs;
+    struct send_buffer *next;
+
+} send_buffer_t;
 
 typedef struct {
 
-    void  *app_info;
-    uint8 *send_buffer;
-    int32  send_len;
-    int32  send_offs;
-    bool   free_on_sent;
+    void          *app_info;
+    send_buffer_t *send_queue;  /* Buffers that haven't been entirely sent yet, oldest first */
+    bool           sending;     /* A packet has been sent and its sent callback is pending */
 
 } conn_info_t;
 
@@ -50,6 +55,10 @@ static void ICACHE_FLASH_ATTR on_client_sent(void *arg);
 static void ICACHE_FLASH_ATTR on_client_disconnect(void *arg);
 static void ICACHE_FLASH_ATTR on_client_error(void *arg, int8 err);
 
+static void ICACHE_FLASH_ATTR queue_buffer(conn_info_t *info, uint8 *data, int len);
+static bool ICACHE_FLASH_ATTR send_next_packet(struct espconn *conn, conn_info_t *info);
+static void ICACHE_FLASH_ATTR free_send_queue(conn_info_t *info);
+
 
 #if defined(_DEBUG) && defined(_DEBUG_TCPSERVER)
 
@@ -129,44 +138,51 @@ void tcp_send(struct espconn *conn, uint8 *data, int len, bool free_on_sent) {
      * data to such connections is sent, in one shot,
      * assuming its length is not above 1k */
 
-    if (!info && len > SEND_PACKET_SIZE) {
+    if (!info && len > TCP_SEND_PACKET_SIZE) {
         DEBUG_TCPSERVER_CONN(conn, "attempting to send %d bytes to unhandled tcp connection", len);
     }
 
-    if (info && info->send_buffer) {
+    if (info && info->send_queue) {
         DEBUG_TCPSERVER_CONN(conn, "refusing to send to tcp connection with pending data");
         return;
     }
 
-    if (len <= SEND_PACKET_SIZE || !info) {
+    if (len <= TCP_SEND_PACKET_SIZE || !info) {
         DEBUG_TCPSERVER_CONN(conn, "sending a single packet of %d bytes", len);
         espconn_send(conn, data, len);
         if (free_on_sent) {
             free(data);
         }
+        if (info) {
+            info->sending = TRUE;
+        }
 
         return;
     }
 
-    if (free_on_sent) {
-        info->send_buffer = data;
-    }
-    else {
-        info->send_buffer = malloc(len);
-        memcpy(info->send_buffer, data, len);
+    if (!free_on_sent) {
+        uint8 *copy = malloc(len);
+        memcpy(copy, data, len);
+        data = copy;
     }
 
-    info->send_len = len;
-    info->send_offs = SEND_PACKET_SIZE;
-    info->free_on_sent = free_on_sent;
+    queue_buffer(info, data, len);
+    send_next_packet(conn, info);
+}
+
+void tcp_queue(struct espconn *conn, uint8 *data, int len) {
+    conn_info_t *info = conn->reverse;
+    if (!info) {
+        DEBUG_TCPSERVER_CONN(conn, "sending a single packet of %d bytes to unhandled tcp connection", len);
+        espconn_send(conn, data, len);
+        free(data);
 
-    int packet_count = len / SEND_PACKET_SIZE;
-    if (len % SEND_PACKET_SIZE) {
-        packet_count++;
+        return;
     }
-    DEBUG_TCPSERVER_CONN(conn, "sending packet %d/%d (%d/%d bytes)", 1, packet_count, SEND_PACKET_SIZE, len);
-    if (espconn_send(conn, data, SEND_PACKET_SIZE)) {
-        DEBUG_TCPSERVER_CONN(conn, "send failed");
+
+    queue_buffer(info, data, len);
+    if (!info->sending) {
+        send_next_packet(conn, info);
     }
 }
 
@@ -212,57 +228,9 @@ void on_client_sent(void *arg) {
     }
 
     conn_info_t *info = conn->reverse;
-    if (!info->send_buffer) {
+    info->sending = FALSE;
+    if (!send_next_packet(conn, info)) {
         tcp_sent_cb(conn, info);
-        return;
-    }
-
-    int packet_count = info->send_len / SEND_PACKET_SIZE;
-    if (info->send_len % SEND_PACKET_SIZE) {
-        packet_count++;
-    }
-
-#if defined(_DEBUG) && defined(_DEBUG_TCPSERVER)
-    int packet_no = info->send_offs / SEND_PACKET_SIZE + 1;
-#endif
-
-    int rem = info->send_len - info->send_offs;
-    if (rem <= SEND_PACKET_SIZE) {
-        DEBUG_TCPSERVER_CONN(
-            conn,
-            "sending packet %d/%d (%d/%d bytes)",
-            packet_no,
-            packet_count,
-            info->send_len,
-            info->send_len
-        );
-
-        if (espconn_send(conn, info->send_buffer + info->send_offs, rem)) {
-            DEBUG_TCPSERVER_CONN(conn, "send failed");
-        }
-        info->send_offs = info->send_len;
-        free(info->send_buffer);
-        info->send_buffer = NULL;
-    }
-    else {
-        DEBUG_TCPSERVER_CONN(
-            conn,
-            "sending packet %d/%d (%d/%d bytes)",
-            packet_no,
-            packet_count,
-            SEND_PACKET_SIZE * packet_no,
-            info->send_len
-        );
-
-        if (espconn_send(conn, info->send_buffer + info->send_offs, SEND_PACKET_SIZE)) {
-            DEBUG_TCPSERVER_CONN(conn, "send failed");
-            info->send_offs = info->send_len;
-            free(info->send_buffer);
-            info->send_buffer = NULL;
-        }
-        else {
-            info->send_offs += SEND_PACKET_SIZE;
-        }
     }
 }
 
@@ -273,7 +241,7 @@ void on_client_disconnect(void *arg) {
     if (conn->reverse) {
         conn_info_t *info = conn->reverse;
         tcp_disc_cb(conn, info->app_info);
-        free(info->send_buffer);
+        free_send_queue(info);
         free(info);
     }
     conn->reverse = NULL;
@@ -287,3 +255,57 @@ void on_client_error(void *arg, int8 err) {
     on_client_disconnect(conn);
 }
 
+void queue_buffer(conn_info_t *info, uint8 *data, int len) {
+    send_buffer_t *buffer = malloc(sizeof(send_buffer_t));
+    buffer->data = data;
+    buffer->len = len;
+    buffer->offs = 0;
+    buffer->next = NULL;
+
+    send_buffer_t **b = &info->send_queue;
+    while (*b) {
+        b = &(*b)->next;
+    }
+    *b = buffer;
+}
+
+bool send_next_packet(struct espconn *conn, conn_info_t *info) {
+    send_buffer_t *buffer = info->send_queue;
+    if (!buffer) {
+        return FALSE;
+    }
+
+    int len = buffer->len - buffer->offs;
+    if (len > TCP_SEND_PACKET_SIZE) {
+        len = TCP_SEND_PACKET_SIZE;
+    }
+
+    DEBUG_TCPSERVER_CONN(conn, "sending packet (%d/%d bytes)", buffer->offs + len, buffer->len);
+    if (espconn_send(conn, buffer->data + buffer->offs, len)) {
+        DEBUG_TCPSERVER_CONN(conn, "send failed");
+        free_send_queue(info);
+        return FALSE;
+    }
+
+    /* Sent data is copied by the SDK, so buffers can be freed as soon as their last packet is sent */
+    info->sending = TRUE;
+    buffer->offs += len;
+    if (buffer->offs >= buffer->len) {
+        info->send_queue = buffer->next;
+        free(buffer->data);
+        free(buffer);
+    }
+
+    return TRUE;
+}
+
+void free_send_queue(conn_info_t *info) {
+    send_buffer_t *buffer, *next;
+    for (buffer = info->send_queue; buffer; buffer = next) {
+        next = buffer->next;
+        free(buffer->data);
+        free(buffer);
+    }
+
+    info->send_queue = NULL;
+}
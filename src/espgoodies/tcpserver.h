@@ -26,6 +26,7 @@
 
 #define TCP_MAX_CONNECTIONS    8
 #define TCP_CONNECTION_TIMEOUT 3600     /* Seconds */
+#define TCP_SEND_PACKET_SIZE   1024
 
 
 #if defined(_DEBUG) && defined(_DEBUG_TCPSERVER)
@@ -55,6 +56,9 @@ void ICACHE_FLASH_ATTR tcp_server_init(
 
 void ICACHE_FLASH_ATTR tcp_server_stop(void);
 void ICACHE_FLASH_ATTR tcp_send(struct espconn *conn, uint8 *data, int len, bool free_on_sent);
+/* Sends data after any data still pending on the connection, freeing it once sent; meant for responses that are sent
+ * piece by piece, as they are produced */
+void ICACHE_FLASH_ATTR tcp_queue(struct espconn *conn, uint8 *data, int len);
 void ICACHE_FLASH_ATTR tcp_disconnect(struct espconn *conn);
 
 
@@ -111,8 +111,8 @@ json_t *event_to_json(event_t *event, json_refs_ctx_t *json_refs_ctx) {
     switch (event->type) {
         case EVENT_TYPE_VALUE_CHANGE:
             params = json_obj_new();
-            json_obj_append(params, "id", json_str_new(event->port_id));
-            json_obj_append(params, "value", json_dup(event->json_value));
+            json_obj_append_static(params, "id", json_str_new(event->port_id));
+            json_obj_append_static(params, "value", json_dup(event->json_value));
             break;
 
         case EVENT_TYPE_PORT_UPDATE:
@@ -128,7 +128,7 @@ json_t *event_to_json(event_t *event, json_refs_ctx_t *json_refs_ctx) {
 
         case EVENT_TYPE_PORT_REMOVE:
             params = json_obj_new();
-            json_obj_append(params, "id", json_str_new(event->port_id));
+            json_obj_append_static(params, "id", json_str_new(event->port_id));
             break;
 
         case EVENT_TYPE_DEVICE_UPDATE:
@@ -138,9 +138,9 @@ json_t *event_to_json(event_t *event, json_refs_ctx_t *json_refs_ctx) {
     }
 
     json_t *json = json_obj_new();
-    json_obj_append(json, "type", json_str_new(EVENT_TYPES_STR[event->type]));
+    json_obj_append_static(json, "type", json_str_new(EVENT_TYPES_STR[event->type]));
     if (params) {
-        json_obj_append(json, "params", params);
+        json_obj_append_static(json, "params", params);
     }
 
     return json;
@@ -33,13 +33,21 @@
 
 
 #define MAX_NAME_LEN 16
-#define MAX_ARGS     32
+#define MAX_ARGS     41 /* Enough for a LUTLI table of 20 points */
 #define MAX_HIST_LEN 32
 
+#define SKIP_TO_PARENT 0xFFFF /* Placeholder for skip index, until the parent call is emitted */
+
 #define LUT_INTERPOLATION_CLOSEST 0
 #define LUT_INTERPOLATION_LINEAR  1
 
 
+#define DELAY_HIST_MIN_CAPACITY 4
+
+#define HEAP_BLOCK_OVERHEAD     8 /* Approximate bookkeeping cost of each heap allocation */
+#define HEAP_BLOCK_SIZE(size)   ((((size) + 7) & ~7) + HEAP_BLOCK_OVERHEAD)
+
+
 typedef struct {
 
     double value;
@@ -47,6 +55,26 @@ typedef struct {
 
 } value_hist_t;
 
+typedef struct {
+
+    uint8         head;      /* Index of the oldest entry */
+    uint8         len;
+    uint8         capacity;  /* Grows by doubling, up to MAX_HIST_LEN */
+    value_hist_t  entries[];
+
+} delay_hist_t;
+
+typedef struct {
+
+    uint8         head;      /* Index of the oldest value */
+    uint8         len;
+    uint8         width;
+    double        sum;       /* Running sum of values, used by FMAVG */
+    double       *sorted;    /* Values in ascending order, used by FMEDIAN; NULL otherwise */
+    double        values[];
+
+} filter_hist_t;
+
 typedef struct {
 
     char   *name;
@@ -54,6 +82,28 @@ typedef struct {
 
 } literal_t;
 
+typedef struct {
+
+    uint16        nodes;
+    uint16        args;
+    uint16        points;    /* Points of cached lookup tables */
+    uint16        instrs;
+    uint16        str_len;
+
+} arena_size_t;
+
+typedef struct {
+
+    expr_t       *nodes;
+    expr_t      **args;
+    double       *points;
+    char         *str;
+    expr_t      **seen;      /* Shared nodes of the original tree... */
+    expr_t      **packed;    /* ... and their copies inside the arena */
+    uint16        seen_count;
+
+} arena_t;
+
 
 static double    ICACHE_FLASH_ATTR  _add_callback(expr_t *expr, int argc, double *args);
 static double    ICACHE_FLASH_ATTR  _sub_callback(expr_t *expr, int argc, double *args);
@@ -101,7 +151,7 @@ static double    ICACHE_FLASH_ATTR  _freeze_callback(expr_t *expr, int argc, dou
 static double    ICACHE_FLASH_ATTR  _held_callback(expr_t *expr, int argc, double *args);
 static double    ICACHE_FLASH_ATTR  _deriv_callback(expr_t *expr, int argc, double *args);
 static double    ICACHE_FLASH_ATTR  _integ_callback(expr_t *expr, int argc, double *args);
-static bool      ICACHE_FLASH_ATTR  _filter_callback(expr_t *expr, int argc, double *args);
+static bool      ICACHE_FLASH_ATTR  _filter_callback(expr_t *expr, int argc, double *args, bool keep_sorted);
 static double    ICACHE_FLASH_ATTR  _fmavg_callback(expr_t *expr, int argc, double *args);
 static double    ICACHE_FLASH_ATTR  _fmedian_callback(expr_t *expr, int argc, double *args);
 
@@ -117,6 +167,14 @@ static double    ICACHE_FLASH_ATTR  _lut_callback(expr_t *expr, int argc, double
 static double    ICACHE_FLASH_ATTR  _lutli_callback(expr_t *expr, int argc, double *args);
 
 static double    ICACHE_FLASH_ATTR  _lut_common_callback(expr_t *expr, int argc, double *args, uint8 interpolation);
+static double    ICACHE_FLASH_ATTR  lut_lookup(double *points, uint32 length, double x, uint8 interpolation);
+
+static void          ICACHE_FLASH_ATTR  set_deadline(uint64 time_ms);
+
+static delay_hist_t  ICACHE_FLASH_ATTR *delay_hist_grow(delay_hist_t *hist);
+static filter_hist_t ICACHE_FLASH_ATTR *filter_hist_new(filter_hist_t *old_hist, uint8 width, bool keep_sorted);
+static void          ICACHE_FLASH_ATTR  filter_hist_push(filter_hist_t *hist, double value);
+static uint8         ICACHE_FLASH_ATTR  sorted_find(double *sorted, uint8 len, double value);
 
 expr_t           ICACHE_FLASH_ATTR *parse_rec(char *port_id, char *input, int len, int abs_pos);
 static expr_t    ICACHE_FLASH_ATTR *parse_port_id_expr(char *port_id, char *input, int abs_pos);
@@ -126,6 +184,36 @@ static literal_t ICACHE_FLASH_ATTR *find_literal_by_name(char *name);
 static func_t    ICACHE_FLASH_ATTR *find_func_by_name(char *name);
 static int       ICACHE_FLASH_ATTR  check_loops_rec(port_t *the_port, int level, expr_t *expr);
 static bool      ICACHE_FLASH_ATTR  func_needs_free(expr_t *expr);
+static bool      ICACHE_FLASH_ATTR  func_has_state(expr_t *expr);
+static void      ICACHE_FLASH_ATTR  tree_free(expr_t *expr);
+static uint16    ICACHE_FLASH_ATTR  count_nodes(expr_t *expr);
+static bool      ICACHE_FLASH_ATTR  fold_constants(expr_t *expr);
+static void      ICACHE_FLASH_ATTR  fold_literal_args(expr_t *expr);
+static bool      ICACHE_FLASH_ATTR  nodes_equal(expr_t *expr1, expr_t *expr2);
+static expr_t    ICACHE_FLASH_ATTR *share_rec(expr_t *expr, expr_t **seen, uint16 *seen_count);
+static void      ICACHE_FLASH_ATTR  cache_lut_tables(expr_t *expr);
+static void      ICACHE_FLASH_ATTR  optimize(expr_t *expr);
+static uint16    ICACHE_FLASH_ATTR  compile_rec(
+                                        expr_t *expr,
+                                        expr_prog_t *prog,
+                                        uint16 pc,
+                                        uint16 pos,
+                                        uint16 base,
+                                        uint16 skip
+                                    );
+static uint16    ICACHE_FLASH_ATTR  compile_lazy_args(
+                                        expr_t *expr,
+                                        expr_prog_t *prog,
+                                        uint16 pc,
+                                        uint16 pos,
+                                        uint16 skip
+                                    );
+static void      ICACHE_FLASH_ATTR  compile(expr_t *expr);
+static double    ICACHE_FLASH_ATTR  eval_tree_lazy(expr_t *expr);
+static void      ICACHE_FLASH_ATTR  arena_size_rec(expr_t *expr, arena_size_t *size, expr_t **seen, uint16 *seen_count);
+static expr_t    ICACHE_FLASH_ATTR *pack_rec(expr_t *expr, arena_t *arena);
+static expr_t    ICACHE_FLASH_ATTR *pack(expr_t *expr);
+static uint32    ICACHE_FLASH_ATTR  state_heap_size_rec(expr_t *expr);
 
 
 static literal_t _false = {.name = "false", .value = 0};
@@ -138,6 +226,11 @@ static literal_t *literals[] = {
 };
 
 static expr_parse_error_t parse_error;
+static uint64             eval_deadline_ms; /* Earliest deadline reported during current evaluation */
+
+/* Evaluations never nest, so all programs share one stack, as deep as the deepest program compiled so far */
+static double            *eval_stack = NULL;
+static uint16             eval_stack_size = 0;
 
 
 double _add_callback(expr_t *expr, int argc, double *args) {
@@ -260,6 +353,10 @@ double _shr_callback(expr_t *expr, int argc, double *args) {
 }
 
 double _if_callback(expr_t *expr, int argc, double *args) {
+    if (argc == 1) { /* Branch already chosen by lazy evaluation */
+        return args[0];
+    }
+
     return args[0] ? args[1] : args[2];
 }
 
@@ -361,7 +458,10 @@ double _time_callback(expr_t *expr, int argc, double *args) {
 }
 
 double _timems_callback(expr_t *expr, int argc, double *args) {
-    return system_uptime_ms();
+    uint64 time_ms = system_uptime_ms();
+    set_deadline(time_ms + 1);
+
+    return time_ms;
 }
 
 double _delay_callback(expr_t *expr, int argc, double *args) {
@@ -375,53 +475,70 @@ double _delay_callback(expr_t *expr, int argc, double *args) {
     double value = args[0];
     double delay = args[1];
     double result = UNDEFINED;
-    int i;
 
-    value_hist_t *hist = expr->paux;
+    delay_hist_t *hist = expr->paux; /* expr->paux flag is used as a pointer to a value history ring buffer */
 
     /* Detect value transitions and push them to history */
     if (value != expr->value) {
         expr->value = value;
 
-        if (expr->len == MAX_HIST_LEN) { /* Shift elements in queue to make place for new value */
-            for (i = 0; i < expr->len - 1; i++) {
-                hist[i] = hist[i + 1];
+        if (!hist || hist->len == hist->capacity) {
+            if (!hist || hist->capacity < MAX_HIST_LEN) {
+                expr->paux = hist = delay_hist_grow(hist);
+            }
+            else { /* Drop oldest value to make place for new value */
+                hist->head = (hist->head + 1) % hist->capacity;
+                hist->len--;
             }
-        }
-        else { /* Grow history for another value */
-            expr->len++;
-            expr->paux = hist = realloc(expr->paux, sizeof(value_hist_t) * expr->len);
         }
 
-        hist[expr->len - 1].value = value;
-        hist[expr->len - 1].time_ms = time_ms;
+        value_hist_t *entry = hist->entries + (hist->head + hist->len) % hist->capacity;
+        entry->value = value;
+        entry->time_ms = time_ms;
+        hist->len++;
     }
 
     /* Go through history (forward) and find the first value that is newer than the delay; use it as a result; keep only
      * newer values in history */
-    bool resized = FALSE;
-    while (expr->len && (time_ms - hist[0].time_ms > delay)) {
-        result = hist[0].value;
-        for (i = 0; i < expr->len - 1; i++) {
-            hist[i] = hist[i + 1];
-        }
-        expr->len--;
-        resized = TRUE;
+    while (hist && hist->len && (time_ms - hist->entries[hist->head].time_ms > delay)) {
+        result = hist->entries[hist->head].value;
+        hist->head = (hist->head + 1) % hist->capacity;
+        hist->len--;
     }
 
-    if (resized) {
-        if (expr->len) {
-            expr->paux = realloc(expr->paux, sizeof(value_hist_t) * expr->len);
-        }
-        else {
-            free(expr->paux);
-            expr->paux = NULL;
-        }
+    if (hist && hist->len) {
+        set_deadline(hist->entries[hist->head].time_ms + delay + 1);
     }
 
     return result;
 }
 
+void set_deadline(uint64 time_ms) {
+    if (time_ms < eval_deadline_ms) {
+        eval_deadline_ms = time_ms;
+    }
+}
+
+delay_hist_t *delay_hist_grow(delay_hist_t *hist) {
+    uint8 capacity = hist ? (MIN(hist->capacity * 2, MAX_HIST_LEN)) : DELAY_HIST_MIN_CAPACITY;
+    delay_hist_t *new_hist = malloc(sizeof(delay_hist_t) + sizeof(value_hist_t) * capacity);
+
+    new_hist->head = 0;
+    new_hist->len = 0;
+    new_hist->capacity = capacity;
+
+    /* Entries are copied in order, so that they don't wrap around in the new buffer */
+    if (hist) {
+        for (; new_hist->len < hist->len; new_hist->len++) {
+            new_hist->entries[new_hist->len] = hist->entries[(hist->head + new_hist->len) % hist->capacity];
+        }
+
+        free(hist);
+    }
+
+    return new_hist;
+}
+
 double _sample_callback(expr_t *expr, int argc, double *args) {
     uint64 time_ms = system_uptime_ms();
     uint64 last_eval_time_ms = expr->aux; /* aux flag is used to store last eval time */
@@ -429,11 +546,13 @@ double _sample_callback(expr_t *expr, int argc, double *args) {
 
     /* Don't return newly evaluated value unless required duration has passed */
     if (time_ms - last_eval_time_ms < duration) {
+        set_deadline(last_eval_time_ms + duration);
         return expr->value;
     }
 
     expr->value = args[0];
     expr->aux = time_ms;
+    set_deadline(time_ms + duration);
 
     return expr->value;
 }
@@ -450,12 +569,19 @@ double _freeze_callback(expr_t *expr, int argc, double *args) {
             expr->aux = time_ms;
             expr->aux2 = duration;
             expr->value = value;
+            set_deadline(time_ms + duration + 1);
         }
     }
     else { /* Timer active */
         int64 delta = time_ms - expr->aux;
         if (delta > expr->aux2) { /* Timer expired */
             expr->aux = -1;
+
+            /* Pick up any value change that occurred meanwhile */
+            set_deadline(time_ms);
+        }
+        else {
+            set_deadline(expr->aux + expr->aux2 + 1);
         }
     }
 
@@ -485,6 +611,10 @@ double _held_callback(expr_t *expr, int argc, double *args) {
         }
     }
 
+    if (!result && value == fixed_value) {
+        set_deadline(expr->aux + duration);
+    }
+
     expr->value = value;
 
     return result;
@@ -499,6 +629,7 @@ double _deriv_callback(expr_t *expr, int argc, double *args) {
     if (expr->aux) { /* Not the very first expression eval call */
         uint32 delta_time_ms = time_ms - expr->aux;
         if (delta_time_ms < sampling_interval) {
+            set_deadline(expr->aux + sampling_interval);
             return UNDEFINED;
         }
 
@@ -507,6 +638,7 @@ double _deriv_callback(expr_t *expr, int argc, double *args) {
 
     expr->value = value;
     expr->aux = time_ms;
+    set_deadline(time_ms + sampling_interval);
 
     return result;
 }
@@ -521,6 +653,7 @@ double _integ_callback(expr_t *expr, int argc, double *args) {
     if (expr->aux) { /* Not the very first expression eval call */
         uint32 delta_time_ms = time_ms - expr->aux;
         if (delta_time_ms < sampling_interval) {
+            set_deadline(expr->aux + sampling_interval);
             return UNDEFINED;
         }
 
@@ -529,21 +662,21 @@ double _integ_callback(expr_t *expr, int argc, double *args) {
 
     expr->value = value;
     expr->aux = time_ms;
+    set_deadline(time_ms + sampling_interval);
 
     return result;
 }
 
-bool _filter_callback(expr_t *expr, int argc, double *args) {
+bool _filter_callback(expr_t *expr, int argc, double *args, bool keep_sorted) {
     if (argc < 1) { /* Called from expr_free() */
         free(expr->paux);
         expr->paux = NULL;
         return FALSE;
     }
 
-    int i;
     uint64 time_ms = system_uptime_ms();
     double value = args[0];
-    double *values = expr->paux; /* expr->paux flag is used as a pointer to a value history queue */
+    filter_hist_t *hist = expr->paux; /* expr->paux flag is used as a pointer to a value history ring buffer */
     int width = (int) args[1];
     int sampling_interval = args[2];
 
@@ -555,86 +688,130 @@ bool _filter_callback(expr_t *expr, int argc, double *args) {
         width = 1;
     }
 
-    /* Very first expression eval call */
-    if (!expr->paux) {
-        expr->paux = values = malloc(sizeof(double));
-        expr->len = 1;
-        expr->aux = time_ms;
-        values[0] = value;
-
-        return TRUE;
+    /* Don't evaluate if below sampling interval, unless this is the very first expression eval call */
+    if (hist) {
+        int32 delta_ms = time_ms - expr->aux;
+        if (delta_ms < sampling_interval) {
+            set_deadline(expr->aux + sampling_interval);
+            return FALSE;
+        }
     }
 
-    /* Don't evaluate if below sampling interval */
-    int32 delta_ms = time_ms - expr->aux;
-    if (delta_ms < sampling_interval) {
-        return FALSE;
+    expr->aux = time_ms;
+
+    /* Window moves on with each sample, even if value stays the same */
+    set_deadline(time_ms + sampling_interval);
+
+    /* (Re)create history upon very first call or if width changed */
+    if (!hist || hist->width != width) {
+        expr->paux = hist = filter_hist_new(hist, width, keep_sorted);
     }
 
-    expr->aux = time_ms;
+    filter_hist_push(hist, value);
+
+    return TRUE;
+}
 
-    int extra = expr->len - width + 1;
-    bool resized = FALSE;
-    if (extra > 0) { /* Drop extra elements from queue */
-        for (i = 0; i < expr->len - extra; i++) {
-            values[i] = values[i + extra];
+filter_hist_t *filter_hist_new(filter_hist_t *old_hist, uint8 width, bool keep_sorted) {
+    filter_hist_t *hist = malloc(sizeof(filter_hist_t) + sizeof(double) * width * (keep_sorted ? 2 : 1));
+
+    hist->head = 0;
+    hist->len = 0;
+    hist->width = width;
+    hist->sum = 0;
+    hist->sorted = keep_sorted ? hist->values + width : NULL;
+
+    /* Carry over the newest values from the old history */
+    if (old_hist) {
+        int i = old_hist->len > width ? old_hist->len - width : 0;
+        for (; i < old_hist->len; i++) {
+            filter_hist_push(hist, old_hist->values[(old_hist->head + i) % old_hist->width]);
         }
 
-        /* Shrink history if width decreased */
-        if (expr->len > width) {
-            expr->len = width;
-            resized = TRUE;
+        free(old_hist);
+    }
+
+    return hist;
+}
+
+void filter_hist_push(filter_hist_t *hist, double value) {
+    uint8 pos;
+
+    if (hist->len == hist->width) { /* Drop oldest value */
+        double oldest = hist->values[hist->head];
+        hist->sum -= oldest;
+
+        if (hist->sorted) {
+            pos = sorted_find(hist->sorted, hist->len, oldest);
+            memmove(hist->sorted + pos, hist->sorted + pos + 1, sizeof(double) * (hist->len - pos - 1));
         }
+
+        hist->head = (hist->head + 1) % hist->width;
+        hist->len--;
     }
-    else { /* Grow history for another element */
-        expr->len++;
-        resized = TRUE;
+
+    uint8 tail = (hist->head + hist->len) % hist->width;
+    hist->values[tail] = value;
+    hist->sum += value;
+
+    if (hist->sorted) {
+        pos = sorted_find(hist->sorted, hist->len, value);
+        memmove(hist->sorted + pos + 1, hist->sorted + pos, sizeof(double) * (hist->len - pos));
+        hist->sorted[pos] = value;
+    }
+
+    hist->len++;
+
+    /* Recompute running sum once every width values, so that rounding errors don't accumulate */
+    if (tail == hist->width - 1) {
+        hist->sum = 0;
+        for (pos = 0; pos < hist->len; pos++) {
+            hist->sum += hist->values[pos];
+        }
     }
+}
 
-    if (resized) {
-        expr->paux = values = realloc(expr->paux, sizeof(double) * expr->len);
+uint8 sorted_find(double *sorted, uint8 len, double value) {
+    /* Returns the position of the first value that is not less than the given value */
+    uint8 lo = 0, hi = len, mid;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (sorted[mid] < value) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
     }
-    values[expr->len - 1] = value;
 
-    return TRUE;
+    return lo;
 }
 
 double _fmavg_callback(expr_t *expr, int argc, double *args) {
-    if (!_filter_callback(expr, argc, args)) {
+    if (!_filter_callback(expr, argc, args, /* keep_sorted = */ FALSE)) {
         return UNDEFINED;
     }
 
     /* Apply moving average filter */
-    int i;
-    double s = 0;
-    double *values = expr->paux;
-    for (i = 0; i < expr->len; i++) {
-        s += values[i];
-    }
+    filter_hist_t *hist = expr->paux;
 
-    return s / expr->len;
+    return hist->sum / hist->len;
 }
 
 double _fmedian_callback(expr_t *expr, int argc, double *args) {
-    if (!_filter_callback(expr, argc, args)) {
+    if (!_filter_callback(expr, argc, args, /* keep_sorted = */ TRUE)) {
         return UNDEFINED;
     }
 
+    filter_hist_t *hist = expr->paux;
+
     /* When dealing with less than 3 values, simply return the first one */
-    if (expr->len < 3) {
-        return ((double *) expr->paux)[0];
+    if (hist->len < 3) {
+        return hist->values[hist->head];
     }
 
-    /* Copy the values to a temporary buffer, so that they can be sorted out-of-place */
-    double *values = malloc(sizeof(double) * expr->len);
-    memcpy(values, expr->paux, sizeof(double) * expr->len);
-
     /* Apply median filter */
-    qsort(values, expr->len, sizeof(double), compare_double);
-    double result = values[expr->len / 2];
-    free(values);
-
-    return result;
+    return hist->sorted[hist->len / 2];
 }
 
 double _available_callback(expr_t *expr, int argc, double *args) {
@@ -642,6 +819,10 @@ double _available_callback(expr_t *expr, int argc, double *args) {
 }
 
 double _default_callback(expr_t *expr, int argc, double *args) {
+    if (argc == 1) { /* Value already chosen by lazy evaluation */
+        return args[0];
+    }
+
     return IS_UNDEFINED(args[0]) ? args[1] : args[0];
 }
 
@@ -726,6 +907,7 @@ double _sequence_callback(expr_t *expr, int argc, double *args) {
     if (!expr->aux || delta < 0) { /* Very first expression eval call or system time overflow */
         /* aux flag is used to store the initial reference time, in milliseconds */
         expr->aux = time_ms;
+        set_deadline(time_ms + 1);
     }
     else {
         int num_values = argc / 2; /* We have pairs of values and delays */
@@ -748,6 +930,9 @@ double _sequence_callback(expr_t *expr, int argc, double *args) {
                 break;
             }
         }
+
+        /* Next value is due as soon as the current delay has passed */
+        set_deadline(time_ms + (delay_so_far >= delta ? delay_so_far - delta : 0) + 1);
     }
 
     return result;
@@ -762,93 +947,112 @@ double _lutli_callback(expr_t *expr, int argc, double *args) {
 }
 
 double _lut_common_callback(expr_t *expr, int argc, double *args, uint8 interpolation) {
+    if (argc < 1) { /* Called from tree_free(); cached tables are part of the arena once packed */
+        free(expr->paux);
+        expr->paux = NULL;
+        return 0;
+    }
+
+    if (expr->paux) {
+        /* Literal table, sorted once at parse time; expr->len holds the number of points */
+        return lut_lookup(expr->paux, expr->len, args[0], interpolation);
+    }
+
     uint32 length = (argc - 1) / 2;
-    double x = args[0];
+    double points[2 * length];
 
     /* Create points list as successive pairs of (x, y) */
-    double *points = malloc(sizeof(double) * 2 * length);
     memcpy(points, args + 1, sizeof(double) * 2 * length);
 
     /* Sort pairs of doubles based only on the first double (x) */
     qsort(points, length, sizeof(double) * 2, compare_double);
 
+    return lut_lookup(points, length, args[0], interpolation);
+}
+
+double lut_lookup(double *points, uint32 length, double x, uint8 interpolation) {
     if (x < points[0]) {
-        double result = points[1];
-        free(points);
-        return result;
+        return points[1];
     }
 
-    for (uint32 i = 0; i < length - 1; i++) {
-        double x1 = points[2 * i];
-        double y1 = points[2 * i + 1];
-        double x2 = points[2 * i + 2];
-        double y2 = points[2 * i + 3];
-
-        if (x > x2) {
-            continue;
+    /* Find the first point (other than the very first one) whose x is not less than ours */
+    uint32 lo = 1, hi = length, mid;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (points[2 * mid] < x) {
+            lo = mid + 1;
         }
+        else {
+            hi = mid;
+        }
+    }
 
-        free(points);
-        points = NULL;
+    if (lo >= length) {
+        return points[2 * length - 1];
+    }
 
-        if (interpolation == LUT_INTERPOLATION_CLOSEST) {
-            if (x - x1 < x2 - x) {
-                return y1;
-            }
-            else {
-                return y2;
-            }
-        }
-        else { /* Assuming LUT_INTERPOLATION_LINEAR */
-            if (x1 == x2) {
-                return y1;
-            }
+    double x1 = points[2 * lo - 2];
+    double y1 = points[2 * lo - 1];
+    double x2 = points[2 * lo];
+    double y2 = points[2 * lo + 1];
 
-            return y1 + (y2 - y1) * (x - x1) / (x2 - x1);
+    if (interpolation == LUT_INTERPOLATION_CLOSEST) {
+        if (x - x1 < x2 - x) {
+            return y1;
+        }
+        else {
+            return y2;
         }
     }
+    else { /* Assuming LUT_INTERPOLATION_LINEAR */
+        if (x1 == x2) {
+            return y1;
+        }
 
-    free(points);
-    return points[2 * length - 1];
+        return y1 + (y2 - y1) * (x - x1) / (x2 - x1);
+    }
 }
 
 
-func_t _add =       {.name = "ADD",       .argc = -2, .callback = _add_callback};
-func_t _sub =       {.name = "SUB",       .argc = 2,  .callback = _sub_callback};
-func_t _mul =       {.name = "MUL",       .argc = -2, .callback = _mul_callback};
-func_t _div =       {.name = "DIV",       .argc = 2,  .callback = _div_callback};
-func_t _mod =       {.name = "MOD",       .argc = 2,  .callback = _mod_callback};
-func_t _pow =       {.name = "POW",       .argc = 2,  .callback = _pow_callback};
+func_t _add =       {.name = "ADD",       .argc = -2, .callback = _add_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _sub =       {.name = "SUB",       .argc = 2,  .callback = _sub_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _mul =       {.name = "MUL",       .argc = -2, .callback = _mul_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _div =       {.name = "DIV",       .argc = 2,  .callback = _div_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _mod =       {.name = "MOD",       .argc = 2,  .callback = _mod_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _pow =       {.name = "POW",       .argc = 2,  .callback = _pow_callback, .flags = EXPR_FUNC_FLAG_PURE};
 
-func_t _and =       {.name = "AND",       .argc = -2, .callback = _and_callback};
-func_t _or =        {.name = "OR",        .argc = -2, .callback = _or_callback};
-func_t _not =       {.name = "NOT",       .argc = 1,  .callback = _not_callback};
-func_t _xor =       {.name = "XOR",       .argc = 2,  .callback = _xor_callback};
+func_t _and =       {.name = "AND",       .argc = -2, .callback = _and_callback,
+                     .flags = EXPR_FUNC_FLAG_PURE | EXPR_FUNC_FLAG_LAZY};
+func_t _or =        {.name = "OR",        .argc = -2, .callback = _or_callback,
+                     .flags = EXPR_FUNC_FLAG_PURE | EXPR_FUNC_FLAG_LAZY};
+func_t _not =       {.name = "NOT",       .argc = 1,  .callback = _not_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _xor =       {.name = "XOR",       .argc = 2,  .callback = _xor_callback, .flags = EXPR_FUNC_FLAG_PURE};
 
-func_t _bitand =    {.name = "BITAND",    .argc = 2,  .callback = _bitand_callback};
-func_t _bitor =     {.name = "BITOR",     .argc = 2,  .callback = _bitor_callback};
-func_t _bitnot =    {.name = "BITNOT",    .argc = 1,  .callback = _bitnot_callback};
-func_t _bitxor =    {.name = "BITXOR",    .argc = 2,  .callback = _bitxor_callback};
-func_t _shl =       {.name = "SHL",       .argc = 2,  .callback = _shl_callback};
-func_t _shr =       {.name = "SHR",       .argc = 2,  .callback = _shr_callback};
+func_t _bitand =    {.name = "BITAND",    .argc = 2,  .callback = _bitand_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _bitor =     {.name = "BITOR",     .argc = 2,  .callback = _bitor_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _bitnot =    {.name = "BITNOT",    .argc = 1,  .callback = _bitnot_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _bitxor =    {.name = "BITXOR",    .argc = 2,  .callback = _bitxor_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _shl =       {.name = "SHL",       .argc = 2,  .callback = _shl_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _shr =       {.name = "SHR",       .argc = 2,  .callback = _shr_callback, .flags = EXPR_FUNC_FLAG_PURE};
 
-func_t _if =        {.name = "IF",        .argc = 3,  .callback = _if_callback};
-func_t _eq =        {.name = "EQ",        .argc = 2,  .callback = _eq_callback};
-func_t _gt =        {.name = "GT",        .argc = 2,  .callback = _gt_callback};
-func_t _gte =       {.name = "GTE",       .argc = 2,  .callback = _gte_callback};
-func_t _lt =        {.name = "LT",        .argc = 2,  .callback = _lt_callback};
-func_t _lte =       {.name = "LTE",       .argc = 2,  .callback = _lte_callback};
+func_t _if =        {.name = "IF",        .argc = 3,  .callback = _if_callback,
+                     .flags = EXPR_FUNC_FLAG_PURE | EXPR_FUNC_FLAG_LAZY};
+func_t _eq =        {.name = "EQ",        .argc = 2,  .callback = _eq_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _gt =        {.name = "GT",        .argc = 2,  .callback = _gt_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _gte =       {.name = "GTE",       .argc = 2,  .callback = _gte_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _lt =        {.name = "LT",        .argc = 2,  .callback = _lt_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _lte =       {.name = "LTE",       .argc = 2,  .callback = _lte_callback, .flags = EXPR_FUNC_FLAG_PURE};
 
-func_t _abs =       {.name = "ABS",       .argc = 1,  .callback = _abs_callback};
-func_t _sgn =       {.name = "SGN",       .argc = 1,  .callback = _sgn_callback};
+func_t _abs =       {.name = "ABS",       .argc = 1,  .callback = _abs_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _sgn =       {.name = "SGN",       .argc = 1,  .callback = _sgn_callback, .flags = EXPR_FUNC_FLAG_PURE};
 
-func_t _min =       {.name = "MIN",       .argc = -2, .callback = _min_callback};
-func_t _max =       {.name = "MAX",       .argc = -2, .callback = _max_callback};
-func_t _avg =       {.name = "AVG",       .argc = -2, .callback = _avg_callback};
+func_t _min =       {.name = "MIN",       .argc = -2, .callback = _min_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _max =       {.name = "MAX",       .argc = -2, .callback = _max_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _avg =       {.name = "AVG",       .argc = -2, .callback = _avg_callback, .flags = EXPR_FUNC_FLAG_PURE};
 
-func_t _floor =     {.name = "FLOOR",     .argc = 1,  .callback = _floor_callback};
-func_t _ceil =      {.name = "CEIL",      .argc = 1,  .callback = _ceil_callback};
-func_t _round =     {.name = "ROUND",     .argc = -1, .callback = _round_callback};
+func_t _floor =     {.name = "FLOOR",     .argc = 1,  .callback = _floor_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _ceil =      {.name = "CEIL",      .argc = 1,  .callback = _ceil_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _round =     {.name = "ROUND",     .argc = -1, .callback = _round_callback, .flags = EXPR_FUNC_FLAG_PURE};
 
 func_t _time =      {.name = "TIME",      .argc = 0,  .callback = _time_callback};
 func_t _timems =    {.name = "TIMEMS",    .argc = 0,  .callback = _timems_callback};
@@ -863,17 +1067,17 @@ func_t _fmavg =     {.name = "FMAVG",     .argc = 3,  .callback = _fmavg_callbac
 func_t _fmedian =   {.name = "FMEDIAN",   .argc = 3,  .callback = _fmedian_callback};
 
 func_t _available = {.name = "AVAILABLE", .argc = 1,  .callback = _available_callback,
-                     .flags = EXPR_FUNC_FLAG_ACCEPT_UNDEFINED};
+                     .flags = EXPR_FUNC_FLAG_ACCEPT_UNDEFINED | EXPR_FUNC_FLAG_PURE};
 func_t _default =   {.name = "DEFAULT",   .argc = 2,  .callback = _default_callback,
-                     .flags = EXPR_FUNC_FLAG_ACCEPT_UNDEFINED};
+                     .flags = EXPR_FUNC_FLAG_ACCEPT_UNDEFINED | EXPR_FUNC_FLAG_PURE | EXPR_FUNC_FLAG_LAZY};
 func_t _rising =    {.name = "RISING",    .argc = 1,  .callback = _rising_callback};
 func_t _falling =   {.name = "FALLING",   .argc = 1,  .callback = _falling_callback};
 func_t _acc =       {.name = "ACC",       .argc = 2,  .callback = _acc_callback};
 func_t _accinc =    {.name = "ACCINC",    .argc = 2,  .callback = _accinc_callback};
 func_t _hyst =      {.name = "HYST",      .argc = 3,  .callback = _hyst_callback};
 func_t _sequence =  {.name = "SEQUENCE",  .argc = -2, .callback = _sequence_callback};
-func_t _lut =       {.name = "LUT",       .argc = -5, .callback = _lut_callback};
-func_t _lutli =     {.name = "LUTLI",     .argc = -5, .callback = _lutli_callback};
+func_t _lut =       {.name = "LUT",       .argc = -5, .callback = _lut_callback, .flags = EXPR_FUNC_FLAG_PURE};
+func_t _lutli =     {.name = "LUTLI",     .argc = -5, .callback = _lutli_callback, .flags = EXPR_FUNC_FLAG_PURE};
 
 func_t *funcs[] = {
     &_add,
@@ -950,8 +1154,8 @@ expr_t *parse_rec(char *port_id, char *input, int len, int abs_pos) {
     int level = 0, pos = 0, skip_pos = 0, c, l;
     char *b = NULL, *e = NULL, *s = input;
     int i, argc = 0;
-    char *argp[MAX_ARGS];
-    uint32 arg_pos[MAX_ARGS];
+    char *argp[MAX_ARGS + 1]; /* Argument separators, including the closing parenthesis */
+    uint32 arg_pos[MAX_ARGS + 1];
 
     /* Skip leading whitespace */
     while (*s && isspace((int) *s) && pos < len) {
@@ -960,7 +1164,7 @@ expr_t *parse_rec(char *port_id, char *input, int len, int abs_pos) {
         skip_pos++;
     }
 
-    char name[MAX_NAME_LEN] = {0};
+    char name[MAX_NAME_LEN + 1] = {0};
     while ((c = *s) && (c != '(') && (pos < len)) {
         append_max_len(name, c, MAX_NAME_LEN);
         s++;
@@ -992,6 +1196,12 @@ expr_t *parse_rec(char *port_id, char *input, int len, int abs_pos) {
                 return NULL;
             }
             else if (level == 1) {
+                if (argc > MAX_ARGS) {
+                    DEBUG_EXPR("too many arguments to function \"%s\"", name);
+                    set_parse_error("invalid-number-of-arguments", /* token = */ name, abs_pos + skip_pos);
+                    return NULL;
+                }
+
                 argp[argc] = s;
                 arg_pos[argc] = pos;
                 e = s - 1;
@@ -1000,10 +1210,12 @@ expr_t *parse_rec(char *port_id, char *input, int len, int abs_pos) {
             level--;
         }
         else if (c == ',' && level == 1) {
-            if (argc < MAX_ARGS) {
+            /* Arguments beyond the maximum are only counted, and refused at the closing parenthesis */
+            if (argc <= MAX_ARGS) {
                 arg_pos[argc] = pos;
-                argp[argc++] = s;
+                argp[argc] = s;
             }
+            argc++;
         }
 
         s++;
@@ -1027,7 +1239,7 @@ expr_t *parse_rec(char *port_id, char *input, int len, int abs_pos) {
             argc = 0;
         }
 
-        expr_t *args[argc];
+        expr_t *args[MAX_ARGS];
 
         for (i = 0; i < argc; i++) {
             l = argp[i + 1] - argp[i] - 1;
@@ -1035,12 +1247,12 @@ expr_t *parse_rec(char *port_id, char *input, int len, int abs_pos) {
                 DEBUG_EXPR("empty argument");
                 /* When encountering empty argument expression, following character is unexpected */
                 set_parse_error("unexpected-character", argp[i + 1], abs_pos + arg_pos[i] + 1);
-                while (i > 0) expr_free(args[--i]);
+                while (i > 0) tree_free(args[--i]);
                 return NULL;
             }
             if (!(args[i] = parse_rec(port_id, argp[i] + 1, l, abs_pos + arg_pos[i] + 1))) {
                 /* An error occurred, free everything and give up */
-                while (i > 0) expr_free(args[--i]);
+                while (i > 0) tree_free(args[--i]);
                 return NULL;
             }
         }
@@ -1049,14 +1261,14 @@ expr_t *parse_rec(char *port_id, char *input, int len, int abs_pos) {
         if (!func) {
             DEBUG_EXPR("no such function \"%s\"", name);
             set_parse_error("unknown-function", /* token = */ name, abs_pos + skip_pos);
-            while (argc > 0) expr_free(args[--argc]);
+            while (argc > 0) tree_free(args[--argc]);
             return NULL;
         }
 
         if ((func->argc >= 0 && func->argc != argc) || (func->argc < 0 && -func->argc > argc)) {
             DEBUG_EXPR("invalid number of arguments to function \"%s\"", name);
             set_parse_error("invalid-number-of-arguments", /* token = */ name, abs_pos + skip_pos);
-            while (argc > 0) expr_free(args[--argc]);
+            while (argc > 0) tree_free(args[--argc]);
             return NULL;
         }
 
@@ -1185,7 +1397,7 @@ int check_loops_rec(port_t *the_port, int level, expr_t *expr) {
     port_t *port;
 
     if (expr->port_id) {
-        if ((port = port_find_by_id(expr->port_id))) {
+        if ((port = expr->port)) {
             /* A loop is detected when we stumble upon the initial port at a level deeper than 1 */
             if (port == the_port && level > 1) {
                 return level;
@@ -1216,14 +1428,530 @@ int check_loops_rec(port_t *the_port, int level, expr_t *expr) {
 }
 
 bool func_needs_free(expr_t *expr) {
+    return (expr->func == &_fmavg ||
+            expr->func == &_fmedian ||
+            expr->func == &_delay ||
+            expr->func == &_lut ||
+            expr->func == &_lutli);
+}
+
+bool func_has_state(expr_t *expr) {
     return (expr->func == &_fmavg ||
             expr->func == &_fmedian ||
             expr->func == &_delay);
 }
 
+void tree_free(expr_t *expr) {
+    /* Frees a tree whose nodes are allocated individually, as built by the parser */
+
+    /* Shared nodes are freed along with their last reference */
+    if (expr->refs) {
+        expr->refs--;
+        return;
+    }
+
+    int i;
+    for (i = 0; i < expr->argc; i++) {
+        tree_free(expr->args[i]);
+    }
+    if (func_needs_free(expr)) {
+        ((func_t *) expr->func)->callback(expr, -1, NULL);
+    }
+
+    free(expr->args);
+    free(expr->port_id);
+    free(expr);
+}
+
+uint16 count_nodes(expr_t *expr) {
+    uint16 count = 1;
+    for (int i = 0; i < expr->argc; i++) {
+        count += count_nodes(expr->args[i]);
+    }
+
+    return count;
+}
+
+bool fold_constants(expr_t *expr) {
+    /* Returns TRUE if expression is (or has become) a literal */
+
+    if (!expr->func) {
+        return !expr->port_id;
+    }
+
+    func_t *func = expr->func;
+    bool all_literals = TRUE;
+    int i;
+    for (i = 0; i < expr->argc; i++) {
+        if (!fold_constants(expr->args[i])) {
+            all_literals = FALSE;
+        }
+    }
+
+    if (!(func->flags & EXPR_FUNC_FLAG_PURE)) {
+        return FALSE;
+    }
+
+    if (!all_literals) {
+        fold_literal_args(expr);
+        return FALSE;
+    }
+
+    double args[expr->argc];
+    for (i = 0; i < expr->argc; i++) {
+        args[i] = expr->args[i]->value;
+        if (IS_UNDEFINED(args[i]) && !(func->flags & EXPR_FUNC_FLAG_ACCEPT_UNDEFINED)) {
+            return FALSE;
+        }
+    }
+
+    /* Leave calls yielding undefined values (e.g. division by zero) alone; they are evaluated as usual */
+    double value = func->callback(expr, expr->argc, args);
+    if (IS_UNDEFINED(value)) {
+        return FALSE;
+    }
+
+    DEBUG_EXPR("folded call to \"%s\" into literal %s", func->name, dtostr(value, -1));
+
+    for (i = 0; i < expr->argc; i++) {
+        tree_free(expr->args[i]);
+    }
+
+    free(expr->args);
+    expr->args = NULL;
+    expr->argc = 0;
+    expr->func = NULL;
+    expr->value = value;
+
+    return TRUE;
+}
+
+void fold_literal_args(expr_t *expr) {
+    /* Literal arguments of associative & commutative functions can be combined into one, regardless of the other
+     * arguments: MUL(2, $x, 3.6) becomes MUL(7.2, $x) */
+
+    func_t *func = expr->func;
+    if (func != &_add && func != &_mul && func != &_min && func != &_max) {
+        return;
+    }
+
+    double args[expr->argc];
+    int i, j, count = 0, first = -1;
+    for (i = 0; i < expr->argc; i++) {
+        if (!expr->args[i]->func && !expr->args[i]->port_id) {
+            if (IS_UNDEFINED(expr->args[i]->value)) {
+                return;
+            }
+
+            args[count++] = expr->args[i]->value;
+            if (first < 0) {
+                first = i;
+            }
+        }
+    }
+
+    if (count < 2) {
+        return;
+    }
+
+    double value = func->callback(expr, count, args);
+    if (IS_UNDEFINED(value)) {
+        return;
+    }
+
+    DEBUG_EXPR("folded %d literal arguments of \"%s\" into %s", count, func->name, dtostr(value, -1));
+
+    expr->args[first]->value = value;
+    for (i = first + 1, j = first + 1; i < expr->argc; i++) {
+        if (!expr->args[i]->func && !expr->args[i]->port_id) {
+            tree_free(expr->args[i]);
+        }
+        else {
+            expr->args[j++] = expr->args[i];
+        }
+    }
+
+    expr->argc = j;
+}
+
+bool nodes_equal(expr_t *expr1, expr_t *expr2) {
+    /* Arguments have already been shared, so comparing their addresses is enough */
+
+    if (expr1->func != expr2->func || expr1->argc != expr2->argc) {
+        return FALSE;
+    }
+
+    if (expr1->func) {
+        for (int i = 0; i < expr1->argc; i++) {
+            if (expr1->args[i] != expr2->args[i]) {
+                return FALSE;
+            }
+        }
+
+        return TRUE;
+    }
+    else if (expr1->port_id || expr2->port_id) {
+        return expr1->port_id && expr2->port_id && !strcmp(expr1->port_id, expr2->port_id);
+    }
+    else {
+        return !memcmp(&expr1->value, &expr2->value, sizeof(double));
+    }
+}
+
+expr_t *share_rec(expr_t *expr, expr_t **seen, uint16 *seen_count) {
+    if (expr->func) {
+        for (int i = 0; i < expr->argc; i++) {
+            expr->args[i] = share_rec(expr->args[i], seen, seen_count);
+        }
+
+        /* Stateful functions keep their own state in their node and can't be shared */
+        if (!(((func_t *) expr->func)->flags & EXPR_FUNC_FLAG_PURE)) {
+            return expr;
+        }
+    }
+
+    expr_t *other;
+    for (int i = 0; i < *seen_count; i++) {
+        other = seen[i];
+        if (other->refs < 255 && nodes_equal(other, expr)) {
+            other->refs++;
+            tree_free(expr);
+
+            return other;
+        }
+    }
+
+    seen[(*seen_count)++] = expr;
+
+    return expr;
+}
+
+void cache_lut_tables(expr_t *expr) {
+    int i;
+    for (i = 0; i < expr->argc; i++) {
+        cache_lut_tables(expr->args[i]);
+    }
+
+    /* Shared nodes may be visited more than once */
+    if ((expr->func != &_lut && expr->func != &_lutli) || expr->paux) {
+        return;
+    }
+
+    for (i = 1; i < expr->argc; i++) {
+        if (expr->args[i]->func || expr->args[i]->port_id || IS_UNDEFINED(expr->args[i]->value)) {
+            return; /* Table will be sorted at each evaluation */
+        }
+    }
+
+    /* Sort the table once and keep it in paux; table arguments are no longer needed, leaving x as only argument */
+    uint32 length = (expr->argc - 1) / 2;
+    double *points = malloc(sizeof(double) * 2 * length);
+    for (i = 0; i < 2 * length; i++) {
+        points[i] = expr->args[i + 1]->value;
+    }
+    qsort(points, length, sizeof(double) * 2, compare_double);
+
+    for (i = 1; i < expr->argc; i++) {
+        tree_free(expr->args[i]);
+    }
+
+    expr->argc = 1;
+    expr->len = length;
+    expr->paux = points;
+
+    DEBUG_EXPR("cached lookup table with %d points", length);
+}
+
+void optimize(expr_t *expr) {
+    fold_constants(expr);
+
+    uint16 seen_count = 0;
+    expr_t **seen = malloc(sizeof(expr_t *) * count_nodes(expr));
+    share_rec(expr, seen, &seen_count);
+    free(seen);
+
+    /* Must come after sharing, since nodes are compared by their arguments only */
+    cache_lut_tables(expr);
+}
+
+uint16 compile_rec(expr_t *expr, expr_prog_t *prog, uint16 pc, uint16 pos, uint16 base, uint16 skip) {
+    /* Instructions are emitted in post-order: arguments first, each pushing its value onto the stack, followed by the
+     * function call that consumes them */
+
+    expr_instr_t *instr;
+
+    if (pos + 1 > prog->stack_size) {
+        prog->stack_size = pos + 1;
+    }
+
+    if (expr->func && expr->refs && expr->aux) {
+        /* Shared call that has already been emitted; its result is simply reused */
+        instr = prog->instrs + pc;
+        instr->op = EXPR_OP_SHARED;
+        instr->expr = expr;
+    }
+    else if (expr->func) {
+        func_t *func = expr->func;
+        uint16 args_pc = pc;
+        uint16 args_skip = (func->flags & EXPR_FUNC_FLAG_ACCEPT_UNDEFINED) ? 0 : SKIP_TO_PARENT;
+
+        int8 argc = expr->argc;
+        if (func->flags & EXPR_FUNC_FLAG_LAZY) {
+            pc = compile_lazy_args(expr, prog, pc, pos, args_skip);
+            argc = 1;
+        }
+        else {
+            for (int i = 0; i < expr->argc; i++) {
+                pc = compile_rec(expr->args[i], prog, pc, pos + i, pos, args_skip);
+            }
+        }
+
+        /* Our own call instruction comes right after the instructions of all our arguments */
+        for (; args_pc < pc; args_pc++) {
+            if (prog->instrs[args_pc].skip == SKIP_TO_PARENT) {
+                prog->instrs[args_pc].skip = pc;
+            }
+        }
+
+        instr = prog->instrs + pc;
+        instr->op = expr->refs ? EXPR_OP_CALL_SHARED : EXPR_OP_CALL;
+        instr->argc = argc;
+        instr->expr = expr;
+
+        /* aux flag of shared (thus pure) nodes marks them as emitted, then holds the stamp of their last evaluation */
+        if (expr->refs) {
+            expr->aux = -1;
+        }
+    }
+    else if (expr->port_id) {
+        instr = prog->instrs + pc;
+        instr->op = EXPR_OP_PORT;
+        instr->expr = expr;
+    }
+    else {
+        instr = prog->instrs + pc;
+        instr->op = EXPR_OP_LITERAL;
+        instr->value = expr->value;
+    }
+
+    instr->skip = skip;
+    instr->base = base;
+
+    return pc + 1;
+}
+
+uint16 compile_lazy_args(expr_t *expr, expr_prog_t *prog, uint16 pc, uint16 pos, uint16 skip) {
+    /* Arguments are evaluated one at a time, each in the stack slot of the call itself; conditional jumps leave out
+     * those that aren't needed, so that a single value remains for the call, which comes right after */
+
+    func_t *func = expr->func;
+    expr_instr_t *instr;
+    uint16 jumps[MAX_ARGS];
+    int i, count = 0;
+
+    if (func == &_if) {
+        pc = compile_rec(expr->args[0], prog, pc, pos, pos, skip);
+
+        /* Condition is dropped either way */
+        instr = prog->instrs + pc++;
+        instr->op = EXPR_OP_JUMP_FALSE;
+        instr->argc = 1;
+
+        pc = compile_rec(expr->args[1], prog, pc, pos, pos, skip);
+
+        jumps[count++] = pc;
+        prog->instrs[pc++].op = EXPR_OP_JUMP;
+
+        instr->target = pc;
+        pc = compile_rec(expr->args[2], prog, pc, pos, pos, skip);
+    }
+    else {
+        /* The first value that decides the result is kept and becomes the argument of the call */
+        uint8 op = func == &_and ? EXPR_OP_JUMP_FALSE : func == &_or ? EXPR_OP_JUMP_TRUE : EXPR_OP_JUMP_DEF;
+        for (i = 0; i < expr->argc; i++) {
+            pc = compile_rec(expr->args[i], prog, pc, pos, pos, skip);
+            if (i < expr->argc - 1) {
+                jumps[count++] = pc;
+                prog->instrs[pc++].op = op;
+            }
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        prog->instrs[jumps[i]].target = pc;
+    }
+
+    return pc;
+}
+
+void compile(expr_t *expr) {
+    /* Program space has already been reserved inside the arena */
+    expr_prog_t *prog = expr->prog;
+    prog->len = compile_rec(expr, prog, /* pc = */ 0, /* pos = */ 0, /* base = */ 0, /* skip = */ 0);
+
+    if (prog->stack_size > eval_stack_size) {
+        eval_stack_size = prog->stack_size;
+        eval_stack = realloc(eval_stack, sizeof(double) * eval_stack_size);
+    }
+
+    DEBUG_EXPR("compiled %d instructions, using %d stack values", prog->len, prog->stack_size);
+}
+
+void arena_size_rec(expr_t *expr, arena_size_t *size, expr_t **seen, uint16 *seen_count) {
+    /* Each visit yields one instruction; shared nodes that have already been visited take up nothing else */
+    size->instrs++;
+
+    if (expr->refs) {
+        for (int i = 0; i < *seen_count; i++) {
+            if (seen[i] == expr) {
+                return;
+            }
+        }
+
+        seen[(*seen_count)++] = expr;
+    }
+
+    size->nodes++;
+    size->args += expr->argc;
+    if (expr->func && (((func_t *) expr->func)->flags & EXPR_FUNC_FLAG_LAZY)) {
+        size->instrs += expr->func == &_if ? 2 : expr->argc - 1; /* Jumps */
+    }
+    if (expr->port_id) {
+        size->str_len += strlen(expr->port_id) + 1;
+    }
+    if ((expr->func == &_lut || expr->func == &_lutli) && expr->paux) {
+        size->points += expr->len;
+    }
+
+    for (int i = 0; i < expr->argc; i++) {
+        arena_size_rec(expr->args[i], size, seen, seen_count);
+    }
+}
+
+expr_t *pack_rec(expr_t *expr, arena_t *arena) {
+    int i;
+    if (expr->refs) {
+        for (i = 0; i < arena->seen_count; i++) {
+            if (arena->seen[i] == expr) {
+                return arena->packed[i];
+            }
+        }
+    }
+
+    expr_t *packed = arena->nodes++;
+    *packed = *expr;
+
+    if (expr->refs) {
+        arena->seen[arena->seen_count] = expr;
+        arena->packed[arena->seen_count++] = packed;
+    }
+
+    if (expr->port_id) {
+        packed->port_id = strcpy(arena->str, expr->port_id);
+        arena->str += strlen(expr->port_id) + 1;
+    }
+
+    if ((expr->func == &_lut || expr->func == &_lutli) && expr->paux) {
+        packed->paux = memcpy(arena->points, expr->paux, sizeof(double) * 2 * expr->len);
+        arena->points += 2 * expr->len;
+    }
+
+    if (expr->argc) {
+        packed->args = arena->args;
+        arena->args += expr->argc;
+        for (i = 0; i < expr->argc; i++) {
+            packed->args[i] = pack_rec(expr->args[i], arena);
+        }
+    }
+
+    return packed;
+}
+
+expr_t *pack(expr_t *expr) {
+    /* Moves the whole tree, along with room for its program, into a single allocation; the root node comes first, so
+     * that freeing the root frees everything */
+
+    uint16 max_nodes = count_nodes(expr);
+    expr_t **seen = malloc(sizeof(expr_t *) * max_nodes * 2);
+    uint16 seen_count = 0;
+    arena_size_t size = {0};
+    arena_size_rec(expr, &size, seen, &seen_count);
+
+    uint32 nodes_size = sizeof(expr_t) * size.nodes;
+    uint32 prog_size = sizeof(expr_prog_t) + sizeof(expr_instr_t) * size.instrs;
+    uint32 points_size = sizeof(double) * 2 * size.points;
+    uint32 args_size = sizeof(expr_t *) * size.args;
+    uint32 arena_size = nodes_size + prog_size + points_size + args_size + size.str_len;
+
+    /* Regions are laid out in decreasing order of alignment */
+    uint8 *ptr = zalloc(arena_size);
+    arena_t arena = {
+        .nodes = (expr_t *) ptr,
+        .points = (double *) (ptr + nodes_size + prog_size),
+        .args = (expr_t **) (ptr + nodes_size + prog_size + points_size),
+        .str = (char *) (ptr + nodes_size + prog_size + points_size + args_size),
+        .seen = seen,
+        .packed = seen + max_nodes,
+        .seen_count = 0
+    };
+
+    expr_t *packed = pack_rec(expr, &arena);
+    packed->prog = (expr_prog_t *) (ptr + nodes_size);
+    packed->prog->heap_size = HEAP_BLOCK_SIZE(arena_size);
+
+    free(seen);
+    tree_free(expr);
+
+    DEBUG_EXPR("packed %d nodes into %d bytes", size.nodes, arena_size);
+
+    return packed;
+}
+
+uint32 state_heap_size_rec(expr_t *expr) {
+    /* State allocated during evaluation is accounted for at its maximum size; stateful nodes are never shared, so
+     * there's no risk of counting them twice */
+
+    uint32 size = 0;
+    if (expr->func == &_delay) {
+        size += HEAP_BLOCK_SIZE(sizeof(delay_hist_t) + sizeof(value_hist_t) * MAX_HIST_LEN);
+    }
+    else if (expr->func == &_fmavg || expr->func == &_fmedian) {
+        int width = MAX_HIST_LEN;
+        expr_t *width_expr = expr->args[1];
+        if (!width_expr->func && !width_expr->port_id && !IS_UNDEFINED(width_expr->value)) {
+            width = width_expr->value;
+            if (width > MAX_HIST_LEN) {
+                width = MAX_HIST_LEN;
+            }
+            if (width < 1) {
+                width = 1;
+            }
+        }
+
+        size += HEAP_BLOCK_SIZE(sizeof(filter_hist_t) + sizeof(double) * width * (expr->func == &_fmedian ? 2 : 1));
+    }
+
+    for (int i = 0; i < expr->argc; i++) {
+        size += state_heap_size_rec(expr->args[i]);
+    }
+
+    return size;
+}
+
 
 expr_t *expr_parse(char *port_id, char *input, int len) {
-    return parse_rec(port_id, input, len, /* abs_pos = */ 1);
+    expr_t *expr = parse_rec(port_id, input, len, /* abs_pos = */ 1);
+    if (expr) {
+        optimize(expr);
+        expr = pack(expr);
+        expr_bind_ports(expr);
+        compile(expr);
+
+        expr->prog->heap_size += state_heap_size_rec(expr);
+        DEBUG_EXPR("expression uses about %d bytes of heap", expr->prog->heap_size);
+    }
+
+    return expr;
 }
 
 expr_parse_error_t *expr_parse_get_error(void) {
@@ -1231,13 +1959,112 @@ expr_parse_error_t *expr_parse_get_error(void) {
 }
 
 double expr_eval(expr_t *expr) {
+    expr_prog_t *prog = expr->prog;
+    if (!prog) {
+        return expr_eval_tree(expr);
+    }
+
+    double *stack = eval_stack;
+    double value = UNDEFINED;
+    expr_instr_t *instr;
+    port_t *port;
+    uint16 pc = 0;
+    uint16 sp = 0;
+
+    prog->eval_stamp++;
+    eval_deadline_ms = EXPR_NO_DEADLINE;
+
+    while (pc < prog->len) {
+        instr = prog->instrs + pc++;
+
+        switch (instr->op) {
+            case EXPR_OP_LITERAL:
+                value = instr->value;
+                break;
+
+            case EXPR_OP_PORT:
+                port = instr->expr->port;
+                if (port && IS_PORT_ENABLED(port)) {
+                    value = port->last_read_value;
+                }
+                else {
+                    value = UNDEFINED;
+                }
+
+                break;
+
+            case EXPR_OP_CALL:
+                sp -= instr->argc;
+                value = ((func_t *) instr->expr->func)->callback(instr->expr, instr->argc, stack + sp);
+                break;
+
+            case EXPR_OP_CALL_SHARED:
+                sp -= instr->argc;
+                value = ((func_t *) instr->expr->func)->callback(instr->expr, instr->argc, stack + sp);
+                instr->expr->value = value;
+                instr->expr->aux = prog->eval_stamp;
+                break;
+
+            case EXPR_OP_SHARED:
+                if (instr->expr->aux == prog->eval_stamp) {
+                    value = instr->expr->value;
+                }
+                else {
+                    /* First occurrence has been skipped during this evaluation */
+                    value = expr_eval_tree(instr->expr);
+                }
+
+                break;
+
+            case EXPR_OP_JUMP:
+                pc = instr->target;
+                continue;
+
+            case EXPR_OP_JUMP_FALSE:
+            case EXPR_OP_JUMP_TRUE:
+            case EXPR_OP_JUMP_DEF:
+                value = stack[sp - 1];
+                if ((instr->op == EXPR_OP_JUMP_FALSE && !value) ||
+                    (instr->op == EXPR_OP_JUMP_TRUE && value) ||
+                    (instr->op == EXPR_OP_JUMP_DEF && !IS_UNDEFINED(value))) {
+
+                    sp -= instr->argc;
+                    pc = instr->target;
+                }
+                else {
+                    sp--;
+                }
+
+                continue;
+        }
+
+        /* If any of the inner expressions is undefined, the outer expression itself is undefined; remaining arguments
+         * are not evaluated and the outer call is skipped altogether */
+        while (instr->skip && IS_UNDEFINED(value)) {
+            sp = instr->base;
+            pc = instr->skip;
+            instr = prog->instrs + pc++;
+        }
+
+        stack[sp++] = value;
+    }
+
+    prog->deadline_ms = eval_deadline_ms;
+
+    return value;
+}
+
+double expr_eval_tree(expr_t *expr) {
     if (expr->func) { /* Function */
         func_t *func = expr->func;
+        if (func->flags & EXPR_FUNC_FLAG_LAZY) {
+            return eval_tree_lazy(expr);
+        }
 
         int i;
         double eval_args[expr->argc];
         for (i = 0; i < expr->argc; i++) {
-            if (IS_UNDEFINED(eval_args[i] = expr_eval(expr->args[i])) &&
+            if (IS_UNDEFINED(eval_args[i] = expr_eval_tree(expr->args[i])) &&
                 !(func->flags & EXPR_FUNC_FLAG_ACCEPT_UNDEFINED)) {
 
                 /* If any of the inner expressions is undefined, the outer expression itself is undefined */
@@ -1248,7 +2075,7 @@ double expr_eval(expr_t *expr) {
         return func->callback(expr, expr->argc, eval_args);
     }
     else if (expr->port_id) { /* Port value */
-        port_t *port = port_find_by_id(expr->port_id);
+        port_t *port = expr->port;
         if (port && IS_PORT_ENABLED(port)) {
             return port->last_read_value;
         }
@@ -1261,18 +2088,63 @@ double expr_eval(expr_t *expr) {
     }
 }
 
+double eval_tree_lazy(expr_t *expr) {
+    func_t *func = expr->func;
+    double value;
+
+    if (func == &_if) {
+        value = expr_eval_tree(expr->args[0]);
+        if (!IS_UNDEFINED(value)) {
+            value = expr_eval_tree(expr->args[value ? 1 : 2]);
+        }
+    }
+    else {
+        for (int i = 0; i < expr->argc; i++) {
+            value = expr_eval_tree(expr->args[i]);
+            if (IS_UNDEFINED(value)) {
+                if (func == &_default) {
+                    continue;
+                }
+
+                break;
+            }
+
+            if ((func == &_and && !value) || (func == &_or && value) || func == &_default) {
+                break;
+            }
+        }
+    }
+
+    if (IS_UNDEFINED(value) && !(func->flags & EXPR_FUNC_FLAG_ACCEPT_UNDEFINED)) {
+        return UNDEFINED;
+    }
+
+    return func->callback(expr, 1, &value);
+}
+
 void expr_free(expr_t *expr) {
-    int i;
-    for (i = 0; i < expr->argc; i++) {
+    /* Only state buffers live outside of the arena */
+    for (int i = 0; i < expr->argc; i++) {
         expr_free(expr->args[i]);
     }
-    if (func_needs_free(expr)) {
+    if (func_has_state(expr)) {
         ((func_t *) expr->func)->callback(expr, -1, NULL);
     }
 
-    free(expr->args);
-    free(expr->port_id);
-    free(expr);
+    if (expr->prog) { /* Root expression, holding the arena */
+        free(expr);
+    }
+}
+
+void expr_bind_ports(expr_t *expr) {
+    if (expr->port_id) {
+        expr->port = port_find_by_id(expr->port_id);
+        return;
+    }
+
+    for (int i = 0; i < expr->argc; i++) {
+        expr_bind_ports(expr->args[i]);
+    }
 }
 
 int expr_check_loops(expr_t *expr, struct port *the_port) {
@@ -1285,22 +2157,17 @@ int expr_check_loops(expr_t *expr, struct port *the_port) {
     return check_loops_rec(the_port, 1, expr);
 }
 
-uint32 expr_get_port_deps(expr_t *expr) {
+void expr_get_port_deps(expr_t *expr, portset_t *deps) {
     port_t *port;
 
     if (expr->func) {
-        uint32 dep_mask = 0;
         for (int i = 0; i < expr->argc; i++) {
-            dep_mask |= expr_get_port_deps(expr->args[i]);
+            expr_get_port_deps(expr->args[i], deps);
         }
-
-        return dep_mask;
     }
-    else if (expr->port_id && (port = port_find_by_id(expr->port_id))) {
-        return BIT(port->slot);
+    else if (expr->port_id && (port = expr->port) && port->slot >= 0) {
+        PORTSET_ADD(deps, port->slot);
     }
-
-    return 0;
 }
 
 bool expr_is_time_dep(expr_t *expr) {
@@ -1320,31 +2187,12 @@ bool expr_is_time_dep(expr_t *expr) {
     return FALSE;
 }
 
-bool expr_is_time_ms_dep(expr_t *expr) {
-    if (expr->func) {
-        if (expr->func == &_timems ||
-            expr->func == &_sample ||
-            expr->func == &_freeze ||
-            expr->func == &_held ||
-            expr->func == &_delay ||
-            expr->func == &_deriv ||
-            expr->func == &_integ||
-            expr->func == &_sequence ||
-            expr->func == &_fmavg ||
-            expr->func == &_fmedian) {
-
-            return TRUE;
-        }
-
-        int i;
-        for (i = 0; i < expr->argc; i++) {
-            if (expr_is_time_ms_dep(expr->args[i])) {
-                return TRUE;
-            }
-        }
-    }
+uint64 expr_get_deadline_ms(expr_t *expr) {
+    return expr->prog ? expr->prog->deadline_ms : EXPR_NO_DEADLINE;
+}
 
-    return FALSE;
+uint32 expr_get_heap_size(expr_t *expr) {
+    return expr->prog ? expr->prog->heap_size : 0;
 }
 
 bool expr_is_rounding(expr_t *expr) {
@@ -22,6 +22,8 @@
 
 #include <c_types.h>
 
+#include "portset.h"
+
 
 #ifdef _DEBUG_EXPR
 #define DEBUG_EXPR(fmt, ...) DEBUG("[expressions   ] " fmt, ##__VA_ARGS__)
@@ -30,7 +32,50 @@
 #endif
 
 #define EXPR_FUNC_FLAG_ACCEPT_UNDEFINED 0x01
+#define EXPR_FUNC_FLAG_PURE             0x02 /* Result depends only on arguments; no state, no time */
+#define EXPR_FUNC_FLAG_LAZY             0x04 /* Arguments are evaluated only as needed; the callback is then called with
+                                              * the single value that decides the result */
+
+#define EXPR_NO_DEADLINE    0xFFFFFFFFFFFFFFFFULL
+
+#define EXPR_OP_LITERAL     0
+#define EXPR_OP_PORT        1
+#define EXPR_OP_CALL        2
+#define EXPR_OP_CALL_SHARED 3 /* Call of a shared node, remembering its result */
+#define EXPR_OP_SHARED      4 /* Reuse of the result of a shared node, computed earlier during the same evaluation */
+#define EXPR_OP_JUMP        5
+#define EXPR_OP_JUMP_FALSE  6 /* Conditional jumps test the value on top of the stack; when not jumping, it's dropped */
+#define EXPR_OP_JUMP_TRUE   7
+#define EXPR_OP_JUMP_DEF    8
+
+
+struct port;
+
+typedef struct {
 
+    uint8         op;
+    int8          argc;    /* Number of stack values consumed by EXPR_OP_CALL, or dropped by conditional jumps */
+    uint16        skip;    /* Index of parent call, used to short-circuit undefined arguments; 0 means no skipping */
+    uint16        base;    /* Stack position of the parent's first argument */
+
+    union {
+        double       value; /* Used by EXPR_OP_LITERAL */
+        struct expr *expr;  /* Used by EXPR_OP_PORT and EXPR_OP_CALL */
+        uint16       target; /* Used by jumps */
+    };
+
+} expr_instr_t;
+
+typedef struct {
+
+    uint16        len;
+    uint16        stack_size;
+    uint32        eval_stamp; /* Incremented with each evaluation; tells if results of shared nodes are current */
+    uint64        deadline_ms; /* Time when the expression needs reevaluation, as reported by its last evaluation */
+    uint32        heap_size;   /* Estimated heap usage of the whole expression, including worst-case function state */
+    expr_instr_t  instrs[];
+
+} expr_prog_t;
 
 typedef struct expr {
 
@@ -44,6 +89,7 @@ typedef struct expr {
         int64     aux2;    /* Auxiliary flag 2 */
         double    faux2;
         void     *paux;
+        struct port *port; /* Port bound to a port expression */
     };
 
     char         *port_id;
@@ -51,7 +97,10 @@ typedef struct expr {
     void         *func;
     struct expr **args;
     int8          argc;
-    uint16        len;     /* Used for value history queue size */
+    uint8         refs;    /* Number of additional references to a node shared within an expression */
+    uint16        len;     /* Used for the number of points of cached lookup tables */
+
+    expr_prog_t  *prog;    /* Compiled program; only set on root expressions */
 
 } expr_t;
 
@@ -63,8 +112,6 @@ typedef struct {
 
 } expr_parse_error_t;
 
-struct port;
-
 typedef double (*func_callback_t)(expr_t *expr, int argc, double *args);
 
 typedef struct {
@@ -80,11 +127,15 @@ typedef struct {
 expr_t             ICACHE_FLASH_ATTR *expr_parse(char *port_id, char *input, int len);
 expr_parse_error_t ICACHE_FLASH_ATTR *expr_parse_get_error(void);
 double             ICACHE_FLASH_ATTR  expr_eval(expr_t *expr);
+double             ICACHE_FLASH_ATTR  expr_eval_tree(expr_t *expr);
 void               ICACHE_FLASH_ATTR  expr_free(expr_t *expr);
+void               ICACHE_FLASH_ATTR  expr_bind_ports(expr_t *expr);
 int                ICACHE_FLASH_ATTR  expr_check_loops(expr_t *expr, struct port *the_port);
-uint32             ICACHE_FLASH_ATTR  expr_get_port_deps(expr_t *expr);
+/* Adds the slots of the ports the expression depends on to deps */
+void               ICACHE_FLASH_ATTR  expr_get_port_deps(expr_t *expr, portset_t *deps);
 bool               ICACHE_FLASH_ATTR  expr_is_time_dep(expr_t *expr);
-bool               ICACHE_FLASH_ATTR  expr_is_time_ms_dep(expr_t *expr);
+uint64             ICACHE_FLASH_ATTR  expr_get_deadline_ms(expr_t *expr);
+uint32             ICACHE_FLASH_ATTR  expr_get_heap_size(expr_t *expr);
 bool               ICACHE_FLASH_ATTR  expr_is_rounding(expr_t *expr);
 
 
@@ -0,0 +1,158 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <string.h>
+#include <c_types.h>
+#include <mem.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/flashcfg.h"
+#include "espgoodies/utils.h"
+
+#include "ports.h"
+#include "journal.h"
+
+
+#define RECORD_MAGIC 0x4A56
+#define RECORD_SIZE  sizeof(record_t)
+#define MAX_RECORDS  (FLASH_CONFIG_SIZE_JOURNAL / RECORD_SIZE)
+
+
+typedef struct {
+
+    uint16 magic;
+    uint8  slot;
+    uint8  check;     /* Tells apart records whose writing was interrupted */
+    uint8  value[8];  /* A double, stored byte by byte to keep the record free of padding */
+
+} record_t;
+
+
+static uint32 write_pos = MAX_RECORDS; /* Index of the first free record; a full journal is reset upon next append */
+
+
+static uint8 ICACHE_FLASH_ATTR record_check(record_t *record);
+static bool  ICACHE_FLASH_ATTR record_is_free(record_t *record);
+static bool  ICACHE_FLASH_ATTR write_record(port_t *port);
+
+
+void journal_load(void) {
+    uint32 *data = malloc(FLASH_CONFIG_SIZE_JOURNAL);
+    if (!flashcfg_read(FLASH_CONFIG_SLOT_JOURNAL, 0, (uint8 *) data, FLASH_CONFIG_SIZE_JOURNAL)) {
+        free(data);
+        return;
+    }
+
+    record_t *records = (record_t *) data;
+    port_t *port;
+    double value;
+    int count = 0;
+    for (write_pos = 0; write_pos < MAX_RECORDS; write_pos++) {
+        record_t *record = records + write_pos;
+        if (record_is_free(record)) {
+            break;
+        }
+
+        if (record->magic != RECORD_MAGIC || record->check != record_check(record)) {
+            DEBUG_JOURNAL("skipping invalid record at %d", write_pos);
+            continue;
+        }
+
+        port = port_find_by_slot(record->slot);
+        if (!port || !IS_PORT_PERSISTED(port)) {
+            continue;
+        }
+
+        /* Later records override earlier ones */
+        memcpy(&value, record->value, sizeof(double));
+        port->last_read_value = port->last_persisted_value = value;
+        count++;
+    }
+
+    free(data);
+
+    DEBUG_JOURNAL("loaded %d values from %d records", count, write_pos);
+}
+
+bool journal_append(port_t *port) {
+    if (write_pos >= MAX_RECORDS) {
+        /* Start over with the current values of all persisted ports, which include this port's one */
+        journal_reset();
+
+        port_t *p;
+        for (int i = 0; i < all_ports_count; i++) {
+            p = all_ports[i];
+            if (IS_PORT_PERSISTED(p) && !write_record(p)) {
+                return FALSE;
+            }
+        }
+
+        return TRUE;
+    }
+
+    return write_record(port);
+}
+
+void journal_reset(void) {
+    DEBUG_JOURNAL("resetting");
+
+    flashcfg_erase(FLASH_CONFIG_SLOT_JOURNAL);
+    write_pos = 0;
+}
+
+
+uint8 record_check(record_t *record) {
+    uint8 check = record->slot ^ 0xA5;
+    for (int i = 0; i < sizeof(record->value); i++) {
+        check = (check << 1 | check >> 7) ^ record->value[i];
+    }
+
+    return check;
+}
+
+bool record_is_free(record_t *record) {
+    uint8 *p = (uint8 *) record;
+    for (int i = 0; i < RECORD_SIZE; i++) {
+        if (p[i] != 0xFF) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+bool write_record(port_t *port) {
+    uint32 data[RECORD_SIZE / 4];
+    record_t *record = (record_t *) data;
+
+    record->magic = RECORD_MAGIC;
+    record->slot = port->slot;
+    memcpy(record->value, &port->last_persisted_value, sizeof(double));
+    record->check = record_check(record);
+
+    /* A record that fails to be written is skipped when loading, so its place is given up anyway */
+    bool result = flashcfg_write(FLASH_CONFIG_SLOT_JOURNAL, write_pos * RECORD_SIZE, (uint8 *) data, RECORD_SIZE);
+    write_pos++;
+    if (!result) {
+        DEBUG_JOURNAL("failed to write record at %d", write_pos - 1);
+        return FALSE;
+    }
+
+    DEBUG_PORT(port, "value %s journaled at %d", dtostr(port->last_persisted_value, -1), write_pos - 1);
+
+    return TRUE;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+
+#include <c_types.h>
+
+#include "ports.h"
+
+
+#ifdef _DEBUG_JOURNAL
+#define DEBUG_JOURNAL(fmt, ...) DEBUG("[journal       ] " fmt, ##__VA_ARGS__)
+#else
+#define DEBUG_JOURNAL(...)      {}
+#endif
+
+
+/* Persisted port values are appended to a journal of their own, rather than saved with the whole configuration, so
+ * that frequently changing values don't have the configuration rewritten over and over; only once the journal is full
+ * is its sector erased and the current values written again */
+
+/* Applies the journaled values to persisted ports, on top of the ones loaded with the configuration */
+void ICACHE_FLASH_ATTR journal_load(void);
+bool ICACHE_FLASH_ATTR journal_append(port_t *port);
+/* Must be called after saving the configuration, which holds the current values of persisted ports from then on */
+void ICACHE_FLASH_ATTR journal_reset(void);
+
+
+#endif /* _JOURNAL_H */
@@ -35,7 +35,7 @@ json_t *make_json_ref(const char *target_fmt, ...) {
     va_end(args);
 
     json_t *ref = json_obj_new();
-    json_obj_append(ref, "$ref", json_str_new(buf));
+    json_obj_append_static(ref, "$ref", json_str_new(buf));
     free(buf);
 
     return ref;
@@ -169,6 +169,9 @@ void peripheral_make_ports(peripheral_t *peripheral, char *port_ids[], uint8 por
             free(ports[i]->id);
             ports[i]->id = strdup(port_ids[i]);
         }
+
+        ports_rebuild_id_index();
+        ports_rebind_expressions();
     }
 }
 
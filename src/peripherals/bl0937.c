@@ -63,7 +63,7 @@ typedef struct {
     uint32 voltage_pulse_count;
 
     bool   mode;
-    uint32 enabled_ports_mask;
+    portset_t enabled_ports_mask;
     bool   interrupt_handler_added;
 
 } user_data_t;
@@ -96,7 +96,7 @@ void handle_gpio_interrupts(uint8 gpio_no, bool value, peripheral_t *peripheral)
     user_data_t *user_data = peripheral->user_data;
 
     /* Ignore interrupt if no port is enabled */
-    if (!user_data->enabled_ports_mask) {
+    if (portset_is_empty(&user_data->enabled_ports_mask)) {
         return;
     }
 
@@ -204,19 +204,20 @@ double read_voltage(port_t *port) {
 void configure(port_t *port, bool enabled) {
     peripheral_t *peripheral = port->peripheral;
     user_data_t *user_data = peripheral->user_data;
-    uint32 prev_enabled_ports_mask = user_data->enabled_ports_mask;
+    bool prev_enabled = !portset_is_empty(&user_data->enabled_ports_mask);
 
     if (enabled) {
-        user_data->enabled_ports_mask |= BIT(port->slot);
+        PORTSET_ADD(&user_data->enabled_ports_mask, port->slot);
     }
     else {
-        user_data->enabled_ports_mask &= ~BIT(port->slot);
+        PORTSET_REMOVE(&user_data->enabled_ports_mask, port->slot);
     }
 
-    if (prev_enabled_ports_mask && !user_data->enabled_ports_mask) {
+    bool now_enabled = !portset_is_empty(&user_data->enabled_ports_mask);
+    if (prev_enabled && !now_enabled) {
         DEBUG_BL0937(peripheral, "all ports disabled, disabling peripheral");
     }
-    else if (!prev_enabled_ports_mask && user_data->enabled_ports_mask) {
+    else if (!prev_enabled && now_enabled) {
         DEBUG_BL0937(peripheral, "first port enabled, enabling peripheral");
 
         if (!user_data->interrupt_handler_added) {
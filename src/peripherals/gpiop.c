@@ -18,11 +18,13 @@
 
 #include <c_types.h>
 #include <gpio.h>
+#include <user_interface.h>
 
 #include "espgoodies/common.h"
 #include "espgoodies/drivers/gpio.h"
 
 #include "common.h"
+#include "core.h"
 #include "peripherals.h"
 #include "ports.h"
 
@@ -34,40 +36,92 @@
 #define FLAG_NO_PULL_DOWN      2
 #define FLAG_NO_DEF_VAL        3
 #define FLAG_NO_IGNORE_DEF_VAL 4
+#define FLAG_NO_INTERRUPT      5
 
 #define PARAM_NO_PIN           0
 
 
 typedef struct {
 
-    uint8 pin;
-    bool  output;
-    bool  value;
+    uint8         pin;
+    bool          output;
+    bool          value;
+
+    bool          interrupt_handler_added;
+    volatile bool latched;        /* Tells if an edge occurred since last read */
+    volatile bool latched_value;  /* Value right after the first edge since last read */
 
 } user_data_t;
 
 
+static void                     handle_gpio_interrupt(uint8 gpio_no, bool value, port_t *port);
+static void   ICACHE_FLASH_ATTR set_interrupt_enabled(port_t *port, bool enabled);
+
 static void   ICACHE_FLASH_ATTR configure(port_t *port, bool enabled);
 static double ICACHE_FLASH_ATTR read_value(port_t *port);
 static bool   ICACHE_FLASH_ATTR write_value(port_t *port, double value);
 
 static void   ICACHE_FLASH_ATTR init(peripheral_t *peripheral);
+static void   ICACHE_FLASH_ATTR cleanup(peripheral_t *peripheral);
 static void   ICACHE_FLASH_ATTR make_ports(peripheral_t *peripheral, port_t **ports, uint8 *ports_len);
 
 
 peripheral_type_t peripheral_type_gpiop = {
 
     .init = init,
+    .cleanup = cleanup,
     .make_ports = make_ports
 
 };
 
 
+void handle_gpio_interrupt(uint8 gpio_no, bool value, port_t *port) {
+    user_data_t *user_data = port->peripheral->user_data;
+
+    /* Only the first edge since last read is latched, so that a short pulse is reported as two changes rather than
+     * being missed altogether */
+    if (!user_data->latched) {
+        user_data->latched = TRUE;
+        user_data->latched_value = value;
+    }
+
+    core_port_interrupt(port);
+}
+
+void set_interrupt_enabled(port_t *port, bool enabled) {
+    user_data_t *user_data = port->peripheral->user_data;
+
+    if (enabled) {
+        port->flags |= PORT_FLAG_INTERRUPT;
+        if (!user_data->interrupt_handler_added) {
+            DEBUG_GPIOP_PORT(port, "interrupt enabled");
+            user_data->interrupt_handler_added = TRUE;
+            user_data->latched = FALSE;
+            gpio_interrupt_handler_add(
+                user_data->pin,
+                GPIO_INTERRUPT_ANY_EDGE,
+                (gpio_interrupt_handler_t) handle_gpio_interrupt,
+                port
+            );
+        }
+    }
+    else {
+        port->flags &= ~PORT_FLAG_INTERRUPT;
+        if (user_data->interrupt_handler_added) {
+            DEBUG_GPIOP_PORT(port, "interrupt disabled");
+            user_data->interrupt_handler_added = FALSE;
+            gpio_interrupt_handler_remove(user_data->pin, (gpio_interrupt_handler_t) handle_gpio_interrupt);
+        }
+    }
+}
+
+
 void configure(port_t *port, bool enabled) {
     user_data_t *user_data = port->peripheral->user_data;
 
     /* If port disabled, leave GPIO as input, pulled down (probably floating) */
     if (!enabled) {
+        set_interrupt_enabled(port, FALSE);
         gpio_configure_input(user_data->pin, /* pull = */ FALSE);
         return;
     }
@@ -104,10 +158,14 @@ void configure(port_t *port, bool enabled) {
         value = gpio_read_value(user_data->pin);
         gpio_configure_output(user_data->pin, value);
         user_data->value = value;
+        set_interrupt_enabled(port, FALSE);
     }
     else {
         DEBUG_GPIOP_PORT(port, "output disabled");
         gpio_configure_input(user_data->pin, value);
+
+        /* GPIO16 can't generate interrupts and is always sampled */
+        set_interrupt_enabled(port, PERIPHERAL_GET_FLAG(port->peripheral, FLAG_NO_INTERRUPT) && user_data->pin != 16);
     }
 }
 
@@ -117,9 +175,22 @@ double read_value(port_t *port) {
     if (user_data->output) {
         return user_data->value; /* Use cached value instead of reading actual GPIO value */
     }
-    else {
-        return gpio_read_value(user_data->pin);
+
+    if (IS_PORT_INTERRUPT(port) && user_data->latched) {
+        ETS_INTR_LOCK();
+        bool value = user_data->latched_value;
+        user_data->latched = FALSE;
+        ETS_INTR_UNLOCK();
+
+        /* If the pin went back since, have it read again right away */
+        if (gpio_read_value(user_data->pin) != value) {
+            core_port_interrupt(port);
+        }
+
+        return value;
     }
+
+    return gpio_read_value(user_data->pin);
 }
 
 bool write_value(port_t *port, double value) {
@@ -142,6 +213,14 @@ void init(peripheral_t *peripheral) {
     peripheral->user_data = user_data;
 }
 
+void cleanup(peripheral_t *peripheral) {
+    user_data_t *user_data = peripheral->user_data;
+
+    if (user_data->interrupt_handler_added) {
+        gpio_interrupt_handler_remove(user_data->pin, (gpio_interrupt_handler_t) handle_gpio_interrupt);
+    }
+}
+
 void make_ports(peripheral_t *peripheral, port_t **ports, uint8 *ports_len) {
     user_data_t *user_data = peripheral->user_data;
     port_t *port = port_new();
@@ -47,6 +47,7 @@
 
 #define READ_TIMEOUT       50000 /* Microseconds */
 #define WRITE_TIMEOUT      50000 /* Microseconds */
+#define WRITE_DELAY        1     /* Milliseconds, between queued DP frames or attempts to send one */
 #define SYNC_TIMEOUT       1000  /* Milliseconds */
 #define HEARTBEAT_INTERVAL 15000 /* Milliseconds */
 
@@ -144,20 +145,34 @@ typedef struct {
 
 } dp_details_t;
 
+typedef struct write_request {
+
+    port_t               *port;
+    uint8                *frame;
+    uint16                frame_len;
+    uint64                start_time_us; /* When sending the frame was first attempted */
+    struct write_request *next;
+
+} write_request_t;
+
 typedef struct {
 
-    int64         last_heartbeat_time_ms;
-    int64         last_polling_time_ms;
-    dp_details_t *dp_details;
-    uint8        *dp_details_pos_by_id;
-    uint8         dp_count;
-    uint8         dp_max_id;
-    uint8         flags;
-    uint8         ir_in_pin;
-    uint8         ir_out_pin;
-    bool          heartbeat_pending;
-    bool          last_net_status;
-    uint8         polling_interval;
+    int64            last_heartbeat_time_ms;
+    int64            last_polling_time_ms;
+    dp_details_t    *dp_details;
+    uint8           *dp_details_pos_by_id;
+    uint8            dp_count;
+    uint8            dp_max_id;
+    uint8            flags;
+    uint8            ir_in_pin;
+    uint8            ir_out_pin;
+    bool             heartbeat_pending;
+    bool             last_net_status;
+    uint8            polling_interval;
+
+    /* DP frames waiting to be sent, at most one per port */
+    write_request_t *write_queue;
+    os_timer_t       write_timer;
 
 } user_data_t;
 
@@ -232,7 +247,8 @@ static bool   ICACHE_FLASH_ATTR wait_uart_cmd(
 static uint8  ICACHE_FLASH_ATTR compute_checksum(uint8 *frame, uint16 frame_len);
 
 static double ICACHE_FLASH_ATTR read_value(port_t *port);
-static bool   ICACHE_FLASH_ATTR write_value(port_t *port, double value);
+static bool   ICACHE_FLASH_ATTR write_value_async(port_t *port, double value);
+static void   ICACHE_FLASH_ATTR on_write_timer(void *arg);
 static void   ICACHE_FLASH_ATTR configure(port_t *port, bool enabled);
 
 static void   ICACHE_FLASH_ATTR init_mcu(peripheral_t *peripheral);
@@ -581,7 +597,7 @@ double read_value(port_t *port) {
     return (int32) dp_details->value;
 }
 
-bool write_value(port_t *port, double value) {
+bool write_value_async(port_t *port, double value) {
     uint8 *data;
     uint16 data_len;
     dp_details_t *dp_details = port->user_data;
@@ -608,16 +624,73 @@ bool write_value(port_t *port, double value) {
 
     uint16 frame_len;
     uint8 *frame = make_frame(port->peripheral, CMD_DP_SET, data, data_len, &frame_len);
-    uint16 size = uart_write(UART_NO, frame, frame_len, WRITE_TIMEOUT);
-    free(frame);
-    if (size != frame_len) {
-        DEBUG_TUYA_MCU(peripheral, "failed to write frame");
-        return FALSE;
+
+    /* The frame is sent from a timer, so that callers don't wait for the UART; a frame that is still waiting for the
+     * same port is simply replaced, as only the last value matters */
+    user_data_t *user_data = peripheral->user_data;
+    write_request_t *request, **last = &user_data->write_queue;
+    for (request = user_data->write_queue; request; request = request->next) {
+        if (request->port == port) {
+            free(request->frame);
+            request->frame = frame;
+            request->frame_len = frame_len;
+            return TRUE;
+        }
+        last = &request->next;
+    }
+
+    request = zalloc(sizeof(write_request_t));
+    request->port = port;
+    request->frame = frame;
+    request->frame_len = frame_len;
+    *last = request;
+
+    if (request == user_data->write_queue) {
+        os_timer_disarm(&user_data->write_timer);
+        os_timer_setfn(&user_data->write_timer, on_write_timer, peripheral);
+        os_timer_arm(&user_data->write_timer, WRITE_DELAY, /* repeat = */ FALSE);
     }
 
     return TRUE;
 }
 
+void on_write_timer(void *arg) {
+    peripheral_t *peripheral = arg;
+    user_data_t *user_data = peripheral->user_data;
+    write_request_t *request = user_data->write_queue;
+    if (!request) {
+        return;
+    }
+
+    /* The frame goes to the TX FIFO as a whole, so that it's never interleaved with other frames; while the FIFO has no
+     * room for it, it waits for the next shot, instead of busy-waiting for the UART to drain */
+    uint64 now_us = system_uptime_us();
+    if (!request->start_time_us) {
+        request->start_time_us = now_us;
+    }
+
+    bool done = uart_write_fifo(UART_NO, request->frame, request->frame_len);
+    if (!done && now_us - request->start_time_us < WRITE_TIMEOUT) {
+        os_timer_arm(&user_data->write_timer, WRITE_DELAY, /* repeat = */ FALSE);
+        return;
+    }
+
+    user_data->write_queue = request->next;
+
+    if (!done) {
+        DEBUG_TUYA_MCU(peripheral, "failed to write frame");
+    }
+    port_write_done(request->port, done);
+
+    free(request->frame);
+    free(request);
+
+    /* Send one frame at a time, leaving room for other tasks in between */
+    if (user_data->write_queue) {
+        os_timer_arm(&user_data->write_timer, WRITE_DELAY, /* repeat = */ FALSE);
+    }
+}
+
 void configure(port_t *port, bool enabled) {
     peripheral_t *peripheral = port->peripheral;
     user_data_t *user_data = peripheral->user_data;
@@ -1106,6 +1179,14 @@ void cleanup(peripheral_t *peripheral) {
 
     free(user_data->dp_details);
     free(user_data->dp_details_pos_by_id);
+
+    os_timer_disarm(&user_data->write_timer);
+    write_request_t *request;
+    while ((request = user_data->write_queue)) {
+        user_data->write_queue = request->next;
+        free(request->frame);
+        free(request);
+    }
 }
 
 void make_ports(peripheral_t *peripheral, port_t **ports, uint8 *ports_len) {
@@ -1198,7 +1279,7 @@ void make_ports(peripheral_t *peripheral, port_t **ports, uint8 *ports_len) {
 
         port->slot = -1;
         port->read_value = read_value;
-        port->write_value = write_value;
+        port->write_value_async = write_value_async;
         port->configure = configure;
         ports[(*ports_len)++] = port;
     }
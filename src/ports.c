@@ -32,16 +32,37 @@
 #include "config.h"
 #include "core.h"
 #include "events.h"
+#include "journal.h"
 #include "peripherals.h"
 #include "stringpool.h"
+#include "stats.h"
 #include "virtual.h"
 #include "ports.h"
 
 
+#define ID_INDEX_SIZE (PORT_MAX_SLOTS * 2) /* Keeps the index at most half full, for short probe sequences */
+
+
 port_t        **all_ports = NULL;
 int             all_ports_count = 0;
+port_slot_t    *port_slots = NULL;
+uint8           port_slot_index[PORT_MAX_SLOTS]; /* Record of each used slot, within port_slots */
+
+uint8           port_slots_count = 0;
 
-static uint32   used_slots = 0;
+static portset_t used_slots;
+static uint8     id_index[ID_INDEX_SIZE]; /* Open addressing hash table of port slots + 1, by ID; 0 means empty */
+
+#if CONFIG_OFFS_PORT_BASE + CONFIG_PORT_SIZE * CONFIG_BASE_PORTS > CONFIG_OFFS_PERIPHERALS_BASE
+#error "Ports configuration doesn't fit before peripherals configuration"
+#endif
+#if CONFIG_OFFS_STR_BASE + CONFIG_STR_SIZE > CONFIG_OFFS_PORT_EXTRA_BASE || \
+    CONFIG_OFFS_PORT_EXTRA_BASE + CONFIG_PORT_SIZE * (CONFIG_MAX_PORTS - CONFIG_BASE_PORTS) > FLASH_CONFIG_SIZE_DEFAULT
+#error "Extra ports configuration doesn't fit after strings pool"
+#endif
+#if PORT_SLOT_VIRTUAL0 + VIRTUAL_MAX_PORTS > CONFIG_MAX_PORTS || CONFIG_MAX_PORTS > PORT_MAX_SLOTS
+#error "Virtual port slots must be persisted and all persisted slots must be usable"
+#endif
 
 
 static int64  ICACHE_FLASH_ATTR attr_get_param_uint8(port_t *port, attrdef_t *attrdef);
@@ -79,6 +100,9 @@ static void   ICACHE_FLASH_ATTR attr_set_user_data_cache(port_t *port, attrdef_t
 static void   ICACHE_FLASH_ATTR port_load(port_t *port, uint8 *config_data);
 static void   ICACHE_FLASH_ATTR port_save(port_t *port, uint8 *config_data, uint32 *strings_offs);
 
+static uint32 ICACHE_FLASH_ATTR id_hash(char *id);
+static void   ICACHE_FLASH_ATTR id_index_add(port_t *port);
+
 
 int64 attr_get_param_uint8(port_t *port, attrdef_t *attrdef) {
     uint8 v = PERIPHERAL_PARAM_UINT8(port->peripheral, attrdef->storage_param_no);
@@ -329,14 +353,21 @@ void attr_set_user_data_cache(port_t *port, attrdef_t *attrdef, double value) {
 }
 
 void port_load(port_t *port, uint8 *config_data) {
-    uint8 *base_ptr = config_data + CONFIG_OFFS_PORT_BASE + CONFIG_PORT_SIZE * port->slot;
+    uint8 *base_ptr = CONFIG_PORT_RECORD(config_data, port->slot);
     char *strings_ptr = (char *) config_data + CONFIG_OFFS_STR_BASE;
 
+    /* Ports without a configuration record start with default attributes */
+    static uint8 default_data[CONFIG_PORT_SIZE];
+    if (!base_ptr) {
+        DEBUG_PORT(port, "not persisted, using defaults");
+        base_ptr = default_data;
+    }
+
     /* id */
     free(port->id);
     port->id = string_pool_read_dup(strings_ptr, base_ptr + PORT_CONFIG_OFFS_ID);
     if (!port->id) {
-        char dummy_id[7];
+        char dummy_id[9]; /* "port" followed by an int8 slot */
         snprintf(dummy_id, sizeof(dummy_id), "port%02d", port->slot);
         port->id = strdup(dummy_id);
     }
@@ -378,6 +409,7 @@ void port_load(port_t *port, uint8 *config_data) {
     /* value */
     if (IS_PORT_PERSISTED(port)) {
         memcpy(&port->last_read_value, base_ptr + PORT_CONFIG_OFFS_VALUE, sizeof(double));
+        port->last_persisted_value = port->last_read_value;
 
         if (IS_UNDEFINED(port->last_read_value)) {
             DEBUG_PORT(port, "persisted value = (undefined)");
@@ -389,15 +421,38 @@ void port_load(port_t *port, uint8 *config_data) {
 
     /* sampling_interval */
     memcpy(&port->sampling_interval, base_ptr + PORT_CONFIG_OFFS_SAMP_INT, 4);
-    port->last_sample_time_ms = -LLONG_MAX;
 
     DEBUG_PORT(port, "sampling_interval = %d ms", port->sampling_interval);
 
+    /* Value-change events */
+    memcpy(&port->change_threshold, base_ptr + PORT_CONFIG_OFFS_CHG_THRES, sizeof(double));
+    memcpy(&port->min_event_interval, base_ptr + PORT_CONFIG_OFFS_MIN_EVT, 4);
+    if (!(port->change_threshold >= 0)) { /* Also catches NaN */
+        port->change_threshold = 0;
+    }
+
+    DEBUG_PORT(
+        port,
+        "change_threshold = %s%s",
+        dtostr(port->change_threshold, -1),
+        IS_PORT_REL_THRESHOLD(port) ? "%" : ""
+    );
+    DEBUG_PORT(port, "min_event_interval = %d ms", port->min_event_interval);
+
+    /* Persisted values */
+    memcpy(&port->persist_interval, base_ptr + PORT_CONFIG_OFFS_PERS_INT, 4);
+    memcpy(&port->persist_threshold, base_ptr + PORT_CONFIG_OFFS_PERS_THR, sizeof(double));
+    if (!(port->persist_threshold >= 0)) { /* Also catches NaN */
+        port->persist_threshold = 0;
+    }
+
+    DEBUG_PORT(port, "persist_interval = %d ms", port->persist_interval);
+    DEBUG_PORT(port, "persist_threshold = %s", dtostr(port->persist_threshold, -1));
+
     /* Heart beat */
     if (!port->heart_beat_interval) {
         port->heart_beat_interval = PORT_DEF_HEART_BEAT_INT;
     }
-    port->last_heart_beat_time_ms = -LLONG_MAX;
 
     DEBUG_PORT(port, "heart_beat_interval = %d ms", port->heart_beat_interval);
 
@@ -448,9 +503,6 @@ void port_load(port_t *port, uint8 *config_data) {
         }
     }
 
-    /* Sequence */
-    port->sequence_pos = -1;
-
     /* Prepare custom attributes */
     if (port->attrdefs) {
         attrdef_t *a, **attrdefs = port->attrdefs;
@@ -516,9 +568,13 @@ void port_load(port_t *port, uint8 *config_data) {
 }
 
 void port_save(port_t *port, uint8 *config_data, uint32 *strings_offs) {
-    uint8 *base_ptr = config_data + CONFIG_OFFS_PORT_BASE + CONFIG_PORT_SIZE * port->slot;
+    uint8 *base_ptr = CONFIG_PORT_RECORD(config_data, port->slot);
     char *strings_ptr = (char *) config_data + CONFIG_OFFS_STR_BASE;
 
+    if (!base_ptr) {
+        return;
+    }
+
     /* id */
     if (!string_pool_write(strings_ptr, strings_offs, port->id, base_ptr + PORT_CONFIG_OFFS_ID)) {
         DEBUG_PORT(port, "no more strings pool space");
@@ -539,8 +595,9 @@ void port_save(port_t *port, uint8 *config_data, uint32 *strings_offs) {
     /* Flags */
     memcpy(base_ptr + PORT_CONFIG_OFFS_FLAGS, &port->flags, 4);
 
-    /* value */
+    /* value; once saved, it is also the persisted value */
     memcpy(base_ptr + PORT_CONFIG_OFFS_VALUE, &port->last_read_value, sizeof(double));
+    port->last_persisted_value = port->last_read_value;
 
     /* min */
     memcpy(base_ptr + PORT_CONFIG_OFFS_MIN, &port->min, sizeof(double));
@@ -554,6 +611,12 @@ void port_save(port_t *port, uint8 *config_data, uint32 *strings_offs) {
     /* sampling_interval */
     memcpy(base_ptr + PORT_CONFIG_OFFS_SAMP_INT, &port->sampling_interval, 4);
 
+    /* Value-change events */
+    memcpy(base_ptr + PORT_CONFIG_OFFS_CHG_THRES, &port->change_threshold, sizeof(double));
+    memcpy(base_ptr + PORT_CONFIG_OFFS_MIN_EVT, &port->min_event_interval, 4);
+    memcpy(base_ptr + PORT_CONFIG_OFFS_PERS_INT, &port->persist_interval, 4);
+    memcpy(base_ptr + PORT_CONFIG_OFFS_PERS_THR, &port->persist_threshold, sizeof(double));
+
     /* value expression */
     if (!string_pool_write(strings_ptr, strings_offs, port->sexpr, base_ptr + PORT_CONFIG_OFFS_EXPR)) {
         DEBUG_PORT(port, "no more strings pool space");
@@ -608,6 +671,13 @@ void ports_init(uint8 *config_data) {
         port_load(port, config_data);
     }
 
+    /* Persisted values journaled since the configuration was last saved override the loaded ones */
+    journal_load();
+
+    /* Transform expressions have been parsed while port IDs were still being loaded */
+    ports_rebuild_id_index();
+    ports_rebind_expressions();
+
     /* Do a second round to configure all ports and set their initial values */
     for (i = 0; i < all_ports_count; i++) {
         port = all_ports[i];
@@ -640,6 +710,7 @@ void ports_init(uint8 *config_data) {
         }
         else { /* Read-only ports start as undefined */
             port->last_read_value = UNDEFINED;
+            port->last_persisted_value = UNDEFINED;
         }
     }
 }
@@ -657,7 +728,7 @@ void ports_save(uint8 *config_data, uint32 *strings_offs) {
 }
 
 bool ports_slot_busy(uint8 slot) {
-    return !!(used_slots & BIT(slot));
+    return slot < PORT_MAX_SLOTS && PORTSET_HAS(&used_slots, slot);
 }
 
 int8 ports_next_slot() {
@@ -667,18 +738,19 @@ int8 ports_next_slot() {
      * extra slots. If no extra slot is available, look through standard slots as well. */
 
     for (slot = PORT_SLOT_EXTRA0; slot < PORT_SLOT_VIRTUAL0; slot++) {
-        if (!(used_slots & BIT(slot))) {
+        if (!PORTSET_HAS(&used_slots, slot)) {
             return slot;
         }
     }
 
     /* If no extra slot is free, try the regular slots */
     for (slot = 0; slot < PORT_SLOT_EXTRA0; slot++) {
-        if (!(used_slots & BIT(slot))) {
+        if (!PORTSET_HAS(&used_slots, slot)) {
             return slot;
         }
     }
 
+    /* Slots past the persisted ones, if any, are never handed out, as their ports would lose their attributes */
     return -1;
 }
 
@@ -689,12 +761,36 @@ void ports_rebuild_change_dep_mask(void) {
     }
 }
 
+void ports_rebuild_id_index(void) {
+    memset(id_index, 0, sizeof(id_index));
+    for (int i = 0; i < all_ports_count; i++) {
+        id_index_add(all_ports[i]);
+    }
+}
+
+void ports_rebind_expressions(void) {
+    /* Port expressions hold pointers to the ports they refer to; these need to be looked up again whenever ports are
+     * added, removed or get their IDs changed */
+    port_t *p;
+    for (int i = 0; i < all_ports_count; i++) {
+        p = all_ports[i];
+        if (p->expr) {
+            expr_bind_ports(p->expr);
+        }
+        if (p->transform_read) {
+            expr_bind_ports(p->transform_read);
+        }
+        if (p->transform_write) {
+            expr_bind_ports(p->transform_write);
+        }
+    }
+}
+
 port_t *port_new(void) {
     port_t *port = zalloc(sizeof(port_t));
 
     port->last_read_value = UNDEFINED;
     port->change_reason = CHANGE_REASON_NATIVE;
-    port->sequence_pos = -1;
 
     return port;
 }
@@ -742,7 +838,7 @@ void port_cleanup(port_t *port, bool free_id) {
     port->stransform_write = NULL;
 
     /* Cancel sequence */
-    if (port->sequence_pos >= 0) {
+    if (port->sequence) {
         port_sequence_cancel(port);
     }
 }
@@ -846,14 +942,29 @@ void port_register(port_t *port) {
         }
     }
 
-    used_slots |= BIT(port->slot);
+    PORTSET_ADD(&used_slots, port->slot);
+    port_slots = realloc(port_slots, (port_slots_count + 1) * sizeof(port_slot_t));
+    port_slot_index[port->slot] = port_slots_count++;
+    port_slot_t *port_slot = PORT_SLOT(port);
+    memset(port_slot, 0, sizeof(port_slot_t));
+    port_slot->port = port;
+    port_slot->slot = port->slot;
+    port_slot->last_sample_time_ms = -LLONG_MAX;
+    port_slot->last_heart_beat_time_ms = -LLONG_MAX;
+    STATS_PORT_RESET(port);
 
     if (!port->id) { /* Port may not have an ID when registered */
-        char dummy_id[7];
+        char dummy_id[9]; /* "port" followed by an int8 slot */
         snprintf(dummy_id, sizeof(dummy_id), "port%02d", port->slot);
         port->id = strdup(dummy_id);
     }
 
+    id_index_add(port);
+
+    ports_rebind_expressions();
+    core_invalidate_eval_order();
+    core_invalidate_poll_schedule();
+
     DEBUG_PORT(port, "registered");
 }
 
@@ -885,7 +996,31 @@ bool port_unregister(port_t *port) {
         all_ports_count = 0;
     }
 
-    used_slots &= ~BIT(port->slot);
+    PORTSET_REMOVE(&used_slots, port->slot);
+
+    /* The last record takes the place of the removed one */
+    uint8 index = port_slot_index[port->slot];
+    if (index < --port_slots_count) {
+        port_slots[index] = port_slots[port_slots_count];
+        port_slot_index[port_slots[index].slot] = index;
+    }
+
+    if (port_slots_count) {
+        port_slots = realloc(port_slots, port_slots_count * sizeof(port_slot_t));
+    }
+    else {
+        free(port_slots);
+        port_slots = NULL;
+    }
+
+    /* Removing entries from an open addressing table would require moving the following ones; ports are rarely
+     * unregistered, so simply start over */
+    ports_rebuild_id_index();
+
+    /* Make sure no expression is left pointing to this port */
+    ports_rebind_expressions();
+    core_invalidate_eval_order();
+    core_invalidate_poll_schedule();
 
     DEBUG_PORT(port, "unregistered");
 
@@ -900,61 +1035,58 @@ bool port_unregister(port_t *port) {
 
 port_t *port_find_by_id(char *id) {
     port_t *p;
-    int i;
-    for (i = 0; i < all_ports_count; i++) {
-        p = all_ports[i];
+    uint32 i = id_hash(id) % ID_INDEX_SIZE;
+    while (id_index[i]) {
+        p = PORT_SLOT_AT(id_index[i] - 1)->port;
         if (!strcmp(p->id, id)) {
             return p;
         }
+
+        i = (i + 1) % ID_INDEX_SIZE;
     }
 
-    return NULL;    
+    return NULL;
 }
 
 port_t *port_find_by_slot(uint8 slot) {
-    port_t *p;
-    int i;
-    for (i = 0; i < all_ports_count; i++) {
-        p = all_ports[i];
-        if (p->slot == slot) {
-            return p;
-        }
+    if (slot >= PORT_MAX_SLOTS || !PORTSET_HAS(&used_slots, slot)) {
+        return NULL;
     }
 
-    return NULL;
+    return PORT_SLOT_AT(slot)->port;
 }
 
 void port_rebuild_change_dep_mask(port_t *the_port) {
-    the_port->change_dep_mask = 0;
+    if (!PORTSET_HAS(&used_slots, the_port->slot)) {
+        return; /* Not registered yet */
+    }
+
+    portset_t *change_dep_mask = &PORT_SLOT(the_port)->change_dep_mask;
+    portset_clear(change_dep_mask);
+
+    /* Expressions evaluation order depends on change dependency masks */
+    core_invalidate_eval_order();
 
     if (!the_port->expr) {
         return;
     }
 
-    the_port->change_dep_mask = expr_get_port_deps(the_port->expr);
+    expr_get_port_deps(the_port->expr, change_dep_mask);
 
     if (expr_is_time_dep(the_port->expr)) {
-        the_port->change_dep_mask |= (1ULL << TIME_EXPR_DEP_BIT);
-    }
-    if (expr_is_time_ms_dep(the_port->expr)) {
-        the_port->change_dep_mask |= (1ULL << TIME_MS_EXPR_DEP_BIT);
+        PORTSET_ADD(change_dep_mask, TIME_EXPR_DEP_BIT);
     }
 
-    DEBUG_PORT(the_port, "change dependency mask is " FMT_UINT64_HEX, FMT_UINT64_VAL(the_port->change_dep_mask));
+    DEBUG_PORT(the_port, "change dependency mask rebuilt");
 }
 
 void port_sequence_cancel(port_t *port) {
     DEBUG_PORT(port, "canceling sequence");
-    free(port->sequence_values);
-    free(port->sequence_delays);
-    port->sequence_pos = -1;
-    port->sequence_repeat = -1;
-
-    if (port->sequence_timer) {
-        os_timer_disarm(port->sequence_timer);
-    }
-    free(port->sequence_timer);
-    port->sequence_timer = NULL;
+    os_timer_disarm(&port->sequence->timer);
+    free(port->sequence->values);
+    free(port->sequence->delays);
+    free(port->sequence);
+    port->sequence = NULL;
 }
 
 void port_expr_remove(port_t *port) {
@@ -969,8 +1101,26 @@ void port_expr_remove(port_t *port) {
     port->sexpr = NULL;
 }
 
+uint32 port_get_expr_heap_size(port_t *port) {
+    uint32 size = 0;
+
+    if (port->expr) {
+        size += expr_get_heap_size(port->expr);
+    }
+    if (port->transform_read) {
+        size += expr_get_heap_size(port->transform_read);
+    }
+    if (port->transform_write) {
+        size += expr_get_heap_size(port->transform_write);
+    }
+
+    return size;
+}
+
 double port_read_value(port_t *port) {
+    STATS_START(start_us);
     double value = port->read_value(port);
+    STATS_PORT_READ(port, start_us);
     if (IS_UNDEFINED(value)) {
         return UNDEFINED;
     }
@@ -1003,7 +1153,23 @@ bool port_write_value(port_t *port, double value, char reason) {
 
     DEBUG_PORT(port, "setting value %s, reason = %c", dtostr(value, -1), reason);
 
-    bool result = port->write_value(port, value);
+    bool result;
+    STATS_START(start_us);
+    if (port->write_value_async) {
+        /* The change reason is only set when the write completes, so that polling rounds in between don't consume
+         * it; drivers may complete the write before returning */
+        port->write_reason = reason;
+        result = port->write_value_async(port, value);
+        STATS_PORT_WRITE(port, start_us);
+        if (!result) {
+            DEBUG_PORT(port, "queueing value failed");
+        }
+
+        return result;
+    }
+
+    result = port->write_value(port, value);
+    STATS_PORT_WRITE(port, start_us);
     if (!result) {
         DEBUG_PORT(port, "setting value failed");
     }
@@ -1013,6 +1179,18 @@ bool port_write_value(port_t *port, double value, char reason) {
     return result;
 }
 
+void port_write_done(port_t *port, bool success) {
+    if (!success) {
+        DEBUG_PORT(port, "setting value failed");
+        return;
+    }
+
+    DEBUG_PORT(port, "value set, reason = %c", port->write_reason);
+
+    port->change_reason = port->write_reason;
+    core_port_interrupt(port);
+}
+
 json_t *port_make_json_value(port_t *port) {
     if (IS_UNDEFINED(port->last_read_value) || !IS_PORT_ENABLED(port)) {
         return json_null_new();
@@ -1032,6 +1210,7 @@ json_t *port_make_json_value(port_t *port) {
 void port_enable(port_t *port) {
     DEBUG_PORT(port, "enabling");
     port->flags |= PORT_FLAG_ENABLED;
+    core_invalidate_poll_schedule();
 
     /* Rebuild expression */
     if (port->expr) {
@@ -1058,6 +1237,7 @@ void port_enable(port_t *port) {
 void port_disable(port_t *port) {
     DEBUG_PORT(port, "disabling");
     port->flags &= ~PORT_FLAG_ENABLED;
+    core_invalidate_poll_schedule();
 
     /* Destroy value expression */
     if (port->expr) {
@@ -1066,7 +1246,7 @@ void port_disable(port_t *port) {
     }
 
     /* Cancel sequence */
-    if (port->sequence_pos >= 0) {
+    if (port->sequence) {
         port_sequence_cancel(port);
     }
 }
@@ -1089,3 +1269,23 @@ void port_configure(port_t *port) {
         port->configure(port, IS_PORT_ENABLED(port));
     }
 }
+
+uint32 id_hash(char *id) {
+    /* FNV-1a */
+    uint32 hash = 2166136261UL;
+    while (*id) {
+        hash ^= (uint8) *id++;
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+void id_index_add(port_t *port) {
+    uint32 i = id_hash(port->id) % ID_INDEX_SIZE;
+    while (id_index[i]) {
+        i = (i + 1) % ID_INDEX_SIZE;
+    }
+
+    id_index[i] = port->slot + 1;
+}
@@ -27,6 +27,7 @@
 #include "espgoodies/json.h"
 
 #include "expr.h"
+#include "portset.h"
 
 
 #ifdef _DEBUG_PORTS
@@ -73,7 +74,10 @@
 #define PORT_FLAG_WRITABLE        0x00000002
 #define PORT_FLAG_SET             0x00000004
 #define PORT_FLAG_PERSISTED       0x00000008
-#define PORT_FLAG_INTERNAL        0x00000010 /* 0x00000020 - 0x00000800: reserved */
+#define PORT_FLAG_INTERNAL        0x00000010
+#define PORT_FLAG_INTERRUPT       0x00000020 /* Changes are signaled using core_port_interrupt() instead of sampling */
+#define PORT_FLAG_REL_THRESHOLD   0x00000040 /* Change threshold is a percent of the last reported value */
+                                             /* 0x00000080 - 0x00000800: reserved */
 
 #define PORT_FLAG_VIRTUAL_INTEGER 0x00001000
 #define PORT_FLAG_VIRTUAL_TYPE    0x00002000
@@ -100,12 +104,14 @@
 #define PORT_SLOT_EXTRA0   18
 #define PORT_SLOT_VIRTUAL0 24
 
-#define IS_PORT_ENABLED(port)   !!((port)->flags & PORT_FLAG_ENABLED)
-#define IS_PORT_WRITABLE(port)  !!((port)->flags & PORT_FLAG_WRITABLE)
-#define IS_PORT_SET(port)       !!((port)->flags & PORT_FLAG_SET)
-#define IS_PORT_PERSISTED(port) !!((port)->flags & PORT_FLAG_PERSISTED)
-#define IS_PORT_INTERNAL(port)  !!((port)->flags & PORT_FLAG_INTERNAL)
-#define IS_PORT_VIRTUAL(port)   !!((port)->flags & PORT_FLAG_VIRTUAL_ACTIVE)
+#define IS_PORT_ENABLED(port)       !!((port)->flags & PORT_FLAG_ENABLED)
+#define IS_PORT_WRITABLE(port)      !!((port)->flags & PORT_FLAG_WRITABLE)
+#define IS_PORT_SET(port)           !!((port)->flags & PORT_FLAG_SET)
+#define IS_PORT_PERSISTED(port)     !!((port)->flags & PORT_FLAG_PERSISTED)
+#define IS_PORT_INTERNAL(port)      !!((port)->flags & PORT_FLAG_INTERNAL)
+#define IS_PORT_VIRTUAL(port)       !!((port)->flags & PORT_FLAG_VIRTUAL_ACTIVE)
+#define IS_PORT_INTERRUPT(port)     !!((port)->flags & PORT_FLAG_INTERRUPT)
+#define IS_PORT_REL_THRESHOLD(port) !!((port)->flags & PORT_FLAG_REL_THRESHOLD)
 
 #define PORT_CONFIG_OFFS_ID        0x00 /*  4 bytes */
 #define PORT_CONFIG_OFFS_DISP_NAME 0x04 /*  4 bytes */
@@ -120,7 +126,11 @@
 #define PORT_CONFIG_OFFS_TRANS_W   0x38 /*  4 bytes */
 #define PORT_CONFIG_OFFS_TRANS_R   0x3C /*  4 bytes */
 #define PORT_CONFIG_OFFS_SAMP_INT  0x40 /*  4 bytes */
-                                        /* 0x44 - 0x60: reserved */
+#define PORT_CONFIG_OFFS_CHG_THRES 0x44 /*  8 bytes */
+#define PORT_CONFIG_OFFS_MIN_EVT   0x4C /*  4 bytes */
+#define PORT_CONFIG_OFFS_PERS_INT  0x50 /*  4 bytes */
+#define PORT_CONFIG_OFFS_PERS_THR  0x54 /*  8 bytes */
+                                        /* 0x5C - 0x60: reserved */
 
 #define CHANGE_REASON_NATIVE     'N'
 #define CHANGE_REASON_API        'A'
@@ -158,6 +168,17 @@ typedef struct attrdef {
 
 } attrdef_t;
 
+typedef struct {
+
+    os_timer_t  timer;
+    int16       len;
+    int16       pos;
+    int         repeat;
+    double     *values;
+    int        *delays;
+
+} port_sequence_t;
+
 typedef struct port {
 
     /* Various 1-byte sized members put together to optimize structure size */
@@ -165,19 +186,17 @@ typedef struct port {
     char               change_reason;         /* Last value-change reason */
     bool               integer;
     char               type;
+    char               write_reason;          /* Reason of the last asynchronous write, set upon its completion */
 
     struct peripheral *peripheral;
 
     double             last_read_value;       /* Last known value for the port */
 
-    uint64             change_dep_mask;       /* Port change dependency mask */
-
     int                aux;                   /* Member used internally for dependency loops & more */
     void              *user_data;             /* Generic pointer to user data */
 
     /* Sampling */
     uint32             sampling_interval;
-    int64              last_sample_time_ms;
     uint32             min_sampling_interval;
     uint32             max_sampling_interval;
     uint32             def_sampling_interval;
@@ -196,13 +215,8 @@ typedef struct port {
     expr_t            *transform_read;
     char              *stransform_read;
 
-    /* Sequence */
-    os_timer_t        *sequence_timer;
-    int16              sequence_len;
-    int16              sequence_pos;
-    int                sequence_repeat;
-    double            *sequence_values;
-    int               *sequence_delays;
+    /* Sequence; NULL unless a sequence is running */
+    port_sequence_t   *sequence;
 
     /* Common attributes */
     char              *id;
@@ -212,11 +226,24 @@ typedef struct port {
 
     /* Heart beat */
     int                heart_beat_interval;
-    uint64             last_heart_beat_time_ms;
+
+    /* Value-change events */
+    double             change_threshold;      /* Changes smaller than this aren't reported; 0 reports all changes */
+    uint32             min_event_interval;    /* Milliseconds */
+    double             last_event_value;      /* Last reported value */
+    uint64             last_event_time_ms;    /* 0 if no change has been reported yet */
+
+    /* Persisted values */
+    double             persist_threshold;     /* Changes smaller than this aren't persisted; 0 persists all changes */
+    uint32             persist_interval;      /* Milliseconds */
+    double             last_persisted_value;
+    uint64             last_persist_time_ms;  /* 0 if no value has been persisted yet */
 
     /* Callbacks */
     double             (*read_value)(struct port *port);
     bool               (*write_value)(struct port *port, double value);
+    /* Optional; queues the write and returns right away, with port_write_done() called once the write completes */
+    bool               (*write_value_async)(struct port *port, double value);
     void               (*configure)(struct port *port, bool enabled);
     void               (*heart_beat)(struct port *port);
 
@@ -225,6 +252,24 @@ typedef struct port {
 
 } port_t;
 
+/* Run-time state that polling rounds go through for each registered port, kept in one contiguous array with a record
+ * per registered port, instead of within each port's own heap block; records are found by slot through
+ * port_slot_index[], and only stay put until the next port is registered or unregistered. Values, flags and sampling
+ * intervals are not part of it: peripherals, expressions and the API set and read them on ports that don't have a
+ * record yet, or no longer have one. */
+typedef struct {
+
+    int64       last_sample_time_ms;
+    uint64      last_heart_beat_time_ms;
+    portset_t   change_dep_mask;         /* Port change dependency mask */
+    port_t     *port;
+    uint8       slot;                    /* Same as port->slot, so that loops over records don't visit the port */
+
+} port_slot_t;
+
+#define PORT_SLOT_AT(slot)          (&port_slots[port_slot_index[slot]])
+#define PORT_SLOT(port)             PORT_SLOT_AT((port)->slot)
+
 
 typedef int64   (*int_getter_t)(struct port *port, attrdef_t *attrdef);
 typedef void    (*int_setter_t)(struct port *port, attrdef_t *attrdef, int64 value);
@@ -236,8 +281,11 @@ typedef double  (*float_getter_t)(struct port *port, attrdef_t *attrdef);
 typedef void    (*float_setter_t)(struct port *port, attrdef_t *attrdef, double value);
 
 
-extern port_t **all_ports;
-extern int      all_ports_count;
+extern port_t      **all_ports;
+extern int           all_ports_count;
+extern port_slot_t  *port_slots;
+extern uint8         port_slots_count;
+extern uint8         port_slot_index[];
 
 
 void   ICACHE_FLASH_ATTR  ports_init(uint8 *config_data);
@@ -246,6 +294,9 @@ void   ICACHE_FLASH_ATTR  ports_save(uint8 *config_data, uint32 *strings_offs);
 bool   ICACHE_FLASH_ATTR  ports_slot_busy(uint8 slot);
 int8   ICACHE_FLASH_ATTR  ports_next_slot(void);
 void   ICACHE_FLASH_ATTR  ports_rebuild_change_dep_mask(void);
+/* Must be called whenever IDs of registered ports change */
+void   ICACHE_FLASH_ATTR  ports_rebuild_id_index(void);
+void   ICACHE_FLASH_ATTR  ports_rebind_expressions(void);
 
 port_t ICACHE_FLASH_ATTR *port_new(void);
 void   ICACHE_FLASH_ATTR  port_cleanup(port_t *port, bool free_id);
@@ -256,8 +307,12 @@ port_t ICACHE_FLASH_ATTR *port_find_by_slot(uint8 slot);
 void   ICACHE_FLASH_ATTR  port_rebuild_change_dep_mask(port_t *port);
 void   ICACHE_FLASH_ATTR  port_sequence_cancel(port_t *port);
 void   ICACHE_FLASH_ATTR  port_expr_remove(port_t *port);
+uint32 ICACHE_FLASH_ATTR  port_get_expr_heap_size(port_t *port);
 double ICACHE_FLASH_ATTR  port_read_value(port_t *port);
 bool   ICACHE_FLASH_ATTR  port_write_value(port_t *port, double value, char reason);
+/* Called by drivers when an asynchronous write completes; has the port read right away, so that the resulting value
+ * change is reported with the reason of the write */
+void   ICACHE_FLASH_ATTR  port_write_done(port_t *port, bool success);
 json_t ICACHE_FLASH_ATTR *port_make_json_value(port_t *port);
 void   ICACHE_FLASH_ATTR  port_enable(port_t *port);
 void   ICACHE_FLASH_ATTR  port_disable(port_t *port);
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <string.h>
+
+#include "espgoodies/common.h"
+
+#include "portset.h"
+
+
+void portset_clear(portset_t *set) {
+    memset(set, 0, sizeof(portset_t));
+}
+
+void portset_fill(portset_t *set) {
+    memset(set, 0xFF, sizeof(portset_t));
+}
+
+bool portset_is_empty(portset_t *set) {
+    for (int i = 0; i < PORTSET_WORDS; i++) {
+        if (set->words[i]) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+void portset_union(portset_t *set, portset_t *other) {
+    for (int i = 0; i < PORTSET_WORDS; i++) {
+        set->words[i] |= other->words[i];
+    }
+}
+
+bool portset_intersects(portset_t *set, portset_t *other) {
+    for (int i = 0; i < PORTSET_WORDS; i++) {
+        if (set->words[i] & other->words[i]) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+bool portset_intersects_except(portset_t *set, portset_t *other, int bit) {
+    uint32 common;
+    for (int i = 0; i < PORTSET_WORDS; i++) {
+        common = set->words[i] & other->words[i];
+        if (i == bit / 32) {
+            common &= ~BIT(bit % 32);
+        }
+        if (common) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef _PORTSET_H
+#define _PORTSET_H
+
+
+#include <c_types.h>
+
+#include "espgoodies/common.h"
+
+
+/* Port slots are numbered from 0 to PORT_MAX_SLOTS - 1; only the first CONFIG_MAX_PORTS slots have their attributes
+ * persisted and are handed out to ports, so builds that raise this also need to make room for more ports in the
+ * configuration */
+#ifndef PORT_MAX_SLOTS
+#define PORT_MAX_SLOTS 40
+#endif
+
+/* Slots are kept in int8 values, and slot counts in uint8 ones */
+#if PORT_MAX_SLOTS > 127
+#error "PORT_MAX_SLOTS must not exceed 127"
+#endif
+
+#define PORTSET_BIT_TIME        PORT_MAX_SLOTS /* Extra bit, right after port slots, for time dependencies */
+#define PORTSET_WORDS           ((PORT_MAX_SLOTS + 1 + 31) / 32)
+
+#define PORTSET_ADD(set, bit)    ((set)->words[(bit) / 32] |= BIT((bit) % 32))
+#define PORTSET_REMOVE(set, bit) ((set)->words[(bit) / 32] &= ~BIT((bit) % 32))
+#define PORTSET_HAS(set, bit)    (!!((set)->words[(bit) / 32] & BIT((bit) % 32)))
+
+
+/* Set of port slots, used for dependencies, changes & more */
+typedef struct {
+
+    uint32 words[PORTSET_WORDS];
+
+} portset_t;
+
+
+void ICACHE_FLASH_ATTR portset_clear(portset_t *set);
+void ICACHE_FLASH_ATTR portset_fill(portset_t *set);
+/* Must not be in flash, as it's called from ISRs */
+bool                   portset_is_empty(portset_t *set);
+void ICACHE_FLASH_ATTR portset_union(portset_t *set, portset_t *other);
+bool ICACHE_FLASH_ATTR portset_intersects(portset_t *set, portset_t *other);
+/* Tells if the two sets have common elements other than the given bit */
+bool ICACHE_FLASH_ATTR portset_intersects_except(portset_t *set, portset_t *other, int bit);
+
+
+#endif /* _PORTSET_H */
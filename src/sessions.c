@@ -174,7 +174,7 @@ void sessions_respond_all(void) {
             DEBUG_SESSIONS_CONN(session->conn, "responding to %s with busy", session->id);
 
             json_t *response_json = json_obj_new();
-            json_obj_append(response_json, "error", json_str_new("busy"));
+            json_obj_append_static(response_json, "error", json_str_new("busy"));
 
             respond_json(session->conn, 503, response_json);
             session->conn = NULL;
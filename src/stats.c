@@ -0,0 +1,179 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef _STATS
+
+#include <string.h>
+#include <mem.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/json.h"
+#include "espgoodies/system.h"
+
+#include "ports.h"
+#include "stats.h"
+
+
+#define TIMINGS_COUNT 3 /* Read, write & eval */
+
+
+static uint64          reset_time_us = 0;
+
+static stats_timing_t  poll_duration;
+static stats_timing_t  poll_interval;  /* Between the starts of consecutive rounds */
+static stats_timing_t  poll_lateness;  /* Between the time a round was due and the time it started */
+static uint64          last_poll_start_us = 0;
+
+/* Allocated when a port records its first timing, indexed by slot */
+static stats_timing_t *port_timings[PORT_MAX_SLOTS];
+
+static char           *TIMING_NAMES[] = {"read", "write", "eval"};
+
+
+static json_t ICACHE_FLASH_ATTR *timing_to_json(stats_timing_t *timing);
+
+
+void stats_timing_add(stats_timing_t *timing, uint32 duration_us) {
+    if (!timing->count || duration_us < timing->min_us) {
+        timing->min_us = duration_us;
+    }
+    if (duration_us > timing->max_us) {
+        timing->max_us = duration_us;
+    }
+
+    timing->count++;
+    timing->total_us += duration_us;
+}
+
+void stats_port_add(port_t *port, uint8 what, uint32 duration_us) {
+    if (port->slot < 0 || port->slot >= PORT_MAX_SLOTS) {
+        return;
+    }
+
+    stats_timing_t *timings = port_timings[port->slot];
+    if (!timings) {
+        timings = port_timings[port->slot] = zalloc(sizeof(stats_timing_t) * TIMINGS_COUNT);
+    }
+
+    stats_timing_add(&timings[what], duration_us);
+}
+
+void stats_port_reset(port_t *port) {
+    if (port->slot < 0 || port->slot >= PORT_MAX_SLOTS) {
+        return;
+    }
+
+    free(port_timings[port->slot]);
+    port_timings[port->slot] = NULL;
+}
+
+void stats_poll_add(uint64 start_us, uint32 duration_us, uint64 due_us) {
+    stats_timing_add(&poll_duration, duration_us);
+
+    if (last_poll_start_us) {
+        stats_timing_add(&poll_interval, start_us - last_poll_start_us);
+    }
+    last_poll_start_us = start_us;
+
+    if (due_us && due_us <= start_us) {
+        stats_timing_add(&poll_lateness, start_us - due_us);
+    }
+}
+
+void stats_reset(void) {
+    reset_time_us = system_uptime_us();
+
+    memset(&poll_duration, 0, sizeof(stats_timing_t));
+    memset(&poll_interval, 0, sizeof(stats_timing_t));
+    memset(&poll_lateness, 0, sizeof(stats_timing_t));
+    last_poll_start_us = 0;
+
+    for (int i = 0; i < PORT_MAX_SLOTS; i++) {
+        free(port_timings[i]);
+        port_timings[i] = NULL;
+    }
+}
+
+json_t *stats_to_json(void) {
+    json_t *json = json_obj_new();
+    uint64 elapsed_ms = (system_uptime_us() - reset_time_us) / 1000;
+
+    json_obj_append_static(json, "elapsed", json_double_new(elapsed_ms));
+
+    /* Polling loop */
+    json_t *poll_json = json_obj_new();
+    json_obj_append_static(json, "poll", poll_json);
+    double rate = elapsed_ms ? poll_duration.count * 1000.0 / elapsed_ms : 0;
+    json_obj_append_static(poll_json, "rate", json_double_new(rate));
+    json_obj_append_static(poll_json, "duration", timing_to_json(&poll_duration));
+    json_obj_append_static(poll_json, "interval", timing_to_json(&poll_interval));
+    json_obj_append_static(poll_json, "lateness", timing_to_json(&poll_lateness));
+
+    /* Ports, along with expressions totals */
+    stats_timing_t eval_total = {0};
+    json_t *ports_json = json_obj_new();
+    json_obj_append_static(json, "ports", ports_json);
+    port_t *p;
+    stats_timing_t *timings;
+    int i, j;
+    for (i = 0; i < all_ports_count; i++) {
+        p = all_ports[i];
+        if (p->slot < 0 || p->slot >= PORT_MAX_SLOTS || !(timings = port_timings[p->slot])) {
+            continue;
+        }
+
+        json_t *port_json = json_obj_new();
+        json_obj_append(ports_json, p->id, port_json);
+        for (j = 0; j < TIMINGS_COUNT; j++) {
+            if (timings[j].count) {
+                json_obj_append_static(port_json, TIMING_NAMES[j], timing_to_json(&timings[j]));
+            }
+        }
+
+        if (timings[STATS_EVAL].count) {
+            if (!eval_total.count || timings[STATS_EVAL].min_us < eval_total.min_us) {
+                eval_total.min_us = timings[STATS_EVAL].min_us;
+            }
+            if (timings[STATS_EVAL].max_us > eval_total.max_us) {
+                eval_total.max_us = timings[STATS_EVAL].max_us;
+            }
+            eval_total.count += timings[STATS_EVAL].count;
+            eval_total.total_us += timings[STATS_EVAL].total_us;
+        }
+    }
+
+    json_obj_append_static(json, "eval", timing_to_json(&eval_total));
+
+    return json;
+}
+
+
+json_t *timing_to_json(stats_timing_t *timing) {
+    /* Durations are in microseconds */
+    json_t *json = json_obj_new();
+
+    json_obj_append_static(json, "count", json_int_new(timing->count));
+    json_obj_append_static(json, "min", json_int_new(timing->min_us));
+    json_obj_append_static(json, "avg", json_int_new(timing->count ? timing->total_us / timing->count : 0));
+    json_obj_append_static(json, "max", json_int_new(timing->max_us));
+    json_obj_append_static(json, "total", json_double_new(timing->total_us));
+
+    return json;
+}
+
+
+#endif /* _STATS */
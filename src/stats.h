@@ -0,0 +1,79 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+
+#include <c_types.h>
+
+#include "espgoodies/json.h"
+#include "espgoodies/system.h"
+
+#include "ports.h"
+
+
+/* Timing statistics are only gathered when building with STATS=true; otherwise, the macros below compile to nothing */
+
+#ifdef _STATS
+#define STATS_START(start_us)                uint64 start_us = system_uptime_us()
+#define STATS_PORT_READ(port, start_us)      stats_port_add(port, STATS_READ,  system_uptime_us() - (start_us))
+#define STATS_PORT_WRITE(port, start_us)     stats_port_add(port, STATS_WRITE, system_uptime_us() - (start_us))
+#define STATS_PORT_EVAL(port, start_us)      stats_port_add(port, STATS_EVAL,  system_uptime_us() - (start_us))
+#define STATS_PORT_RESET(port)               stats_port_reset(port)
+#define STATS_POLL(start_us, due_us)         stats_poll_add(start_us, system_uptime_us() - (start_us), due_us)
+#else
+#define STATS_START(start_us)                {}
+#define STATS_PORT_READ(port, start_us)      {}
+#define STATS_PORT_WRITE(port, start_us)     {}
+#define STATS_PORT_EVAL(port, start_us)      {}
+#define STATS_PORT_RESET(port)               {}
+#define STATS_POLL(start_us, due_us)         {}
+#endif
+
+#define STATS_READ  0
+#define STATS_WRITE 1
+#define STATS_EVAL  2
+
+
+#ifdef _STATS
+
+typedef struct {
+
+    uint32 count;
+    uint32 min_us;
+    uint32 max_us;
+    uint64 total_us;
+
+} stats_timing_t;
+
+
+void   ICACHE_FLASH_ATTR  stats_timing_add(stats_timing_t *timing, uint32 duration_us);
+
+void   ICACHE_FLASH_ATTR  stats_port_add(port_t *port, uint8 what, uint32 duration_us);
+void   ICACHE_FLASH_ATTR  stats_port_reset(port_t *port);
+
+/* Records a polling round that started at start_us and was due at due_us (0 if unknown) */
+void   ICACHE_FLASH_ATTR  stats_poll_add(uint64 start_us, uint32 duration_us, uint64 due_us);
+
+void   ICACHE_FLASH_ATTR  stats_reset(void);
+json_t ICACHE_FLASH_ATTR *stats_to_json(void);
+
+#endif /* _STATS */
+
+
+#endif /* _STATS_H */
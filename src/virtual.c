@@ -62,7 +62,7 @@ void init_virtual_port(uint8 *base_ptr, char *strings_ptr, uint32 flags, uint8 i
     port->slot = index + PORT_SLOT_VIRTUAL0;
 
     /* Use a dummy ID until later when port_load() is called */
-    char dummy_id[7];
+    char dummy_id[9]; /* "port" followed by an int8 slot */
     snprintf(dummy_id, sizeof(dummy_id), "port%02d", port->slot);
     port->id = strdup(dummy_id);
 
@@ -109,7 +109,11 @@ void virtual_ports_init(uint8 *config_data) {
     int i;
 
     for (i = 0; i < VIRTUAL_MAX_PORTS; i++) {
-        base_ptr = config_data + CONFIG_OFFS_PORT_BASE + CONFIG_PORT_SIZE * (i + PORT_SLOT_VIRTUAL0);
+        base_ptr = CONFIG_PORT_RECORD(config_data, i + PORT_SLOT_VIRTUAL0);
+        if (!base_ptr) {
+            continue;
+        }
+
         memcpy(&flags, base_ptr + PORT_CONFIG_OFFS_FLAGS, 4);
 
         if (flags & PORT_FLAG_VIRTUAL_ACTIVE) {
@@ -125,7 +129,7 @@ void virtual_ports_save(uint8 *config_data, uint32 *strings_offs) {
 
     for (i = 0; i < VIRTUAL_MAX_PORTS; i++) {
         slot = i + PORT_SLOT_VIRTUAL0;
-        base_ptr = config_data + CONFIG_OFFS_PORT_BASE + CONFIG_PORT_SIZE * slot;
+        base_ptr = CONFIG_PORT_RECORD(config_data, slot);
         memcpy(&flags, base_ptr + PORT_CONFIG_OFFS_FLAGS, 4);
         if (ports_slot_busy(slot)) {
             flags |= PORT_FLAG_VIRTUAL_ACTIVE;
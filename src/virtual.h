@@ -24,7 +24,7 @@
 #include "ports.h"
 
 
-#define VIRTUAL_MAX_PORTS 8
+#define VIRTUAL_MAX_PORTS 16
 
 #ifdef _DEBUG_VIRTUAL
 #define DEBUG_VIRTUAL(fmt, ...) DEBUG("[virtual       ] " fmt, ##__VA_ARGS__)
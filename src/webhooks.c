@@ -195,8 +195,8 @@ void do_webhook_request(event_t *event) {
 
     /* Add authorization header */
     json_t *claims = json_obj_new();
-    json_obj_append(claims, "iss", json_str_new("qToggle"));
-    json_obj_append(claims, "ori", json_str_new("device"));
+    json_obj_append_static(claims, "iss", json_str_new("qToggle"));
+    json_obj_append_static(claims, "ori", json_str_new("device"));
 
     jwt_t *jwt = jwt_new(JWT_ALG_HS256, claims);
     json_free(claims);
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Compares tree-walking and compiled (bytecode) evaluation of port expressions, over a corpus of expressions taken
+ * from the API test cases */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/utils.h"
+
+#include "common.h"
+#include "expr.h"
+#include "ports.h"
+
+#include "host.h"
+
+
+#define ITERATIONS 200000
+
+
+static char *corpus[] = {
+    "123",
+    "$num_port",
+    "ADD(10, 20, 30)",
+    "MUL($num_port, $num_port2, 10)",
+    "ADD($bool_port, $num_port)",
+    "IF($bool_port, NOT($), $)",
+    "AND(true, false, true)",
+    "OR($bool_port, GT($num_port, 10), LT($num_port2, 5))",
+    "BITAND(SHL($num_port, 3), BITNOT(11))",
+    "ROUND(DIV(MUL($num_port, 9), 5), 1)",
+    "AVG($num_port, $num_port2, MAX($num_port, 20), MIN($num_port2, 30))",
+    "DEFAULT($inexistent, 13)",
+    "ADD($some, $inexistent, $ports)",
+    "AVAILABLE($num_port)",
+    "HYST($num_port, 8, 12)",
+    "ACC($num_port, $)",
+    "RISING($num_port)",
+    "HELD($num_port, 123, 2000)",
+    "SAMPLE($num_port, 2000)",
+    "DELAY($num_port, 1000)",
+    "FMAVG($num_port, 3, 2000)",
+    "FMEDIAN($num_port, 3, 2000)",
+    "LUTLI($num_port, 0, 0, 1, 10, 2, 100, 5, 120, 10, 150)",
+    "IF(EQ($bool_port, 1), ADD(MUL($num_port, 2), 1), SUB($num_port2, DIV($num_port, 3)))",
+    "MUL(2, 3.6, $num_port)",
+    "IF(GT(MUL($num_port, 2), 10), MUL($num_port, 2), 0)",
+    "DEFAULT(ADD($inexistent, MUL($num_port, 3)), MUL($num_port, 3))",
+    NULL
+};
+
+static port_t  ports[] = {
+    {.id = "bench",     .type = PORT_TYPE_NUMBER,  .flags = PORT_FLAG_ENABLED | PORT_FLAG_WRITABLE},
+    {.id = "num_port",  .type = PORT_TYPE_NUMBER,  .flags = PORT_FLAG_ENABLED},
+    {.id = "num_port2", .type = PORT_TYPE_NUMBER,  .flags = PORT_FLAG_ENABLED},
+    {.id = "bool_port", .type = PORT_TYPE_BOOLEAN, .flags = PORT_FLAG_ENABLED}
+};
+static port_t *ports_list[] = {&ports[0], &ports[1], &ports[2], &ports[3]};
+
+port_t        **all_ports = ports_list;
+int             all_ports_count = sizeof(ports_list) / sizeof(port_t *);
+
+
+port_t *port_find_by_id(char *id) {
+    for (int i = 0; i < all_ports_count; i++) {
+        if (!strcmp(all_ports[i]->id, id)) {
+            return all_ports[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+static void set_port_values(int i) {
+    ports[0].last_read_value = i % 7;
+    ports[1].last_read_value = i % 17;
+    ports[2].last_read_value = (i / 3) % 11;
+    ports[3].last_read_value = (i / 5) % 2;
+}
+
+static bool same_value(double v1, double v2) {
+    return (IS_UNDEFINED(v1) && IS_UNDEFINED(v2)) || v1 == v2;
+}
+
+static uint64 run(expr_t *expr, double (*eval)(expr_t *), double *results) {
+    host_time_set_us(0);
+
+    /* Port value updates are timed as well, but they add the same overhead to both evaluation methods */
+    uint64 start = host_clock_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        set_port_values(i);
+        host_time_advance_ms(10);
+        results[i] = eval(expr);
+    }
+
+    return host_clock_ns() - start;
+}
+
+int main(void) {
+    static double tree_results[ITERATIONS];
+    static double prog_results[ITERATIONS];
+    uint64 tree_total = 0, prog_total = 0;
+    int failed = 0;
+
+    printf("%-90s %10s %10s %8s %8s\n", "expression", "tree ns", "prog ns", "speedup", "heap");
+
+    for (char **sexpr = corpus; *sexpr; sexpr++) {
+        /* Use two separate parsed instances so that stateful functions evolve independently */
+        expr_t *tree_expr = expr_parse("bench", *sexpr, strlen(*sexpr));
+        expr_t *prog_expr = expr_parse("bench", *sexpr, strlen(*sexpr));
+        if (!tree_expr || !prog_expr) {
+            printf("failed to parse \"%s\"\n", *sexpr);
+            return 1;
+        }
+
+        uint64 tree_ns = run(tree_expr, expr_eval_tree, tree_results);
+        uint64 prog_ns = run(prog_expr, expr_eval, prog_results);
+
+        for (int i = 0; i < ITERATIONS; i++) {
+            if (!same_value(tree_results[i], prog_results[i])) {
+                printf("result mismatch for \"%s\" at iteration %d: %s != %s\n",
+                       *sexpr, i, dtostr(tree_results[i], -1), dtostr(prog_results[i], -1));
+                failed++;
+                break;
+            }
+        }
+
+        printf("%-90s %10.1f %10.1f %7.2fx %8d\n", *sexpr,
+               (double) tree_ns / ITERATIONS, (double) prog_ns / ITERATIONS, (double) tree_ns / prog_ns,
+               expr_get_heap_size(prog_expr));
+
+        tree_total += tree_ns;
+        prog_total += prog_ns;
+
+        expr_free(tree_expr);
+        expr_free(prog_expr);
+    }
+
+    printf("%-90s %10.1f %10.1f %7.2fx\n", "total",
+           (double) tree_total / ITERATIONS, (double) prog_total / ITERATIONS, (double) tree_total / prog_total);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Compares building port JSON structures, the way port_to_json() does, with lists and objects growing geometrically
+ * against growing them by one member with each append, counting allocations and timing */
+
+#include <stdio.h>
+#include <string.h>
+#include <mem.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/json.h"
+
+#include "host.h"
+
+
+#define ITERATIONS  20000
+#define PORTS_COUNT 30
+#define ATTRS_COUNT 8   /* Extra, driver specific attributes */
+#define CHOICES     4
+
+
+typedef void (*obj_append_t)(json_t *json, char *key, json_t *child);
+typedef void (*list_append_t)(json_t *json, json_t *child);
+
+
+static void   ICACHE_FLASH_ATTR  former_list_append(json_t *json, json_t *child);
+static void   ICACHE_FLASH_ATTR  former_obj_append(json_t *json, char *key, json_t *child);
+static json_t ICACHE_FLASH_ATTR *make_port_json(int index, obj_append_t obj_append, list_append_t list_append);
+static json_t ICACHE_FLASH_ATTR *make_ports_json(int count, obj_append_t obj_append, list_append_t list_append);
+static int    ICACHE_FLASH_ATTR  compare(
+                                     char *what,
+                                     json_t *(*make)(int, obj_append_t, list_append_t),
+                                     int arg
+                                 );
+
+
+void former_list_append(json_t *json, json_t *child) {
+    /* Former implementation of json_list_append() */
+    json->children = realloc(json->children, sizeof(json_t *) * (json->len + 1));
+    json->children[(int) json->len++] = child;
+}
+
+void former_obj_append(json_t *json, char *key, json_t *child) {
+    /* Former implementation of json_obj_append() */
+    json->children = realloc(json->children, sizeof(json_t *) * (json->len + 1));
+    json->keys = realloc(json->keys, sizeof(char *) * (json->len + 1));
+    json->keys[(int) json->len] = strdup(key);
+    json->children[(int) json->len++] = child;
+}
+
+json_t *make_port_json(int index, obj_append_t obj_append, list_append_t list_append) {
+    /* Same attributes as port_to_json() returns for a writable numeric port with choices and extra attributes */
+    char id[16], name[16];
+    int i;
+
+    snprintf(id, sizeof(id), "port%d", index);
+    json_t *json = json_obj_new();
+    obj_append(json, "id", json_str_new(id));
+    obj_append(json, "display_name", json_str_new("Living room temperature"));
+    obj_append(json, "enabled", json_bool_new(TRUE));
+    obj_append(json, "writable", json_bool_new(TRUE));
+    obj_append(json, "persisted", json_bool_new(FALSE));
+    obj_append(json, "internal", json_bool_new(FALSE));
+    obj_append(json, "sampling_interval", json_int_new(1000));
+    obj_append(json, "transform_read", json_str_new(""));
+    obj_append(json, "min_event_interval", json_int_new(0));
+    obj_append(json, "persist_interval", json_int_new(0));
+    obj_append(json, "type", json_str_new("number"));
+    obj_append(json, "unit", json_str_new("C"));
+    obj_append(json, "change_threshold", json_double_new(0.1));
+    obj_append(json, "change_threshold_relative", json_bool_new(FALSE));
+    obj_append(json, "persist_threshold", json_double_new(0));
+    obj_append(json, "min", json_double_new(-40));
+    obj_append(json, "max", json_double_new(125));
+
+    json_t *choices = json_list_new();
+    for (i = 0; i < CHOICES; i++) {
+        json_t *choice = json_obj_new();
+        obj_append(choice, "value", json_int_new(i));
+        obj_append(choice, "display_name", json_str_new("Choice"));
+        list_append(choices, choice);
+    }
+    obj_append(json, "choices", choices);
+
+    obj_append(json, "expression", json_str_new("ADD($port0, 1)"));
+    obj_append(json, "transform_write", json_str_new(""));
+    obj_append(json, "expr_heap_size", json_int_new(96));
+
+    for (i = 0; i < ATTRS_COUNT; i++) {
+        snprintf(name, sizeof(name), "attr%d", i);
+        obj_append(json, name, json_int_new(i));
+    }
+
+    obj_append(json, "value", json_double_new(21.5));
+    obj_append(json, "definitions", json_obj_new());
+
+    return json;
+}
+
+json_t *make_ports_json(int count, obj_append_t obj_append, list_append_t list_append) {
+    json_t *json = json_list_new();
+    for (int i = 0; i < count; i++) {
+        list_append(json, make_port_json(i, obj_append, list_append));
+    }
+
+    return json;
+}
+
+int compare(char *what, json_t *(*make)(int, obj_append_t, list_append_t), int arg) {
+    host_alloc_stats_t former_stats, stats;
+    uint64 start, former_ns, ns;
+    json_t *json;
+    int j;
+
+    /* Allocations of one structure, and the structures themselves, which must not differ */
+    host_alloc_stats_reset();
+    json = make(arg, former_obj_append, former_list_append);
+    host_alloc_stats_get(&former_stats);
+    char *former_dump = json_dump(json, JSON_FREE_EVERYTHING);
+
+    host_alloc_stats_reset();
+    json = make(arg, json_obj_append, json_list_append);
+    host_alloc_stats_get(&stats);
+    char *dump = json_dump(json, JSON_FREE_EVERYTHING);
+
+    int failed = strcmp(dump, former_dump) != 0;
+    if (failed) {
+        printf("FAIL: %s structures differ\n", what);
+    }
+    free(dump);
+    free(former_dump);
+
+    start = host_clock_ns();
+    for (j = 0; j < ITERATIONS; j++) {
+        json_free(make(arg, former_obj_append, former_list_append));
+    }
+    former_ns = host_clock_ns() - start;
+
+    start = host_clock_ns();
+    for (j = 0; j < ITERATIONS; j++) {
+        json_free(make(arg, json_obj_append, json_list_append));
+    }
+    ns = host_clock_ns() - start;
+
+    printf("%-8s %7d %9d %7d %9d %10.1f %10.1f %7.2fx\n", what,
+           former_stats.mallocs, former_stats.reallocs, stats.mallocs, stats.reallocs,
+           (double) former_ns / ITERATIONS, (double) ns / ITERATIONS, (double) former_ns / ns);
+
+    if (stats.mallocs + stats.reallocs >= former_stats.mallocs + former_stats.reallocs) {
+        printf("FAIL: %s takes no fewer allocations\n", what);
+        failed = 1;
+    }
+
+    return failed;
+}
+
+
+int main(void) {
+    int failed = 0;
+
+    printf("%-8s %7s %9s %7s %9s %10s %10s %8s\n", "build", "mallocs", "reallocs", "mallocs", "reallocs",
+           "former ns", "ns", "speedup");
+    printf("%-8s %17s %17s\n", "", "(former)", "(geometric)");
+    failed += compare("port", make_port_json, 0);
+    failed += compare("ports", make_ports_json, PORTS_COUNT);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Compares looking up ports by ID and by slot through the port index against a linear search of all ports, with as
+ * many ports as slots */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "espgoodies/common.h"
+
+#include "common.h"
+#include "ports.h"
+#include "virtual.h"
+
+#include "host.h"
+
+
+#define ITERATIONS 20000
+
+
+static port_t *ports[PORT_MAX_SLOTS];
+static int     ports_count = 0;
+
+
+static port_t ICACHE_FLASH_ATTR *linear_find_by_id(char *id);
+static port_t ICACHE_FLASH_ATTR *linear_find_by_slot(uint8 slot);
+
+
+port_t *linear_find_by_id(char *id) {
+    /* Former implementation of port_find_by_id() */
+    for (int i = 0; i < all_ports_count; i++) {
+        if (!strcmp(all_ports[i]->id, id)) {
+            return all_ports[i];
+        }
+    }
+
+    return NULL;
+}
+
+port_t *linear_find_by_slot(uint8 slot) {
+    /* Former implementation of port_find_by_slot() */
+    for (int i = 0; i < all_ports_count; i++) {
+        if (all_ports[i]->slot == slot) {
+            return all_ports[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+int main(void) {
+    char id[PORT_MAX_ID_LEN];
+    char *ids[PORT_MAX_SLOTS];
+    port_t *port;
+    int i, j, failed = 0;
+
+    /* Fill all slots, with IDs that look like actual ones */
+    for (i = 0; i < PORT_MAX_SLOTS - VIRTUAL_MAX_PORTS; i++) {
+        snprintf(id, sizeof(id), "sensor_%02d_temperature", i);
+        ports[ports_count++] = host_add_port(id, NULL);
+    }
+    for (i = 0; i < VIRTUAL_MAX_PORTS; i++) {
+        snprintf(id, sizeof(id), "virtual_%02d", i);
+        ports[ports_count++] = host_add_virtual_port(id, NULL);
+    }
+
+    for (i = 0; i < ports_count; i++) {
+        if (!ports[i]) {
+            printf("FAIL: could not add port %d\n", i);
+            return 1;
+        }
+        ids[i] = ports[i]->id;
+    }
+
+    /* Both methods must agree, including on inexistent IDs */
+    for (i = 0; i < ports_count; i++) {
+        if (port_find_by_id(ids[i]) != ports[i] || port_find_by_slot(ports[i]->slot) != ports[i]) {
+            printf("FAIL: index lookup of port %s\n", ids[i]);
+            failed++;
+        }
+    }
+    if (port_find_by_id("inexistent") || port_find_by_id("sensor_00_temperatur")) {
+        printf("FAIL: index lookup of inexistent port\n");
+        failed++;
+    }
+
+    uint64 start, linear_id_ns, index_id_ns, linear_slot_ns, index_slot_ns;
+    int found = 0;
+
+    start = host_clock_ns();
+    for (j = 0; j < ITERATIONS; j++) {
+        for (i = 0; i < ports_count; i++) {
+            found += linear_find_by_id(ids[i]) != NULL;
+        }
+    }
+    linear_id_ns = host_clock_ns() - start;
+
+    start = host_clock_ns();
+    for (j = 0; j < ITERATIONS; j++) {
+        for (i = 0; i < ports_count; i++) {
+            found += port_find_by_id(ids[i]) != NULL;
+        }
+    }
+    index_id_ns = host_clock_ns() - start;
+
+    start = host_clock_ns();
+    for (j = 0; j < ITERATIONS; j++) {
+        for (i = 0; i < ports_count; i++) {
+            found += linear_find_by_slot(ports[i]->slot) != NULL;
+        }
+    }
+    linear_slot_ns = host_clock_ns() - start;
+
+    start = host_clock_ns();
+    for (j = 0; j < ITERATIONS; j++) {
+        for (i = 0; i < ports_count; i++) {
+            found += port_find_by_slot(ports[i]->slot) != NULL;
+        }
+    }
+    index_slot_ns = host_clock_ns() - start;
+
+    if (found != 4 * ITERATIONS * ports_count) {
+        printf("FAIL: found %d ports, expected %d\n", found, 4 * ITERATIONS * ports_count);
+        failed++;
+    }
+
+    double lookups = (double) ITERATIONS * ports_count;
+    printf("%d ports\n", ports_count);
+    printf("%-10s %10s %10s %8s\n", "lookup", "linear ns", "index ns", "speedup");
+    printf("%-10s %10.1f %10.1f %7.2fx\n", "by id",
+           linear_id_ns / lookups, index_id_ns / lookups, (double) linear_id_ns / index_id_ns);
+    printf("%-10s %10.1f %10.1f %7.2fx\n", "by slot",
+           linear_slot_ns / lookups, index_slot_ns / lookups, (double) linear_slot_ns / index_slot_ns);
+
+    /* The index and slot records follow ports being removed */
+    int8 slot;
+    for (i = 0; i < ports_count; i += 2) {
+        port = ports[i];
+        slot = port->slot;
+        snprintf(id, sizeof(id), "%s", port->id);
+        if (i < PORT_MAX_SLOTS - VIRTUAL_MAX_PORTS) {
+            host_remove_port(port);
+        }
+        else {
+            host_remove_virtual_port(port);
+        }
+        if (port_find_by_id(id) || port_find_by_slot(slot)) {
+            printf("FAIL: removed port %s still found\n", id);
+            failed++;
+        }
+        ports[i] = NULL;
+    }
+    for (i = 1; i < ports_count; i += 2) {
+        port = ports[i];
+        if (port_find_by_id(port->id) != port || port_find_by_slot(port->slot) != port ||
+            PORT_SLOT(port)->port != port) {
+
+            printf("FAIL: port %s lost after removing others\n", port->id);
+            failed++;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
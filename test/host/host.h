@@ -0,0 +1,85 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef _HOST_H
+#define _HOST_H
+
+
+#include <c_types.h>
+
+
+struct port;
+struct espconn;
+
+typedef struct {
+
+    uint32 mallocs;
+    uint32 reallocs;
+    uint32 frees;
+    uint32 live;
+
+} host_alloc_stats_t;
+
+typedef struct {
+
+    uint32 erases;         /* Erased sectors */
+    uint32 writes;
+    uint32 written_bytes;
+
+} host_flash_stats_t;
+
+
+typedef struct {
+
+    struct espconn *conn;
+    int             status;
+    char           *body;  /* Dumped JSON of the last response */
+    int             count; /* Number of responses sent so far */
+
+} host_response_t;
+
+
+extern host_response_t host_last_response;      /* Recorded by the respond_json() stub */
+extern int             host_webhooks_events[];  /* Counted by event type, when webhooks are enabled */
+
+
+void   host_time_set_us(uint64 us);
+/* Advances the clock, firing armed timers that become due along the way */
+void   host_time_advance_ms(uint32 ms);
+/* Runs the tasks scheduled so far, returning their number */
+int    host_run_tasks(void);
+
+void   host_alloc_stats_reset(void);
+void   host_alloc_stats_get(host_alloc_stats_t *stats);
+
+uint64 host_clock_ns(void);
+
+/* Flash starts out erased, as on a freshly flashed device */
+void   host_flash_erase_all(void);
+void   host_flash_stats_reset(void);
+void   host_flash_stats_get(host_flash_stats_t *stats);
+
+/* Registers & enables a new virtual number port, optionally with a value expression */
+struct port *host_add_virtual_port(char *id, char *sexpr);
+void         host_remove_virtual_port(struct port *port);
+/* Registers & enables a new writable number port, in the next free non-virtual slot, optionally with a value
+ * expression */
+struct port *host_add_port(char *id, char *sexpr);
+void         host_remove_port(struct port *port);
+
+
+#endif /* _HOST_H */
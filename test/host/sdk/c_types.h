@@ -0,0 +1,67 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Host replacement for the ESP8266 non-OS SDK c_types.h */
+
+#ifndef _HOST_C_TYPES_H
+#define _HOST_C_TYPES_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+typedef uint8_t            uint8;
+typedef uint8_t            u8;
+typedef int8_t             sint8;
+typedef int8_t             int8;
+typedef int8_t             s8;
+typedef uint16_t           uint16;
+typedef uint16_t           u16;
+typedef int16_t            sint16;
+typedef int16_t            int16;
+typedef int16_t            s16;
+typedef uint32_t           uint32;
+typedef uint32_t           u32;
+typedef int32_t            sint32;
+typedef int32_t            int32;
+typedef int32_t            s32;
+typedef uint64_t           uint64;
+typedef uint64_t           u64;
+typedef int64_t            sint64;
+typedef int64_t            int64;
+typedef float              real32;
+typedef double             real64;
+
+typedef unsigned char      bool;
+
+#define BOOL               bool
+#define true               (1)
+#define false              (0)
+#define TRUE               true
+#define FALSE              false
+
+#define BIT(nr)            (1UL << (nr))
+
+#define LOCAL              static
+#define ICACHE_FLASH_ATTR
+#define ICACHE_RODATA_ATTR
+#define ICACHE_RAM_ATTR
+#define STORE_ATTR         __attribute__((aligned(4)))
+
+
+#endif /* _HOST_C_TYPES_H */
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Host replacement for the ESP8266 non-OS SDK espconn.h; only what is needed to compile espgoodies and the API headers */
+
+#ifndef _HOST_ESPCONN_H
+#define _HOST_ESPCONN_H
+
+
+#include <c_types.h>
+
+
+typedef struct {
+
+    int    remote_port;
+    int    local_port;
+    uint8  local_ip[4];
+    uint8  remote_ip[4];
+
+} esp_tcp;
+
+/* Connections are never actually opened on the host; tests only use them as opaque peers */
+struct espconn {
+
+    union {
+        esp_tcp *tcp;
+    } proto;
+
+    void *reverse;
+
+};
+
+
+#endif /* _HOST_ESPCONN_H */
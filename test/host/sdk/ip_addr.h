@@ -0,0 +1,52 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+/* Host replacement for the ESP8266 non-OS SDK ip_addr.h */
+
+#ifndef _HOST_IP_ADDR_H
+#define _HOST_IP_ADDR_H
+
+
+#include <c_types.h>
+
+
+typedef struct ip_addr {
+
+    uint32 addr;
+
+} ip_addr_t;
+
+struct ip_info {
+
+    ip_addr_t ip;
+    ip_addr_t netmask;
+    ip_addr_t gw;
+
+};
+
+
+#define ip4_addr1(ipaddr) (((uint8 *) (ipaddr))[0])
+#define ip4_addr2(ipaddr) (((uint8 *) (ipaddr))[1])
+#define ip4_addr3(ipaddr) (((uint8 *) (ipaddr))[2])
+#define ip4_addr4(ipaddr) (((uint8 *) (ipaddr))[3])
+
+#define IP2STR(ipaddr) ip4_addr1(ipaddr), ip4_addr2(ipaddr), ip4_addr3(ipaddr), ip4_addr4(ipaddr)
+#define IPSTR          "%d.%d.%d.%d"
+
+
+#endif /* _HOST_IP_ADDR_H */
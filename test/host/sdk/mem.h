@@ -0,0 +1,33 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Host replacement for the ESP8266 non-OS SDK mem.h */
+
+#ifndef _HOST_MEM_H
+#define _HOST_MEM_H
+
+
+#include <stdlib.h>
+
+
+void *pvPortMalloc(size_t size, const char *file, unsigned line);
+void *pvPortZalloc(size_t size, const char *file, unsigned line);
+void *pvPortRealloc(void *ptr, size_t size, const char *file, unsigned line);
+void  vPortFree(void *ptr, const char *file, unsigned line);
+
+
+#endif /* _HOST_MEM_H */
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Host replacement for the ESP8266 non-OS SDK os_type.h */
+
+#ifndef _HOST_OS_TYPE_H
+#define _HOST_OS_TYPE_H
+
+
+#include <c_types.h>
+
+
+typedef uint32 os_signal_t;
+typedef uint32 os_param_t;
+
+typedef struct {
+
+    os_signal_t sig;
+    os_param_t  par;
+
+} os_event_t;
+
+typedef void os_timer_func_t(void *timer_arg);
+
+typedef struct _os_timer_t {
+
+    struct _os_timer_t *timer_next;
+    uint64              timer_expire;  /* Absolute host uptime, in microseconds */
+    uint32              timer_period;  /* Milliseconds; 0 for one-shot timers */
+    os_timer_func_t    *timer_func;
+    void               *timer_arg;
+    bool                timer_armed;
+
+} os_timer_t;
+
+
+#endif /* _HOST_OS_TYPE_H */
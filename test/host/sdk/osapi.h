@@ -0,0 +1,45 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Host replacement for the ESP8266 non-OS SDK osapi.h */
+
+#ifndef _HOST_OSAPI_H
+#define _HOST_OSAPI_H
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <os_type.h>
+
+
+#define os_printf    printf
+#define os_sprintf   sprintf
+#define os_snprintf  snprintf
+#define os_vsnprintf vsnprintf
+#define os_memcpy    memcpy
+#define os_memset    memset
+#define os_strlen    strlen
+
+
+void os_timer_arm(os_timer_t *timer, uint32 ms, bool repeat);
+void os_timer_disarm(os_timer_t *timer);
+void os_timer_setfn(os_timer_t *timer, os_timer_func_t *func, void *arg);
+void os_delay_us(uint32 us);
+
+
+#endif /* _HOST_OSAPI_H */
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Host replacement for the ESP8266 non-OS SDK user_interface.h */
+
+#ifndef _HOST_USER_INTERFACE_H
+#define _HOST_USER_INTERFACE_H
+
+
+#include <c_types.h>
+#include <os_type.h>
+
+
+#define USER_TASK_PRIO_0 0
+
+/* Nothing ever interrupts the host code under test */
+#define ETS_INTR_LOCK()   {}
+#define ETS_INTR_UNLOCK() {}
+
+
+uint32 system_get_time(void);
+uint32 system_get_free_heap_size(void);
+void   system_restart(void);
+bool   system_os_post(uint8 prio, os_signal_t sig, os_param_t par);
+bool   system_rtc_mem_read(uint8 addr, void *dst, uint16 size);
+bool   system_rtc_mem_write(uint8 addr, const void *src, uint16 size);
+
+
+#endif /* _HOST_USER_INTERFACE_H */
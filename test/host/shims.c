@@ -0,0 +1,340 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Host implementations of the ESP8266 SDK and espgoodies system functions used by the modules under test */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <c_types.h>
+#include <mem.h>
+#include <osapi.h>
+#include <spi_flash.h>
+#include <user_interface.h>
+
+#include "espgoodies/system.h"
+
+#include "host.h"
+
+
+#define RTC_MEM_SIZE         768
+#define TASK_QUEUE_LEN       32
+#define FLASH_SIZE           0x4000 /* Emulated flash, covering all configuration slots, from FLASH_CONFIG_ADDR */
+
+
+typedef struct {
+
+    uint32  task_id;
+    void   *param;
+
+} task_t;
+
+
+static uint64                 uptime_us = 0;
+static host_alloc_stats_t     alloc_stats;
+static uint8                  rtc_mem[RTC_MEM_SIZE];
+static os_timer_t            *armed_timers = NULL;
+static system_task_handler_t  task_handler = NULL;
+static task_t                 task_queue[TASK_QUEUE_LEN];
+static uint8                  task_queue_head = 0;
+static uint8                  task_queue_len = 0;
+static uint8                  flash[FLASH_SIZE];
+static bool                   flash_initialized = FALSE;
+static host_flash_stats_t     flash_stats;
+
+
+static void        timer_unlink(os_timer_t *timer);
+static os_timer_t *timer_next_due(uint64 until_us);
+static uint8      *flash_ptr(uint32 addr, uint32 size);
+
+
+void host_time_set_us(uint64 us) {
+    uptime_us = us;
+}
+
+void host_time_advance_ms(uint32 ms) {
+    uint64 until_us = uptime_us + ms * 1000ULL;
+    os_timer_t *timer;
+
+    /* Fire due timers in order of expiry, with the clock showing each timer's expiry time while it runs */
+    while ((timer = timer_next_due(until_us))) {
+        uptime_us = timer->timer_expire;
+        if (timer->timer_period) {
+            timer->timer_expire += timer->timer_period * 1000ULL;
+        }
+        else {
+            timer_unlink(timer);
+        }
+
+        timer->timer_func(timer->timer_arg);
+    }
+
+    uptime_us = until_us;
+}
+
+int host_run_tasks(void) {
+    /* Only run the tasks that are already scheduled, so that self-rescheduling tasks (e.g. polling) run once per
+     * call */
+    int count = task_queue_len;
+    int i;
+    task_t task;
+    for (i = 0; i < count; i++) {
+        task = task_queue[task_queue_head];
+        task_queue_head = (task_queue_head + 1) % TASK_QUEUE_LEN;
+        task_queue_len--;
+
+        if (task_handler) {
+            task_handler(task.task_id, task.param);
+        }
+    }
+
+    return count;
+}
+
+void host_alloc_stats_reset(void) {
+    memset(&alloc_stats, 0, sizeof(alloc_stats));
+}
+
+void host_alloc_stats_get(host_alloc_stats_t *stats) {
+    *stats = alloc_stats;
+}
+
+uint64 host_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+void *pvPortMalloc(size_t size, const char *file, unsigned line) {
+    alloc_stats.mallocs++;
+    alloc_stats.live++;
+
+    return malloc(size);
+}
+
+void *pvPortZalloc(size_t size, const char *file, unsigned line) {
+    alloc_stats.mallocs++;
+    alloc_stats.live++;
+
+    return calloc(1, size);
+}
+
+void *pvPortRealloc(void *ptr, size_t size, const char *file, unsigned line) {
+    if (ptr) {
+        alloc_stats.reallocs++;
+    }
+    else {
+        alloc_stats.mallocs++;
+        alloc_stats.live++;
+    }
+
+    return realloc(ptr, size);
+}
+
+void vPortFree(void *ptr, const char *file, unsigned line) {
+    if (ptr) {
+        alloc_stats.frees++;
+        alloc_stats.live--;
+    }
+
+    free(ptr);
+}
+
+
+uint32 system_get_time(void) {
+    return uptime_us;
+}
+
+uint32 system_get_free_heap_size(void) {
+    return MAX_AVAILABLE_RAM;
+}
+
+void system_restart(void) {
+    abort();
+}
+
+bool system_os_post(uint8 prio, os_signal_t sig, os_param_t par) {
+    return TRUE;
+}
+
+bool system_rtc_mem_read(uint8 addr, void *dst, uint16 size) {
+    if (addr * 4 + size > RTC_MEM_SIZE) {
+        return FALSE;
+    }
+
+    memcpy(dst, rtc_mem + addr * 4, size);
+
+    return TRUE;
+}
+
+bool system_rtc_mem_write(uint8 addr, const void *src, uint16 size) {
+    if (addr * 4 + size > RTC_MEM_SIZE) {
+        return FALSE;
+    }
+
+    memcpy(rtc_mem + addr * 4, src, size);
+
+    return TRUE;
+}
+
+void host_flash_erase_all(void) {
+    memset(flash, 0xFF, FLASH_SIZE);
+    flash_initialized = TRUE;
+}
+
+void host_flash_stats_reset(void) {
+    memset(&flash_stats, 0, sizeof(flash_stats));
+}
+
+void host_flash_stats_get(host_flash_stats_t *stats) {
+    *stats = flash_stats;
+}
+
+SpiFlashOpResult spi_flash_erase_sector(uint16 sec) {
+    uint8 *ptr = flash_ptr(sec * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE);
+    if (!ptr) {
+        return SPI_FLASH_RESULT_ERR;
+    }
+
+    memset(ptr, 0xFF, SPI_FLASH_SEC_SIZE);
+    flash_stats.erases++;
+
+    return SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_write(uint32 des_addr, uint32 *src_addr, uint32 size) {
+    uint8 *ptr = flash_ptr(des_addr, size);
+    if (!ptr || (des_addr | size) & 3) {
+        return SPI_FLASH_RESULT_ERR;
+    }
+
+    /* Like NOR flash, writing can only clear bits */
+    uint8 *src = (uint8 *) src_addr;
+    for (int i = 0; i < size; i++) {
+        ptr[i] &= src[i];
+    }
+    flash_stats.writes++;
+    flash_stats.written_bytes += size;
+
+    return SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_read(uint32 src_addr, uint32 *des_addr, uint32 size) {
+    uint8 *ptr = flash_ptr(src_addr, size);
+    if (!ptr || (src_addr | size) & 3) {
+        return SPI_FLASH_RESULT_ERR;
+    }
+
+    memcpy(des_addr, ptr, size);
+
+    return SPI_FLASH_RESULT_OK;
+}
+
+
+void os_timer_arm(os_timer_t *timer, uint32 ms, bool repeat) {
+    if (!timer->timer_armed) {
+        timer->timer_next = armed_timers;
+        armed_timers = timer;
+    }
+
+    timer->timer_expire = uptime_us + ms * 1000ULL;
+    timer->timer_period = repeat ? ms : 0;
+    timer->timer_armed = TRUE;
+}
+
+void os_timer_disarm(os_timer_t *timer) {
+    if (timer->timer_armed) {
+        timer_unlink(timer);
+    }
+}
+
+void os_timer_setfn(os_timer_t *timer, os_timer_func_t *func, void *arg) {
+    timer->timer_func = func;
+    timer->timer_arg = arg;
+}
+
+void os_delay_us(uint32 us) {
+    uptime_us += us;
+}
+
+
+uint32 system_uptime(void) {
+    return uptime_us / 1000000;
+}
+
+uint64 system_uptime_ms(void) {
+    return uptime_us / 1000;
+}
+
+uint64 system_uptime_us(void) {
+    return uptime_us;
+}
+
+/* Tasks are never run on their own; tests run them explicitly using host_run_tasks() */
+
+void system_task_set_handler(system_task_handler_t handler) {
+    task_handler = handler;
+}
+
+void system_task_schedule(uint32 task_id, void *param) {
+    if (task_queue_len >= TASK_QUEUE_LEN) {
+        abort(); /* The real task queue would overflow as well */
+    }
+
+    task_queue[(task_queue_head + task_queue_len) % TASK_QUEUE_LEN] = (task_t) {task_id, param};
+    task_queue_len++;
+}
+
+
+void timer_unlink(os_timer_t *timer) {
+    os_timer_t **t = &armed_timers;
+    while (*t && *t != timer) {
+        t = &(*t)->timer_next;
+    }
+
+    if (*t) {
+        *t = timer->timer_next;
+    }
+
+    timer->timer_next = NULL;
+    timer->timer_armed = FALSE;
+}
+
+os_timer_t *timer_next_due(uint64 until_us) {
+    os_timer_t *t, *due = NULL;
+    for (t = armed_timers; t; t = t->timer_next) {
+        if (t->timer_expire <= until_us && (!due || t->timer_expire < due->timer_expire)) {
+            due = t;
+        }
+    }
+
+    return due;
+}
+
+uint8 *flash_ptr(uint32 addr, uint32 size) {
+    if (!flash_initialized) {
+        host_flash_erase_all();
+    }
+
+    if (addr < FLASH_CONFIG_ADDR || addr + size > FLASH_CONFIG_ADDR + FLASH_SIZE) {
+        return NULL;
+    }
+
+    return flash + addr - FLASH_CONFIG_ADDR;
+}
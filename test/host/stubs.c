@@ -0,0 +1,183 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Stubs for modules that are not part of the host build, along with helpers shared by tests */
+
+#include <string.h>
+
+#include "espgoodies/common.h"
+
+#include "espgoodies/json.h"
+
+#include "api.h"
+#include "client.h"
+#include "config.h"
+#include "device.h"
+#include "events.h"
+#include "ports.h"
+#include "virtual.h"
+#include "webhooks.h"
+
+#include "host.h"
+
+
+uint32             device_flags = 0;
+uint8              webhooks_events_mask = 0;
+
+host_response_t    host_last_response = {0};
+int                host_webhooks_events[EVENT_TYPE_MAX + 1];
+
+
+static double ICACHE_FLASH_ATTR host_port_read_value(port_t *port);
+static bool   ICACHE_FLASH_ATTR host_port_write_value(port_t *port, double value);
+static bool   ICACHE_FLASH_ATTR host_port_set_expression(port_t *port, char *sexpr);
+static int8   ICACHE_FLASH_ATTR host_next_slot(void);
+
+
+void config_save(void) {
+}
+
+bool config_is_provisioning(void) {
+    return FALSE;
+}
+
+void webhooks_push_event(int type, char *port_id) {
+    host_webhooks_events[type]++;
+}
+
+json_t *port_to_json(port_t *port, json_refs_ctx_t *json_refs_ctx) {
+    /* Only the attributes that tests look at */
+    json_t *json = json_obj_new();
+    json_obj_append(json, "id", json_str_new(port->id));
+    json_obj_append(json, "enabled", json_bool_new(IS_PORT_ENABLED(port)));
+
+    return json;
+}
+
+json_t *device_to_json(void) {
+    return json_obj_new();
+}
+
+void respond_json(struct espconn *conn, int status, json_t *json) {
+    free(host_last_response.body);
+
+    host_last_response.conn = conn;
+    host_last_response.status = status;
+    host_last_response.body = json_dump(json, JSON_FREE_EVERYTHING);
+    host_last_response.count++;
+}
+
+
+port_t *host_add_virtual_port(char *id, char *sexpr) {
+    port_t *port = port_new();
+
+    port->id = strdup(id);
+    port->type = PORT_TYPE_NUMBER;
+    port->slot = -1;
+
+    if (!virtual_port_register(port)) {
+        return NULL;
+    }
+
+    port_register(port);
+    port->flags |= PORT_FLAG_ENABLED;
+
+    if (!host_port_set_expression(port, sexpr)) {
+        return NULL;
+    }
+
+    return port;
+}
+
+port_t *host_add_port(char *id, char *sexpr) {
+    port_t *port = port_new();
+
+    port->id = strdup(id);
+    port->type = PORT_TYPE_NUMBER;
+    port->slot = host_next_slot();
+    if (port->slot < 0) {
+        free(port->id);
+        free(port);
+        return NULL;
+    }
+
+    port->flags = PORT_FLAG_WRITABLE;
+    port->user_data = zalloc(sizeof(double));
+    port->read_value = host_port_read_value;
+    port->write_value = host_port_write_value;
+
+    port_register(port);
+    port->flags |= PORT_FLAG_ENABLED;
+
+    if (!host_port_set_expression(port, sexpr)) {
+        return NULL;
+    }
+
+    return port;
+}
+
+void host_remove_port(port_t *port) {
+    port_cleanup(port, /* free_id = */ TRUE);
+    port_unregister(port);
+    free(port->user_data);
+    free(port);
+}
+
+void host_remove_virtual_port(port_t *port) {
+    port_cleanup(port, /* free_id = */ FALSE);
+    virtual_port_unregister(port);
+    port_unregister(port);
+    free(port);
+}
+
+
+double host_port_read_value(port_t *port) {
+    return *(double *) port->user_data;
+}
+
+bool host_port_write_value(port_t *port, double value) {
+    *(double *) port->user_data = value;
+
+    return TRUE;
+}
+
+bool host_port_set_expression(port_t *port, char *sexpr) {
+    if (!sexpr) {
+        return TRUE;
+    }
+
+    port->sexpr = strdup(sexpr);
+    port->expr = expr_parse(port->id, sexpr, strlen(sexpr));
+
+    return port->expr != NULL;
+}
+
+int8 host_next_slot(void) {
+    int8 slot = ports_next_slot();
+    if (slot >= 0) {
+        return slot;
+    }
+
+    /* Host ports aren't persisted, so they also take the slots that ports_next_slot() leaves out, for port sets wider
+     * than the configuration */
+    for (slot = CONFIG_MAX_PORTS; slot < PORT_MAX_SLOTS; slot++) {
+        if (!ports_slot_busy(slot)) {
+            return slot;
+        }
+    }
+
+    return -1;
+}
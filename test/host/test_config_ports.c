@@ -0,0 +1,160 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Checks that all virtual ports, including those whose records come after the strings pool, have their attributes
+ * saved and loaded back, that configurations of the previous layout don't get them from their strings pool, and that
+ * slots past the persisted ones are never handed out */
+
+#include <stdio.h>
+#include <string.h>
+#include <mem.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/flashcfg.h"
+
+#include "common.h"
+#include "config.h"
+#include "ports.h"
+#include "virtual.h"
+
+#include "host.h"
+
+
+static int ICACHE_FLASH_ATTR check_next_slot(void);
+static int ICACHE_FLASH_ATTR check_round_trip(uint8 *config_data);
+static int ICACHE_FLASH_ATTR check_previous_layout(uint8 *config_data);
+static int ICACHE_FLASH_ATTR remove_virtual_ports(void);
+
+
+int check_next_slot(void) {
+    port_t *ports[PORT_MAX_SLOTS];
+    char id[PORT_MAX_ID_LEN];
+    int count = 0, failed = 0;
+
+    for (int8 slot; (slot = ports_next_slot()) >= 0;) {
+        if (slot >= CONFIG_MAX_PORTS || (slot >= PORT_SLOT_VIRTUAL0 && slot < PORT_SLOT_VIRTUAL0 + VIRTUAL_MAX_PORTS)) {
+            printf("FAIL: slot %d handed out\n", slot);
+            failed++;
+            break;
+        }
+
+        snprintf(id, sizeof(id), "port_%02d", count);
+        ports[count++] = host_add_port(id, NULL);
+    }
+
+    if (count != PORT_SLOT_VIRTUAL0) {
+        printf("FAIL: %d slots handed out, expected %d\n", count, PORT_SLOT_VIRTUAL0);
+        failed++;
+    }
+
+    while (count) {
+        host_remove_port(ports[--count]);
+    }
+
+    return failed;
+}
+
+int check_round_trip(uint8 *config_data) {
+    uint32 strings_offs = 1;
+    char id[PORT_MAX_ID_LEN];
+    int failed = 0;
+
+    for (int i = 0; i < VIRTUAL_MAX_PORTS; i++) {
+        snprintf(id, sizeof(id), "virtual_%02d", i);
+        if (!host_add_virtual_port(id, NULL)) {
+            printf("FAIL: could not add virtual port %d\n", i);
+            return 1;
+        }
+    }
+    if (virtual_find_unused_slot() >= 0) {
+        printf("FAIL: free virtual slot left after adding %d virtual ports\n", VIRTUAL_MAX_PORTS);
+        failed++;
+    }
+
+    config_data[CONFIG_OFFS_LAYOUT_VERSION] = CONFIG_LAYOUT_VERSION;
+    ports_save(config_data, &strings_offs);
+    remove_virtual_ports();
+
+    ports_init(config_data);
+    for (int i = 0; i < VIRTUAL_MAX_PORTS; i++) {
+        snprintf(id, sizeof(id), "virtual_%02d", i);
+        port_t *port = port_find_by_id(id);
+        if (!port || port->slot != PORT_SLOT_VIRTUAL0 + i) {
+            printf("FAIL: virtual port %s not loaded back in slot %d\n", id, PORT_SLOT_VIRTUAL0 + i);
+            failed++;
+        }
+    }
+
+    if (remove_virtual_ports() != VIRTUAL_MAX_PORTS) {
+        printf("FAIL: loaded back %d ports, expected %d\n", all_ports_count, VIRTUAL_MAX_PORTS);
+        failed++;
+    }
+
+    return failed;
+}
+
+int check_previous_layout(uint8 *config_data) {
+    int failed = 0, count = 0;
+
+    /* Records of extra ports are still there, but belong to the strings pool of the previous layout */
+    config_data[CONFIG_OFFS_LAYOUT_VERSION] = 0;
+    ports_init(config_data);
+    for (int i = 0; i < all_ports_count; i++) {
+        if (all_ports[i]->slot >= CONFIG_BASE_PORTS) {
+            printf("FAIL: port %s loaded from previous layout in slot %d\n", all_ports[i]->id, all_ports[i]->slot);
+            failed++;
+        }
+    }
+
+    count = remove_virtual_ports();
+    if (count != CONFIG_BASE_PORTS - PORT_SLOT_VIRTUAL0) {
+        printf("FAIL: loaded %d ports from previous layout, expected %d\n", count,
+               CONFIG_BASE_PORTS - PORT_SLOT_VIRTUAL0);
+        failed++;
+    }
+
+    return failed;
+}
+
+int remove_virtual_ports(void) {
+    int count = 0;
+
+    while (all_ports_count) {
+        host_remove_virtual_port(all_ports[all_ports_count - 1]);
+        count++;
+    }
+
+    return count;
+}
+
+
+int main(void) {
+    uint8 *config_data = zalloc(FLASH_CONFIG_SIZE_DEFAULT);
+    int failed = 0;
+
+    failed += check_next_slot();
+    failed += check_round_trip(config_data);
+    failed += check_previous_layout(config_data);
+
+    free(config_data);
+
+    if (!failed) {
+        printf("%d virtual ports persisted, up to slot %d\n", VIRTUAL_MAX_PORTS,
+               PORT_SLOT_VIRTUAL0 + VIRTUAL_MAX_PORTS - 1);
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Checks that asynchronous writes return right away, without touching the port value, and that their completion has
+ * the port read within the next polling round, reporting the change with the reason of the write */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/utils.h"
+
+#include "common.h"
+#include "core.h"
+#include "device.h"
+#include "events.h"
+#include "ports.h"
+#include "webhooks.h"
+
+#include "host.h"
+
+
+#define SAMPLING_INTERVAL 60000 /* Milliseconds; long enough for polling not to notice values by itself */
+
+
+static double  queued_values[PORT_MAX_SLOTS];
+static int     queued_count;
+
+
+static bool ICACHE_FLASH_ATTR queue_write(port_t *port, double value);
+static void ICACHE_FLASH_ATTR complete_write(port_t *port);
+static int  ICACHE_FLASH_ATTR expect(port_t *port, double value, int events, char *what);
+
+
+bool queue_write(port_t *port, double value) {
+    queued_values[port->slot] = value;
+    queued_count++;
+
+    return TRUE;
+}
+
+void complete_write(port_t *port) {
+    *(double *) port->user_data = queued_values[port->slot];
+    port_write_done(port, /* success = */ TRUE);
+}
+
+int expect(port_t *port, double value, int events, char *what) {
+    if (port->last_read_value != value) {
+        printf("FAIL: %s: %s is %s, expected %s\n", what, port->id, dtostr(port->last_read_value, -1),
+               dtostr(value, -1));
+        return 1;
+    }
+    if (host_webhooks_events[EVENT_TYPE_VALUE_CHANGE] != events) {
+        printf("FAIL: %s: got %d events, expected %d\n", what, host_webhooks_events[EVENT_TYPE_VALUE_CHANGE], events);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+int main(void) {
+    host_time_set_us(1000000);
+    core_init();
+
+    port_t *a = host_add_port("a", NULL);
+    port_t *b = host_add_port("b", "ADD($a, 1)");
+    ports_rebuild_change_dep_mask();
+    update_port_expression(b);
+
+    core_poll();
+    a->write_value_async = b->write_value_async = queue_write;
+    a->sampling_interval = b->sampling_interval = SAMPLING_INTERVAL;
+    core_invalidate_poll_schedule();
+    core_enable_polling();
+    if (expect(a, 0, 0, "initial") || expect(b, 1, 0, "initial")) {
+        return 1;
+    }
+
+    device_flags |= DEVICE_FLAG_WEBHOOKS_ENABLED;
+    webhooks_events_mask = BIT(EVENT_TYPE_VALUE_CHANGE);
+
+    /* Queuing the write changes nothing yet, not even the change reason */
+    host_time_advance_ms(100);
+    if (!port_write_value(a, 5, CHANGE_REASON_API) || queued_count != 1) {
+        printf("FAIL: write was not queued\n");
+        return 1;
+    }
+    host_run_tasks();
+    if (expect(a, 0, 0, "queued") || a->change_reason != CHANGE_REASON_NATIVE) {
+        return 1;
+    }
+
+    /* Completion sets the change reason and has the port read right away, despite its sampling interval */
+    complete_write(a);
+    if (a->change_reason != CHANGE_REASON_API) {
+        printf("FAIL: change reason is %c, expected %c\n", a->change_reason, CHANGE_REASON_API);
+        return 1;
+    }
+    host_run_tasks();
+    if (expect(a, 5, 1, "completed") || a->change_reason != CHANGE_REASON_NATIVE) {
+        return 1;
+    }
+
+    /* The dependent port's expression queued its own write, which isn't read back before completing */
+    if (queued_count != 2 || queued_values[b->slot] != 6) {
+        printf("FAIL: expression write was not queued\n");
+        return 1;
+    }
+    host_time_advance_ms(100);
+    host_run_tasks();
+    if (expect(b, 1, 1, "expression queued")) {
+        return 1;
+    }
+
+    complete_write(b);
+    if (b->change_reason != CHANGE_REASON_EXPRESSION) {
+        printf("FAIL: change reason is %c, expected %c\n", b->change_reason, CHANGE_REASON_EXPRESSION);
+        return 1;
+    }
+    host_run_tasks();
+    if (expect(b, 6, 2, "expression completed")) {
+        return 1;
+    }
+
+    /* Failed writes report nothing */
+    port_write_value(a, 7, CHANGE_REASON_API);
+    port_write_done(a, /* success = */ FALSE);
+    host_time_advance_ms(100);
+    host_run_tasks();
+    if (expect(a, 5, 2, "failed")) {
+        return 1;
+    }
+
+    core_disable_polling();
+    host_remove_port(b);
+    host_remove_port(a);
+
+    printf("asynchronous writes were reported upon completion, with their reasons\n");
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Checks that a value change propagates through a chain of dependent port expressions within a single polling
+ * round */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/utils.h"
+
+#include "common.h"
+#include "core.h"
+#include "device.h"
+#include "events.h"
+#include "ports.h"
+#include "webhooks.h"
+
+#include "host.h"
+
+
+#define CHAIN_LEN 40 /* More than 32, so that dependencies span several words of port sets */
+
+
+int main(void) {
+    port_t *chain[CHAIN_LEN];
+    char id[8], sexpr[16];
+    int i;
+
+    host_time_set_us(1000000);
+    core_init();
+
+    /* Register ports in reverse order, so that natural ports order is the opposite of the dependency order:
+     * p0 <- p1 = $p0 <- p2 = $p1 <- ... */
+    for (i = CHAIN_LEN - 1; i >= 0; i--) {
+        snprintf(id, sizeof(id), "p%d", i);
+        snprintf(sexpr, sizeof(sexpr), "$p%d", i - 1);
+        chain[i] = host_add_port(id, i ? sexpr : NULL);
+        if (!chain[i]) {
+            printf("FAIL: could not add port %s\n", id);
+            return 1;
+        }
+    }
+
+    ports_rebuild_change_dep_mask();
+    for (i = 1; i < CHAIN_LEN; i++) {
+        update_port_expression(chain[i]);
+    }
+
+    /* Let all ports settle to their initial value */
+    core_poll();
+
+    host_time_advance_ms(1000);
+    port_write_value(chain[0], 42, CHANGE_REASON_API);
+
+    /* Value changes are counted as pushed to webhooks */
+    device_flags |= DEVICE_FLAG_WEBHOOKS_ENABLED;
+    webhooks_events_mask = BIT(EVENT_TYPE_VALUE_CHANGE);
+
+    host_time_advance_ms(100);
+    core_poll();
+
+    for (i = 0; i < CHAIN_LEN; i++) {
+        if (chain[i]->last_read_value != 42) {
+            printf(
+                "FAIL: port %s = %s after one polling round (chain length %d)\n",
+                chain[i]->id,
+                dtostr(chain[i]->last_read_value, -1),
+                CHAIN_LEN
+            );
+            return 1;
+        }
+    }
+
+    if (host_webhooks_events[EVENT_TYPE_VALUE_CHANGE] != CHAIN_LEN) {
+        printf(
+            "FAIL: got %d value-change events, expected %d\n",
+            host_webhooks_events[EVENT_TYPE_VALUE_CHANGE],
+            CHAIN_LEN
+        );
+        return 1;
+    }
+
+    for (i = 0; i < CHAIN_LEN; i++) {
+        host_remove_port(chain[i]);
+    }
+
+    printf("chain of %d ports settled in a single polling round\n", CHAIN_LEN);
+
+    return 0;
+}
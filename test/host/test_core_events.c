@@ -0,0 +1,197 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Checks that value changes below a port's change threshold are not reported, that changes coming faster than its
+ * minimum event interval are coalesced into a single later event, and that the port value itself stays accurate */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/json.h"
+#include "espgoodies/utils.h"
+
+#include "common.h"
+#include "core.h"
+#include "events.h"
+#include "ports.h"
+#include "sessions.h"
+
+#include "host.h"
+
+
+#define STEP 100 /* Milliseconds between writes */
+
+
+typedef struct {
+
+    double  value;
+    double  reported;  /* Value reported by a value-change event right after writing value; UNDEFINED for none */
+
+} events_step_t;
+
+
+#define U UNDEFINED
+
+static events_step_t threshold_steps[] = {
+    {10,   10},
+    {10.5, U},
+    {9.1,  U},
+    {11.2, 11.2},
+    {10.3, U},
+    {U}
+};
+
+/* With a 10% relative threshold, starting from 11.2 */
+static events_step_t rel_threshold_steps[] = {
+    {12,   U},
+    {12.4, 12.4},
+    {11.3, U},
+    {11.1, 11.1},
+    {U}
+};
+
+static port_t    *port;
+static session_t *session;
+
+
+static double ICACHE_FLASH_ATTR pop_reported_value(int *count);
+static int    ICACHE_FLASH_ATTR run_steps(events_step_t *steps, char *name);
+
+
+double pop_reported_value(int *count) {
+    /* Returns the value of the last value-change event queued since last call, counting and dropping the events */
+    double value = UNDEFINED;
+    session_queue_node_t *n, *next;
+    *count = 0;
+    for (n = session->queue; n; n = next) {
+        if (n->event->type == EVENT_TYPE_VALUE_CHANGE) {
+            value = json_double_get(n->event->json_value);
+            (*count)++;
+        }
+
+        next = n->next;
+        event_free(n->event);
+        free(n);
+    }
+
+    session->queue = NULL;
+    session->queue_len = 0;
+
+    return value;
+}
+
+int run_steps(events_step_t *steps, char *name) {
+    int count;
+    double reported;
+    for (events_step_t *s = steps; !IS_UNDEFINED(s->value); s++) {
+        port_write_value(port, s->value, CHANGE_REASON_API);
+        host_time_advance_ms(STEP);
+        host_run_tasks();
+
+        if (port->last_read_value != s->value) {
+            printf("FAIL: %s: port value is %s, expected %s\n", name, dtostr(port->last_read_value, -1),
+                   dtostr(s->value, -1));
+            return 1;
+        }
+
+        reported = pop_reported_value(&count);
+        if (count != !IS_UNDEFINED(s->reported) || (count && reported != s->reported)) {
+            printf("FAIL: %s: writing %s reported %d events, last one with %s, expected %s\n", name,
+                   dtostr(s->value, -1), count, dtostr(reported, -1), dtostr(s->reported, -1));
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+int main(void) {
+    int count;
+    double reported;
+
+    host_time_set_us(1000000);
+    core_init();
+
+    port = host_add_virtual_port("p", NULL);
+    session = session_create("host", NULL, 3600, API_ACCESS_LEVEL_VIEWONLY);
+    core_enable_polling();
+    host_run_tasks();
+    pop_reported_value(&count);
+
+    /* Absolute threshold */
+    port->change_threshold = 1;
+    if (run_steps(threshold_steps, "absolute threshold")) {
+        return 1;
+    }
+
+    /* Relative threshold */
+    port->change_threshold = 10;
+    port->flags |= PORT_FLAG_REL_THRESHOLD;
+    if (run_steps(rel_threshold_steps, "relative threshold")) {
+        return 1;
+    }
+
+    /* Minimum event interval: the first change is reported right away, the following ones are held back and
+     * reported at once, with the latest value, when the interval elapses */
+    port->change_threshold = 0;
+    port->min_event_interval = 1000;
+    host_time_advance_ms(1000);
+    host_run_tasks();
+    int total = 0;
+    for (int i = 1; i <= 20; i++) {
+        port_write_value(port, i, CHANGE_REASON_API);
+        host_time_advance_ms(STEP);
+        host_run_tasks();
+        reported = pop_reported_value(&count);
+        total += count;
+        if (i == 1 && (count != 1 || reported != 1)) {
+            printf("FAIL: first change not reported right away\n");
+            return 1;
+        }
+    }
+
+    /* Writes span 2 seconds: the first one, then one per elapsed interval */
+    if (total != 2) {
+        printf("FAIL: 20 changes in 2 s were reported by %d events, expected 2\n", total);
+        return 1;
+    }
+
+    /* The last change is reported once its interval elapses, without any further change */
+    host_time_advance_ms(1000);
+    host_run_tasks();
+    reported = pop_reported_value(&count);
+    if (count != 1 || reported != 20) {
+        printf("FAIL: held back change reported by %d events, last one with %s\n", count, dtostr(reported, -1));
+        return 1;
+    }
+
+    host_time_advance_ms(5000);
+    host_run_tasks();
+    pop_reported_value(&count);
+    if (count) {
+        printf("FAIL: got %d more events\n", count);
+        return 1;
+    }
+
+    core_disable_polling();
+    host_remove_virtual_port(port);
+
+    printf("value changes were coalesced as expected\n");
+
+    return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Checks that value changes reach a pending listen request through the core task, and that listen sessions are kept
+ * alive and expired by their timers */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "espgoodies/common.h"
+
+#include "common.h"
+#include "core.h"
+#include "ports.h"
+#include "sessions.h"
+
+#include "host.h"
+
+
+#define SESSION_TIMEOUT 10 /* Seconds */
+
+
+static struct espconn conn;
+
+
+static int ICACHE_FLASH_ATTR expect_response(int count, int status, char *body);
+
+
+int expect_response(int count, int status, char *body) {
+    if (host_last_response.count != count) {
+        printf("FAIL: got %d responses, expected %d\n", host_last_response.count, count);
+        return 1;
+    }
+    if (host_last_response.status != status || host_last_response.conn != &conn) {
+        printf("FAIL: got status %d, expected %d\n", host_last_response.status, status);
+        return 1;
+    }
+    if (strcmp(host_last_response.body, body)) {
+        printf("FAIL: got response %s, expected %s\n", host_last_response.body, body);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+int main(void) {
+    host_time_set_us(1000000);
+    core_init();
+
+    port_t *port = host_add_virtual_port("p", NULL);
+    core_poll();
+
+    /* A listen request is pending; the change is sent from within the listen-respond task, not right away */
+    session_t *session = session_create("host", &conn, SESSION_TIMEOUT, API_ACCESS_LEVEL_VIEWONLY);
+    session_reset(session);
+
+    host_time_advance_ms(100);
+    port_write_value(port, 7, CHANGE_REASON_API);
+    core_poll();
+    if (host_last_response.count) {
+        printf("FAIL: responded before running tasks\n");
+        return 1;
+    }
+
+    host_run_tasks();
+    if (expect_response(1, 200, "[{\"type\":\"value-change\",\"params\":{\"id\":\"p\",\"value\":7}}]")) {
+        return 1;
+    }
+
+    /* With the request answered, changes are queued until the next request */
+    host_time_advance_ms(100);
+    port_write_value(port, 8, CHANGE_REASON_API);
+    core_poll();
+    host_run_tasks();
+    if (session->queue_len != 1 || host_last_response.count != 1) {
+        printf("FAIL: expected 1 queued event, got %d\n", session->queue_len);
+        return 1;
+    }
+
+    /* A new request takes the queued events when the keep-alive timer fires */
+    session->conn = &conn;
+    session_reset(session);
+    host_time_advance_ms(SESSION_TIMEOUT * 1000 - 1);
+    if (host_last_response.count != 1) {
+        printf("FAIL: keep-alive fired early\n");
+        return 1;
+    }
+
+    host_time_advance_ms(1);
+    if (expect_response(2, 200, "[{\"type\":\"value-change\",\"params\":{\"id\":\"p\",\"value\":8}}]")) {
+        return 1;
+    }
+
+    /* Without a new request, the session expires after another timeout */
+    host_time_advance_ms(SESSION_TIMEOUT * 1000);
+    if (session->id[0]) {
+        printf("FAIL: session did not expire\n");
+        return 1;
+    }
+
+    host_remove_virtual_port(port);
+    free(host_last_response.body);
+
+    printf("listen session responded, kept alive and expired as expected\n");
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Checks that persisted port values are journaled instead of having the configuration saved, honoring each port's
+ * persist threshold and interval, that journaled values are loaded back and that a full journal starts over with a
+ * single sector erase */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/utils.h"
+
+#include "common.h"
+#include "core.h"
+#include "journal.h"
+#include "ports.h"
+
+#include "host.h"
+
+
+#define STEP               100  /* Milliseconds between writes */
+#define MANY_VALUES        1000 /* More than a journal sector can hold */
+#define RECORDS_PER_SECTOR 341  /* 12 bytes each */
+
+
+typedef struct {
+
+    double  value;
+    bool    persisted;  /* Whether writing value is expected to journal it right away */
+
+} persist_step_t;
+
+
+#define U UNDEFINED
+
+static persist_step_t threshold_steps[] = {
+    {10,   TRUE},
+    {10.5, FALSE},
+    {9.1,  FALSE},
+    {11.2, TRUE},
+    {10.3, FALSE},
+    {U}
+};
+
+static port_t *port;
+
+
+static uint32 ICACHE_FLASH_ATTR flash_writes(void);
+static uint32 ICACHE_FLASH_ATTR flash_erases(void);
+static int    ICACHE_FLASH_ATTR check_loaded(double expected, char *name);
+
+
+uint32 flash_writes(void) {
+    host_flash_stats_t stats;
+    host_flash_stats_get(&stats);
+
+    return stats.writes;
+}
+
+uint32 flash_erases(void) {
+    host_flash_stats_t stats;
+    host_flash_stats_get(&stats);
+
+    return stats.erases;
+}
+
+int check_loaded(double expected, char *name) {
+    /* Loading the journal brings back the last persisted value, as it happens at boot */
+    double value = port->last_read_value;
+    port->last_read_value = UNDEFINED;
+    journal_load();
+    double loaded = port->last_read_value;
+    port->last_read_value = value;
+
+    if (loaded != expected) {
+        printf("FAIL: %s: loaded value %s, expected %s\n", name, dtostr(loaded, -1), dtostr(expected, -1));
+        return 1;
+    }
+
+    return 0;
+}
+
+
+int main(void) {
+    uint32 writes;
+
+    host_time_set_us(1000000);
+    host_flash_erase_all();
+    core_init();
+
+    port = host_add_virtual_port("p", NULL);
+    port->flags |= PORT_FLAG_PERSISTED;
+    journal_load();
+    core_enable_polling();
+    host_run_tasks();
+
+    /* Values aren't persisted during the first seconds of polling */
+    host_time_advance_ms(3000);
+    host_run_tasks();
+    host_flash_stats_reset();
+
+    /* Persist threshold */
+    port->persist_threshold = 1;
+    for (persist_step_t *s = threshold_steps; !IS_UNDEFINED(s->value); s++) {
+        writes = flash_writes();
+        port_write_value(port, s->value, CHANGE_REASON_API);
+        host_time_advance_ms(STEP);
+        host_run_tasks();
+
+        if (flash_writes() - writes != s->persisted) {
+            printf("FAIL: writing %s journaled %d records, expected %d\n", dtostr(s->value, -1),
+                   flash_writes() - writes, s->persisted);
+            return 1;
+        }
+    }
+    if (check_loaded(11.2, "threshold")) {
+        return 1;
+    }
+
+    /* Persist interval: the first change is persisted right away, the following ones are held back and persisted at
+     * once, with the latest value, when the interval elapses */
+    port->persist_threshold = 0;
+    port->persist_interval = 1000;
+    host_time_advance_ms(1000);
+    host_run_tasks();
+    writes = flash_writes();
+    for (int i = 1; i <= 20; i++) {
+        port_write_value(port, i, CHANGE_REASON_API);
+        host_time_advance_ms(STEP);
+        host_run_tasks();
+    }
+
+    /* Writes span 2 seconds: the first one, then one per elapsed interval */
+    if (flash_writes() - writes != 2) {
+        printf("FAIL: 20 changes in 2 s were journaled as %d records, expected 2\n", flash_writes() - writes);
+        return 1;
+    }
+
+    /* The last value is persisted once its interval elapses, without any further change */
+    host_time_advance_ms(1000);
+    host_run_tasks();
+    if (flash_writes() - writes != 3) {
+        printf("FAIL: held back value was not journaled\n");
+        return 1;
+    }
+    if (check_loaded(20, "interval")) {
+        return 1;
+    }
+
+    host_time_advance_ms(5000);
+    host_run_tasks();
+    if (flash_writes() - writes != 3) {
+        printf("FAIL: got %d more records\n", flash_writes() - writes - 3);
+        return 1;
+    }
+
+    /* Filling up the journal starts it over, erasing its sector just once, and nothing else is ever erased */
+    port->persist_interval = 0;
+    for (int i = 1; i <= MANY_VALUES; i++) {
+        port_write_value(port, 100 + i, CHANGE_REASON_API);
+        host_time_advance_ms(STEP);
+        host_run_tasks();
+    }
+    int expected_erases = (flash_writes() - 1) / RECORDS_PER_SECTOR;
+    if (flash_erases() != expected_erases) {
+        printf("FAIL: %d records caused %d erases, expected %d\n", flash_writes(), flash_erases(), expected_erases);
+        return 1;
+    }
+    if (check_loaded(100 + MANY_VALUES, "compaction")) {
+        return 1;
+    }
+
+    core_disable_polling();
+    host_remove_virtual_port(port);
+
+    printf("%d persisted values were journaled with %d sector erases\n", flash_writes(), flash_erases());
+
+    return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Checks that polling, driven by tasks and timers, wakes up only when a port's sample or heart beat is due, while
+ * still honoring each port's sampling interval, and that ports signaling their changes are read only when they do */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "espgoodies/common.h"
+
+#include "common.h"
+#include "core.h"
+#include "ports.h"
+
+#include "host.h"
+
+
+#define DURATION   10000 /* Milliseconds */
+#define MAX_ROUNDS 150   /* Polling rounds over the whole run */
+
+
+typedef struct {
+
+    char   *id;
+    uint32  sampling_interval;
+    int     heart_beat_interval;
+    bool    interrupt;
+    port_t *port;
+    int     reads;
+    int     heart_beats;
+
+} poll_case_t;
+
+
+static poll_case_t cases[] = {
+    {.id = "fast",   .sampling_interval = 100},
+    {.id = "slow",   .sampling_interval = 1000},
+    {.id = "beat",   .sampling_interval = 5000, .heart_beat_interval = 500},
+    {.id = "idle",   .sampling_interval = 60000},
+    {.id = "intr",   .sampling_interval = 100, .interrupt = TRUE},
+    {NULL}
+};
+
+static poll_case_t *cases_by_slot[PORT_MAX_SLOTS];
+static double (*virtual_read_value)(port_t *port);
+
+
+static double ICACHE_FLASH_ATTR counting_read_value(port_t *port);
+static void   ICACHE_FLASH_ATTR counting_heart_beat(port_t *port);
+static int    ICACHE_FLASH_ATTR run(uint32 duration_ms);
+static int    ICACHE_FLASH_ATTR check(poll_case_t *c, uint32 duration_ms);
+
+
+double counting_read_value(port_t *port) {
+    cases_by_slot[port->slot]->reads++;
+
+    return virtual_read_value(port);
+}
+
+void counting_heart_beat(port_t *port) {
+    cases_by_slot[port->slot]->heart_beats++;
+}
+
+int run(uint32 duration_ms) {
+    /* Advance time one millisecond at a time, as a busy polling loop would, counting actual polling rounds */
+    int rounds = 0;
+    poll_case_t *c;
+    for (c = cases; c->id; c++) {
+        c->reads = c->heart_beats = 0;
+    }
+
+    for (uint32 t = 0; t < duration_ms; t++) {
+        host_time_advance_ms(1);
+        rounds += host_run_tasks();
+    }
+
+    return rounds;
+}
+
+int check(poll_case_t *c, uint32 duration_ms) {
+    int expected_reads = 0;
+    if (IS_PORT_ENABLED(c->port) && !c->interrupt) {
+        expected_reads = duration_ms / c->port->sampling_interval;
+    }
+    int expected_heart_beats = c->heart_beat_interval ? duration_ms / c->heart_beat_interval : 0;
+
+    printf(
+        "%-6s sampling interval %5d ms: %4d reads, %3d heart beats\n",
+        c->id,
+        c->port->sampling_interval,
+        c->reads,
+        c->heart_beats
+    );
+
+    /* The first round may or may not fall within the run */
+    if (c->reads < expected_reads || c->reads > expected_reads + 1) {
+        printf("FAIL: expected %d reads\n", expected_reads);
+        return 1;
+    }
+    if (c->heart_beats < expected_heart_beats || c->heart_beats > expected_heart_beats + 1) {
+        printf("FAIL: expected %d heart beats\n", expected_heart_beats);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+int main(void) {
+    poll_case_t *c;
+    int rounds, failed = 0;
+
+    host_time_set_us(1000000);
+    core_init();
+
+    for (c = cases; c->id; c++) {
+        c->port = host_add_virtual_port(c->id, NULL);
+        if (!c->port) {
+            printf("FAIL: could not add port %s\n", c->id);
+            return 1;
+        }
+
+        cases_by_slot[c->port->slot] = c;
+        virtual_read_value = c->port->read_value;
+        c->port->read_value = counting_read_value;
+        c->port->sampling_interval = c->sampling_interval;
+        if (c->heart_beat_interval) {
+            c->port->heart_beat = counting_heart_beat;
+            c->port->heart_beat_interval = c->heart_beat_interval;
+        }
+        if (c->interrupt) {
+            c->port->flags |= PORT_FLAG_INTERRUPT;
+        }
+    }
+
+    core_enable_polling();
+
+    /* Let initial reads and heart beats happen */
+    run(1);
+
+    rounds = run(DURATION);
+    printf("%d polling rounds in %d ms\n", rounds, DURATION);
+    for (c = cases; c->id; c++) {
+        failed += check(c, DURATION);
+    }
+    if (rounds > MAX_ROUNDS) {
+        printf("FAIL: expected at most %d polling rounds\n", MAX_ROUNDS);
+        failed++;
+    }
+
+    /* Signaled changes are read right away, but only once */
+    poll_case_t *intr = &cases[4];
+    core_port_interrupt(intr->port);
+    run(1);
+    if (intr->reads != 1) {
+        printf("FAIL: signaled port read %d times, expected once\n", intr->reads);
+        failed++;
+    }
+    run(DURATION);
+    if (intr->reads) {
+        printf("FAIL: signaled port read %d more times\n", intr->reads);
+        failed++;
+    }
+
+    /* Changing sampling intervals and disabling ports take effect right away */
+    cases[0].port->sampling_interval = 10;
+    core_invalidate_poll_schedule();
+    port_disable(cases[1].port);
+
+    rounds = run(DURATION);
+    printf("%d polling rounds in %d ms\n", rounds, DURATION);
+    for (c = cases; c->id; c++) {
+        failed += check(c, DURATION);
+    }
+
+    core_disable_polling();
+    for (c = cases; c->id; c++) {
+        host_remove_virtual_port(c->port);
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Checks that time dependent expressions are evaluated when their deadlines pass, rather than at each polling round */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/utils.h"
+
+#include "common.h"
+#include "core.h"
+#include "ports.h"
+
+#include "host.h"
+
+
+#define POLL_INTERVAL   1    /* Milliseconds */
+#define DURATION        6000 /* Milliseconds */
+#define TOLERANCE       1    /* Milliseconds */
+#define MAX_EVALS       100  /* Per expression, over the whole run */
+#define MAX_TRANSITIONS 64
+
+
+typedef struct {
+
+    int    time;
+    double value;
+
+} transition_t;
+
+typedef struct {
+
+    char         *id;
+    char         *sexpr;
+    port_t       *port;
+    transition_t  transitions[2][MAX_TRANSITIONS];
+    int           transitions_count[2];
+    uint32        evals[2];
+
+} sched_case_t;
+
+
+static sched_case_t cases[] = {
+    {.id = "held",   .sexpr = "HELD($input, 1, 500)"},
+    {.id = "delay",  .sexpr = "DELAY($input, 300)"},
+    {.id = "sample", .sexpr = "SAMPLE($input, 2000)"},
+    {.id = "freeze", .sexpr = "FREEZE($input, 1200)"},
+    {.id = "fmavg",  .sexpr = "FMAVG($input, 4, 250)"},
+    {.id = "deriv",  .sexpr = "DERIV($input, 400)"},
+    {.id = "seq",    .sexpr = "SEQUENCE(0, 700, 1, 900)"},
+    {.id = NULL}
+};
+
+/* Input value changes, as pairs of (time, value) */
+static int input_changes[][2] = {
+    {1000, 1},
+    {2500, 0},
+    {2600, 1},
+    {4000, 2},
+    {4010, 3},
+    {-1, 0}
+};
+
+
+static void ICACHE_FLASH_ATTR run(int forced);
+
+
+void run(int forced) {
+    /* When forced, all expressions are evaluated at each polling round, regardless of their deadlines */
+    sched_case_t *c;
+    int t, i;
+
+    host_time_set_us(1000000);
+
+    port_t *input = host_add_virtual_port("input", NULL);
+    for (c = cases; c->id; c++) {
+        c->port = host_add_virtual_port(c->id, c->sexpr);
+        c->transitions_count[forced] = 0;
+    }
+
+    ports_rebuild_change_dep_mask();
+    for (c = cases; c->id; c++) {
+        update_port_expression(c->port);
+    }
+
+    port_write_value(input, 0, CHANGE_REASON_API);
+
+    for (t = 0, i = 0; t < DURATION; t += POLL_INTERVAL) {
+        if (t == input_changes[i][0]) {
+            port_write_value(input, input_changes[i][1], CHANGE_REASON_API);
+            i++;
+        }
+
+        if (forced) {
+            for (c = cases; c->id; c++) {
+                update_port_expression(c->port);
+            }
+        }
+
+        core_poll();
+
+        for (c = cases; c->id; c++) {
+            int *count = c->transitions_count + forced;
+            transition_t *last = c->transitions[forced] + *count - 1;
+            double value = c->port->last_read_value;
+
+            if (*count < MAX_TRANSITIONS && (!*count || (last->value != value && !(IS_UNDEFINED(last->value) &&
+                                                                                  IS_UNDEFINED(value))))) {
+                c->transitions[forced][*count].time = t;
+                c->transitions[forced][*count].value = value;
+                (*count)++;
+            }
+        }
+
+        host_time_advance_ms(POLL_INTERVAL);
+    }
+
+    for (c = cases; c->id; c++) {
+        c->evals[forced] = c->port->expr->prog->eval_stamp;
+        host_remove_virtual_port(c->port);
+    }
+
+    host_remove_virtual_port(input);
+}
+
+
+int main(void) {
+    sched_case_t *c;
+    int i, failed = 0;
+
+    run(/* forced = */ 1);
+    run(/* forced = */ 0);
+
+    for (c = cases; c->id; c++) {
+        bool same = c->transitions_count[0] == c->transitions_count[1];
+        for (i = 0; same && i < c->transitions_count[0]; i++) {
+            transition_t *t0 = c->transitions[0] + i;
+            transition_t *t1 = c->transitions[1] + i;
+            same = (t0->value == t1->value || (IS_UNDEFINED(t0->value) && IS_UNDEFINED(t1->value))) &&
+                   (t0->time - t1->time <= TOLERANCE) && (t1->time - t0->time <= TOLERANCE);
+        }
+
+        if (!same) {
+            printf("FAIL: %s = %s: value transitions differ from evaluating at each polling round\n", c->id, c->sexpr);
+            for (i = 0; i < c->transitions_count[0] || i < c->transitions_count[1]; i++) {
+                printf("    %5d: %-10s", c->transitions[0][i].time, dtostr(c->transitions[0][i].value, -1));
+                printf("    %5d: %-10s\n", c->transitions[1][i].time, dtostr(c->transitions[1][i].value, -1));
+            }
+            failed++;
+        }
+
+        if (c->evals[0] > MAX_EVALS) {
+            printf("FAIL: %s = %s was evaluated %d times\n", c->id, c->sexpr, c->evals[0]);
+            failed++;
+        }
+
+        printf("%-8s %-28s %2d transitions, evaluated %4d times instead of %4d\n",
+               c->id, c->sexpr, c->transitions_count[0], c->evals[0], c->evals[1]);
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Checks that timing statistics count port reads and expression evaluations, measure their durations and the polling
+ * rate, and are cleared on reset */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/system.h"
+
+#include "common.h"
+#include "core.h"
+#include "ports.h"
+#include "stats.h"
+
+#include "host.h"
+
+
+#define DURATION      1000 /* Milliseconds */
+#define READ_DURATION 50   /* Microseconds */
+#define SAMPLING      100  /* Milliseconds */
+
+
+static double (*virtual_read_value)(port_t *port);
+
+
+static double ICACHE_FLASH_ATTR slow_read_value(port_t *port);
+static int    ICACHE_FLASH_ATTR get_int(json_t *json, char *path);
+static int    ICACHE_FLASH_ATTR expect_int(json_t *json, char *path, int min, int max);
+
+
+double slow_read_value(port_t *port) {
+    host_time_set_us(system_uptime_us() + READ_DURATION);
+
+    return virtual_read_value(port);
+}
+
+int get_int(json_t *json, char *path) {
+    /* Follows a dot-separated path of keys */
+    char key[32], *s = path, *e;
+    while (json && *s) {
+        e = strchr(s, '.');
+        if (!e) {
+            e = s + strlen(s);
+        }
+        snprintf(key, sizeof(key), "%.*s", (int) (e - s), s);
+        json = json_obj_lookup_key(json, key);
+        s = *e ? e + 1 : e;
+    }
+
+    if (!json) {
+        return -1;
+    }
+    if (json_get_type(json) == JSON_TYPE_DOUBLE) {
+        return json_double_get(json);
+    }
+
+    return json_int_get(json);
+}
+
+int expect_int(json_t *json, char *path, int min, int max) {
+    int value = get_int(json, path);
+    if (value < min || value > max) {
+        printf("FAIL: %s = %d, expected between %d and %d\n", path, value, min, max);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+int main(void) {
+    int failed = 0;
+
+    host_time_set_us(1000000);
+    core_init();
+    stats_reset();
+
+    port_t *a = host_add_virtual_port("a", NULL);
+    port_t *b = host_add_virtual_port("b", "$a");
+    if (!a || !b) {
+        printf("FAIL: could not add ports\n");
+        return 1;
+    }
+
+    virtual_read_value = a->read_value;
+    a->read_value = slow_read_value;
+    a->sampling_interval = SAMPLING;
+    ports_rebuild_change_dep_mask();
+    update_port_expression(b);
+
+    core_enable_polling();
+    for (int t = 0; t < DURATION; t++) {
+        if (t == DURATION / 2) {
+            port_write_value(a, 7, CHANGE_REASON_API);
+        }
+        host_time_advance_ms(1);
+        host_run_tasks();
+    }
+    core_disable_polling();
+
+    json_t *json = stats_to_json();
+    char *dump = json_dump(json, /* free_mode = */ JSON_FREE_NOTHING);
+    printf("%s\n", dump);
+    free(dump);
+
+    failed += expect_int(json, "elapsed", DURATION, DURATION + 10);
+    failed += expect_int(json, "ports.a.read.count", DURATION / SAMPLING, DURATION / SAMPLING + 1);
+    failed += expect_int(json, "ports.a.read.min", READ_DURATION, READ_DURATION);
+    failed += expect_int(json, "ports.a.read.max", READ_DURATION, READ_DURATION);
+    failed += expect_int(json, "ports.a.write.count", 1, 1);
+    failed += expect_int(json, "ports.b.eval.count", 1, 100);
+    failed += expect_int(json, "eval.count", get_int(json, "ports.b.eval.count"), get_int(json, "ports.b.eval.count"));
+    failed += expect_int(json, "poll.duration.max", READ_DURATION, 10 * READ_DURATION);
+    failed += expect_int(json, "poll.rate", 1, 200);
+    failed += expect_int(json, "poll.lateness.max", 0, 1000);
+    json_free(json);
+
+    /* Reset clears everything */
+    stats_reset();
+    json = stats_to_json();
+    failed += expect_int(json, "elapsed", 0, 0);
+    failed += expect_int(json, "poll.duration.count", 0, 0);
+    if (json_obj_get_len(json_obj_lookup_key(json, "ports"))) {
+        printf("FAIL: ports stats not cleared\n");
+        failed++;
+    }
+    json_free(json);
+
+    host_remove_virtual_port(b);
+    host_remove_virtual_port(a);
+    stats_reset();
+
+    if (!failed) {
+        printf("timing statistics match\n");
+    }
+
+    return failed ? 1 : 0;
+}
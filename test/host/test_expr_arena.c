@@ -0,0 +1,220 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Checks that each parsed expression, taken from the API test cases, is held by a single allocation and that nothing
+ * leaks, reporting how many allocations the same tree would hold if its nodes were allocated one by one */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/utils.h"
+
+#include "common.h"
+#include "expr.h"
+#include "ports.h"
+
+#include "host.h"
+
+
+#define EVAL_ITERATIONS 100
+#define MAX_NODES       256
+
+
+static char *corpus[] = {
+    "123",
+    "-16.5",
+    "true",
+    "$num_port",
+    "ABS(-12)",
+    "ADD(10, 20, 30)",
+    "ADD($bool_port, $num_port)",
+    "ADD($some, $inexistent, $ports)",
+    "MUL($num_port, $num_port2, 10)",
+    "AND(true, false, true)",
+    "AVG(10, 20, 60)",
+    "BITAND(11, 12)",
+    "IF($bool_port, NOT($), $)",
+    "IF(true, 12, 13)",
+    "POW(100, 0.5)",
+    "ACC($num_port, $)",
+    "ACCINC($num_port, $)",
+    "AVAILABLE($inexistent)",
+    "DEFAULT($num_port, 13)",
+    "DELAY($num_port, 1000)",
+    "DERIV($num_port, 2000)",
+    "INTEG($num_port, $, 1000)",
+    "FALLING($num_port)",
+    "RISING($num_port)",
+    "FMAVG($num_port, 3, 2000)",
+    "FMEDIAN($num_port, 3, 2000)",
+    "FREEZE($num_port, 2000)",
+    "HELD($num_port, 123, 2000)",
+    "HYST($num_port, 8, 12)",
+    "SAMPLE($num_port, 2000)",
+    "SEQUENCE(1, 3000, 2, 3000, 3, 3000)",
+    "LUT(0.6, 0, 0, 1, 10, 2, 100)",
+    "LUTLI($num_port, 0, 0, 1, 10, 2, 100)",
+    "TIME()",
+    "TIMEMS()",
+    "IF(EQ($bool_port, 1), ADD(MUL($num_port, 2), 1), SUB($num_port2, DIV($num_port, 3)))",
+    "IF(GT(MUL($num_port, 2), 10), MUL($num_port, 2), 0)",
+    NULL
+};
+
+static char *invalid_corpus[] = {
+    "  ABS(#)",
+    "  ABS($invalid, $number, $of, $arguments)",
+    "  ADD($unbalanced, $parentheses))",
+    "  ADD($unterminated, $expression",
+    "  SUM(10, 3.14.15)",
+    "  SUM(10,,)",
+    "  UNKNOWN_FUNC($gpio0, $gpio1)",
+    "  some random text",
+    NULL
+};
+
+static port_t  ports[] = {
+    {.id = "test",      .type = PORT_TYPE_NUMBER,  .flags = PORT_FLAG_ENABLED | PORT_FLAG_WRITABLE},
+    {.id = "num_port",  .type = PORT_TYPE_NUMBER,  .flags = PORT_FLAG_ENABLED},
+    {.id = "num_port2", .type = PORT_TYPE_NUMBER,  .flags = PORT_FLAG_ENABLED},
+    {.id = "bool_port", .type = PORT_TYPE_BOOLEAN, .flags = PORT_FLAG_ENABLED}
+};
+static port_t *ports_list[] = {&ports[0], &ports[1], &ports[2], &ports[3]};
+
+port_t        **all_ports = ports_list;
+int             all_ports_count = sizeof(ports_list) / sizeof(port_t *);
+
+
+static int ICACHE_FLASH_ATTR node_allocs_rec(expr_t *expr, expr_t **seen, int *seen_count);
+static int ICACHE_FLASH_ATTR live_allocs(void);
+
+
+port_t *port_find_by_id(char *id) {
+    for (int i = 0; i < all_ports_count; i++) {
+        if (!strcmp(all_ports[i]->id, id)) {
+            return all_ports[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+int node_allocs_rec(expr_t *expr, expr_t **seen, int *seen_count) {
+    /* Allocations held by a node of a tree that is not packed: the node itself, its arguments array, its port id and
+     * its cached lookup table */
+
+    for (int i = 0; i < *seen_count; i++) {
+        if (seen[i] == expr) {
+            return 0;
+        }
+    }
+    seen[(*seen_count)++] = expr;
+
+    int count = 1 + (expr->argc > 0) + (expr->port_id != NULL);
+    if (expr->func && !strncmp(((func_t *) expr->func)->name, "LUT", 3) && expr->paux) {
+        count++;
+    }
+
+    for (int i = 0; i < expr->argc; i++) {
+        count += node_allocs_rec(expr->args[i], seen, seen_count);
+    }
+
+    return count;
+}
+
+int live_allocs(void) {
+    host_alloc_stats_t stats;
+    host_alloc_stats_get(&stats);
+
+    return (int32) stats.live;
+}
+
+
+int main(void) {
+    expr_t *seen[MAX_NODES];
+    int seen_count, before_total = 0, after_total = 0, failed = 0;
+    host_alloc_stats_t stats;
+
+    printf("%-90s %8s %8s %8s\n", "expression", "before", "after", "parsing");
+
+    /* The evaluation stack shared by all programs is allocated along with the first one, and only grows afterwards */
+    expr_free(expr_parse("test", "0", 1));
+
+    for (char **sexpr = corpus; *sexpr; sexpr++) {
+        host_alloc_stats_reset();
+        expr_t *expr = expr_parse("test", *sexpr, strlen(*sexpr));
+        if (!expr) {
+            printf("failed to parse \"%s\"\n", *sexpr);
+            return 1;
+        }
+
+        host_alloc_stats_get(&stats);
+        int after = live_allocs();
+        seen_count = 0;
+        int before = node_allocs_rec(expr, seen, &seen_count) + 1; /* Plus the program */
+
+        printf("%-90s %8d %8d %8d\n", *sexpr, before, after, stats.mallocs);
+        if (after != 1) {
+            printf("expected a single allocation for \"%s\", got %d\n", *sexpr, after);
+            failed++;
+        }
+
+        before_total += before;
+        after_total += after;
+
+        /* Let stateful functions allocate their buffers */
+        host_time_set_us(0);
+        for (int i = 0; i < EVAL_ITERATIONS; i++) {
+            ports[1].last_read_value = i % 17;
+            ports[2].last_read_value = i % 11;
+            ports[3].last_read_value = i % 2;
+            expr_eval(expr);
+            host_time_advance_ms(500);
+        }
+
+        expr_free(expr);
+        if (live_allocs()) {
+            printf("%d allocations leaked by \"%s\"\n", live_allocs(), *sexpr);
+            failed++;
+        }
+    }
+
+    printf("%-90s %8d %8d\n", "total", before_total, after_total);
+
+    for (char **sexpr = invalid_corpus; *sexpr; sexpr++) {
+        bool had_token = expr_parse_get_error()->token != NULL;
+
+        host_alloc_stats_reset();
+        if (expr_parse("test", *sexpr, strlen(*sexpr))) {
+            printf("unexpectedly parsed \"%s\"\n", *sexpr);
+            return 1;
+        }
+
+        /* The error token is kept until the next parse error */
+        int expected = (expr_parse_get_error()->token != NULL) - had_token;
+        if (live_allocs() != expected) {
+            printf("%d allocations leaked by invalid \"%s\"\n", live_allocs() - expected, *sexpr);
+            failed++;
+        }
+    }
+
+    printf("%d invalid expressions rejected without leaks\n", (int) (sizeof(invalid_corpus) / sizeof(char *) - 1));
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Checks DELAY, FMAVG and FMEDIAN history ring buffers against straightforward array based implementations, and that
+ * they stop allocating memory once their history is full */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/utils.h"
+
+#include "common.h"
+#include "expr.h"
+#include "ports.h"
+
+#include "host.h"
+
+
+#define STEPS      20000
+#define WARMUP     2000
+#define MAX_VALUES 64
+
+
+typedef struct {
+
+    double values[MAX_VALUES];
+    uint64 times[MAX_VALUES];
+    int    len;
+    uint64 last_time_ms;
+    double last_value;
+
+} ref_hist_t;
+
+
+static port_t  ports[] = {
+    {.id = "test", .type = PORT_TYPE_NUMBER, .flags = PORT_FLAG_ENABLED | PORT_FLAG_WRITABLE},
+    {.id = "x",    .type = PORT_TYPE_NUMBER, .flags = PORT_FLAG_ENABLED},
+};
+static port_t *ports_list[] = {&ports[0], &ports[1]};
+
+port_t        **all_ports = ports_list;
+int             all_ports_count = sizeof(ports_list) / sizeof(port_t *);
+
+
+static void   ICACHE_FLASH_ATTR  ref_drop(ref_hist_t *hist, int count);
+static double ICACHE_FLASH_ATTR  ref_delay(ref_hist_t *hist, double value, double delay, uint64 time_ms);
+static bool   ICACHE_FLASH_ATTR  ref_filter(ref_hist_t *hist, double value, int width, int interval, uint64 time_ms);
+static int    ICACHE_FLASH_ATTR  compare_values(const void *a, const void *b);
+static int    ICACHE_FLASH_ATTR  check(char *sexpr, char *func, int width, int interval);
+
+
+port_t *port_find_by_id(char *id) {
+    for (int i = 0; i < all_ports_count; i++) {
+        if (!strcmp(all_ports[i]->id, id)) {
+            return all_ports[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+void ref_drop(ref_hist_t *hist, int count) {
+    memmove(hist->values, hist->values + count, sizeof(double) * (hist->len - count));
+    memmove(hist->times, hist->times + count, sizeof(uint64) * (hist->len - count));
+    hist->len -= count;
+}
+
+double ref_delay(ref_hist_t *hist, double value, double delay, uint64 time_ms) {
+    double result = UNDEFINED;
+
+    if (value != hist->last_value) {
+        hist->last_value = value;
+        if (hist->len == 32) {
+            ref_drop(hist, 1);
+        }
+
+        hist->values[hist->len] = value;
+        hist->times[hist->len++] = time_ms;
+    }
+
+    while (hist->len && time_ms - hist->times[0] > delay) {
+        result = hist->values[0];
+        ref_drop(hist, 1);
+    }
+
+    return result;
+}
+
+bool ref_filter(ref_hist_t *hist, double value, int width, int interval, uint64 time_ms) {
+    if (hist->len && (int32) (time_ms - hist->last_time_ms) < interval) {
+        return FALSE;
+    }
+
+    hist->last_time_ms = time_ms;
+    if (hist->len == width) {
+        ref_drop(hist, 1);
+    }
+
+    hist->values[hist->len++] = value;
+
+    return TRUE;
+}
+
+int compare_values(const void *a, const void *b) {
+    double d = *(double *) a - *(double *) b;
+    return d < 0 ? -1 : d > 0 ? 1 : 0;
+}
+
+int check(char *sexpr, char *func, int width, int interval) {
+    ref_hist_t ref = {.len = 0, .last_value = UNDEFINED};
+    host_alloc_stats_t stats;
+    double expected, sorted[MAX_VALUES];
+    int i, j;
+
+    host_time_set_us(1000000);
+    srand(1);
+
+    expr_t *expr = expr_parse("test", sexpr, strlen(sexpr));
+    if (!expr) {
+        printf("FAIL: could not parse \"%s\"\n", sexpr);
+        return 1;
+    }
+
+    for (i = 0; i < STEPS; i++) {
+        if (i == WARMUP) {
+            host_alloc_stats_reset();
+        }
+
+        /* Values change now and then, with a few large outliers */
+        if (rand() % 3 == 0) {
+            ports[1].last_read_value = (rand() % 10 == 0) ? rand() % 100000 : rand() % 100 / 4.0;
+        }
+
+        host_time_advance_ms(rand() % 40);
+        uint64 time_ms = system_uptime_ms();
+        double value = ports[1].last_read_value;
+        double result = expr_eval(expr);
+
+        if (!strcmp(func, "DELAY")) {
+            expected = ref_delay(&ref, value, interval, time_ms);
+        }
+        else if (!ref_filter(&ref, value, width, interval, time_ms)) {
+            expected = UNDEFINED;
+        }
+        else if (!strcmp(func, "FMAVG")) {
+            expected = 0;
+            for (j = 0; j < ref.len; j++) {
+                expected += ref.values[j];
+            }
+            expected /= ref.len;
+        }
+        else { /* Assuming FMEDIAN */
+            if (ref.len < 3) {
+                expected = ref.values[0];
+            }
+            else {
+                memcpy(sorted, ref.values, sizeof(double) * ref.len);
+                qsort(sorted, ref.len, sizeof(double), compare_values);
+                expected = sorted[ref.len / 2];
+            }
+        }
+
+        /* Running sums may differ from fresh sums by rounding errors */
+        bool same = (IS_UNDEFINED(result) && IS_UNDEFINED(expected)) ||
+                    (result == expected) ||
+                    (result - expected < 1e-6 && expected - result < 1e-6);
+        if (!same) {
+            printf(
+                "FAIL: \"%s\" at step %d: expected %s, got %s\n",
+                sexpr,
+                i,
+                dtostr(expected, -1),
+                dtostr(result, -1)
+            );
+            expr_free(expr);
+            return 1;
+        }
+    }
+
+    host_alloc_stats_get(&stats);
+    expr_free(expr);
+
+    if (stats.mallocs || stats.reallocs || stats.frees) {
+        printf(
+            "FAIL: \"%s\" still allocates memory after warmup (%d mallocs, %d reallocs, %d frees)\n",
+            sexpr,
+            stats.mallocs,
+            stats.reallocs,
+            stats.frees
+        );
+        return 1;
+    }
+
+    printf("%-30s matches reference over %d steps\n", sexpr, STEPS);
+
+    return 0;
+}
+
+
+int main(void) {
+    int failed = 0;
+
+    failed += check("DELAY($x, 300)", "DELAY", 0, 300);
+    failed += check("DELAY($x, 5000)", "DELAY", 0, 5000);
+    failed += check("FMAVG($x, 1, 0)", "FMAVG", 1, 0);
+    failed += check("FMAVG($x, 8, 50)", "FMAVG", 8, 50);
+    failed += check("FMAVG($x, 32, 10)", "FMAVG", 32, 10);
+    failed += check("FMEDIAN($x, 3, 0)", "FMEDIAN", 3, 0);
+    failed += check("FMEDIAN($x, 9, 50)", "FMEDIAN", 9, 50);
+    failed += check("FMEDIAN($x, 32, 10)", "FMEDIAN", 32, 10);
+
+    return failed ? 1 : 0;
+}
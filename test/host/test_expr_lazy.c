@@ -0,0 +1,140 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Checks that IF, AND, OR and DEFAULT only evaluate the arguments they need, both when compiled and when walking the
+ * tree, so that stateful functions in branches that are not taken keep their state */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/utils.h"
+
+#include "common.h"
+#include "expr.h"
+#include "ports.h"
+
+#include "host.h"
+
+
+#define STEPS 20
+
+
+typedef struct {
+
+    char   *sexpr;
+    double  expected[STEPS];  /* Expected values, with $c alternating between 1 and 0, starting with 1, and $n being
+                               * the step number */
+
+} lazy_case_t;
+
+
+#define U UNDEFINED
+
+static lazy_case_t cases[] = {
+    /* Undefined values in arguments that aren't needed don't matter */
+    {"IF($c, 5, $inexistent)",                 {5, U, 5, U, 5, U, 5, U, 5, U, 5, U, 5, U, 5, U, 5, U, 5, U}},
+    {"AND(NOT($c), $inexistent)",              {0, U, 0, U, 0, U, 0, U, 0, U, 0, U, 0, U, 0, U, 0, U, 0, U}},
+    {"OR($c, $inexistent)",                    {1, U, 1, U, 1, U, 1, U, 1, U, 1, U, 1, U, 1, U, 1, U, 1, U}},
+    {"DEFAULT($c, $inexistent)",               {1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0}},
+    {"AND($c, 7)",                             {1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0}},
+
+    /* $n increases with each step, so accumulators tell how many steps passed since they were last evaluated */
+    {"IF($c, ACC($n, 0), ACC($n, 100))",
+                                               {0, 100, 2, 102, 2, 102, 2, 102, 2, 102, 2, 102, 2, 102, 2, 102, 2, 102, 2, 102}},
+    {"AND($c, EQ(ACC($n, 0), 2))",             {0, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0}},
+    {"OR($c, EQ(ACC($n, 0), 2))",              {1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}},
+    {"DEFAULT(IF($c, 1, $inexistent), ACC($n, 0))",
+                                               {1, 0, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2}},
+
+    /* Shared nodes that are first met in a branch that isn't taken */
+    {"ADD(IF($c, 0, MUL($c, 3)), MUL($c, 3))", {3, 0, 3, 0, 3, 0, 3, 0, 3, 0, 3, 0, 3, 0, 3, 0, 3, 0, 3, 0}},
+    {NULL}
+};
+
+static port_t  ports[] = {
+    {.id = "test", .type = PORT_TYPE_NUMBER,  .flags = PORT_FLAG_ENABLED | PORT_FLAG_WRITABLE},
+    {.id = "c",    .type = PORT_TYPE_BOOLEAN, .flags = PORT_FLAG_ENABLED},
+    {.id = "n",    .type = PORT_TYPE_NUMBER,  .flags = PORT_FLAG_ENABLED}
+};
+static port_t *ports_list[] = {&ports[0], &ports[1], &ports[2]};
+
+port_t        **all_ports = ports_list;
+int             all_ports_count = sizeof(ports_list) / sizeof(port_t *);
+
+
+static bool ICACHE_FLASH_ATTR same_value(double v1, double v2);
+static int  ICACHE_FLASH_ATTR check(lazy_case_t *c, double (*eval)(expr_t *), char *method);
+
+
+port_t *port_find_by_id(char *id) {
+    for (int i = 0; i < all_ports_count; i++) {
+        if (!strcmp(all_ports[i]->id, id)) {
+            return all_ports[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+bool same_value(double v1, double v2) {
+    return (IS_UNDEFINED(v1) && IS_UNDEFINED(v2)) || v1 == v2;
+}
+
+int check(lazy_case_t *c, double (*eval)(expr_t *), char *method) {
+    /* Each method gets its own instance, so that stateful functions evolve independently */
+    expr_t *expr = expr_parse("test", c->sexpr, strlen(c->sexpr));
+    if (!expr) {
+        printf("failed to parse \"%s\"\n", c->sexpr);
+        return 1;
+    }
+
+    int failed = 0;
+    for (int i = 0; i < STEPS; i++) {
+        ports[1].last_read_value = !(i % 2);
+        ports[2].last_read_value = i;
+        double value = eval(expr);
+        if (!same_value(value, c->expected[i])) {
+            printf("%-42s %-8s step %2d: expected %s, got %s\n", c->sexpr, method, i,
+                   dtostr(c->expected[i], -1), dtostr(value, -1));
+            failed = 1;
+            break;
+        }
+    }
+
+    expr_free(expr);
+
+    return failed;
+}
+
+
+int main(void) {
+    int count = 0, failed = 0;
+
+    for (lazy_case_t *c = cases; c->sexpr; c++) {
+        failed += check(c, expr_eval, "compiled");
+        failed += check(c, expr_eval_tree, "tree");
+        count++;
+    }
+
+    if (!failed) {
+        printf("%d lazy evaluation cases match, compiled and tree walking\n", count);
+    }
+
+    return failed ? 1 : 0;
+}
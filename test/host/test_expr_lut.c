@@ -0,0 +1,216 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Checks LUT & LUTLI lookups with literal tables, sorted once at parse time, against tables that need sorting at
+ * each evaluation and against a plain linear lookup */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/utils.h"
+
+#include "common.h"
+#include "expr.h"
+#include "ports.h"
+
+#include "host.h"
+
+
+static char *tables[] = {
+    "0, 0, 1, 10, 2, 100, 5, 120, 10, 150",
+    "10, 150, 2, 100, 0, 0, 5, 120, 1, 10",
+    "3, 30, 3, 40, -1, 5, 7, 70",
+    "-2.5, 1, 4.25, -3",
+    "0, 0, 1, 1, 2, 4, 3, 9, 4, 16, 5, 25, 6, 36, 7, 49, 8, 64, 9, 81, 10, 100, 11, 121, 12, 144, 13, 169, 14, 196",
+    /* A calibration curve of 20 points, the most a table can have */
+    "0, 1.5, 1, -0.13, 2, -1.02, 3, -1.17, 4, -0.58, 5, 0.75, 6, 2.82, 7, 5.63, 8, 9.18, 9, 13.47, 10, 18.5, "
+    "11, 24.27, 12, 30.78, 13, 38.03, 14, 46.02, 15, 54.75, 16, 64.22, 17, 74.43, 18, 85.38, 19, 97.07",
+    NULL
+};
+
+/* One point too many */
+static char *too_long_table = "0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, "
+                              "11, 11, 12, 12, 13, 13, 14, 14, 15, 15, 16, 16, 17, 17, 18, 18, 19, 19, 20, 20";
+
+static port_t  ports[] = {
+    {.id = "test", .type = PORT_TYPE_NUMBER, .flags = PORT_FLAG_ENABLED | PORT_FLAG_WRITABLE},
+    {.id = "x",    .type = PORT_TYPE_NUMBER, .flags = PORT_FLAG_ENABLED},
+    {.id = "zero", .type = PORT_TYPE_NUMBER, .flags = PORT_FLAG_ENABLED}
+};
+static port_t *ports_list[] = {&ports[0], &ports[1], &ports[2]};
+
+port_t        **all_ports = ports_list;
+int             all_ports_count = sizeof(ports_list) / sizeof(port_t *);
+
+
+static int    ICACHE_FLASH_ATTR  parse_table(char *table, double *points);
+static double ICACHE_FLASH_ATTR  linear_lookup(double *points, int length, double x, bool interpolate);
+static expr_t ICACHE_FLASH_ATTR *parse_lut(char *func, char *table, bool literal);
+
+
+port_t *port_find_by_id(char *id) {
+    for (int i = 0; i < all_ports_count; i++) {
+        if (!strcmp(all_ports[i]->id, id)) {
+            return all_ports[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+int parse_table(char *table, double *points) {
+    int count = 0;
+    char *s = table, *e;
+    while (*s) {
+        points[count++] = strtod(s, &e);
+        s = e;
+        while (*s == ',' || *s == ' ') {
+            s++;
+        }
+    }
+
+    return count / 2;
+}
+
+double linear_lookup(double *points, int length, double x, bool interpolate) {
+    /* Sort pairs by x, keeping the original order of equal xs */
+    double sorted[2 * length];
+    int i, j;
+    memcpy(sorted, points, sizeof(double) * 2 * length);
+    for (i = 1; i < length; i++) {
+        for (j = i; j > 0 && sorted[2 * j - 2] > sorted[2 * j]; j--) {
+            double x1 = sorted[2 * j - 2], y1 = sorted[2 * j - 1];
+            sorted[2 * j - 2] = sorted[2 * j];
+            sorted[2 * j - 1] = sorted[2 * j + 1];
+            sorted[2 * j] = x1;
+            sorted[2 * j + 1] = y1;
+        }
+    }
+
+    if (x < sorted[0]) {
+        return sorted[1];
+    }
+
+    for (i = 0; i < length - 1; i++) {
+        double x1 = sorted[2 * i], y1 = sorted[2 * i + 1];
+        double x2 = sorted[2 * i + 2], y2 = sorted[2 * i + 3];
+        if (x > x2) {
+            continue;
+        }
+
+        if (!interpolate) {
+            return x - x1 < x2 - x ? y1 : y2;
+        }
+
+        return x1 == x2 ? y1 : y1 + (y2 - y1) * (x - x1) / (x2 - x1);
+    }
+
+    return sorted[2 * length - 1];
+}
+
+expr_t *parse_lut(char *func, char *table, bool literal) {
+    /* Non-literal tables have each of their values added to a zero-valued port */
+    char sexpr[1024], *s = table, *e;
+    int len = snprintf(sexpr, sizeof(sexpr), "%s($x", func);
+    while (*s) {
+        double value = strtod(s, &e);
+        s = e;
+        while (*s == ',' || *s == ' ') {
+            s++;
+        }
+
+        if (literal) {
+            len += snprintf(sexpr + len, sizeof(sexpr) - len, ", %s", dtostr(value, -1));
+        }
+        else {
+            len += snprintf(sexpr + len, sizeof(sexpr) - len, ", ADD($zero, %s)", dtostr(value, -1));
+        }
+    }
+    len += snprintf(sexpr + len, sizeof(sexpr) - len, ")");
+
+    return expr_parse("test", sexpr, len);
+}
+
+
+int main(void) {
+    double points[64];
+    host_alloc_stats_t stats;
+    int failed = 0;
+
+    ports[2].last_read_value = 0;
+
+    for (char **table = tables; *table; table++) {
+        int length = parse_table(*table, points);
+
+        for (int interpolate = 0; interpolate <= 1; interpolate++) {
+            char *func = interpolate ? "LUTLI" : "LUT";
+            expr_t *literal_expr = parse_lut(func, *table, /* literal = */ TRUE);
+            expr_t *dynamic_expr = parse_lut(func, *table, /* literal = */ FALSE);
+            if (!literal_expr || !dynamic_expr) {
+                printf("FAIL: could not parse %s with table %s\n", func, *table);
+                return 1;
+            }
+
+            host_alloc_stats_reset();
+
+            for (double x = -5; x <= 20; x += 0.25) {
+                ports[1].last_read_value = x;
+                double expected = linear_lookup(points, length, x, interpolate);
+                double literal_value = expr_eval(literal_expr);
+                double dynamic_value = expr_eval(dynamic_expr);
+
+                if (literal_value != expected || dynamic_value != expected) {
+                    printf(
+                        "FAIL: %s(%s, %s): expected %s, got %s (literal table), %s (dynamic table)\n",
+                        func,
+                        dtostr(x, -1),
+                        *table,
+                        dtostr(expected, -1),
+                        dtostr(literal_value, -1),
+                        dtostr(dynamic_value, -1)
+                    );
+                    failed++;
+                    break;
+                }
+            }
+
+            host_alloc_stats_get(&stats);
+            if (stats.mallocs || stats.reallocs) {
+                printf("FAIL: %s lookups allocated memory %d times\n", func, stats.mallocs + stats.reallocs);
+                failed++;
+            }
+
+            expr_free(literal_expr);
+            expr_free(dynamic_expr);
+        }
+    }
+
+    expr_t *expr = parse_lut("LUTLI", too_long_table, /* literal = */ TRUE);
+    if (expr) {
+        printf("FAIL: parsed LUTLI with a table of 21 points\n");
+        expr_free(expr);
+        failed++;
+    }
+
+    if (!failed) {
+        printf("LUT & LUTLI lookups match for %d tables\n", (int) (sizeof(tables) / sizeof(char *) - 1));
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Checks that lists and objects grow geometrically, that json_shrink() trims them, and that appending to a container
+ * that already holds as many members as its 16-bit length allows is refused */
+
+#include <stdio.h>
+#include <string.h>
+#include <mem.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/json.h"
+
+#include "host.h"
+
+
+#define MAX_LEN 0xFFFF
+
+
+static int ICACHE_FLASH_ATTR check_growth(void);
+static int ICACHE_FLASH_ATTR check_full_list(void);
+static int ICACHE_FLASH_ATTR check_full_obj(void);
+
+
+int check_growth(void) {
+    int failed = 0;
+
+    json_t *json = json_list_new();
+    for (int i = 0; i < 100; i++) {
+        json_list_append(json, json_int_new(i));
+        if (json->capacity < json->len || (json->capacity & (json->capacity - 1))) {
+            printf("FAIL: capacity is %d at length %d, expected a power of 2\n", json->capacity, json->len);
+            failed++;
+            break;
+        }
+    }
+
+    json_shrink(json);
+    if (json->capacity != json->len) {
+        printf("FAIL: shrinking left a capacity of %d at length %d\n", json->capacity, json->len);
+        failed++;
+    }
+
+    json_free(json);
+
+    return failed;
+}
+
+int check_full_list(void) {
+    host_alloc_stats_t stats;
+    int failed = 0;
+
+    host_alloc_stats_reset();
+    json_t *json = json_list_new();
+    for (int i = 0; i < MAX_LEN; i++) {
+        json_list_append(json, json_null_new());
+    }
+
+    json_list_append(json, json_null_new());
+    if (json->len != MAX_LEN || json->capacity != MAX_LEN) {
+        printf("FAIL: full list has length %d and capacity %d after appending\n", json->len, json->capacity);
+        failed++;
+    }
+
+    json_free(json);
+    host_alloc_stats_get(&stats);
+    if (stats.live) {
+        printf("FAIL: %d allocations leaked with a full list\n", stats.live);
+        failed++;
+    }
+
+    return failed;
+}
+
+int check_full_obj(void) {
+    host_alloc_stats_t stats;
+    char key[8];
+    int failed = 0;
+
+    host_alloc_stats_reset();
+    json_t *json = json_obj_new();
+    for (int i = 0; i < MAX_LEN; i++) {
+        snprintf(key, sizeof(key), "%d", i);
+        json_obj_append(json, key, json_null_new());
+    }
+
+    json_obj_append(json, "extra", json_int_new(1));
+    if (json->len != MAX_LEN || json_obj_lookup_key(json, "extra")) {
+        printf("FAIL: full object has length %d after appending\n", json->len);
+        failed++;
+    }
+    if (!json_obj_lookup_key(json, "65534")) {
+        printf("FAIL: last member of full object not found\n");
+        failed++;
+    }
+
+    json_free(json);
+    host_alloc_stats_get(&stats);
+    if (stats.live) {
+        printf("FAIL: %d allocations leaked with a full object\n", stats.live);
+        failed++;
+    }
+
+    return failed;
+}
+
+
+int main(void) {
+    int failed = 0;
+
+    failed += check_growth();
+    failed += check_full_list();
+    failed += check_full_obj();
+
+    if (!failed) {
+        printf("lists and objects grow up to %d members\n", MAX_LEN);
+    }
+
+    return failed ? 1 : 0;
+}
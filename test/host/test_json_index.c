@@ -0,0 +1,223 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Checks that objects large enough to be indexed look keys up, pop and dump exactly like a linear scan would, first
+ * among duplicates and in insertion order, while members are appended, popped and objects are shrunk or copied */
+
+#include <stdio.h>
+#include <string.h>
+#include <mem.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/json.h"
+
+#include "host.h"
+
+
+#define KEYS_COUNT   40   /* Distinct keys; fewer than the steps, so that some are duplicated */
+#define STEPS        3000
+#define MAX_MEMBERS  200
+
+
+typedef struct {
+
+    char keys[MAX_MEMBERS][8];
+    int  values[MAX_MEMBERS];
+    int  len;
+
+} reference_t;
+
+
+static uint32 seed = 1;
+
+
+static uint32 ICACHE_FLASH_ATTR  next_random(void);
+static int    ICACHE_FLASH_ATTR  ref_find(reference_t *ref, char *key);
+static void   ICACHE_FLASH_ATTR  ref_remove(reference_t *ref, int index);
+static char   ICACHE_FLASH_ATTR *ref_dump(reference_t *ref);
+static int    ICACHE_FLASH_ATTR  check_lookups(json_t *json, reference_t *ref, char *when);
+static int    ICACHE_FLASH_ATTR  check_random(void);
+static int    ICACHE_FLASH_ATTR  check_in_situ(void);
+
+
+uint32 next_random(void) {
+    seed = seed * 1103515245 + 12345;
+
+    return (seed >> 16) & 0x7FFF;
+}
+
+int ref_find(reference_t *ref, char *key) {
+    for (int i = 0; i < ref->len; i++) {
+        if (!strcmp(ref->keys[i], key)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void ref_remove(reference_t *ref, int index) {
+    ref->len--;
+    memmove(ref->keys + index, ref->keys + index + 1, sizeof(ref->keys[0]) * (ref->len - index));
+    memmove(ref->values + index, ref->values + index + 1, sizeof(int) * (ref->len - index));
+}
+
+char *ref_dump(reference_t *ref) {
+    char *dump = malloc(ref->len * 24 + 3);
+    int len = sprintf(dump, "{");
+
+    for (int i = 0; i < ref->len; i++) {
+        len += sprintf(dump + len, "%s\"%s\":%d", i ? "," : "", ref->keys[i], ref->values[i]);
+    }
+    strcpy(dump + len, "}");
+
+    return dump;
+}
+
+int check_lookups(json_t *json, reference_t *ref, char *when) {
+    char key[8];
+    int i, r;
+    json_t *child;
+
+    if (json_obj_get_len(json) != ref->len) {
+        printf("FAIL: %s: object has %d members, expected %d\n", when, json_obj_get_len(json), ref->len);
+        return 1;
+    }
+
+    for (i = 0; i <= KEYS_COUNT; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        child = json_obj_lookup_key(json, key);
+        r = ref_find(ref, key);
+        if ((r < 0) != !child || (child && json_int_get(child) != ref->values[r])) {
+            printf("FAIL: %s: looking up %s among %d members gave %s\n", when, key, ref->len,
+                   child ? "another member" : "nothing");
+            return 1;
+        }
+    }
+
+    char *dump = json_dump(json, JSON_FREE_NOTHING);
+    char *expected = ref_dump(ref);
+    int failed = 0;
+    if (strcmp(dump, expected)) {
+        printf("FAIL: %s: dumped as %s, expected %s\n", when, dump, expected);
+        failed = 1;
+    }
+    free(dump);
+    free(expected);
+
+    return failed;
+}
+
+int check_random(void) {
+    /* Appends outweigh pops, so that the object grows past the indexing threshold, then shrinks back now and then */
+    static reference_t ref;
+    host_alloc_stats_t stats;
+    char key[8], when[32];
+    int step, op, i, failed = 0;
+
+    host_alloc_stats_reset();
+    json_t *json = json_obj_new();
+    for (step = 0; step < STEPS && !failed; step++) {
+        op = next_random() % 16;
+        snprintf(when, sizeof(when), "step %d", step);
+
+        if (op < 9 && ref.len < MAX_MEMBERS) {
+            snprintf(key, sizeof(key), "k%d", (int) (next_random() % KEYS_COUNT));
+            json_obj_append(json, key, json_int_new(step));
+            strcpy(ref.keys[ref.len], key);
+            ref.values[ref.len++] = step;
+        }
+        else if (op < 13 && ref.len) {
+            snprintf(key, sizeof(key), "k%d", (int) (next_random() % KEYS_COUNT));
+            json_free(json_obj_pop_key(json, key));
+            if ((i = ref_find(&ref, key)) >= 0) {
+                ref_remove(&ref, i);
+            }
+        }
+        else if (op < 15 && ref.len) {
+            i = next_random() % ref.len;
+            json_free(json_obj_pop_at(json, i));
+            ref_remove(&ref, ref_find(&ref, ref.keys[i]));
+        }
+        else if (next_random() % 2) {
+            json_shrink(json);
+        }
+        else {
+            json_t *dup = json_dup(json);
+            json_free(json);
+            json = dup;
+        }
+
+        failed += check_lookups(json, &ref, when);
+    }
+
+    json_free(json);
+    host_alloc_stats_get(&stats);
+    if (stats.live) {
+        printf("FAIL: %d allocations leaked\n", stats.live);
+        failed++;
+    }
+
+    return failed;
+}
+
+int check_in_situ(void) {
+    /* Large objects parsed in situ are indexed within the arena */
+    static reference_t ref;
+    char input[2048];
+    int len, i, failed = 0;
+
+    len = sprintf(input, "{");
+    ref.len = 0;
+    for (i = 0; i < KEYS_COUNT; i++) {
+        snprintf(ref.keys[i], sizeof(ref.keys[i]), "k%d", (KEYS_COUNT - i) % (KEYS_COUNT / 2));
+        ref.values[i] = i;
+        len += sprintf(input + len, "%s\"%s\": %d", i ? ", " : "", ref.keys[i], i);
+    }
+    ref.len = i;
+    strcpy(input + len, "}");
+
+    json_t *json = json_parse_in_situ(input);
+    if (!json) {
+        printf("FAIL: could not parse large object\n");
+        return 1;
+    }
+
+    failed += check_lookups(json, &ref, "parsed in situ");
+    while (ref.len && !failed) {
+        json_free(json_obj_pop_key(json, ref.keys[ref.len / 2]));
+        ref_remove(&ref, ref_find(&ref, ref.keys[ref.len / 2]));
+        failed += check_lookups(json, &ref, "popped in situ");
+    }
+
+    json_free(json);
+
+    return failed;
+}
+
+
+int main(void) {
+    int failed = 0;
+
+    failed += check_random();
+    failed += check_in_situ();
+
+    if (!failed) {
+        printf("%d random steps on indexed objects match a linear scan\n", STEPS);
+    }
+
+    return failed ? 1 : 0;
+}
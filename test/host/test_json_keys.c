@@ -0,0 +1,198 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/* Checks that objects with static keys dump, look up, pop and copy like objects with regular keys, without allocating
+ * their keys, and that mixing in regular keys duplicates the static ones */
+
+#include <stdio.h>
+#include <string.h>
+#include <mem.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/json.h"
+
+#include "host.h"
+
+
+#define KEYS_COUNT 12 /* More than JSON_OBJ_INDEX_MIN_LEN, so that lookups go through the index as well */
+
+
+static char *KEYS[] = {
+    "id", "display_name", "type", "enabled", "writable", "persisted", "internal", "unit", "min", "max", "step", "value"
+};
+
+
+static json_t ICACHE_FLASH_ATTR *make_obj(bool static_keys);
+static int    ICACHE_FLASH_ATTR  check_same(json_t *json, json_t *expected, char *what);
+static int    ICACHE_FLASH_ATTR  check_allocations(void);
+static int    ICACHE_FLASH_ATTR  check_mixed(void);
+
+
+json_t *make_obj(bool static_keys) {
+    json_t *json = json_obj_new();
+
+    for (int i = 0; i < KEYS_COUNT; i++) {
+        if (static_keys) {
+            json_obj_append_static(json, KEYS[i], json_int_new(i));
+        }
+        else {
+            json_obj_append(json, KEYS[i], json_int_new(i));
+        }
+    }
+
+    return json;
+}
+
+int check_same(json_t *json, json_t *expected, char *what) {
+    char *dump = json_dump(json, JSON_FREE_NOTHING);
+    char *expected_dump = json_dump(expected, JSON_FREE_NOTHING);
+    int failed = 0;
+
+    if (strcmp(dump, expected_dump)) {
+        printf("FAIL: %s dumped as %s, expected %s\n", what, dump, expected_dump);
+        failed = 1;
+    }
+    for (int i = 0; i < KEYS_COUNT && !failed; i++) {
+        json_t *child = json_obj_lookup_key(json, KEYS[i]);
+        json_t *expected_child = json_obj_lookup_key(expected, KEYS[i]);
+        if (!child != !expected_child || (child && json_int_get(child) != json_int_get(expected_child))) {
+            printf("FAIL: %s: looking up %s differs\n", what, KEYS[i]);
+            failed = 1;
+        }
+    }
+
+    free(dump);
+    free(expected_dump);
+
+    return failed;
+}
+
+int check_allocations(void) {
+    host_alloc_stats_t owned_stats, static_stats, stats;
+    int failed = 0;
+
+    host_alloc_stats_reset();
+    json_free(make_obj(FALSE));
+    host_alloc_stats_get(&owned_stats);
+
+    host_alloc_stats_reset();
+    json_t *json = make_obj(TRUE);
+    host_alloc_stats_get(&static_stats);
+
+    printf("%d keys: %d allocations with regular keys, %d with static keys\n", KEYS_COUNT,
+           owned_stats.mallocs + owned_stats.reallocs, static_stats.mallocs + static_stats.reallocs);
+    if (owned_stats.mallocs - static_stats.mallocs != KEYS_COUNT) {
+        printf("FAIL: static keys took %d allocations, expected %d fewer than %d\n", static_stats.mallocs, KEYS_COUNT,
+               owned_stats.mallocs);
+        failed++;
+    }
+
+    /* Popping and copying */
+    json_t *expected = make_obj(FALSE);
+    failed += check_same(json, expected, "static keys");
+
+    json_free(json_obj_pop_key(json, "enabled"));
+    json_free(json_obj_pop_key(expected, "enabled"));
+    json_free(json_obj_pop_at(json, 0));
+    json_free(json_obj_pop_at(expected, 0));
+    failed += check_same(json, expected, "popped static keys");
+
+    json_t *dup = json_dup(json);
+    if (!(dup->flags & JSON_FLAG_STATIC_KEYS)) {
+        printf("FAIL: copy of static keys has regular keys\n");
+        failed++;
+    }
+    failed += check_same(dup, expected, "copied static keys");
+
+    json_free(dup);
+    json_free(json);
+    json_free(expected);
+    host_alloc_stats_get(&stats);
+    if (stats.live) {
+        printf("FAIL: %d allocations leaked\n", stats.live);
+        failed++;
+    }
+
+    return failed;
+}
+
+int check_mixed(void) {
+    /* Keys that don't outlive the object, appended after static ones */
+    host_alloc_stats_t stats, mix_stats;
+    char key[16];
+    int failed = 0;
+
+    host_alloc_stats_reset();
+    json_t *json = make_obj(TRUE);
+    json_t *expected = make_obj(FALSE);
+
+    /* The first regular key duplicates all the static keys before it */
+    strcpy(key, "transient");
+    host_alloc_stats_get(&stats);
+    json_obj_append(json, key, json_int_new(-1));
+    host_alloc_stats_get(&mix_stats);
+    if (mix_stats.mallocs - stats.mallocs != KEYS_COUNT + 2) {
+        printf("FAIL: mixing keys took %d allocations, expected %d\n", mix_stats.mallocs - stats.mallocs,
+               KEYS_COUNT + 2);
+        failed++;
+    }
+    json_obj_append(expected, key, json_int_new(-1));
+    json_obj_append_static(json, "last", json_int_new(-2));
+    json_obj_append(expected, "last", json_int_new(-2));
+    strcpy(key, "overwritten");
+
+    if (json->flags & JSON_FLAG_STATIC_KEYS) {
+        printf("FAIL: mixed keys are still static\n");
+        failed++;
+    }
+    failed += check_same(json, expected, "mixed keys");
+
+    json_free(json_obj_pop_key(json, "id"));
+    json_free(json_obj_pop_key(expected, "id"));
+    failed += check_same(json, expected, "popped mixed keys");
+
+    json_t *dup = json_dup(json);
+    if (dup->flags & JSON_FLAG_STATIC_KEYS) {
+        printf("FAIL: copy of mixed keys has static keys\n");
+        failed++;
+    }
+    failed += check_same(dup, expected, "copied mixed keys");
+    json_free(dup);
+
+    free(json_dump(json, JSON_FREE_EVERYTHING));
+    json_free(expected);
+    host_alloc_stats_get(&stats);
+    if (stats.live) {
+        printf("FAIL: %d allocations leaked with mixed keys\n", stats.live);
+        failed++;
+    }
+
+    return failed;
+}
+
+
+int main(void) {
+    int failed = 0;
+
+    failed += check_allocations();
+    failed += check_mixed();
+
+    if (!failed) {
+        printf("static keys behave like regular keys\n");
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Checks that parsing in situ gives the same results as regular parsing, for valid as well as invalid input, using a
+ * fixed, small number of allocations, and that documents parsed in situ can be popped from and freed at once */
+
+#include <stdio.h>
+#include <string.h>
+#include <mem.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/json.h"
+
+#include "host.h"
+
+
+#define PORTS_COUNT      20
+#define MAX_SITU_MALLOCS 3   /* Parsing context, arena and temporary members */
+
+
+static char *cases[] = {
+    /* Valid */
+    "{}",
+    "[]",
+    "  {\"a\": 1, \"b\": -2.5, \"c\": [true, false, null], \"d\": {\"e\": {}, \"f\": []}}  \n",
+    "[1, [2, [3, [4, [5]]]], {\"x\": [{}, {\"y\": \"z\"}]}]",
+    "{\"esc\": \"q\\\"b\\\\s\\/n\\nt\\tr\\rb\\bf\\fu\\u0041\", \"\": \"\", \"k\" : \"v\"}",
+    "\"root string\"",
+    "-12",
+    "3.25",
+    "true",
+    "null",
+
+    /* Invalid */
+    "{",
+    "[1, 2",
+    "{\"a\" 1}",
+    "{\"a\": 1,}",
+    "[1 2]",
+    "{\"a\": \"unterminated}",
+    "{1: 2}",
+    "[1] [2]",
+    "1.2.3",
+    "[nul]",
+    "{\"a\": 1}}",
+    "\"a\" \"b\"",
+    "",
+    "   ",
+    NULL
+};
+
+
+static char ICACHE_FLASH_ATTR *dump_parsed(char *input, bool in_situ, host_alloc_stats_t *stats);
+static int  ICACHE_FLASH_ATTR  check_case(char *input);
+static int  ICACHE_FLASH_ATTR  check_pop(void);
+static int  ICACHE_FLASH_ATTR  check_allocations(void);
+
+
+char *dump_parsed(char *input, bool in_situ, host_alloc_stats_t *stats) {
+    /* Parses a copy of input, as parsing in situ alters it */
+    char *copy = strdup(input);
+    char *dump = NULL;
+
+    host_alloc_stats_reset();
+    json_t *json = in_situ ? json_parse_in_situ(copy) : json_parse(copy);
+    host_alloc_stats_get(stats);
+    if (json) {
+        dump = json_dump(json, JSON_FREE_EVERYTHING);
+    }
+    free(copy);
+
+    return dump;
+}
+
+int check_case(char *input) {
+    host_alloc_stats_t stats;
+    char *expected = dump_parsed(input, FALSE, &stats);
+    char *dump = dump_parsed(input, TRUE, &stats);
+    int failed = 0;
+
+    if ((!expected != !dump) || (dump && strcmp(dump, expected))) {
+        printf("FAIL: parsing %s in situ gave %s, expected %s\n", input, dump ? dump : "NULL",
+               expected ? expected : "NULL");
+        failed = 1;
+    }
+    else if (stats.mallocs > MAX_SITU_MALLOCS) {
+        printf("FAIL: parsing %s in situ took %d allocations\n", input, stats.mallocs);
+        failed = 1;
+    }
+
+    free(expected);
+    free(dump);
+
+    return failed;
+}
+
+int check_pop(void) {
+    /* Popped elements are freed as usual, and may be moved into other JSON structures, yet they really go away only
+     * along with the whole document */
+    char input[] = "{\"a\": [1, {\"b\": \"c\"}, 3], \"d\": \"e\", \"f\": {\"g\": null}}";
+    host_alloc_stats_t stats;
+    int failed = 0;
+
+    host_alloc_stats_reset();
+    json_t *json = json_parse_in_situ(input);
+
+    json_t *a = json_obj_pop_key(json, "a");
+    json_t *first = json_list_pop_at(a, 0);
+    json_free(first);
+    json_free(json_obj_pop_at(json, 1));
+
+    json_t *other = json_obj_new();
+    json_obj_append(other, "a", a);
+    char *dump = json_dump(other, JSON_FREE_EVERYTHING);
+    if (strcmp(dump, "{\"a\":[{\"b\":\"c\"},3]}")) {
+        printf("FAIL: moved popped list dumped as %s\n", dump);
+        failed++;
+    }
+    free(dump);
+
+    dump = json_dump(json, JSON_FREE_NOTHING);
+    if (strcmp(dump, "{\"d\":\"e\"}")) {
+        printf("FAIL: document dumped as %s after popping\n", dump);
+        failed++;
+    }
+    free(dump);
+
+    json_free(json);
+    host_alloc_stats_get(&stats);
+    if (stats.live) {
+        printf("FAIL: %d allocations leaked after popping\n", stats.live);
+        failed++;
+    }
+
+    return failed;
+}
+
+int check_allocations(void) {
+    /* A provisioning-like body, with a list of ports */
+    char *input = NULL;
+    int len = 0, l, i;
+    char port[256];
+
+    input = realloc(input, 64);
+    len = sprintf(input, "{\"version\": 3, \"ports\": [");
+    for (i = 0; i < PORTS_COUNT; i++) {
+        l = snprintf(port, sizeof(port), "%s{\"id\": \"port%d\", \"display_name\": \"Port \\\"%d\\\"\", "
+                     "\"enabled\": true, \"value\": %d.5, \"expression\": \"ADD($port%d, 1)\", "
+                     "\"choices\": [{\"value\": 1, \"display_name\": \"One\"}]}", i ? ", " : "", i, i, i, i);
+        input = realloc(input, len + l + 3);
+        strcpy(input + len, port);
+        len += l;
+    }
+    strcpy(input + len, "]}");
+
+    host_alloc_stats_t heap_stats, situ_stats;
+    char *expected = dump_parsed(input, FALSE, &heap_stats);
+    char *dump = dump_parsed(input, TRUE, &situ_stats);
+    int failed = 0;
+
+    printf("%d bytes: %d allocations parsing regularly, %d in situ\n", (int) strlen(input),
+           heap_stats.mallocs + heap_stats.reallocs, situ_stats.mallocs + situ_stats.reallocs);
+
+    if (!dump || !expected || strcmp(dump, expected)) {
+        printf("FAIL: body parsed in situ differs\n");
+        failed++;
+    }
+    if (situ_stats.mallocs > MAX_SITU_MALLOCS) {
+        printf("FAIL: parsing in situ took %d allocations\n", situ_stats.mallocs);
+        failed++;
+    }
+
+    free(input);
+    free(expected);
+    free(dump);
+
+    return failed;
+}
+
+
+int main(void) {
+    int count = 0, failed = 0;
+
+    for (char **c = cases; *c; c++) {
+        failed += check_case(*c);
+        count++;
+    }
+
+    failed += check_pop();
+    failed += check_allocations();
+
+    if (!failed) {
+        printf("%d inputs parse the same in situ\n", count);
+    }
+
+    return failed ? 1 : 0;
+}
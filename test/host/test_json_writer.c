@@ -0,0 +1,215 @@
+/*
+ * Copyright 2019 The qToggle Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Checks that the JSON writer produces exactly what dumping the same structure produces, whatever the chunk size, that
+ * every chunk but the last one is full and that nothing leaks */
+
+#include <stdio.h>
+#include <string.h>
+#include <mem.h>
+
+#include "espgoodies/common.h"
+#include "espgoodies/json.h"
+
+#include "host.h"
+
+
+#define PORTS_COUNT 30
+
+
+typedef struct {
+
+    char  *output;
+    int    len;
+    int    chunks;
+    bool   short_chunk;  /* A chunk other than the last one wasn't full */
+    uint16 chunk_size;
+    int    last_chunk_len;
+
+} output_t;
+
+
+static uint16 chunk_sizes[] = {1, 7, 64, 1024, 0};
+
+
+static json_t ICACHE_FLASH_ATTR *make_port_json(int index);
+static void   ICACHE_FLASH_ATTR  on_chunk(uint8 *chunk, int len, void *arg);
+static int    ICACHE_FLASH_ATTR  check_output(output_t *output, char *expected, char *what);
+
+
+json_t *make_port_json(int index) {
+    /* Resembles what the API returns for a port, including attribute definitions that are stringified */
+    char id[16];
+    snprintf(id, sizeof(id), "port%d", index);
+
+    json_t *json = json_obj_new();
+    json_obj_append(json, "id", json_str_new(id));
+    json_obj_append(json, "display_name", json_str_new("Living \"room\"\\temp\n"));
+    json_obj_append(json, "enabled", json_bool_new(index % 2));
+    json_obj_append(json, "writable", json_bool_new(FALSE));
+    json_obj_append(json, "value", index % 3 ? json_double_new(index * 1.5) : json_null_new());
+    json_obj_append(json, "sampling_interval", json_int_new(-index * 1000));
+    json_obj_append(json, "tag", json_str_new(""));
+
+    json_t *choices = json_list_new();
+    for (int i = 0; i < index % 4; i++) {
+        json_t *choice = json_obj_new();
+        json_obj_append(choice, "value", json_int_new(i));
+        json_obj_append(choice, "display_name", json_str_new("\tchoice\r"));
+        json_list_append(choices, choice);
+    }
+    json_obj_append(json, "choices", choices);
+
+    json_t *attrdefs = json_obj_new();
+    json_t *attrdef = json_obj_new();
+    json_obj_append(attrdef, "display_name", json_str_new("Some attribute with a somewhat longer description"));
+    json_obj_append(attrdef, "type", json_str_new("number"));
+    json_obj_append(attrdef, "modifiable", json_bool_new(TRUE));
+    json_obj_append(attrdef, "min", json_int_new(0));
+    json_obj_append(attrdef, "max", json_double_new(3600.5));
+    json_obj_append(attrdefs, "some_attr", attrdef);
+    json_obj_append(attrdefs, "empty", json_list_new());
+    json_stringify(attrdefs);
+    json_obj_append(json, "definitions", attrdefs);
+
+    return json;
+}
+
+void on_chunk(uint8 *chunk, int len, void *arg) {
+    output_t *output = arg;
+
+    if (output->chunks && output->last_chunk_len != output->chunk_size) {
+        output->short_chunk = TRUE;
+    }
+
+    output->output = realloc(output->output, output->len + len + 1);
+    memcpy(output->output + output->len, chunk, len);
+    output->len += len;
+    output->output[output->len] = 0;
+    output->chunks++;
+    output->last_chunk_len = len;
+
+    free(chunk);
+}
+
+int check_output(output_t *output, char *expected, char *what) {
+    if (!output->output || strcmp(output->output, expected)) {
+        printf("FAIL: %s, %d bytes chunks: got\n%s\nexpected\n%s\n", what, output->chunk_size,
+               output->output ? output->output : "(nothing)", expected);
+        return 1;
+    }
+    if (output->short_chunk) {
+        printf("FAIL: %s, %d bytes chunks: some chunk other than the last one wasn't full\n", what,
+               output->chunk_size);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+int main(void) {
+    host_alloc_stats_t stats;
+    json_writer_t writer;
+    output_t output;
+    int failed = 0;
+
+    /* Stringifying keeps a dump buffer around for reuse, which isn't a leak */
+    json_free(make_port_json(0));
+    host_alloc_stats_reset();
+
+    json_t *list = json_list_new();
+    for (int i = 0; i < PORTS_COUNT; i++) {
+        json_list_append(list, make_port_json(i));
+    }
+    char *expected = json_dump(list, JSON_FREE_NOTHING);
+
+    for (uint16 *size = chunk_sizes; *size; size++) {
+        /* A whole structure at once */
+        memset(&output, 0, sizeof(output));
+        output.chunk_size = *size;
+        json_writer_init(&writer, *size, on_chunk, &output);
+        json_writer_json(&writer, list);
+        if (json_writer_finish(&writer) != strlen(expected)) {
+            printf("FAIL: %d bytes chunks: wrong total length\n", *size);
+            failed++;
+        }
+        failed += check_output(&output, expected, "structure");
+        free(output.output);
+
+        /* Piece by piece, as the API writes ports */
+        memset(&output, 0, sizeof(output));
+        output.chunk_size = *size;
+        json_writer_init(&writer, *size, on_chunk, &output);
+        json_writer_begin_list(&writer);
+        for (int i = 0; i < PORTS_COUNT; i++) {
+            json_t *port_json = make_port_json(i);
+            json_writer_json(&writer, port_json);
+            json_free(port_json);
+        }
+        json_writer_end_list(&writer);
+        json_writer_finish(&writer);
+        failed += check_output(&output, expected, "ports");
+        free(output.output);
+    }
+
+    /* Values written by hand, with an empty object and a leading raw head */
+    memset(&output, 0, sizeof(output));
+    output.chunk_size = 5;
+    json_writer_init(&writer, 5, on_chunk, &output);
+    json_writer_raw(&writer, (uint8 *) "HEAD\r\n", 6);
+    json_writer_begin_obj(&writer);
+    json_writer_key(&writer, "a");
+    json_writer_int(&writer, 1);
+    json_writer_key(&writer, "b");
+    json_writer_begin_obj(&writer);
+    json_writer_end_obj(&writer);
+    json_writer_key(&writer, "c");
+    json_writer_begin_list(&writer);
+    json_writer_str(&writer, "x");
+    json_writer_null(&writer);
+    json_writer_bool(&writer, TRUE);
+    json_writer_double(&writer, 0.25);
+    json_writer_end_list(&writer);
+    json_writer_end_obj(&writer);
+    json_writer_finish(&writer);
+    failed += check_output(&output, "HEAD\r\n{\"a\":1,\"b\":{},\"c\":[\"x\",null,true,0.25]}", "by hand");
+    free(output.output);
+
+    /* Nothing written, nothing handed over */
+    memset(&output, 0, sizeof(output));
+    json_writer_init(&writer, 16, on_chunk, &output);
+    if (json_writer_finish(&writer) || output.chunks) {
+        printf("FAIL: empty writer handed over %d chunks\n", output.chunks);
+        failed++;
+    }
+
+    json_free(list);
+    free(expected);
+
+    host_alloc_stats_get(&stats);
+    if (stats.live) {
+        printf("FAIL: %d allocations leaked\n", stats.live);
+        failed++;
+    }
+
+    if (!failed) {
+        printf("JSON writer output matches dumped JSON for chunks of 1 to 1024 bytes\n");
+    }
+
+    return failed ? 1 : 0;
+}